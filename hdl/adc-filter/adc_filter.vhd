@@ -0,0 +1,172 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- ADC Oversampling / Decimation Filter
+-- Reads every ADC channel from the ADC IP over an Avalon-MM master, once per
+-- sweep, and runs a boxcar integrate-and-dump (first-order CIC) per channel:
+--
+--     result = (sum of 2^osr samples) * 16 / 2^osr
+--
+--     osr:    log2 of the oversampling ratio, 0 to 8 per channel (1 to 256
+--             samples); larger values are treated as 8
+--     result: 16-bit mean, full scale 4095 * 16 = 65520. With osr > 0 the
+--             low 4 bits carry the extra resolution averaging buys.
+--
+-- The decimation ratio equals the oversampling ratio: each channel produces
+-- one result per 2^osr sweeps and the accumulator starts over. Changing a
+-- channel's osr drops its partial sum, so no result mixes two ratios.
+--
+-- A sweep reads channels 0 to NUM_CHANNELS - 1 back to back and starts every
+-- sweep_period clocks while enable is '1'. The ADC IP converts on its own, so
+-- sweeping faster than it converts only averages repeated values. A sweep
+-- that takes longer than sweep_period delays the next one.
+--
+-- The master uses waitrequest only (no readdatavalid), like adc_direct.
+
+entity adc_filter is
+    generic (
+        ADC_BASE     : natural := 0;    -- byte address of ADC channel 0
+        NUM_CHANNELS : natural := 8
+    );
+    port (
+        clk             : in  std_logic;
+        rst             : in  std_logic;
+
+        enable          : in  std_logic;
+        sweep_period    : in  unsigned(31 downto 0);
+        -- 4 bits per channel, channel 0 in bits 3..0
+        osr_log2        : in  std_logic_vector(NUM_CHANNELS * 4 - 1 downto 0);
+
+        -- Avalon master to the ADC
+        avm_address     : out std_logic_vector(31 downto 0);
+        avm_read        : out std_logic;
+        avm_readdata    : in  std_logic_vector(31 downto 0);
+        avm_waitrequest : in  std_logic;
+
+        -- 16 bits per channel, channel 0 in bits 15..0
+        results         : out std_logic_vector(NUM_CHANNELS * 16 - 1 downto 0);
+        -- results produced since reset, all channels; wraps
+        result_count    : out unsigned(31 downto 0)
+    );
+end entity adc_filter;
+
+architecture rtl of adc_filter is
+
+    constant ADC_BITS : integer := 12;
+    constant OSR_MAX  : integer := 8;
+    constant ACC_BITS : integer := ADC_BITS + OSR_MAX;
+
+    type acc_array_t is array (0 to NUM_CHANNELS - 1) of unsigned(ACC_BITS - 1 downto 0);
+    type cnt_array_t is array (0 to NUM_CHANNELS - 1) of unsigned(OSR_MAX - 1 downto 0);
+    type osr_array_t is array (0 to NUM_CHANNELS - 1) of unsigned(3 downto 0);
+    type res_array_t is array (0 to NUM_CHANNELS - 1) of unsigned(15 downto 0);
+
+    signal channel      : natural range 0 to NUM_CHANNELS - 1 := 0;
+    signal reading      : std_logic := '0';
+    signal timer        : unsigned(31 downto 0) := (others => '0');
+
+    signal acc          : acc_array_t := (others => (others => '0'));
+    signal cnt          : cnt_array_t := (others => (others => '0'));
+    -- ratio the running sum was started with
+    signal osr_cur      : osr_array_t := (others => (others => '0'));
+    signal res          : res_array_t := (others => (others => '0'));
+    signal count        : unsigned(31 downto 0) := (others => '0');
+
+    function clamp_osr (osr : std_logic_vector(3 downto 0)) return unsigned is
+    begin
+        if unsigned(osr) > OSR_MAX then
+            return to_unsigned(OSR_MAX, 4);
+        end if;
+        return unsigned(osr);
+    end function clamp_osr;
+
+    -- sum * 16 / 2^osr, which fits 16 bits for any osr up to OSR_MAX
+    function scale (sum : unsigned(ACC_BITS - 1 downto 0);
+                    osr : unsigned(3 downto 0)) return unsigned is
+        variable wide : unsigned(ACC_BITS + 4 - 1 downto 0);
+    begin
+        wide := shift_left(resize(sum, ACC_BITS + 4), 4);
+        wide := shift_right(wide, to_integer(osr));
+        return wide(15 downto 0);
+    end function scale;
+
+begin
+
+    avm_address <= std_logic_vector(to_unsigned(ADC_BASE + channel * 4, 32));
+    avm_read    <= reading;
+
+    result_count <= count;
+
+    pack_results : for i in 0 to NUM_CHANNELS - 1 generate
+        results(i * 16 + 15 downto i * 16) <= std_logic_vector(res(i));
+    end generate pack_results;
+
+    sample : process(clk, rst)
+        variable osr  : unsigned(3 downto 0);
+        variable sum  : unsigned(ACC_BITS - 1 downto 0);
+        variable n    : unsigned(OSR_MAX - 1 downto 0);
+        variable last : unsigned(OSR_MAX downto 0);
+    begin
+        if rst = '1' then
+            channel <= 0;
+            reading <= '0';
+            timer <= (others => '0');
+            acc <= (others => (others => '0'));
+            cnt <= (others => (others => '0'));
+            osr_cur <= (others => (others => '0'));
+            res <= (others => (others => '0'));
+            count <= (others => '0');
+
+        elsif rising_edge(clk) then
+            if timer /= 0 then
+                timer <= timer - 1;
+            end if;
+
+            if reading = '0' then
+                -- a sweep in flight always completes so the bus is never
+                -- left hanging; enable only gates the start of the next one
+                if enable = '1' and timer = 0 then
+                    reading <= '1';
+                    channel <= 0;
+                    if sweep_period /= 0 then
+                        timer <= sweep_period - 1;
+                    end if;
+                end if;
+
+            elsif avm_waitrequest = '0' then
+                osr := clamp_osr(osr_log2(channel * 4 + 3 downto channel * 4));
+
+                if osr /= osr_cur(channel) then
+                    -- new ratio: this sample starts a fresh window
+                    osr_cur(channel) <= osr;
+                    sum := resize(unsigned(avm_readdata(ADC_BITS - 1 downto 0)), ACC_BITS);
+                    n := (others => '0');
+                else
+                    sum := acc(channel) +
+                           unsigned(avm_readdata(ADC_BITS - 1 downto 0));
+                    n := cnt(channel);
+                end if;
+
+                last := shift_left(to_unsigned(1, OSR_MAX + 1), to_integer(osr)) - 1;
+                if resize(n, OSR_MAX + 1) = last then
+                    res(channel) <= scale(sum, osr);
+                    acc(channel) <= (others => '0');
+                    cnt(channel) <= (others => '0');
+                    count <= count + 1;
+                else
+                    acc(channel) <= sum;
+                    cnt(channel) <= n + 1;
+                end if;
+
+                if channel = NUM_CHANNELS - 1 then
+                    channel <= 0;
+                    reading <= '0';
+                else
+                    channel <= channel + 1;
+                end if;
+            end if;
+        end if;
+    end process sample;
+
+end architecture rtl;
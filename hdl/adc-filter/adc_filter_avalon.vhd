@@ -0,0 +1,156 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Avalon-MM register map
+--   Base: 0x0017f500
+--   Span: 0x80 bytes (0x0017f500 - 0x0017f57f)
+--     0x00 - 0x1C : Filtered channel 0 - 7 (16 bit, read-only)
+--                   mean of the last 2^osr samples * 16, full scale 65520
+--     0x20 - 0x3C : OSR channel 0 - 7 (log2 of the oversampling ratio,
+--                   0 - 8, reset 4 = 16 samples); larger writes store 8
+--     0x40        : Control
+--         bit 0 = '1' : sweep the ADC (reset '1')
+--     0x44        : Sweep period in clocks (reset 2500 = 20 kHz at 50 MHz)
+--     0x48        : Result count (read-only), filtered results produced
+--                   since reset over all channels; wraps
+--
+--  adc_filter reads the ADC IP through avm_adc_* once per sweep period and
+--  averages each channel in the fabric, so software gets a settled value
+--  with one bus read instead of averaging N raw reads itself. Each channel
+--  produces a new value every 2^osr sweeps, e.g. 20 kHz / 16 = 1.25 kHz
+--  with the reset values.
+--
+--  These registers are mapped into HPS address space through
+--  HPS-to-FPGA lightweight bridge.  Linux reads them through the ADC
+--  driver's second reg window.
+
+entity adc_filter_avalon is
+    port (
+        clk           : in  std_logic;
+        rst           : in  std_logic;
+
+        --Avalon Slave Interface
+        avs_read      : in  std_logic;
+        avs_write     : in  std_logic;
+        avs_address   : in  std_logic_vector(4 downto 0);
+        avs_writedata : in  std_logic_vector(31 downto 0);
+        avs_readdata  : out std_logic_vector(31 downto 0);
+
+        -- Avalon Master Interface, reads the ADC channels
+        avm_adc_address      : out std_logic_vector(31 downto 0);
+        avm_adc_read         : out std_logic;
+        avm_adc_readdata     : in  std_logic_vector(31 downto 0);
+        avm_adc_waitrequest  : in  std_logic
+    );
+end entity adc_filter_avalon;
+
+architecture rtl of adc_filter_avalon is
+
+    constant NUM_CHANNELS : natural := 8;
+    constant OSR_RESET    : std_logic_vector(3 downto 0) := "0100";
+    constant OSR_MAX      : natural := 8;
+    constant SWEEP_RESET  : unsigned(31 downto 0) := to_unsigned(2500, 32);
+
+    signal reg_enable   : std_logic := '1';
+    signal reg_sweep    : unsigned(31 downto 0) := SWEEP_RESET;
+    signal reg_osr      : std_logic_vector(NUM_CHANNELS * 4 - 1 downto 0);
+
+    signal results      : std_logic_vector(NUM_CHANNELS * 16 - 1 downto 0);
+    signal result_count : unsigned(31 downto 0);
+
+    component adc_filter is
+        generic (
+            ADC_BASE     : natural := 0;
+            NUM_CHANNELS : natural := 8
+        );
+        port (
+            clk             : in  std_logic;
+            rst             : in  std_logic;
+            enable          : in  std_logic;
+            sweep_period    : in  unsigned(31 downto 0);
+            osr_log2        : in  std_logic_vector(NUM_CHANNELS * 4 - 1 downto 0);
+            avm_address     : out std_logic_vector(31 downto 0);
+            avm_read        : out std_logic;
+            avm_readdata    : in  std_logic_vector(31 downto 0);
+            avm_waitrequest : in  std_logic;
+            results         : out std_logic_vector(NUM_CHANNELS * 16 - 1 downto 0);
+            result_count    : out unsigned(31 downto 0)
+        );
+    end component adc_filter;
+
+begin
+
+    adc_filter_inst : adc_filter
+        generic map (
+            NUM_CHANNELS => NUM_CHANNELS
+        )
+        port map (
+            clk             => clk,
+            rst             => rst,
+            enable          => reg_enable,
+            sweep_period    => reg_sweep,
+            osr_log2        => reg_osr,
+            avm_address     => avm_adc_address,
+            avm_read        => avm_adc_read,
+            avm_readdata    => avm_adc_readdata,
+            avm_waitrequest => avm_adc_waitrequest,
+            results         => results,
+            result_count    => result_count
+        );
+
+    avalon_register_read : process(clk)
+        variable addr : natural range 0 to 31;
+    begin
+        if rising_edge(clk) and avs_read = '1' then
+            addr := to_integer(unsigned(avs_address));
+            case addr is
+                when 0 to 7 =>
+                    avs_readdata <= (31 downto 16 => '0') &
+                                    results(addr * 16 + 15 downto addr * 16);
+                when 8 to 15 =>
+                    avs_readdata <= (31 downto 4 => '0') &
+                                    reg_osr((addr - 8) * 4 + 3 downto (addr - 8) * 4);
+                when 16 =>
+                    avs_readdata <= (0 => reg_enable, others => '0');
+                when 17 =>
+                    avs_readdata <= std_logic_vector(reg_sweep);
+                when 18 =>
+                    avs_readdata <= std_logic_vector(result_count);
+                when others =>
+                    avs_readdata <= (others => '0');
+            end case;
+        end if;
+    end process avalon_register_read;
+
+    avalon_register_write : process(clk, rst)
+        variable addr : natural range 0 to 31;
+    begin
+        if rst = '1' then
+            reg_enable <= '1';
+            reg_sweep <= SWEEP_RESET;
+            for i in 0 to NUM_CHANNELS - 1 loop
+                reg_osr(i * 4 + 3 downto i * 4) <= OSR_RESET;
+            end loop;
+        elsif rising_edge(clk) and avs_write = '1' then
+            addr := to_integer(unsigned(avs_address));
+            case addr is
+                when 8 to 15 =>
+                    if unsigned(avs_writedata) > OSR_MAX then
+                        reg_osr((addr - 8) * 4 + 3 downto (addr - 8) * 4) <=
+                            std_logic_vector(to_unsigned(OSR_MAX, 4));
+                    else
+                        reg_osr((addr - 8) * 4 + 3 downto (addr - 8) * 4) <=
+                            avs_writedata(3 downto 0);
+                    end if;
+                when 16 =>
+                    reg_enable <= avs_writedata(0);
+                when 17 =>
+                    reg_sweep <= unsigned(avs_writedata);
+                when others =>
+                    null;
+            end case;
+        end if;
+    end process avalon_register_write;
+
+end architecture rtl;
@@ -0,0 +1,153 @@
+# TCL File Generated by Component Editor 24.1
+# Mon Dec 08 16:20:59 MST 2025
+# DO NOT MODIFY
+
+
+# 
+# adc_filter_avalon "adc_filter_avalon" v1.0
+#  2025.12.08.16:20:59
+# 
+# 
+
+# 
+# request TCL package from ACDS 16.1
+# 
+package require -exact qsys 16.1
+
+
+# 
+# module adc_filter_avalon
+# 
+set_module_property DESCRIPTION ""
+set_module_property NAME adc_filter_avalon
+set_module_property VERSION 1.0
+set_module_property INTERNAL false
+set_module_property OPAQUE_ADDRESS_MAP true
+set_module_property AUTHOR ""
+set_module_property DISPLAY_NAME adc_filter_avalon
+set_module_property INSTANTIATE_IN_SYSTEM_MODULE true
+set_module_property EDITABLE true
+set_module_property REPORT_TO_TALKBACK false
+set_module_property ALLOW_GREYBOX_GENERATION false
+set_module_property REPORT_HIERARCHY false
+
+
+# 
+# file sets
+# 
+add_fileset QUARTUS_SYNTH QUARTUS_SYNTH "" ""
+set_fileset_property QUARTUS_SYNTH TOP_LEVEL adc_filter_avalon
+set_fileset_property QUARTUS_SYNTH ENABLE_RELATIVE_INCLUDE_PATHS false
+set_fileset_property QUARTUS_SYNTH ENABLE_FILE_OVERWRITE_MODE false
+add_fileset_file adc_filter.vhd VHDL PATH adc_filter.vhd
+add_fileset_file adc_filter_avalon.vhd VHDL PATH adc_filter_avalon.vhd TOP_LEVEL_FILE
+
+
+# 
+# parameters
+# 
+
+
+# 
+# display items
+# 
+
+
+# 
+# connection point avalon_slave_0
+# 
+add_interface avalon_slave_0 avalon end
+set_interface_property avalon_slave_0 addressUnits WORDS
+set_interface_property avalon_slave_0 associatedClock clock
+set_interface_property avalon_slave_0 associatedReset reset
+set_interface_property avalon_slave_0 bitsPerSymbol 8
+set_interface_property avalon_slave_0 burstOnBurstBoundariesOnly false
+set_interface_property avalon_slave_0 burstcountUnits WORDS
+set_interface_property avalon_slave_0 explicitAddressSpan 0
+set_interface_property avalon_slave_0 holdTime 0
+set_interface_property avalon_slave_0 linewrapBursts false
+set_interface_property avalon_slave_0 maximumPendingReadTransactions 0
+set_interface_property avalon_slave_0 maximumPendingWriteTransactions 0
+set_interface_property avalon_slave_0 readLatency 0
+set_interface_property avalon_slave_0 readWaitTime 1
+set_interface_property avalon_slave_0 setupTime 0
+set_interface_property avalon_slave_0 timingUnits Cycles
+set_interface_property avalon_slave_0 writeWaitTime 0
+set_interface_property avalon_slave_0 ENABLED true
+set_interface_property avalon_slave_0 EXPORT_OF ""
+set_interface_property avalon_slave_0 PORT_NAME_MAP ""
+set_interface_property avalon_slave_0 CMSIS_SVD_VARIABLES ""
+set_interface_property avalon_slave_0 SVD_ADDRESS_GROUP ""
+
+add_interface_port avalon_slave_0 avs_read read Input 1
+add_interface_port avalon_slave_0 avs_write write Input 1
+add_interface_port avalon_slave_0 avs_address address Input 5
+add_interface_port avalon_slave_0 avs_writedata writedata Input 32
+add_interface_port avalon_slave_0 avs_readdata readdata Output 32
+set_interface_assignment avalon_slave_0 embeddedsw.configuration.isFlash 0
+set_interface_assignment avalon_slave_0 embeddedsw.configuration.isMemoryDevice 0
+set_interface_assignment avalon_slave_0 embeddedsw.configuration.isNonVolatileStorage 0
+set_interface_assignment avalon_slave_0 embeddedsw.configuration.isPrintableDevice 0
+
+
+# 
+# connection point adc_master
+# 
+add_interface adc_master avalon start
+set_interface_property adc_master addressUnits SYMBOLS
+set_interface_property adc_master associatedClock clock
+set_interface_property adc_master associatedReset reset
+set_interface_property adc_master bitsPerSymbol 8
+set_interface_property adc_master burstOnBurstBoundariesOnly false
+set_interface_property adc_master burstcountUnits WORDS
+set_interface_property adc_master doStreamReads false
+set_interface_property adc_master doStreamWrites false
+set_interface_property adc_master holdTime 0
+set_interface_property adc_master linewrapBursts false
+set_interface_property adc_master maximumPendingReadTransactions 0
+set_interface_property adc_master maximumPendingWriteTransactions 0
+set_interface_property adc_master readLatency 0
+set_interface_property adc_master readWaitTime 1
+set_interface_property adc_master setupTime 0
+set_interface_property adc_master timingUnits Cycles
+set_interface_property adc_master writeWaitTime 0
+set_interface_property adc_master ENABLED true
+set_interface_property adc_master EXPORT_OF ""
+set_interface_property adc_master PORT_NAME_MAP ""
+set_interface_property adc_master CMSIS_SVD_VARIABLES ""
+set_interface_property adc_master SVD_ADDRESS_GROUP ""
+
+add_interface_port adc_master avm_adc_address address Output 32
+add_interface_port adc_master avm_adc_read read Output 1
+add_interface_port adc_master avm_adc_readdata readdata Input 32
+add_interface_port adc_master avm_adc_waitrequest waitrequest Input 1
+
+
+# 
+# connection point clock
+# 
+add_interface clock clock end
+set_interface_property clock clockRate 0
+set_interface_property clock ENABLED true
+set_interface_property clock EXPORT_OF ""
+set_interface_property clock PORT_NAME_MAP ""
+set_interface_property clock CMSIS_SVD_VARIABLES ""
+set_interface_property clock SVD_ADDRESS_GROUP ""
+
+add_interface_port clock clk clk Input 1
+
+
+# 
+# connection point reset
+# 
+add_interface reset reset end
+set_interface_property reset associatedClock clock
+set_interface_property reset synchronousEdges DEASSERT
+set_interface_property reset ENABLED true
+set_interface_property reset EXPORT_OF ""
+set_interface_property reset PORT_NAME_MAP ""
+set_interface_property reset CMSIS_SVD_VARIABLES ""
+set_interface_property reset SVD_ADDRESS_GROUP ""
+
+add_interface_port reset rst reset Input 1
+
@@ -6,20 +6,58 @@ use std.standard;
 
 -- Avalon-MM base address (HPS lightweight bridge):
 --   Base: 0x0017F450
---   Span: 0x10 bytes (0x0017F450 – 0x0017F45F)
+--   Span: 0x20 bytes (0x0017F450 – 0x0017F46F)
 -- 32-bit register map (word offsets from base):
---   0x0 @ 0x0017F450 : LED pattern register
---       - avs_address = "00"
---       - Bits 9 downto 0 drive the 10 LEDs directly.
+--   0x00 @ 0x0017F450 : LED pattern register
+--       - avs_address = "000"
+--       - Bits 9 downto 0 turn the 10 LEDs on at their Brightness level
+--         while the sequencer is stopped.
 --       - Bits 31 downto 10 are ignored on write and read back as '0'.
+--   0x04 @ 0x0017F454 : Sequencer control
+--       - bit 0 = run: play the front bank's frames (reset '0')
+--       - bit 1 = loop: start over after the last frame, else stop on it
+--       - bit 2 = swap: write 1 to swap the banks at the next frame
+--                 boundary (at once while stopped or finished); reads '1'
+--                 until the swap has happened
+--   0x08 @ 0x0017F458 : Back bank length, frames in its sequence
+--   0x0C @ 0x0017F45C : Back bank write address, frame index for the next
+--                       Frame Time write
+--   0x10 @ 0x0017F460 : Frame levels, staged for the next Frame Time write
+--       - 3 bits per LED, LED n in bits 3n+2 downto 3n
+--   0x14 @ 0x0017F464 : Frame time
+--       - write: ms to show the frame (16 bits, 0 = 1), and store it with
+--                the staged levels at the write address in the back bank;
+--                the write address steps
+--   0x18 @ 0x0017F468 : Sequencer status, read only
+--       - bits 7 downto 0 = frame showing
+--       - bit 8           = front bank
+--       - bit 9           = done, a one-shot sequence reached its last frame
+--       - bit 10          = playing, a frame is on the LEDs
+--       - bits 19 downto 16 = FRAME_BITS
+--   0x1C @ 0x0017F46C : Brightness, 3 bits per LED like Frame Levels; the
+--                       pattern register's levels (reset all 7)
+--
+--  Each LED is pulse-width modulated with 8 levels: level n is on for n of
+--  every 7 PWM steps, so 0 is off and 7 is fully on. A PWM step is PWM_DIV
+--  clocks.
+--
+--  The frame RAM holds two banks of 2^FRAME_BITS frames. The sequencer
+--  plays the front bank while software fills the back one, and a swap
+--  only happens between frames, so a display update never tears. Every
+--  frame shows for exactly its time in ms, counted in CLKS_PER_MS clocks.
 
 entity ledbus_avalon is
+    generic (
+        FRAME_BITS      : natural := 6;       -- frames per bank = 2^FRAME_BITS, 1 to 8
+        CLKS_PER_MS     : natural := 50000;   -- 50 MHz, at least 3
+        PWM_DIV         : natural := 4096     -- clocks per PWM step, 1.7 kHz at 50 MHz
+    );
     port (
         clk             : in  std_logic;
         rst             : in  std_logic;
         avs_read        : in  std_logic;
         avs_write       : in  std_logic;
-        avs_address     : in  std_logic_vector(1 downto 0);
+        avs_address     : in  std_logic_vector(2 downto 0);
         avs_writedata   : in  std_logic_vector(31 downto 0);
         avs_readdata    : out std_logic_vector(31 downto 0);
         led_out         : out std_logic_vector(9 downto 0)
@@ -28,38 +66,287 @@ end entity ledbus_avalon;
 
 architecture rtl of ledbus_avalon is
 
+    constant NUM_LEDS     : natural := 10;
+    constant LEVEL_BITS   : natural := 3;
+    constant LEVELS_WIDTH : natural := NUM_LEDS * LEVEL_BITS;
+    constant FULL_LEVELS  : std_logic_vector(LEVELS_WIDTH - 1 downto 0) := (others => '1');
+
     signal reg_leds   : std_logic_vector(9 downto 0) := (others => '0');
     signal reg_readdata  : std_logic_vector(31 downto 0) := (others => '0');
 
+    signal reg_run        : std_logic := '0';
+    signal reg_loop       : std_logic := '0';
+    signal reg_brightness : std_logic_vector(LEVELS_WIDTH - 1 downto 0) := FULL_LEVELS;
+    signal reg_levels     : std_logic_vector(LEVELS_WIDTH - 1 downto 0) := (others => '0');
+    signal reg_wr_addr    : unsigned(FRAME_BITS - 1 downto 0) := (others => '0');
+
+    -- frames in each bank's sequence
+    type length_t is array (0 to 1) of unsigned(FRAME_BITS downto 0);
+    signal bank_length    : length_t := (others => (others => '0'));
+
+    -- frame RAM: bank & index -> levels & ms, no reset so it maps to block RAM
+    type frame_mem_t is array (0 to 2 ** (FRAME_BITS + 1) - 1)
+        of std_logic_vector(LEVELS_WIDTH + 15 downto 0);
+    signal frame_mem      : frame_mem_t;
+    signal frame_we       : std_logic;
+    signal frame_q        : std_logic_vector(LEVELS_WIDTH + 15 downto 0) := (others => '0');
+    signal rd_addr        : unsigned(FRAME_BITS downto 0) := (others => '0');
+
+    -- sequencer
+    type seq_state_t is (STOPPED, FETCH, LOAD, SHOW, FINISHED);
+    signal state          : seq_state_t := STOPPED;
+    signal bank           : std_logic := '0';       -- front bank
+    signal back           : std_logic;
+    signal swap_pending   : std_logic := '0';
+    signal frame_idx      : unsigned(FRAME_BITS - 1 downto 0) := (others => '0');
+    signal ms_left        : unsigned(15 downto 0) := (others => '0');
+    signal ms_count       : natural range 0 to CLKS_PER_MS - 1 := 0;
+    signal playing        : std_logic := '0';
+    signal cur_levels     : std_logic_vector(LEVELS_WIDTH - 1 downto 0) := (others => '0');
+
+    -- PWM
+    signal pwm_div_count  : natural range 0 to PWM_DIV - 1 := 0;
+    signal pwm_step       : unsigned(LEVEL_BITS - 1 downto 0) := (others => '0');
+    signal levels         : std_logic_vector(LEVELS_WIDTH - 1 downto 0);
+
+    function bank_index (b : std_logic) return natural is
+    begin
+        if b = '1' then
+            return 1;
+        end if;
+        return 0;
+    end function bank_index;
+
 begin
 
-    led_out <= reg_leds;
     avs_readdata <= reg_readdata;
+    back <= not bank;
+
+    -- frames while playing, else the pattern at the Brightness levels
+    pattern_levels : process(reg_leds, reg_brightness, cur_levels, playing)
+    begin
+        for i in 0 to NUM_LEDS - 1 loop
+            if playing = '1' then
+                levels(LEVEL_BITS * i + 2 downto LEVEL_BITS * i) <=
+                    cur_levels(LEVEL_BITS * i + 2 downto LEVEL_BITS * i);
+            elsif reg_leds(i) = '1' then
+                levels(LEVEL_BITS * i + 2 downto LEVEL_BITS * i) <=
+                    reg_brightness(LEVEL_BITS * i + 2 downto LEVEL_BITS * i);
+            else
+                levels(LEVEL_BITS * i + 2 downto LEVEL_BITS * i) <= (others => '0');
+            end if;
+        end loop;
+    end process pattern_levels;
+
+    -- level 7 is above every step, so a full LED never blinks
+    pwm_outputs : for i in 0 to NUM_LEDS - 1 generate
+        led_out(i) <= '1' when unsigned(levels(LEVEL_BITS * i + 2 downto LEVEL_BITS * i)) > pwm_step
+                      else '0';
+    end generate pwm_outputs;
+
+    pwm_counter : process(clk, rst)
+    begin
+        if rst = '1' then
+            pwm_div_count <= 0;
+            pwm_step <= (others => '0');
+        elsif rising_edge(clk) then
+            if pwm_div_count = PWM_DIV - 1 then
+                pwm_div_count <= 0;
+                if pwm_step = 6 then
+                    pwm_step <= (others => '0');
+                else
+                    pwm_step <= pwm_step + 1;
+                end if;
+            else
+                pwm_div_count <= pwm_div_count + 1;
+            end if;
+        end if;
+    end process pwm_counter;
+
+    frame_we <= '1' when avs_write = '1' and avs_address = "101" else '0';
+
+    frame_ram : process(clk)
+    begin
+        if rising_edge(clk) then
+            if frame_we = '1' then
+                frame_mem(to_integer(unsigned'(back & reg_wr_addr))) <=
+                    reg_levels & avs_writedata(15 downto 0);
+            end if;
+            frame_q <= frame_mem(to_integer(rd_addr));
+        end if;
+    end process frame_ram;
+
+    -- STOPPED -> FETCH -> LOAD -> SHOW -> FETCH ... -> FINISHED. The next
+    -- frame is read in FETCH and LOAD, two clocks the new frame's SHOW
+    -- leaves out, so every frame lasts exactly its time.
+    sequencer : process(clk, rst)
+        variable next_bank : std_logic;
+    begin
+        if rst = '1' then
+            state <= STOPPED;
+            bank <= '0';
+            frame_idx <= (others => '0');
+            rd_addr <= (others => '0');
+            ms_left <= (others => '0');
+            ms_count <= 0;
+            playing <= '0';
+            cur_levels <= (others => '0');
+        elsif rising_edge(clk) then
+            if reg_run = '0' then
+                state <= STOPPED;
+                playing <= '0';
+                if swap_pending = '1' then
+                    bank <= back;
+                end if;
+            else
+                case state is
+                    when STOPPED | FINISHED =>
+                        -- start, or start over on a bank swapped in
+                        next_bank := bank;
+                        if swap_pending = '1' then
+                            next_bank := back;
+                            bank <= back;
+                        end if;
+                        if state = STOPPED or swap_pending = '1' then
+                            frame_idx <= (others => '0');
+                            rd_addr <= next_bank & to_unsigned(0, FRAME_BITS);
+                            if bank_length(bank_index(next_bank)) = 0 then
+                                playing <= '0';
+                                state <= FINISHED;
+                            else
+                                state <= FETCH;
+                            end if;
+                        end if;
+
+                    when FETCH =>
+                        state <= LOAD;
+
+                    when LOAD =>
+                        cur_levels <= frame_q(LEVELS_WIDTH + 15 downto 16);
+                        if unsigned(frame_q(15 downto 0)) = 0 then
+                            ms_left <= to_unsigned(1, 16);
+                        else
+                            ms_left <= unsigned(frame_q(15 downto 0));
+                        end if;
+                        ms_count <= 2;
+                        playing <= '1';
+                        state <= SHOW;
+
+                    when SHOW =>
+                        if ms_count = CLKS_PER_MS - 1 then
+                            ms_count <= 0;
+                            if ms_left > 1 then
+                                ms_left <= ms_left - 1;
+                            elsif swap_pending = '1' then
+                                bank <= back;
+                                frame_idx <= (others => '0');
+                                rd_addr <= back & to_unsigned(0, FRAME_BITS);
+                                if bank_length(bank_index(back)) = 0 then
+                                    playing <= '0';
+                                    state <= FINISHED;
+                                else
+                                    state <= FETCH;
+                                end if;
+                            elsif resize(frame_idx, FRAME_BITS + 1) + 1 < bank_length(bank_index(bank)) then
+                                frame_idx <= frame_idx + 1;
+                                rd_addr <= bank & (frame_idx + 1);
+                                state <= FETCH;
+                            elsif reg_loop = '1' then
+                                frame_idx <= (others => '0');
+                                rd_addr <= bank & to_unsigned(0, FRAME_BITS);
+                                state <= FETCH;
+                            else
+                                -- one-shot: the last frame stays on
+                                state <= FINISHED;
+                            end if;
+                        else
+                            ms_count <= ms_count + 1;
+                        end if;
+                end case;
+            end if;
+        end if;
+    end process sequencer;
 
     avalon_register_read : process(clk)
     begin
         if rising_edge(clk) and avs_read = '1' then
             case avs_address is
-                when "00" =>
+                when "000" =>
                     reg_readdata <= (others => '0');
                     reg_readdata(9 downto 0) <= reg_leds;
+                when "001" =>
+                    reg_readdata <= (0 => reg_run, 1 => reg_loop, 2 => swap_pending,
+                                     others => '0');
+                when "010" =>
+                    reg_readdata <= std_logic_vector(resize(bank_length(bank_index(back)), 32));
+                when "011" =>
+                    reg_readdata <= std_logic_vector(resize(reg_wr_addr, 32));
+                when "100" =>
+                    reg_readdata <= (31 downto LEVELS_WIDTH => '0') & reg_levels;
+                when "110" =>
+                    reg_readdata <= (others => '0');
+                    reg_readdata(FRAME_BITS - 1 downto 0) <= std_logic_vector(frame_idx);
+                    reg_readdata(8) <= bank;
+                    if state = FINISHED then
+                        reg_readdata(9) <= '1';
+                    end if;
+                    reg_readdata(10) <= playing;
+                    reg_readdata(19 downto 16) <= std_logic_vector(to_unsigned(FRAME_BITS, 4));
+                when "111" =>
+                    reg_readdata <= (31 downto LEVELS_WIDTH => '0') & reg_brightness;
                 when others =>
                     reg_readdata <= (others => '0');
             end case;
         end if;
     end process avalon_register_read;
 
-    avalon_register_write : process(clk)
+    avalon_register_write : process(clk, rst)
     begin
         if rst = '1' then
             reg_leds <= (others => '0');
-        elsif rising_edge(clk) and avs_write = '1' then
-            case avs_address is
-                when "00" =>
-                    reg_leds <= avs_writedata(9 downto 0);
-                when others =>
-                    null;
-            end case;
+            reg_run <= '0';
+            reg_loop <= '0';
+            reg_brightness <= FULL_LEVELS;
+            reg_levels <= (others => '0');
+            reg_wr_addr <= (others => '0');
+            bank_length <= (others => (others => '0'));
+            swap_pending <= '0';
+        elsif rising_edge(clk) then
+            -- the sequencer swaps at a frame boundary, or at once when idle
+            if swap_pending = '1' and (reg_run = '0' or state = STOPPED or
+                                       state = FINISHED or
+                                       (state = SHOW and ms_count = CLKS_PER_MS - 1 and ms_left <= 1)) then
+                swap_pending <= '0';
+            end if;
+
+            if avs_write = '1' then
+                case avs_address is
+                    when "000" =>
+                        reg_leds <= avs_writedata(9 downto 0);
+                    when "001" =>
+                        reg_run <= avs_writedata(0);
+                        reg_loop <= avs_writedata(1);
+                        if avs_writedata(2) = '1' then
+                            swap_pending <= '1';
+                        end if;
+                    when "010" =>
+                        if unsigned(avs_writedata(30 downto 0)) > 2 ** FRAME_BITS then
+                            bank_length(bank_index(back)) <= to_unsigned(2 ** FRAME_BITS, FRAME_BITS + 1);
+                        else
+                            bank_length(bank_index(back)) <= unsigned(avs_writedata(FRAME_BITS downto 0));
+                        end if;
+                    when "011" =>
+                        reg_wr_addr <= unsigned(avs_writedata(FRAME_BITS - 1 downto 0));
+                    when "100" =>
+                        reg_levels <= avs_writedata(LEVELS_WIDTH - 1 downto 0);
+                    when "101" =>
+                        reg_wr_addr <= reg_wr_addr + 1;
+                    when "111" =>
+                        reg_brightness <= avs_writedata(LEVELS_WIDTH - 1 downto 0);
+                    when others =>
+                        null;
+                end case;
+            end if;
         end if;
     end process avalon_register_write;
 end architecture rtl;
\ No newline at end of file
@@ -2,6 +2,14 @@ library ieee;
 use ieee.std_logic_1164.all;
 use ieee.numeric_std.all;
 
+-- Avalon-MM register map (word offsets from base 0x0017F470):
+--   0x0 : button_status  (R/W)
+--       - bit 0 is set by a debounced press and held until software writes 0
+--   0x4 : irq_enable     (R/W)
+--       - bit 0 = '1' drives irq high while button_status is set
+--
+-- irq is level-sensitive: it stays asserted until software clears
+-- button_status (or disables the interrupt).
 
 entity led_patterns_avalon is
     port (
@@ -15,6 +23,9 @@ entity led_patterns_avalon is
         avs_readdata : out   std_logic_vector(31 downto 0);
         avs_writedata : in  std_logic_vector(31 downto 0);
 
+        -- interrupt sender; connect to hps.f2h_irq0
+        irq         : out   std_logic;
+
         -- External I/O; export to top-level
         push_button : in    std_logic
     );
@@ -23,19 +34,24 @@ end entity led_patterns_avalon;
 architecture led_patterns_avalon_arch of led_patterns_avalon is
 
     signal button_status : std_logic;
+    signal irq_enable    : std_logic;
 
     signal debounce_timer : unsigned(31 downto 0);
 
     signal debounced_button : std_logic;
-    
+
 begin
 
+    irq <= button_status and irq_enable;
+
     avalon_register_read : process (clk)
     begin
         if rising_edge(clk) and avs_read = '1' then
             case avs_address is
-                when "00" => 
+                when "00" =>
                     avs_readdata <= (0 => button_status, others => '0');
+                when "01" =>
+                    avs_readdata <= (0 => irq_enable, others => '0');
                 when others =>
                     avs_readdata <= (others => '0');
             end case;
@@ -43,19 +59,28 @@ begin
     end process;
 
 
+    -- A press takes priority over a software write in the same cycle so a
+    -- press is never lost while software is clearing the previous one.
     avalon_register_write : process (clk, rst)
     begin
         if rst = '1' then
             button_status <= '0';
-        elsif debounced_button = '1' then
-            button_status <= '1';
-        elsif rising_edge(clk) and avs_write = '1' then 
-            case avs_address is
-                when "00" =>
-                    button_status <= avs_writedata(1);
-                when others =>
-                    null;
-            end case;
+            irq_enable <= '0';
+        elsif rising_edge(clk) then
+            if avs_write = '1' then
+                case avs_address is
+                    when "00" =>
+                        button_status <= avs_writedata(0);
+                    when "01" =>
+                        irq_enable <= avs_writedata(0);
+                    when others =>
+                        null;
+                end case;
+            end if;
+
+            if debounced_button = '1' then
+                button_status <= '1';
+            end if;
         end if;
     end process;
 
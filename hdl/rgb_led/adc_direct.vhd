@@ -0,0 +1,120 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- ADC Direct Mapping
+-- Reads ADC channels 0-2 straight from the ADC IP over an Avalon-MM master
+-- and turns them into PWM duties without involving the HPS:
+--     channel 0 -> red, channel 1 -> green, channel 2 -> blue
+--
+-- duty = min(1.0, adc * gain / 4096)
+--     adc:  12-bit ADC value (0 to 4095)
+--     gain: 18.17 fixed point, software-loadable per channel
+--           (1 << 17 = 1.0 maps full-scale ADC to ~100% duty)
+--
+-- While enable is '1' the channels are read round-robin, back to back, so a
+-- new duty reaches the PWM a few microseconds after the ADC converts it.
+-- While enable is '0' the master is idle and the duties hold their values.
+--
+-- The master uses waitrequest only (no readdatavalid); the interconnect
+-- holds waitrequest until the ADC returns data.
+
+entity adc_direct is
+    generic (
+        ADC_BASE : natural := 0     -- byte address of ADC channel 0
+    );
+    port (
+        clk             : in  std_logic;
+        rst             : in  std_logic;
+
+        enable          : in  std_logic;
+        gain_r          : in  unsigned(17 downto 0);
+        gain_g          : in  unsigned(17 downto 0);
+        gain_b          : in  unsigned(17 downto 0);
+
+        -- Avalon master to the ADC
+        avm_address     : out std_logic_vector(31 downto 0);
+        avm_read        : out std_logic;
+        avm_readdata    : in  std_logic_vector(31 downto 0);
+        avm_waitrequest : in  std_logic;
+
+        duty_r          : out unsigned(17 downto 0);
+        duty_g          : out unsigned(17 downto 0);
+        duty_b          : out unsigned(17 downto 0)
+    );
+end entity adc_direct;
+
+architecture rtl of adc_direct is
+
+    constant ADC_BITS   : integer := 12;
+    constant DUTY_SCALE : unsigned(17 downto 0) := to_unsigned(131072, 18);
+
+    signal channel      : unsigned(1 downto 0) := (others => '0');
+    signal reading      : std_logic := '0';
+
+    signal reg_duty_r   : unsigned(17 downto 0) := (others => '0');
+    signal reg_duty_g   : unsigned(17 downto 0) := (others => '0');
+    signal reg_duty_b   : unsigned(17 downto 0) := (others => '0');
+
+    -- adc * gain / 4096, clamped to 1.0
+    function scale (adc : std_logic_vector(ADC_BITS - 1 downto 0);
+                    gain : unsigned(17 downto 0)) return unsigned is
+        variable product : unsigned(ADC_BITS + 18 - 1 downto 0);
+    begin
+        product := unsigned(adc) * gain;
+        if product(product'high downto ADC_BITS) > DUTY_SCALE then
+            return DUTY_SCALE;
+        end if;
+        return product(ADC_BITS + 18 - 1 downto ADC_BITS);
+    end function scale;
+
+begin
+
+    avm_address <= std_logic_vector(to_unsigned(ADC_BASE, 32) +
+                                    resize(channel & "00", 32));
+    avm_read    <= reading;
+
+    duty_r <= reg_duty_r;
+    duty_g <= reg_duty_g;
+    duty_b <= reg_duty_b;
+
+    -- Sweep channels 0, 1, 2, 0, ... one read at a time
+    sample : process(clk, rst)
+    begin
+        if rst = '1' then
+            channel <= (others => '0');
+            reading <= '0';
+            reg_duty_r <= (others => '0');
+            reg_duty_g <= (others => '0');
+            reg_duty_b <= (others => '0');
+
+        elsif rising_edge(clk) then
+            if reading = '0' then
+                -- only start a read when enabled; a read in flight always
+                -- completes so the bus is never left hanging
+                if enable = '1' then
+                    reading <= '1';
+                end if;
+
+            elsif avm_waitrequest = '0' then
+                case channel is
+                    when "00" =>
+                        reg_duty_r <= scale(avm_readdata(ADC_BITS - 1 downto 0), gain_r);
+                    when "01" =>
+                        reg_duty_g <= scale(avm_readdata(ADC_BITS - 1 downto 0), gain_g);
+                    when others =>
+                        reg_duty_b <= scale(avm_readdata(ADC_BITS - 1 downto 0), gain_b);
+                end case;
+
+                if channel = 2 then
+                    channel <= (others => '0');
+                else
+                    channel <= channel + 1;
+                end if;
+
+                reading <= enable;
+            end if;
+        end if;
+    end process sample;
+
+end architecture rtl;
@@ -0,0 +1,151 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Fade / ramp engine for one PWM channel
+--
+-- A start pulse ramps duty linearly from `from` to `target` over `steps`
+-- PWM periods (0 counts as 1), one step per tick (period_end):
+--
+--     increment = |target - from| * 2^FRAC / steps
+--
+-- The increment comes from a 32-cycle serial divider started by `start`,
+-- so the first step lands on the first tick after that (ticks are
+-- thousands of clocks apart). The position keeps FRAC fraction bits so
+-- slow ramps still move, and the last step is exactly `target`.
+--
+-- busy is '1' from start to the last step, done pulses for the clock after
+-- it. duty holds `from` until the first step and `target` after the last.
+-- A start while busy restarts the ramp; pass the current duty as `from` to
+-- change course without a jump.
+
+entity fade_ramp is
+    port (
+        clk     : in  std_logic;
+        rst     : in  std_logic;
+
+        start   : in  std_logic;
+        from    : in  unsigned(17 downto 0);
+        target  : in  unsigned(17 downto 0);
+        steps   : in  unsigned(15 downto 0);
+        tick    : in  std_logic;
+
+        duty    : out unsigned(17 downto 0);
+        busy    : out std_logic;
+        done    : out std_logic
+    );
+end entity fade_ramp;
+
+architecture rtl of fade_ramp is
+
+    constant FRAC : natural := 14;
+
+    type state_t is (IDLE, DIVIDE, RAMP);
+    signal state      : state_t := IDLE;
+
+    -- duty with FRAC fraction bits
+    signal pos        : unsigned(17 + FRAC downto 0) := (others => '0');
+    signal tgt        : unsigned(17 downto 0) := (others => '0');
+    signal down       : std_logic := '0';
+    signal remaining  : unsigned(15 downto 0) := (others => '0');
+
+    -- restoring divider: inc = num / divisor, one quotient bit per clock
+    signal num        : unsigned(17 + FRAC downto 0) := (others => '0');
+    signal divisor    : unsigned(15 downto 0) := (others => '0');
+    signal partial    : unsigned(15 downto 0) := (others => '0');
+    signal inc        : unsigned(17 + FRAC downto 0) := (others => '0');
+    signal div_count  : natural range 0 to 18 + FRAC := 0;
+
+    signal done_i     : std_logic := '0';
+
+begin
+
+    duty <= pos(17 + FRAC downto FRAC);
+    busy <= '0' when state = IDLE else '1';
+    done <= done_i;
+
+    ramp_step : process(clk, rst)
+        variable delta : unsigned(17 downto 0);
+        variable n     : unsigned(15 downto 0);
+        variable trial : unsigned(16 downto 0);
+    begin
+        if rst = '1' then
+            state <= IDLE;
+            pos <= (others => '0');
+            tgt <= (others => '0');
+            down <= '0';
+            remaining <= (others => '0');
+            num <= (others => '0');
+            divisor <= (others => '0');
+            partial <= (others => '0');
+            inc <= (others => '0');
+            div_count <= 0;
+            done_i <= '0';
+
+        elsif rising_edge(clk) then
+            done_i <= '0';
+
+            if start = '1' then
+                if target < from then
+                    delta := from - target;
+                    down <= '1';
+                else
+                    delta := target - from;
+                    down <= '0';
+                end if;
+
+                n := steps;
+                if n = 0 then
+                    n := to_unsigned(1, n'length);
+                end if;
+
+                pos <= from & to_unsigned(0, FRAC);
+                tgt <= target;
+                remaining <= n;
+                num <= delta & to_unsigned(0, FRAC);
+                divisor <= n;
+                partial <= (others => '0');
+                inc <= (others => '0');
+                div_count <= 18 + FRAC;
+                state <= DIVIDE;
+
+            else
+                case state is
+                    when DIVIDE =>
+                        trial := partial & num(num'high);
+                        num <= num(num'high - 1 downto 0) & '0';
+                        if trial >= divisor then
+                            partial <= resize(trial - divisor, partial'length);
+                            inc <= inc(inc'high - 1 downto 0) & '1';
+                        else
+                            partial <= trial(15 downto 0);
+                            inc <= inc(inc'high - 1 downto 0) & '0';
+                        end if;
+
+                        if div_count = 1 then
+                            state <= RAMP;
+                        end if;
+                        div_count <= div_count - 1;
+
+                    when RAMP =>
+                        if tick = '1' then
+                            if remaining = 1 then
+                                pos <= tgt & to_unsigned(0, FRAC);
+                                state <= IDLE;
+                                done_i <= '1';
+                            elsif down = '1' then
+                                pos <= pos - inc;
+                            else
+                                pos <= pos + inc;
+                            end if;
+                            remaining <= remaining - 1;
+                        end if;
+
+                    when IDLE =>
+                        null;
+                end case;
+            end if;
+        end if;
+    end process ramp_step;
+
+end architecture rtl;
@@ -0,0 +1,112 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Frame FIFO
+--
+--   2^FIFO_BITS entries of WIDTH bits in block RAM, show-ahead: q is the
+--   oldest entry whenever q_valid is '1', and pop moves on to the next.
+--   The RAM reads synchronously, so q_valid drops for one clock after a
+--   pop, and after a push into an empty FIFO, while the new head is read.
+--
+--   push while full is ignored (full tells the caller), pop is ignored
+--   unless q_valid, flush empties the FIFO.
+
+entity frame_fifo is
+    generic (
+        FIFO_BITS : natural := 9;
+        WIDTH     : natural := 70
+    );
+    port (
+        clk      : in  std_logic;
+        rst      : in  std_logic;
+
+        push     : in  std_logic;
+        data     : in  std_logic_vector(WIDTH - 1 downto 0);
+        pop      : in  std_logic;
+        flush    : in  std_logic;
+
+        q        : out std_logic_vector(WIDTH - 1 downto 0);
+        q_valid  : out std_logic;
+        level    : out unsigned(FIFO_BITS downto 0);
+        full     : out std_logic
+    );
+end entity frame_fifo;
+
+architecture rtl of frame_fifo is
+
+    constant DEPTH : natural := 2 ** FIFO_BITS;
+
+    type mem_t is array (0 to DEPTH - 1) of std_logic_vector(WIDTH - 1 downto 0);
+    signal mem      : mem_t;
+
+    signal wr_ptr   : unsigned(FIFO_BITS - 1 downto 0) := (others => '0');
+    signal rd_ptr   : unsigned(FIFO_BITS - 1 downto 0) := (others => '0');
+    signal count    : unsigned(FIFO_BITS downto 0) := (others => '0');
+    -- q doesn't hold mem(rd_ptr) yet
+    signal stale    : std_logic := '1';
+
+    signal do_push  : std_logic;
+    signal do_pop   : std_logic;
+    signal full_i   : std_logic;
+    signal valid_i  : std_logic;
+
+begin
+
+    full_i  <= '1' when count = DEPTH else '0';
+    valid_i <= '1' when count /= 0 and stale = '0' else '0';
+    do_push <= push and not full_i and not flush;
+    do_pop  <= pop and valid_i and not flush;
+
+    full    <= full_i;
+    q_valid <= valid_i;
+    level   <= count;
+
+    -- no reset here, so the array maps to block RAM
+    fifo_ram : process(clk)
+    begin
+        if rising_edge(clk) then
+            if do_push = '1' then
+                mem(to_integer(wr_ptr)) <= data;
+            end if;
+            q <= mem(to_integer(rd_ptr));
+        end if;
+    end process fifo_ram;
+
+    fifo_pointers : process(clk, rst)
+    begin
+        if rst = '1' then
+            wr_ptr <= (others => '0');
+            rd_ptr <= (others => '0');
+            count <= (others => '0');
+            stale <= '1';
+        elsif rising_edge(clk) then
+            if flush = '1' then
+                rd_ptr <= wr_ptr;
+                count <= (others => '0');
+                stale <= '1';
+            else
+                if do_push = '1' then
+                    wr_ptr <= wr_ptr + 1;
+                end if;
+                if do_pop = '1' then
+                    rd_ptr <= rd_ptr + 1;
+                end if;
+
+                if do_push = '1' and do_pop = '0' then
+                    count <= count + 1;
+                elsif do_push = '0' and do_pop = '1' then
+                    count <= count - 1;
+                end if;
+
+                -- q catches up one clock after the head moves or is written
+                if do_pop = '1' or (do_push = '1' and wr_ptr = rd_ptr) then
+                    stale <= '1';
+                else
+                    stale <= '0';
+                end if;
+            end if;
+        end if;
+    end process fifo_pointers;
+
+end architecture rtl;
@@ -0,0 +1,69 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use ieee.math_real.all;
+
+-- Gamma / brightness lookup table for one PWM channel
+--
+--   2^LUT_BITS entries of 18-bit duty (18.17), one M10K block at 8 bits,
+--   nine at 12 bits. Power-up contents are a gamma 2.2 curve from 0 to
+--   1.0, so a linear intensity comes out perceptually even without any
+--   software setup; the table can be rewritten at any time through port A.
+--
+--   Port A : table access from the bus, read or write one entry per clock
+--   Port B : lookup, read only
+--   Both ports read synchronously: q is valid the clock after the address.
+
+entity gamma_lut is
+    generic (
+        LUT_BITS : natural := 8         -- 8 to 12
+    );
+    port (
+        clk      : in  std_logic;
+
+        a_addr   : in  unsigned(LUT_BITS - 1 downto 0);
+        a_we     : in  std_logic;
+        a_wdata  : in  std_logic_vector(17 downto 0);
+        a_q      : out std_logic_vector(17 downto 0);
+
+        b_addr   : in  unsigned(LUT_BITS - 1 downto 0);
+        b_q      : out std_logic_vector(17 downto 0)
+    );
+end entity gamma_lut;
+
+architecture rtl of gamma_lut is
+
+    constant ENTRIES : natural := 2 ** LUT_BITS;
+    constant GAMMA   : real := 2.2;
+
+    type lut_t is array (0 to ENTRIES - 1) of std_logic_vector(17 downto 0);
+
+    -- round((i / (ENTRIES - 1)) ^ GAMMA * 2^17)
+    function gamma_table return lut_t is
+        variable t : lut_t;
+    begin
+        for i in 0 to ENTRIES - 1 loop
+            t(i) := std_logic_vector(to_unsigned(integer(round(
+                (real(i) / real(ENTRIES - 1)) ** GAMMA * 131072.0)), 18));
+        end loop;
+        return t;
+    end function gamma_table;
+
+    signal lut : lut_t := gamma_table;
+
+begin
+
+    -- one write port, two read ports: a_q returns the old entry when it is
+    -- written in the same clock
+    lut_ram : process(clk)
+    begin
+        if rising_edge(clk) then
+            if a_we = '1' then
+                lut(to_integer(a_addr)) <= a_wdata;
+            end if;
+            a_q <= lut(to_integer(a_addr));
+            b_q <= lut(to_integer(b_addr));
+        end if;
+    end process lut_ram;
+
+end architecture rtl;
@@ -9,9 +9,23 @@ use ieee.numeric_std.all;
 -- duty_cycle: 18.17 fixed point (0 to 1)
 --     fraction of full duty cycle
 -- output is high for 'high_cycles' clock ticks per period
+-- period_end pulses high on the last clock tick of every period, so
+-- anything latched on it takes effect cleanly at the start of the next one
 --
 -- How fpga fabric turns register writes into LED brightness
 -- How period and duty interact to control LED intensity
+--
+-- period and duty_cycle only change on Avalon writes, so period_cycles and
+-- high_cycles are computed in a short pipeline that runs only when an input
+-- changes (and once after reset), instead of every clock:
+--   stage 0 : register inputs, flag a change
+--   stage 1 : period * CYCLES_PER_MS >> 5, clamped to [1, 2^20 - 1]
+--             (PERIOD_SCALE is a power of two, so the divide is a shift)
+--   stage 2 : cycles * duty, the only real multiplier (20 x 18)
+--   stage 3 : slice the product, update period and high time together
+-- A change reaches the counter 4 clocks later. The counter and compare
+-- logic are unchanged; the counter only sees registered values, so the
+-- long multiply/divide path is off the PWM clock path.
 
 
 entity pwm_controller is
@@ -23,7 +37,8 @@ entity pwm_controller is
         rst        : in std_logic;
         period     : unsigned(10 downto 0);
         duty_cycle : unsigned(17 downto 0);
-        output     : out std_logic
+        output     : out std_logic;
+        period_end : out std_logic
     );
 end entity pwm_controller;
 
@@ -33,72 +48,117 @@ architecture pwm_arch of pwm_controller is
     constant F_PERIOD           : integer := 5;     -- period : 11.5
     constant F_DUTY             : integer := 17;    -- duty cycle : 18.17
 
-    constant PERIOD_SCALE       : integer := 32;
-    constant DUTY_SCALE         : integer := 131072;
-
     constant CYCLES_PER_MS      : integer := integer(1 ms / CLK_PERIOD);
     constant WIDTH 		        : integer := 20;
+    constant MAX_CYCLES         : integer := 2 ** WIDTH - 1;
+
+    -- period * CYCLES_PER_MS fits in 11 + 32 bits for any sane clock
+    constant CPM_U              : unsigned(31 downto 0) := to_unsigned(CYCLES_PER_MS, 32);
+
+    -- stage 0
+    signal period_q             : unsigned(10 downto 0) := (others => '0');
+    signal duty_q               : unsigned(17 downto 0) := (others => '0');
+    signal changed              : std_logic := '1';
+
+    -- stage 1
+    signal cycles_1             : unsigned(WIDTH - 1 downto 0) := (others => '0');
+    signal duty_1               : unsigned(17 downto 0) := (others => '0');
+    signal valid_1              : std_logic := '0';
+
+    -- stage 2
+    signal product_2            : unsigned(WIDTH + 18 - 1 downto 0) := (others => '0');
+    signal cycles_2             : unsigned(WIDTH - 1 downto 0) := (others => '0');
+    signal valid_2              : std_logic := '0';
+
+    -- stage 3 / counter
     signal count                : unsigned(WIDTH - 1 downto 0) := (others => '0');
-    signal period_cycles        : unsigned(WIDTH - 1 downto 0) := (others => '0');
+    signal last_count           : unsigned(WIDTH - 1 downto 0) := (others => '0');
     signal high_cycles          : unsigned(WIDTH - 1 downto 0) := (others => '0');
     signal pwm_reg              : std_logic := '0';
 
 begin
 
-    -- Main PWM Process
-    --  - Computes how many clock cycles output should stay high
-    --    based on duty_cycle
-    --  - Increments counter from 0 to (period-1) and compares 
-    --    to high_cycles to set output
+    -- Period/high time pipeline
+    --  - Each stage only loads when the stage before it has new data
+    --  - last_count (period_cycles - 1) and high_cycles land on the
+    --    same clock so the counter never sees a half-updated pair
 
-    process(clk, rst)
+    pipeline : process(clk, rst)
 
-        variable period_int     : integer;
-        variable duty_int       : integer;
-        variable cycles_v       : integer;
-        variable cycles_u       : unsigned(WIDTH - 1 downto 0);
-        variable product        : unsigned(WIDTH + duty_cycle'length - 1 downto 0);
-        variable high_u         : unsigned(WIDTH - 1 downto 0);
+        variable scaled         : unsigned(period'length + CPM_U'length - 1 downto 0);
+        variable cycles_full    : unsigned(scaled'length - F_PERIOD - 1 downto 0);
     begin
         if rst = '1' then
-            count               <= (others => '0');
-            period_cycles       <= (others => '0');
+            period_q            <= (others => '0');
+            duty_q              <= (others => '0');
+            changed             <= '1';
+            cycles_1            <= (others => '0');
+            duty_1              <= (others => '0');
+            valid_1             <= '0';
+            product_2           <= (others => '0');
+            cycles_2            <= (others => '0');
+            valid_2             <= '0';
+            last_count          <= (others => '1');
             high_cycles         <= (others => '0');
-            pwm_reg             <= '0';
 
         elsif rising_edge(clk) then
-            
-            -- Fixed point input to integers
-            period_int := to_integer(period);
-            duty_int := to_integer(duty_cycle);
-
-            -- Clamp duty to 0,1
-            if duty_int > DUTY_SCALE then
-                duty_int := DUTY_SCALE;
-	        elsif duty_int < 0 then
-		        duty_int := 0;
+
+            -- stage 0: register inputs
+            period_q <= period;
+            duty_q <= duty_cycle;
+            if period /= period_q or duty_cycle /= duty_q then
+                changed <= '1';
+            else
+                changed <= '0';
             end if;
 
-            -- Convert period to clock cycles
-            cycles_v := (period_int * CYCLES_PER_MS) / PERIOD_SCALE;
+            -- stage 1: period to clock cycles
+            valid_1 <= changed;
+            if changed = '1' then
+                scaled := period_q * CPM_U;
+                cycles_full := scaled(scaled'high downto F_PERIOD);
+
+                if cycles_full = 0 then
+                    cycles_1 <= to_unsigned(1, WIDTH);
+                elsif cycles_full > MAX_CYCLES then
+                    cycles_1 <= to_unsigned(MAX_CYCLES, WIDTH);
+                else
+                    cycles_1 <= cycles_full(WIDTH - 1 downto 0);
+                end if;
+                duty_1 <= duty_q;
+            end if;
 
-            if cycles_v < 1 then
-                cycles_v := 1;
-            elsif cycles_v > (2 ** WIDTH - 1) then
-                cycles_v := 2 ** WIDTH - 1;
+            -- stage 2: on time in clock cycles
+            valid_2 <= valid_1;
+            if valid_1 = '1' then
+                product_2 <= cycles_1 * duty_1;
+                cycles_2 <= cycles_1;
             end if;
 
-            cycles_u := to_unsigned(cycles_v, cycles_u'length);
+            -- stage 3: duty above 1.0 keeps the old behaviour, the top
+            -- product bit is dropped and count < high_cycles saturates
+            if valid_2 = '1' then
+                high_cycles <= product_2(product_2'high - 1 downto F_DUTY);
+                last_count <= cycles_2 - 1;
+            end if;
+
+        end if;
+    end process pipeline;
 
-            -- On time in clock cycles
-            product := cycles_u * duty_cycle;
-            high_u  := product(product'high - 1 downto F_DUTY);
+    -- Main PWM Process
+    --  - Increments counter from 0 to (period-1) and compares
+    --    to high_cycles to set output
+
+    process(clk, rst)
+    begin
+        if rst = '1' then
+            count               <= (others => '0');
+            pwm_reg             <= '0';
 
-            period_cycles <= cycles_u;
-            high_cycles <= high_u;
+        elsif rising_edge(clk) then
 
             -- count and output logic
-            if count >= (period_cycles - 1) then
+            if count >= last_count then
                 count <= (others => '0');
             else
                 count <= count + 1;
@@ -109,10 +169,12 @@ begin
             else
                 pwm_reg <= '0';
             end if;
-            
+
         end if;
     end process;
 
     output <= pwm_reg;
 
-end architecture pwm_arch;
\ No newline at end of file
+    period_end <= '1' when count >= last_count else '0';
+
+end architecture pwm_arch;
@@ -8,6 +8,8 @@ use ieee.numeric_std.all;
 --   - One for each color channel
 --   - Share same period, but have independent duty cycles
 -- Bridge between avalon registers and actual pins
+-- period_end comes from the red channel; all three channels share period
+-- and reset so their counters wrap together
 --
 
 entity pwm_rgb is
@@ -20,7 +22,8 @@ entity pwm_rgb is
         period    : in  unsigned(10 downto 0);
         pwm_r     : out std_logic;
         pwm_g     : out std_logic;
-        pwm_b     : out std_logic
+        pwm_b     : out std_logic;
+        period_end : out std_logic
     );
 end entity pwm_rgb;
 
@@ -32,7 +35,8 @@ architecture rtl of pwm_rgb is
             rst      : in  std_logic;
             period     : in  unsigned(10 downto 0);
             duty_cycle   : in  unsigned(17 downto 0);
-            output  : out std_logic
+            output  : out std_logic;
+            period_end : out std_logic
         );
     end component pwm_controller;
     
@@ -44,7 +48,8 @@ begin
             rst     => rst,
             period  => period,
 				duty_cycle    => duty_r,
-            output => pwm_r
+            output => pwm_r,
+            period_end => period_end
         );
 
     pwm_green_inst : pwm_controller
@@ -53,7 +58,8 @@ begin
             rst     => rst,
 				period  => period,
             duty_cycle    => duty_g,
-            output => pwm_g
+            output => pwm_g,
+            period_end => open
         );
 
     pwm_blue_inst : pwm_controller
@@ -62,7 +68,8 @@ begin
             rst     => rst,
 				period  => period,
             duty_cycle    => duty_b,
-            output => pwm_b
+            output => pwm_b,
+            period_end => open
         );
 
         
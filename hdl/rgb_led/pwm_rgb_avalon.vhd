@@ -6,17 +6,132 @@ use std.standard;
 
 -- Avalon-MM register map
 --   Base: 0x0017f430
---   Span: 0x10 bytes (0x0017f430 - 0x0017f43f)
---     0x0 @ 0x0017f430 : Red Duty Cycle (duty_r)
---     0x4 @ 0x0017f434 : Green Duty Cycle (duty_g)
---     0x8 @ 0x0017f438 : Blue Duty Cycle (duty_b)
---     0xC @ 0x0017f43C : PWM Period (period)
+--   Span: 0x20 bytes (0x0017f430 - 0x0017f44f)
+--     0x00 @ 0x0017f430 : Red Duty Cycle (duty_r)     - shadow
+--     0x04 @ 0x0017f434 : Green Duty Cycle (duty_g)   - shadow
+--     0x08 @ 0x0017f438 : Blue Duty Cycle (duty_b)    - shadow
+--     0x0C @ 0x0017f43C : PWM Period (period)
+--     0x10 @ 0x0017f440 : Commit
+--         write bit 0 = '1' : copy the three shadow duties into the PWM
+--                             channels at the end of the current PWM period
+--         read  bit 0       : '1' while a commit is waiting for that boundary
+--
+--  Duty writes only land in the shadow registers, so a color written as
+--  R, G, B then Commit reaches the LED in one step, on a period boundary,
+--  instead of passing through intermediate colors. Reads of 0x0-0x8 return
+--  the shadow values. Period is not shadowed and takes effect immediately.
+--
+-- Direct mode register map (second slave, avs_direct_*)
+--   Base: 0x0017f480
+--   Span: 0x10 bytes (0x0017f480 - 0x0017f48f)
+--     0x0 @ 0x0017f480 : Mode
+--         bit 0 = '0' : software control, duties come from the registers above
+--         bit 0 = '1' : hardware direct, duties come from ADC channels 0-2
+--     0x4 @ 0x0017f484 : Red Gain   (18.17, reset 1.0)
+--     0x8 @ 0x0017f488 : Green Gain (18.17, reset 1.0)
+--     0xC @ 0x0017f48C : Blue Gain  (18.17, reset 1.0)
+--
+--  In direct mode adc_direct reads the ADC IP through avm_adc_* and drives
+--  the PWM channels itself, so pot-to-light latency is a few microseconds
+--  and no software runs. Switching back to software control restores the
+--  last committed duties. Period still comes from the main register map.
+--
+-- Gamma LUT register map (third slave, avs_lut_*)
+--   Base: 0x0017f4a0
+--   Span: 0x20 bytes (0x0017f4a0 - 0x0017f4bf)
+--     0x00 @ 0x0017f4a0 : Red Intensity   (LUT_BITS wide)
+--     0x04 @ 0x0017f4a4 : Green Intensity
+--     0x08 @ 0x0017f4a8 : Blue Intensity
+--         write : look the intensity up in the channel's table and put the
+--                 result in that channel's shadow duty (no commit)
+--         read  : the last intensity looked up for the channel
+--     0x0C @ 0x0017f4ac : Color, write only
+--         bits 7:0 red, 15:8 green, 23:16 blue, 8 bits each (scaled up to
+--         LUT_BITS by repeating the top bits), looked up, then committed:
+--         a whole color in one bus write
+--     0x10 @ 0x0017f4b0 : Commit, as in the main map, but ordered behind
+--                         the lookups written before it
+--     0x14 @ 0x0017f4b4 : Table Address
+--         bits LUT_BITS+1:LUT_BITS channel (0 red, 1 green, 2 blue),
+--         bits LUT_BITS-1:0 entry
+--     0x18 @ 0x0017f4b8 : Table Data, the 18.17 duty at Table Address.
+--                         Every read or write moves Table Address to the
+--                         next entry, running on from red into green and
+--                         blue, so all three tables load in one pass.
+--     0x1C @ 0x0017f4bc : Info, read only: LUT_BITS
+--
+--  Lookups take two clocks and land in the shadow duties in the order they
+--  were written, so intensities followed by Commit latch together like
+--  duty writes do. The duty registers in the main map are unchanged and
+--  bypass the tables. Tables power up as gamma 2.2 curves (gamma_lut.vhd).
+--  This slave has readLatency 1, since Table Data comes out of block RAM.
+--
+-- Fade register map (fourth slave, avs_fade_*)
+--   Base: 0x0017f4c0
+--   Span: 0x20 bytes (0x0017f4c0 - 0x0017f4df)
+--     0x00 @ 0x0017f4c0 : Red Target   (18.17)
+--     0x04 @ 0x0017f4c4 : Green Target
+--     0x08 @ 0x0017f4c8 : Blue Target
+--     0x0C @ 0x0017f4cc : Red Steps    (16 bits, PWM periods, 0 = 1)
+--     0x10 @ 0x0017f4d0 : Green Steps
+--     0x14 @ 0x0017f4d4 : Blue Steps
+--     0x18 @ 0x0017f4d8 : Fade Control / Status
+--         write bits 2:0 : start a fade on red/green/blue
+--         read  bits 2:0 : red/green/blue fading
+--         read  bit  8   : done, '1' when no channel is fading
+--
+--  A fade moves the channel from wherever it is now to its target in a
+--  straight line, one step per PWM period (fade_ramp.vhd), with no bus
+--  traffic after the start write. Starting a fade also sets the channel's
+--  shadow duty to the target, and the target becomes the committed duty
+--  when the fade ends, so reads and later commits pick up where it
+--  finished. While a channel fades, the fade drives it and commits don't
+--  show on it; start another fade to change course.
+--
+-- Frame FIFO register map (fifth slave, avs_fifo_*)
+--   Base: 0x0017f4e0
+--   Span: 0x20 bytes (0x0017f4e0 - 0x0017f4ff)
+--     0x00 @ 0x0017f4e0 : Frame Red   (18.17), staged for the next push
+--     0x04 @ 0x0017f4e4 : Frame Green
+--     0x08 @ 0x0017f4e8 : Frame Blue
+--     0x0C @ 0x0017f4ec : Frame Hold
+--         write : PWM periods to show the frame for (16 bits, 0 = 1), and
+--                 push the staged red/green/blue with it
+--         read  : periods left on the frame showing now
+--     0x10 @ 0x0017f4f0 : FIFO Control
+--         bit 0 = run: play frames (reset '1')
+--         bit 1 = flush, write only: drop every queued frame
+--         bit 2 = interrupt enable: irq while the FIFO is low
+--     0x14 @ 0x0017f4f4 : FIFO Level, read only: frames queued
+--     0x18 @ 0x0017f4f8 : FIFO Watermark: low while Level <= Watermark
+--                         (reset FIFO_DEPTH / 2)
+--     0x1C @ 0x0017f4fc : FIFO Status
+--         bit 0     = low (Level <= Watermark)
+--         bit 1     = underrun, a frame ended with the FIFO empty (write 1
+--                     to clear)
+--         bit 2     = overflow, a push found the FIFO full and was dropped
+--                     (write 1 to clear)
+--         bit 3     = playing, a frame is on the LED
+--         bits 31:16 = FIFO depth
+--
+--  Frames (red, green, blue, hold) queue in block RAM (frame_fifo.vhd)
+--  and play without software: at each PWM period boundary where the
+--  current frame's hold has run out, the next frame becomes the committed
+--  duty, like a commit. Playback timing is therefore exact to the clock
+--  whenever software keeps the FIFO from running dry. After an underrun
+--  the last frame stays on and the next push starts playback again at the
+--  following boundary. irq (level-sensitive, like the push button's) lets
+--  software sleep until the FIFO needs a refill.
 --
 --  These registers are mapped into HPS address space through
 --  HPS-to-FPGA lightweight bridge.  Linux uses this map to control
 --  the RGB LED PWM controller from sysfs.
 
 entity pwm_rgb_avalon is
+    generic (
+        LUT_BITS      : natural := 8;     -- gamma table index width, 8 to 12
+        FIFO_BITS     : natural := 9      -- frame FIFO depth = 2^FIFO_BITS
+    );
     port (
         clk           : in  std_logic;
         rst           : in  std_logic;
@@ -24,9 +139,47 @@ entity pwm_rgb_avalon is
         --Avalon Slave Interface
         avs_read      : in  std_logic;
         avs_write     : in  std_logic;
-        avs_address   : in  std_logic_vector(1 downto 0);
+        avs_address   : in  std_logic_vector(2 downto 0);
         avs_writedata : in  std_logic_vector(31 downto 0);
         avs_readdata  : out std_logic_vector(31 downto 0);
+
+        -- Avalon Slave Interface, direct mode registers
+        avs_direct_read      : in  std_logic;
+        avs_direct_write     : in  std_logic;
+        avs_direct_address   : in  std_logic_vector(1 downto 0);
+        avs_direct_writedata : in  std_logic_vector(31 downto 0);
+        avs_direct_readdata  : out std_logic_vector(31 downto 0);
+
+        -- Avalon Slave Interface, gamma LUT registers
+        avs_lut_read         : in  std_logic;
+        avs_lut_write        : in  std_logic;
+        avs_lut_address      : in  std_logic_vector(2 downto 0);
+        avs_lut_writedata    : in  std_logic_vector(31 downto 0);
+        avs_lut_readdata     : out std_logic_vector(31 downto 0);
+
+        -- Avalon Slave Interface, fade registers
+        avs_fade_read        : in  std_logic;
+        avs_fade_write       : in  std_logic;
+        avs_fade_address     : in  std_logic_vector(2 downto 0);
+        avs_fade_writedata   : in  std_logic_vector(31 downto 0);
+        avs_fade_readdata    : out std_logic_vector(31 downto 0);
+
+        -- Avalon Slave Interface, frame FIFO registers
+        avs_fifo_read        : in  std_logic;
+        avs_fifo_write       : in  std_logic;
+        avs_fifo_address     : in  std_logic_vector(2 downto 0);
+        avs_fifo_writedata   : in  std_logic_vector(31 downto 0);
+        avs_fifo_readdata    : out std_logic_vector(31 downto 0);
+
+        -- interrupt sender, frame FIFO low; connect to hps.f2h_irq0
+        irq                  : out std_logic;
+
+        -- Avalon Master Interface, reads the ADC in direct mode
+        avm_adc_address      : out std_logic_vector(31 downto 0);
+        avm_adc_read         : out std_logic;
+        avm_adc_readdata     : in  std_logic_vector(31 downto 0);
+        avm_adc_waitrequest  : in  std_logic;
+
         -- External I/O
         pwm_r         : out std_logic;
         pwm_g         : out std_logic;
@@ -41,6 +194,171 @@ architecture rtl of pwm_rgb_avalon is
     signal reg_duty_b   : std_logic_vector(17 downto 0) := (others => '0');
     signal reg_period   : std_logic_vector(10 downto 0) := (others => '0');
 
+    -- duties currently driving the PWM channels
+    signal duty_r       : std_logic_vector(17 downto 0) := (others => '0');
+    signal duty_g       : std_logic_vector(17 downto 0) := (others => '0');
+    signal duty_b       : std_logic_vector(17 downto 0) := (others => '0');
+
+    signal commit_pending : std_logic := '0';
+    signal period_end     : std_logic;
+
+    -- direct mode
+    constant GAIN_ONE   : std_logic_vector(17 downto 0) := std_logic_vector(to_unsigned(131072, 18));
+
+    signal reg_mode     : std_logic := '0';
+    signal reg_gain_r   : std_logic_vector(17 downto 0) := GAIN_ONE;
+    signal reg_gain_g   : std_logic_vector(17 downto 0) := GAIN_ONE;
+    signal reg_gain_b   : std_logic_vector(17 downto 0) := GAIN_ONE;
+
+    signal direct_r     : unsigned(17 downto 0);
+    signal direct_g     : unsigned(17 downto 0);
+    signal direct_b     : unsigned(17 downto 0);
+
+    -- duties actually fed to pwm_rgb
+    signal pwm_duty_r   : unsigned(17 downto 0);
+    signal pwm_duty_g   : unsigned(17 downto 0);
+    signal pwm_duty_b   : unsigned(17 downto 0);
+
+    -- fades
+    signal reg_target_r : std_logic_vector(17 downto 0) := (others => '0');
+    signal reg_target_g : std_logic_vector(17 downto 0) := (others => '0');
+    signal reg_target_b : std_logic_vector(17 downto 0) := (others => '0');
+    signal reg_steps_r  : std_logic_vector(15 downto 0) := (others => '0');
+    signal reg_steps_g  : std_logic_vector(15 downto 0) := (others => '0');
+    signal reg_steps_b  : std_logic_vector(15 downto 0) := (others => '0');
+
+    -- start pulses, bits 0/1/2 = red/green/blue
+    signal fade_start   : std_logic_vector(2 downto 0) := (others => '0');
+    signal fade_busy    : std_logic_vector(2 downto 0);
+    signal fade_done    : std_logic_vector(2 downto 0);
+    signal fade_r       : unsigned(17 downto 0);
+    signal fade_g       : unsigned(17 downto 0);
+    signal fade_b       : unsigned(17 downto 0);
+
+    -- duties under software control: the fade while one runs, else the
+    -- committed duty
+    signal sw_duty_r    : unsigned(17 downto 0);
+    signal sw_duty_g    : unsigned(17 downto 0);
+    signal sw_duty_b    : unsigned(17 downto 0);
+
+    -- frame FIFO; an entry is red & green & blue & hold
+    constant FIFO_DEPTH : natural := 2 ** FIFO_BITS;
+    constant FRAME_BITS : natural := 3 * 18 + 16;
+
+    signal reg_frame_r  : std_logic_vector(17 downto 0) := (others => '0');
+    signal reg_frame_g  : std_logic_vector(17 downto 0) := (others => '0');
+    signal reg_frame_b  : std_logic_vector(17 downto 0) := (others => '0');
+    signal reg_run      : std_logic := '1';
+    signal reg_irq_en   : std_logic := '0';
+    signal reg_watermark : unsigned(FIFO_BITS downto 0) := to_unsigned(FIFO_DEPTH / 2, FIFO_BITS + 1);
+
+    signal fifo_push    : std_logic;
+    signal fifo_data    : std_logic_vector(FRAME_BITS - 1 downto 0);
+    signal fifo_pop     : std_logic;
+    signal fifo_flush   : std_logic;
+    signal fifo_q       : std_logic_vector(FRAME_BITS - 1 downto 0);
+    signal fifo_valid   : std_logic;
+    signal fifo_level   : unsigned(FIFO_BITS downto 0);
+    signal fifo_full    : std_logic;
+    signal fifo_low     : std_logic;
+
+    -- periods left on the frame showing, '1' once it may be replaced
+    signal hold_left    : unsigned(15 downto 0) := (others => '0');
+    signal playing      : std_logic := '0';
+    signal underrun     : std_logic := '0';
+    signal overflow     : std_logic := '0';
+
+    -- gamma LUT
+    subtype lut_index_t is unsigned(LUT_BITS - 1 downto 0);
+
+    -- channel & entry, see Table Address
+    signal lut_addr     : unsigned(LUT_BITS + 1 downto 0) := (others => '0');
+    signal lut_we_r     : std_logic;
+    signal lut_we_g     : std_logic;
+    signal lut_we_b     : std_logic;
+    signal lut_q_r      : std_logic_vector(17 downto 0);
+    signal lut_q_g      : std_logic_vector(17 downto 0);
+    signal lut_q_b      : std_logic_vector(17 downto 0);
+
+    -- lookup pipeline: index -> table (lk_q_*) -> shadow duty. lk_mask
+    -- bits 0/1/2 = red/green/blue looked up, lk_commit = commit after them
+    signal lk_index_r   : lut_index_t := (others => '0');
+    signal lk_index_g   : lut_index_t := (others => '0');
+    signal lk_index_b   : lut_index_t := (others => '0');
+    signal lk_q_r       : std_logic_vector(17 downto 0);
+    signal lk_q_g       : std_logic_vector(17 downto 0);
+    signal lk_q_b       : std_logic_vector(17 downto 0);
+    signal lk_mask1     : std_logic_vector(2 downto 0) := (others => '0');
+    signal lk_mask2     : std_logic_vector(2 downto 0) := (others => '0');
+    signal lk_commit1   : std_logic := '0';
+    signal lk_commit2   : std_logic := '0';
+
+    -- readLatency 1: a register value captured on the read, or the table
+    -- entry Table Address pointed at
+    signal lut_rd_data  : std_logic_vector(31 downto 0) := (others => '0');
+    signal lut_rd_table : std_logic := '0';
+    signal lut_rd_ch    : unsigned(1 downto 0) := (others => '0');
+
+    -- 8-bit color component -> LUT_BITS index, top bits repeated so 0xFF
+    -- still reaches the last entry
+    function expand8 (v : std_logic_vector(7 downto 0)) return lut_index_t is
+        variable r : lut_index_t;
+    begin
+        for i in 0 to LUT_BITS - 1 loop
+            r(LUT_BITS - 1 - i) := v(7 - (i mod 8));
+        end loop;
+        return r;
+    end function expand8;
+
+    component frame_fifo is
+        generic (
+            FIFO_BITS : natural := 9;
+            WIDTH     : natural := 70
+        );
+        port (
+            clk      : in  std_logic;
+            rst      : in  std_logic;
+            push     : in  std_logic;
+            data     : in  std_logic_vector(WIDTH - 1 downto 0);
+            pop      : in  std_logic;
+            flush    : in  std_logic;
+            q        : out std_logic_vector(WIDTH - 1 downto 0);
+            q_valid  : out std_logic;
+            level    : out unsigned(FIFO_BITS downto 0);
+            full     : out std_logic
+        );
+    end component frame_fifo;
+
+    component fade_ramp is
+        port (
+            clk     : in  std_logic;
+            rst     : in  std_logic;
+            start   : in  std_logic;
+            from    : in  unsigned(17 downto 0);
+            target  : in  unsigned(17 downto 0);
+            steps   : in  unsigned(15 downto 0);
+            tick    : in  std_logic;
+            duty    : out unsigned(17 downto 0);
+            busy    : out std_logic;
+            done    : out std_logic
+        );
+    end component fade_ramp;
+
+    component gamma_lut is
+        generic (
+            LUT_BITS : natural := 8
+        );
+        port (
+            clk      : in  std_logic;
+            a_addr   : in  unsigned(LUT_BITS - 1 downto 0);
+            a_we     : in  std_logic;
+            a_wdata  : in  std_logic_vector(17 downto 0);
+            a_q      : out std_logic_vector(17 downto 0);
+            b_addr   : in  unsigned(LUT_BITS - 1 downto 0);
+            b_q      : out std_logic_vector(17 downto 0)
+        );
+    end component gamma_lut;
+
     component pwm_rgb is
         port (
             clk       : in  std_logic;
@@ -51,37 +369,207 @@ architecture rtl of pwm_rgb_avalon is
             period    : in  unsigned(10 downto 0);
             pwm_r     : out std_logic;
             pwm_g     : out std_logic;
-            pwm_b     : out std_logic
+            pwm_b     : out std_logic;
+            period_end : out std_logic
         );
     end component pwm_rgb;
 
+    component adc_direct is
+        generic (
+            ADC_BASE : natural := 0
+        );
+        port (
+            clk             : in  std_logic;
+            rst             : in  std_logic;
+            enable          : in  std_logic;
+            gain_r          : in  unsigned(17 downto 0);
+            gain_g          : in  unsigned(17 downto 0);
+            gain_b          : in  unsigned(17 downto 0);
+            avm_address     : out std_logic_vector(31 downto 0);
+            avm_read        : out std_logic;
+            avm_readdata    : in  std_logic_vector(31 downto 0);
+            avm_waitrequest : in  std_logic;
+            duty_r          : out unsigned(17 downto 0);
+            duty_g          : out unsigned(17 downto 0);
+            duty_b          : out unsigned(17 downto 0)
+        );
+    end component adc_direct;
+
 begin
 
+    adc_direct_inst : adc_direct
+        port map (
+            clk             => clk,
+            rst             => rst,
+            enable          => reg_mode,
+            gain_r          => unsigned(reg_gain_r),
+            gain_g          => unsigned(reg_gain_g),
+            gain_b          => unsigned(reg_gain_b),
+            avm_address     => avm_adc_address,
+            avm_read        => avm_adc_read,
+            avm_readdata    => avm_adc_readdata,
+            avm_waitrequest => avm_adc_waitrequest,
+            duty_r          => direct_r,
+            duty_g          => direct_g,
+            duty_b          => direct_b
+        );
+
+    -- Table Data writes go to the table Table Address points at
+    lut_we_r <= '1' when avs_lut_write = '1' and avs_lut_address = "110"
+                and lut_addr(LUT_BITS + 1 downto LUT_BITS) = "00" else '0';
+    lut_we_g <= '1' when avs_lut_write = '1' and avs_lut_address = "110"
+                and lut_addr(LUT_BITS + 1 downto LUT_BITS) = "01" else '0';
+    lut_we_b <= '1' when avs_lut_write = '1' and avs_lut_address = "110"
+                and lut_addr(LUT_BITS + 1 downto LUT_BITS) = "10" else '0';
+
+    lut_r : gamma_lut
+        generic map (LUT_BITS => LUT_BITS)
+        port map (
+            clk     => clk,
+            a_addr  => lut_addr(LUT_BITS - 1 downto 0),
+            a_we    => lut_we_r,
+            a_wdata => avs_lut_writedata(17 downto 0),
+            a_q     => lut_q_r,
+            b_addr  => lk_index_r,
+            b_q     => lk_q_r
+        );
+
+    lut_g : gamma_lut
+        generic map (LUT_BITS => LUT_BITS)
+        port map (
+            clk     => clk,
+            a_addr  => lut_addr(LUT_BITS - 1 downto 0),
+            a_we    => lut_we_g,
+            a_wdata => avs_lut_writedata(17 downto 0),
+            a_q     => lut_q_g,
+            b_addr  => lk_index_g,
+            b_q     => lk_q_g
+        );
+
+    lut_b : gamma_lut
+        generic map (LUT_BITS => LUT_BITS)
+        port map (
+            clk     => clk,
+            a_addr  => lut_addr(LUT_BITS - 1 downto 0),
+            a_we    => lut_we_b,
+            a_wdata => avs_lut_writedata(17 downto 0),
+            a_q     => lut_q_b,
+            b_addr  => lk_index_b,
+            b_q     => lk_q_b
+        );
+
+    -- a Frame Hold write pushes the staged frame
+    fifo_push  <= '1' when avs_fifo_write = '1' and avs_fifo_address = "011" else '0';
+    fifo_data  <= reg_frame_r & reg_frame_g & reg_frame_b & avs_fifo_writedata(15 downto 0);
+    fifo_flush <= '1' when avs_fifo_write = '1' and avs_fifo_address = "100"
+                  and avs_fifo_writedata(1) = '1' else '0';
+
+    -- next frame at the first period boundary after the hold runs out
+    fifo_pop   <= '1' when period_end = '1' and reg_run = '1' and fifo_valid = '1'
+                  and (playing = '0' or hold_left <= 1) else '0';
+
+    fifo_low   <= '1' when fifo_level <= reg_watermark else '0';
+    irq        <= fifo_low and reg_irq_en;
+
+    frame_fifo_inst : frame_fifo
+        generic map (
+            FIFO_BITS => FIFO_BITS,
+            WIDTH     => FRAME_BITS
+        )
+        port map (
+            clk      => clk,
+            rst      => rst,
+            push     => fifo_push,
+            data     => fifo_data,
+            pop      => fifo_pop,
+            flush    => fifo_flush,
+            q        => fifo_q,
+            q_valid  => fifo_valid,
+            level    => fifo_level,
+            full     => fifo_full
+        );
+
+    -- each fade starts from what the channel shows now, so a fade started
+    -- during another one carries on from where it got to
+    fade_r_inst : fade_ramp
+        port map (
+            clk     => clk,
+            rst     => rst,
+            start   => fade_start(0),
+            from    => sw_duty_r,
+            target  => unsigned(reg_target_r),
+            steps   => unsigned(reg_steps_r),
+            tick    => period_end,
+            duty    => fade_r,
+            busy    => fade_busy(0),
+            done    => fade_done(0)
+        );
+
+    fade_g_inst : fade_ramp
+        port map (
+            clk     => clk,
+            rst     => rst,
+            start   => fade_start(1),
+            from    => sw_duty_g,
+            target  => unsigned(reg_target_g),
+            steps   => unsigned(reg_steps_g),
+            tick    => period_end,
+            duty    => fade_g,
+            busy    => fade_busy(1),
+            done    => fade_done(1)
+        );
+
+    fade_b_inst : fade_ramp
+        port map (
+            clk     => clk,
+            rst     => rst,
+            start   => fade_start(2),
+            from    => sw_duty_b,
+            target  => unsigned(reg_target_b),
+            steps   => unsigned(reg_steps_b),
+            tick    => period_end,
+            duty    => fade_b,
+            busy    => fade_busy(2),
+            done    => fade_done(2)
+        );
+
+    -- done covers the clock in which duty_* takes over the final value
+    sw_duty_r <= fade_r when (fade_busy(0) or fade_done(0)) = '1' else unsigned(duty_r);
+    sw_duty_g <= fade_g when (fade_busy(1) or fade_done(1)) = '1' else unsigned(duty_g);
+    sw_duty_b <= fade_b when (fade_busy(2) or fade_done(2)) = '1' else unsigned(duty_b);
+
+    pwm_duty_r <= direct_r when reg_mode = '1' else sw_duty_r;
+    pwm_duty_g <= direct_g when reg_mode = '1' else sw_duty_g;
+    pwm_duty_b <= direct_b when reg_mode = '1' else sw_duty_b;
+
     pwm_rgb_inst : pwm_rgb
         port map (
             clk     => clk,
             rst     => rst,
-            duty_r  => unsigned(reg_duty_r),
-            duty_g  => unsigned(reg_duty_g),
-            duty_b  => unsigned(reg_duty_b),
+            duty_r  => pwm_duty_r,
+            duty_g  => pwm_duty_g,
+            duty_b  => pwm_duty_b,
             period  => unsigned(reg_period),
             pwm_r   => pwm_r,
             pwm_g   => pwm_g,
-            pwm_b   => pwm_b
+            pwm_b   => pwm_b,
+            period_end => period_end
         );
     
     avalon_register_read : process(clk)
     begin
         if rising_edge(clk) and avs_read = '1' then
                 case avs_address is
-                    when "00" =>
+                    when "000" =>
                         avs_readdata <= (31 downto 18 => '0') & reg_duty_r;
-                    when "01" =>
+                    when "001" =>
                         avs_readdata <= (31 downto 18 => '0') & reg_duty_g;
-                    when "10" =>
+                    when "010" =>
                         avs_readdata <= (31 downto 18 => '0') & reg_duty_b;
-                    when "11" =>
+                    when "011" =>
                         avs_readdata <= (31 downto 11 => '0') & reg_period;
+                    when "100" =>
+                        avs_readdata <= (0 => commit_pending, others => '0');
                     when others =>
                         avs_readdata <= (others => '0');
                 end case;
@@ -89,6 +577,10 @@ begin
         end if;
     end process avalon_register_read;
 
+    -- The latch is evaluated before the register write so that a commit
+    -- written in the same cycle as a period boundary stays pending for the
+    -- next boundary rather than being dropped. Gamma lookups land before
+    -- the bus write too, so a duty written directly in the same clock wins.
     avalon_register_write : process(clk, rst)
     begin
         if rst = '1' then
@@ -96,19 +588,363 @@ begin
             reg_duty_g <= (others => '0');
             reg_duty_b <= (others => '0');
             reg_period <= (others => '0');
-        elsif rising_edge(clk) and avs_write = '1' then
-            case avs_address is
+            duty_r <= (others => '0');
+            duty_g <= (others => '0');
+            duty_b <= (others => '0');
+            commit_pending <= '0';
+        elsif rising_edge(clk) then
+            if commit_pending = '1' and period_end = '1' then
+                duty_r <= reg_duty_r;
+                duty_g <= reg_duty_g;
+                duty_b <= reg_duty_b;
+                commit_pending <= '0';
+            end if;
+
+            if lk_mask2(0) = '1' then
+                reg_duty_r <= lk_q_r;
+            end if;
+            if lk_mask2(1) = '1' then
+                reg_duty_g <= lk_q_g;
+            end if;
+            if lk_mask2(2) = '1' then
+                reg_duty_b <= lk_q_b;
+            end if;
+            if lk_commit2 = '1' then
+                commit_pending <= '1';
+            end if;
+
+            -- fades: the shadow heads for the target at the start, the
+            -- committed duty takes the final value at the end
+            if fade_start(0) = '1' then
+                reg_duty_r <= reg_target_r;
+            end if;
+            if fade_start(1) = '1' then
+                reg_duty_g <= reg_target_g;
+            end if;
+            if fade_start(2) = '1' then
+                reg_duty_b <= reg_target_b;
+            end if;
+            if fade_done(0) = '1' then
+                duty_r <= std_logic_vector(fade_r);
+            end if;
+            if fade_done(1) = '1' then
+                duty_g <= std_logic_vector(fade_g);
+            end if;
+            if fade_done(2) = '1' then
+                duty_b <= std_logic_vector(fade_b);
+            end if;
+
+            -- frames: on a period boundary, like a commit
+            if fifo_pop = '1' then
+                duty_r <= fifo_q(69 downto 52);
+                duty_g <= fifo_q(51 downto 34);
+                duty_b <= fifo_q(33 downto 16);
+                reg_duty_r <= fifo_q(69 downto 52);
+                reg_duty_g <= fifo_q(51 downto 34);
+                reg_duty_b <= fifo_q(33 downto 16);
+            end if;
+
+            if avs_write = '1' then
+                case avs_address is
+                    when "000" =>
+                        reg_duty_r <= avs_writedata(17 downto 0);
+                    when "001" =>
+                        reg_duty_g <= avs_writedata(17 downto 0);
+                    when "010" =>
+                        reg_duty_b <= avs_writedata(17 downto 0);
+                    when "011" =>
+                        reg_period <= avs_writedata(10 downto 0);
+                    when "100" =>
+                        if avs_writedata(0) = '1' then
+                            commit_pending <= '1';
+                        end if;
+                    when others =>
+                        null;
+                end case;
+            end if;
+        end if;
+    end process avalon_register_write;
+
+    direct_register_read : process(clk)
+    begin
+        if rising_edge(clk) and avs_direct_read = '1' then
+            case avs_direct_address is
                 when "00" =>
-                    reg_duty_r <= avs_writedata(17 downto 0);
+                    avs_direct_readdata <= (0 => reg_mode, others => '0');
                 when "01" =>
-                    reg_duty_g <= avs_writedata(17 downto 0);
+                    avs_direct_readdata <= (31 downto 18 => '0') & reg_gain_r;
                 when "10" =>
-                    reg_duty_b <= avs_writedata(17 downto 0);
+                    avs_direct_readdata <= (31 downto 18 => '0') & reg_gain_g;
                 when "11" =>
-                    reg_period <= avs_writedata(10 downto 0);
+                    avs_direct_readdata <= (31 downto 18 => '0') & reg_gain_b;
+                when others =>
+                    avs_direct_readdata <= (others => '0');
+            end case;
+        end if;
+    end process direct_register_read;
+
+    direct_register_write : process(clk, rst)
+    begin
+        if rst = '1' then
+            reg_mode <= '0';
+            reg_gain_r <= GAIN_ONE;
+            reg_gain_g <= GAIN_ONE;
+            reg_gain_b <= GAIN_ONE;
+        elsif rising_edge(clk) and avs_direct_write = '1' then
+            case avs_direct_address is
+                when "00" =>
+                    reg_mode <= avs_direct_writedata(0);
+                when "01" =>
+                    reg_gain_r <= avs_direct_writedata(17 downto 0);
+                when "10" =>
+                    reg_gain_g <= avs_direct_writedata(17 downto 0);
+                when "11" =>
+                    reg_gain_b <= avs_direct_writedata(17 downto 0);
                 when others =>
                     null;
             end case;
         end if;
-    end process avalon_register_write;
+    end process direct_register_write;
+
+    lut_register_read : process(clk)
+    begin
+        if rising_edge(clk) and avs_lut_read = '1' then
+            lut_rd_table <= '0';
+            case avs_lut_address is
+                when "000" =>
+                    lut_rd_data <= (31 downto LUT_BITS => '0') & std_logic_vector(lk_index_r);
+                when "001" =>
+                    lut_rd_data <= (31 downto LUT_BITS => '0') & std_logic_vector(lk_index_g);
+                when "010" =>
+                    lut_rd_data <= (31 downto LUT_BITS => '0') & std_logic_vector(lk_index_b);
+                when "100" =>
+                    lut_rd_data <= (0 => commit_pending, others => '0');
+                when "101" =>
+                    lut_rd_data <= (31 downto LUT_BITS + 2 => '0') & std_logic_vector(lut_addr);
+                when "110" =>
+                    -- the tables' port A output already holds this entry
+                    lut_rd_table <= '1';
+                    lut_rd_ch <= lut_addr(LUT_BITS + 1 downto LUT_BITS);
+                when "111" =>
+                    lut_rd_data <= std_logic_vector(to_unsigned(LUT_BITS, 32));
+                when others =>
+                    lut_rd_data <= (others => '0');
+            end case;
+        end if;
+    end process lut_register_read;
+
+    avs_lut_readdata <= lut_rd_data when lut_rd_table = '0' else
+                        (31 downto 18 => '0') & lut_q_r when lut_rd_ch = "00" else
+                        (31 downto 18 => '0') & lut_q_g when lut_rd_ch = "01" else
+                        (31 downto 18 => '0') & lut_q_b when lut_rd_ch = "10" else
+                        (others => '0');
+
+    -- Lookups enter the pipeline here; avalon_register_write takes them out
+    -- two clocks later. Table Data accesses step Table Address.
+    lut_register_write : process(clk, rst)
+    begin
+        if rst = '1' then
+            lut_addr <= (others => '0');
+            lk_index_r <= (others => '0');
+            lk_index_g <= (others => '0');
+            lk_index_b <= (others => '0');
+            lk_mask1 <= (others => '0');
+            lk_mask2 <= (others => '0');
+            lk_commit1 <= '0';
+            lk_commit2 <= '0';
+        elsif rising_edge(clk) then
+            lk_mask2 <= lk_mask1;
+            lk_commit2 <= lk_commit1;
+            lk_mask1 <= (others => '0');
+            lk_commit1 <= '0';
+
+            if avs_lut_read = '1' and avs_lut_address = "110" then
+                lut_addr <= lut_addr + 1;
+            end if;
+
+            if avs_lut_write = '1' then
+                case avs_lut_address is
+                    when "000" =>
+                        lk_index_r <= unsigned(avs_lut_writedata(LUT_BITS - 1 downto 0));
+                        lk_mask1 <= "001";
+                    when "001" =>
+                        lk_index_g <= unsigned(avs_lut_writedata(LUT_BITS - 1 downto 0));
+                        lk_mask1 <= "010";
+                    when "010" =>
+                        lk_index_b <= unsigned(avs_lut_writedata(LUT_BITS - 1 downto 0));
+                        lk_mask1 <= "100";
+                    when "011" =>
+                        lk_index_r <= expand8(avs_lut_writedata(7 downto 0));
+                        lk_index_g <= expand8(avs_lut_writedata(15 downto 8));
+                        lk_index_b <= expand8(avs_lut_writedata(23 downto 16));
+                        lk_mask1 <= "111";
+                        lk_commit1 <= '1';
+                    when "100" =>
+                        lk_commit1 <= avs_lut_writedata(0);
+                    when "101" =>
+                        lut_addr <= unsigned(avs_lut_writedata(LUT_BITS + 1 downto 0));
+                    when "110" =>
+                        lut_addr <= lut_addr + 1;
+                    when others =>
+                        null;
+                end case;
+            end if;
+        end if;
+    end process lut_register_write;
+
+    fade_register_read : process(clk)
+    begin
+        if rising_edge(clk) and avs_fade_read = '1' then
+            case avs_fade_address is
+                when "000" =>
+                    avs_fade_readdata <= (31 downto 18 => '0') & reg_target_r;
+                when "001" =>
+                    avs_fade_readdata <= (31 downto 18 => '0') & reg_target_g;
+                when "010" =>
+                    avs_fade_readdata <= (31 downto 18 => '0') & reg_target_b;
+                when "011" =>
+                    avs_fade_readdata <= (31 downto 16 => '0') & reg_steps_r;
+                when "100" =>
+                    avs_fade_readdata <= (31 downto 16 => '0') & reg_steps_g;
+                when "101" =>
+                    avs_fade_readdata <= (31 downto 16 => '0') & reg_steps_b;
+                when "110" =>
+                    -- a start written in the previous clock counts as busy
+                    avs_fade_readdata <= (others => '0');
+                    avs_fade_readdata(2 downto 0) <= fade_busy or fade_start;
+                    if (fade_busy or fade_start) = "000" then
+                        avs_fade_readdata(8) <= '1';
+                    end if;
+                when others =>
+                    avs_fade_readdata <= (others => '0');
+            end case;
+        end if;
+    end process fade_register_read;
+
+    fade_register_write : process(clk, rst)
+    begin
+        if rst = '1' then
+            reg_target_r <= (others => '0');
+            reg_target_g <= (others => '0');
+            reg_target_b <= (others => '0');
+            reg_steps_r <= (others => '0');
+            reg_steps_g <= (others => '0');
+            reg_steps_b <= (others => '0');
+            fade_start <= (others => '0');
+        elsif rising_edge(clk) then
+            fade_start <= (others => '0');
+
+            if avs_fade_write = '1' then
+                case avs_fade_address is
+                    when "000" =>
+                        reg_target_r <= avs_fade_writedata(17 downto 0);
+                    when "001" =>
+                        reg_target_g <= avs_fade_writedata(17 downto 0);
+                    when "010" =>
+                        reg_target_b <= avs_fade_writedata(17 downto 0);
+                    when "011" =>
+                        reg_steps_r <= avs_fade_writedata(15 downto 0);
+                    when "100" =>
+                        reg_steps_g <= avs_fade_writedata(15 downto 0);
+                    when "101" =>
+                        reg_steps_b <= avs_fade_writedata(15 downto 0);
+                    when "110" =>
+                        fade_start <= avs_fade_writedata(2 downto 0);
+                    when others =>
+                        null;
+                end case;
+            end if;
+        end if;
+    end process fade_register_write;
+
+    fifo_register_read : process(clk)
+    begin
+        if rising_edge(clk) and avs_fifo_read = '1' then
+            case avs_fifo_address is
+                when "000" =>
+                    avs_fifo_readdata <= (31 downto 18 => '0') & reg_frame_r;
+                when "001" =>
+                    avs_fifo_readdata <= (31 downto 18 => '0') & reg_frame_g;
+                when "010" =>
+                    avs_fifo_readdata <= (31 downto 18 => '0') & reg_frame_b;
+                when "011" =>
+                    avs_fifo_readdata <= (31 downto 16 => '0') & std_logic_vector(hold_left);
+                when "100" =>
+                    avs_fifo_readdata <= (0 => reg_run, 2 => reg_irq_en, others => '0');
+                when "101" =>
+                    avs_fifo_readdata <= std_logic_vector(resize(fifo_level, 32));
+                when "110" =>
+                    avs_fifo_readdata <= std_logic_vector(resize(reg_watermark, 32));
+                when others =>
+                    avs_fifo_readdata <= std_logic_vector(to_unsigned(FIFO_DEPTH, 16)) &
+                                         (15 downto 4 => '0') &
+                                         playing & overflow & underrun & fifo_low;
+            end case;
+        end if;
+    end process fifo_register_read;
+
+    -- Staging registers, control and playback state. The duties themselves
+    -- change in avalon_register_write, on fifo_pop.
+    fifo_register_write : process(clk, rst)
+    begin
+        if rst = '1' then
+            reg_frame_r <= (others => '0');
+            reg_frame_g <= (others => '0');
+            reg_frame_b <= (others => '0');
+            reg_run <= '1';
+            reg_irq_en <= '0';
+            reg_watermark <= to_unsigned(FIFO_DEPTH / 2, FIFO_BITS + 1);
+            hold_left <= (others => '0');
+            playing <= '0';
+            underrun <= '0';
+            overflow <= '0';
+        elsif rising_edge(clk) then
+            if fifo_pop = '1' then
+                playing <= '1';
+                if unsigned(fifo_q(15 downto 0)) = 0 then
+                    hold_left <= to_unsigned(1, 16);
+                else
+                    hold_left <= unsigned(fifo_q(15 downto 0));
+                end if;
+            elsif period_end = '1' and playing = '1' then
+                if hold_left > 1 then
+                    hold_left <= hold_left - 1;
+                elsif fifo_level = 0 then
+                    -- ran dry: the last frame stays on
+                    hold_left <= (others => '0');
+                    playing <= '0';
+                    underrun <= '1';
+                end if;
+            end if;
+
+            if fifo_push = '1' and fifo_full = '1' then
+                overflow <= '1';
+            end if;
+
+            if avs_fifo_write = '1' then
+                case avs_fifo_address is
+                    when "000" =>
+                        reg_frame_r <= avs_fifo_writedata(17 downto 0);
+                    when "001" =>
+                        reg_frame_g <= avs_fifo_writedata(17 downto 0);
+                    when "010" =>
+                        reg_frame_b <= avs_fifo_writedata(17 downto 0);
+                    when "100" =>
+                        reg_run <= avs_fifo_writedata(0);
+                        reg_irq_en <= avs_fifo_writedata(2);
+                    when "110" =>
+                        reg_watermark <= unsigned(avs_fifo_writedata(FIFO_BITS downto 0));
+                    when "111" =>
+                        if avs_fifo_writedata(1) = '1' then
+                            underrun <= '0';
+                        end if;
+                        if avs_fifo_writedata(2) = '1' then
+                            overflow <= '0';
+                        end if;
+                    when others =>
+                        null;
+                end case;
+            end if;
+        end if;
+    end process fifo_register_write;
 end architecture rtl;
\ No newline at end of file
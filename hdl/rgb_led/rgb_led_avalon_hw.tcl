@@ -39,6 +39,10 @@ add_fileset QUARTUS_SYNTH QUARTUS_SYNTH "" ""
 set_fileset_property QUARTUS_SYNTH TOP_LEVEL pwm_rgb_avalon
 set_fileset_property QUARTUS_SYNTH ENABLE_RELATIVE_INCLUDE_PATHS false
 set_fileset_property QUARTUS_SYNTH ENABLE_FILE_OVERWRITE_MODE false
+add_fileset_file adc_direct.vhd VHDL PATH adc_direct.vhd
+add_fileset_file fade_ramp.vhd VHDL PATH fade_ramp.vhd
+add_fileset_file frame_fifo.vhd VHDL PATH frame_fifo.vhd
+add_fileset_file gamma_lut.vhd VHDL PATH gamma_lut.vhd
 add_fileset_file pwm_controller.vhd VHDL PATH pwm_controller.vhd
 add_fileset_file pwm_rgb.vhd VHDL PATH pwm_rgb.vhd
 add_fileset_file pwm_rgb_avalon.vhd VHDL PATH pwm_rgb_avalon.vhd TOP_LEVEL_FILE
@@ -47,6 +51,20 @@ add_fileset_file pwm_rgb_avalon.vhd VHDL PATH pwm_rgb_avalon.vhd TOP_LEVEL_FILE
 # 
 # parameters
 # 
+add_parameter LUT_BITS NATURAL 8
+set_parameter_property LUT_BITS DEFAULT_VALUE 8
+set_parameter_property LUT_BITS DISPLAY_NAME LUT_BITS
+set_parameter_property LUT_BITS TYPE NATURAL
+set_parameter_property LUT_BITS UNITS None
+set_parameter_property LUT_BITS ALLOWED_RANGES 8:12
+set_parameter_property LUT_BITS HDL_PARAMETER true
+add_parameter FIFO_BITS NATURAL 9
+set_parameter_property FIFO_BITS DEFAULT_VALUE 9
+set_parameter_property FIFO_BITS DISPLAY_NAME FIFO_BITS
+set_parameter_property FIFO_BITS TYPE NATURAL
+set_parameter_property FIFO_BITS UNITS None
+set_parameter_property FIFO_BITS ALLOWED_RANGES 4:12
+set_parameter_property FIFO_BITS HDL_PARAMETER true
 
 
 # 
@@ -82,7 +100,7 @@ set_interface_property avalon_slave_0 SVD_ADDRESS_GROUP ""
 
 add_interface_port avalon_slave_0 avs_read read Input 1
 add_interface_port avalon_slave_0 avs_write write Input 1
-add_interface_port avalon_slave_0 avs_address address Input 2
+add_interface_port avalon_slave_0 avs_address address Input 3
 add_interface_port avalon_slave_0 avs_writedata writedata Input 32
 add_interface_port avalon_slave_0 avs_readdata readdata Output 32
 set_interface_assignment avalon_slave_0 embeddedsw.configuration.isFlash 0
@@ -91,6 +109,205 @@ set_interface_assignment avalon_slave_0 embeddedsw.configuration.isNonVolatileSt
 set_interface_assignment avalon_slave_0 embeddedsw.configuration.isPrintableDevice 0
 
 
+# 
+# connection point direct_slave
+# 
+add_interface direct_slave avalon end
+set_interface_property direct_slave addressUnits WORDS
+set_interface_property direct_slave associatedClock clock
+set_interface_property direct_slave associatedReset reset
+set_interface_property direct_slave bitsPerSymbol 8
+set_interface_property direct_slave burstOnBurstBoundariesOnly false
+set_interface_property direct_slave burstcountUnits WORDS
+set_interface_property direct_slave explicitAddressSpan 0
+set_interface_property direct_slave holdTime 0
+set_interface_property direct_slave linewrapBursts false
+set_interface_property direct_slave maximumPendingReadTransactions 0
+set_interface_property direct_slave maximumPendingWriteTransactions 0
+set_interface_property direct_slave readLatency 0
+set_interface_property direct_slave readWaitTime 1
+set_interface_property direct_slave setupTime 0
+set_interface_property direct_slave timingUnits Cycles
+set_interface_property direct_slave writeWaitTime 0
+set_interface_property direct_slave ENABLED true
+set_interface_property direct_slave EXPORT_OF ""
+set_interface_property direct_slave PORT_NAME_MAP ""
+set_interface_property direct_slave CMSIS_SVD_VARIABLES ""
+set_interface_property direct_slave SVD_ADDRESS_GROUP ""
+
+add_interface_port direct_slave avs_direct_read read Input 1
+add_interface_port direct_slave avs_direct_write write Input 1
+add_interface_port direct_slave avs_direct_address address Input 2
+add_interface_port direct_slave avs_direct_writedata writedata Input 32
+add_interface_port direct_slave avs_direct_readdata readdata Output 32
+set_interface_assignment direct_slave embeddedsw.configuration.isFlash 0
+set_interface_assignment direct_slave embeddedsw.configuration.isMemoryDevice 0
+set_interface_assignment direct_slave embeddedsw.configuration.isNonVolatileStorage 0
+set_interface_assignment direct_slave embeddedsw.configuration.isPrintableDevice 0
+
+
+# 
+# connection point lut_slave
+# 
+add_interface lut_slave avalon end
+set_interface_property lut_slave addressUnits WORDS
+set_interface_property lut_slave associatedClock clock
+set_interface_property lut_slave associatedReset reset
+set_interface_property lut_slave bitsPerSymbol 8
+set_interface_property lut_slave burstOnBurstBoundariesOnly false
+set_interface_property lut_slave burstcountUnits WORDS
+set_interface_property lut_slave explicitAddressSpan 0
+set_interface_property lut_slave holdTime 0
+set_interface_property lut_slave linewrapBursts false
+set_interface_property lut_slave maximumPendingReadTransactions 0
+set_interface_property lut_slave maximumPendingWriteTransactions 0
+set_interface_property lut_slave readLatency 1
+set_interface_property lut_slave readWaitTime 0
+set_interface_property lut_slave setupTime 0
+set_interface_property lut_slave timingUnits Cycles
+set_interface_property lut_slave writeWaitTime 0
+set_interface_property lut_slave ENABLED true
+set_interface_property lut_slave EXPORT_OF ""
+set_interface_property lut_slave PORT_NAME_MAP ""
+set_interface_property lut_slave CMSIS_SVD_VARIABLES ""
+set_interface_property lut_slave SVD_ADDRESS_GROUP ""
+
+add_interface_port lut_slave avs_lut_read read Input 1
+add_interface_port lut_slave avs_lut_write write Input 1
+add_interface_port lut_slave avs_lut_address address Input 3
+add_interface_port lut_slave avs_lut_writedata writedata Input 32
+add_interface_port lut_slave avs_lut_readdata readdata Output 32
+set_interface_assignment lut_slave embeddedsw.configuration.isFlash 0
+set_interface_assignment lut_slave embeddedsw.configuration.isMemoryDevice 0
+set_interface_assignment lut_slave embeddedsw.configuration.isNonVolatileStorage 0
+set_interface_assignment lut_slave embeddedsw.configuration.isPrintableDevice 0
+
+
+# 
+# connection point fade_slave
+# 
+add_interface fade_slave avalon end
+set_interface_property fade_slave addressUnits WORDS
+set_interface_property fade_slave associatedClock clock
+set_interface_property fade_slave associatedReset reset
+set_interface_property fade_slave bitsPerSymbol 8
+set_interface_property fade_slave burstOnBurstBoundariesOnly false
+set_interface_property fade_slave burstcountUnits WORDS
+set_interface_property fade_slave explicitAddressSpan 0
+set_interface_property fade_slave holdTime 0
+set_interface_property fade_slave linewrapBursts false
+set_interface_property fade_slave maximumPendingReadTransactions 0
+set_interface_property fade_slave maximumPendingWriteTransactions 0
+set_interface_property fade_slave readLatency 0
+set_interface_property fade_slave readWaitTime 1
+set_interface_property fade_slave setupTime 0
+set_interface_property fade_slave timingUnits Cycles
+set_interface_property fade_slave writeWaitTime 0
+set_interface_property fade_slave ENABLED true
+set_interface_property fade_slave EXPORT_OF ""
+set_interface_property fade_slave PORT_NAME_MAP ""
+set_interface_property fade_slave CMSIS_SVD_VARIABLES ""
+set_interface_property fade_slave SVD_ADDRESS_GROUP ""
+
+add_interface_port fade_slave avs_fade_read read Input 1
+add_interface_port fade_slave avs_fade_write write Input 1
+add_interface_port fade_slave avs_fade_address address Input 3
+add_interface_port fade_slave avs_fade_writedata writedata Input 32
+add_interface_port fade_slave avs_fade_readdata readdata Output 32
+set_interface_assignment fade_slave embeddedsw.configuration.isFlash 0
+set_interface_assignment fade_slave embeddedsw.configuration.isMemoryDevice 0
+set_interface_assignment fade_slave embeddedsw.configuration.isNonVolatileStorage 0
+set_interface_assignment fade_slave embeddedsw.configuration.isPrintableDevice 0
+
+
+# 
+# connection point fifo_slave
+# 
+add_interface fifo_slave avalon end
+set_interface_property fifo_slave addressUnits WORDS
+set_interface_property fifo_slave associatedClock clock
+set_interface_property fifo_slave associatedReset reset
+set_interface_property fifo_slave bitsPerSymbol 8
+set_interface_property fifo_slave burstOnBurstBoundariesOnly false
+set_interface_property fifo_slave burstcountUnits WORDS
+set_interface_property fifo_slave explicitAddressSpan 0
+set_interface_property fifo_slave holdTime 0
+set_interface_property fifo_slave linewrapBursts false
+set_interface_property fifo_slave maximumPendingReadTransactions 0
+set_interface_property fifo_slave maximumPendingWriteTransactions 0
+set_interface_property fifo_slave readLatency 0
+set_interface_property fifo_slave readWaitTime 1
+set_interface_property fifo_slave setupTime 0
+set_interface_property fifo_slave timingUnits Cycles
+set_interface_property fifo_slave writeWaitTime 0
+set_interface_property fifo_slave ENABLED true
+set_interface_property fifo_slave EXPORT_OF ""
+set_interface_property fifo_slave PORT_NAME_MAP ""
+set_interface_property fifo_slave CMSIS_SVD_VARIABLES ""
+set_interface_property fifo_slave SVD_ADDRESS_GROUP ""
+
+add_interface_port fifo_slave avs_fifo_read read Input 1
+add_interface_port fifo_slave avs_fifo_write write Input 1
+add_interface_port fifo_slave avs_fifo_address address Input 3
+add_interface_port fifo_slave avs_fifo_writedata writedata Input 32
+add_interface_port fifo_slave avs_fifo_readdata readdata Output 32
+set_interface_assignment fifo_slave embeddedsw.configuration.isFlash 0
+set_interface_assignment fifo_slave embeddedsw.configuration.isMemoryDevice 0
+set_interface_assignment fifo_slave embeddedsw.configuration.isNonVolatileStorage 0
+set_interface_assignment fifo_slave embeddedsw.configuration.isPrintableDevice 0
+
+
+# 
+# connection point fifo_irq
+# 
+add_interface fifo_irq interrupt end
+set_interface_property fifo_irq associatedAddressablePoint fifo_slave
+set_interface_property fifo_irq associatedClock clock
+set_interface_property fifo_irq associatedReset reset
+set_interface_property fifo_irq bridgedReceiverOffset ""
+set_interface_property fifo_irq bridgesToReceiver ""
+set_interface_property fifo_irq ENABLED true
+set_interface_property fifo_irq EXPORT_OF ""
+set_interface_property fifo_irq PORT_NAME_MAP ""
+set_interface_property fifo_irq CMSIS_SVD_VARIABLES ""
+set_interface_property fifo_irq SVD_ADDRESS_GROUP ""
+
+add_interface_port fifo_irq irq irq Output 1
+
+
+# 
+# connection point adc_master
+# 
+add_interface adc_master avalon start
+set_interface_property adc_master addressUnits SYMBOLS
+set_interface_property adc_master associatedClock clock
+set_interface_property adc_master associatedReset reset
+set_interface_property adc_master bitsPerSymbol 8
+set_interface_property adc_master burstOnBurstBoundariesOnly false
+set_interface_property adc_master burstcountUnits WORDS
+set_interface_property adc_master doStreamReads false
+set_interface_property adc_master doStreamWrites false
+set_interface_property adc_master holdTime 0
+set_interface_property adc_master linewrapBursts false
+set_interface_property adc_master maximumPendingReadTransactions 0
+set_interface_property adc_master maximumPendingWriteTransactions 0
+set_interface_property adc_master readLatency 0
+set_interface_property adc_master readWaitTime 1
+set_interface_property adc_master setupTime 0
+set_interface_property adc_master timingUnits Cycles
+set_interface_property adc_master writeWaitTime 0
+set_interface_property adc_master ENABLED true
+set_interface_property adc_master EXPORT_OF ""
+set_interface_property adc_master PORT_NAME_MAP ""
+set_interface_property adc_master CMSIS_SVD_VARIABLES ""
+set_interface_property adc_master SVD_ADDRESS_GROUP ""
+
+add_interface_port adc_master avm_adc_address address Output 32
+add_interface_port adc_master avm_adc_read read Output 1
+add_interface_port adc_master avm_adc_readdata readdata Input 32
+add_interface_port adc_master avm_adc_waitrequest waitrequest Input 1
+
+
 # 
 # connection point pwm_rgb
 # 
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Run each testbench, time it and print simulated clocks per wall-clock
+# second, taken from the "CYCLES n" line each bench reports at the end.
+# Latency lines ("LATENCY ...") are passed through. Called by `make bench`.
+#
+# Usage: bash ./run_bench.sh tb_pwm_controller tb_pwm_rgb ...
+
+GHDL=${GHDL:-ghdl}
+GHDLFLAGS=${GHDLFLAGS:---std=08 --workdir=work}
+RUNFLAGS=${RUNFLAGS:---assert-level=error}
+status=0
+
+for tb in "$@"; do
+    start=$(date +%s.%N)
+    out=$($GHDL -r $GHDLFLAGS "$tb" $RUNFLAGS 2>&1)
+    rc=$?
+    end=$(date +%s.%N)
+
+    cycles=$(echo "$out" | sed -n 's/.*CYCLES \([0-9]*\).*/\1/p' | tail -n 1)
+    echo "$out" | grep -o 'LATENCY.*\|RESULT.*'
+
+    if [ $rc -ne 0 ] || [ -z "$cycles" ]; then
+        echo "$tb: FAILED"
+        echo "$out" | tail -n 20
+        status=1
+        continue
+    fi
+
+    awk -v tb="$tb" -v c="$cycles" -v s="$start" -v e="$end" 'BEGIN {
+        t = e - s
+        printf "%s: %d clocks in %.3f s, %.0f clocks/s\n", tb, c, t, c / t
+    }'
+done
+
+exit $status
@@ -0,0 +1,206 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.tb_pkg.all;
+
+-- adc_filter_avalon testbench
+--   - reset values and register readback, OSR writes above 8 store 8
+--   - filtered values against sum * 16 / 2^osr for several ratios, one
+--     channel alternating between two codes to check the extra resolution
+--   - CONTROL = 0 stops the sweep and the result count
+--   - latency in clocks from an ADC change to the filtered register (OSR 0)
+
+entity tb_adc_filter_avalon is
+end entity tb_adc_filter_avalon;
+
+architecture sim of tb_adc_filter_avalon is
+
+    constant REG_FILT     : natural := 0;       -- 0 to 7
+    constant REG_OSR      : natural := 8;       -- 8 to 15
+    constant REG_CONTROL  : natural := 16;
+    constant REG_SWEEP    : natural := 17;
+    constant REG_COUNT    : natural := 18;
+
+    constant ADC_WAIT     : natural := 4;       -- wait states per ADC read
+    constant SWEEP        : natural := 100;     -- clocks per sweep in the bench
+
+    type adc_values_t is array (0 to 7) of natural;
+
+    signal clk                  : std_logic := '0';
+    signal rst                  : std_logic := '1';
+
+    signal avs_read             : std_logic := '0';
+    signal avs_write            : std_logic := '0';
+    signal avs_address          : std_logic_vector(4 downto 0) := (others => '0');
+    signal avs_writedata        : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_readdata         : std_logic_vector(31 downto 0);
+
+    signal avm_adc_address      : std_logic_vector(31 downto 0);
+    signal avm_adc_read         : std_logic;
+    signal avm_adc_readdata     : std_logic_vector(31 downto 0);
+    signal avm_adc_waitrequest  : std_logic;
+
+    signal adc_values           : adc_values_t := (others => 0);
+    signal adc_wait_count       : natural := 0;
+    -- channel 3 reads adc_values(3) and adc_values(3) + 1 in turn
+    signal ch3_odd              : natural range 0 to 1 := 0;
+
+    signal cycles               : natural := 0;
+    signal done                 : boolean := false;
+
+begin
+
+    clk <= not clk after CLK_PERIOD / 2 when not done;
+
+    cycle_counter : process(clk)
+    begin
+        if rising_edge(clk) then
+            cycles <= cycles + 1;
+        end if;
+    end process cycle_counter;
+
+    dut : entity work.adc_filter_avalon
+        port map (
+            clk                  => clk,
+            rst                  => rst,
+            avs_read             => avs_read,
+            avs_write            => avs_write,
+            avs_address          => avs_address,
+            avs_writedata        => avs_writedata,
+            avs_readdata         => avs_readdata,
+            avm_adc_address      => avm_adc_address,
+            avm_adc_read         => avm_adc_read,
+            avm_adc_readdata     => avm_adc_readdata,
+            avm_adc_waitrequest  => avm_adc_waitrequest
+        );
+
+    -- ADC IP model: channel N at byte address N * 4, ADC_WAIT wait states
+    adc_slave : process(clk)
+    begin
+        if rising_edge(clk) then
+            if avm_adc_read = '1' and adc_wait_count < ADC_WAIT then
+                adc_wait_count <= adc_wait_count + 1;
+            else
+                adc_wait_count <= 0;
+                if avm_adc_read = '1' and avm_adc_address(4 downto 2) = "011" then
+                    ch3_odd <= 1 - ch3_odd;
+                end if;
+            end if;
+        end if;
+    end process adc_slave;
+
+    avm_adc_waitrequest <= '1' when avm_adc_read = '1' and adc_wait_count < ADC_WAIT else '0';
+    avm_adc_readdata <= std_logic_vector(to_unsigned(
+        adc_values(to_integer(unsigned(avm_adc_address(4 downto 2)))) + ch3_odd, 32))
+        when avm_adc_address(4 downto 2) = "011" else
+        std_logic_vector(to_unsigned(
+        adc_values(to_integer(unsigned(avm_adc_address(4 downto 2)))), 32));
+
+    stimulus : process
+
+        variable errors : natural := 0;
+        variable data   : natural;
+        variable count  : natural;
+        variable t0     : natural;
+
+        procedure write_reg (addr : natural; value : natural) is
+        begin
+            avalon_write(clk, avs_write, avs_address, avs_writedata, addr, value);
+        end procedure write_reg;
+
+        procedure read_reg (addr : natural; value : out natural) is
+        begin
+            avalon_read(clk, avs_read, avs_address, avs_readdata, addr, value);
+        end procedure read_reg;
+
+        -- wait for n sweeps
+        procedure settle (n : natural) is
+        begin
+            for i in 1 to n * SWEEP loop
+                wait until rising_edge(clk);
+            end loop;
+        end procedure settle;
+
+    begin
+        wait for 5 * CLK_PERIOD;
+        rst <= '0';
+        wait until rising_edge(clk);
+
+        ------------------------------------------------------------ reset
+        for ch in 0 to 7 loop
+            read_reg(REG_OSR + ch, data);
+            expect("reset osr " & integer'image(ch), data, 4, errors);
+        end loop;
+        read_reg(REG_CONTROL, data); expect("reset control", data, 1, errors);
+        read_reg(REG_SWEEP, data); expect("reset sweep period", data, 2500, errors);
+
+        write_reg(REG_OSR + 7, 9);
+        read_reg(REG_OSR + 7, data); expect("osr clamp", data, 8, errors);
+
+        ------------------------------------------------------------ filter
+        adc_values <= (0 => 4095, 1 => 1000, 2 => 100, 3 => 10, others => 0);
+        write_reg(REG_SWEEP, SWEEP);
+        write_reg(REG_OSR + 0, 0);
+        write_reg(REG_OSR + 1, 2);
+        write_reg(REG_OSR + 2, 4);
+        write_reg(REG_OSR + 3, 1);
+        read_reg(REG_SWEEP, data); expect("sweep period readback", data, SWEEP, errors);
+        read_reg(REG_OSR + 1, data); expect("osr readback", data, 2, errors);
+
+        -- two full windows of the slowest channel (16 sweeps) after the change
+        settle(40);
+        read_reg(REG_FILT + 0, data); expect("ch0 osr 0", data, 4095 * 16, errors);
+        read_reg(REG_FILT + 1, data); expect("ch1 osr 2", data, 1000 * 16, errors);
+        read_reg(REG_FILT + 2, data); expect("ch2 osr 4", data, 100 * 16, errors);
+        -- (10 + 11) * 16 / 2: the half code shows up in the low bits
+        read_reg(REG_FILT + 3, data); expect("ch3 osr 1, 10/11", data, 168, errors);
+        read_reg(REG_FILT + 4, data); expect("ch4 zero", data, 0, errors);
+
+        read_reg(REG_COUNT, count);
+        if count = 0 then
+            report "result count did not advance" severity error;
+            errors := errors + 1;
+        end if;
+
+        ------------------------------------------------------------ latency
+        -- ADC change -> filtered register, OSR 0 on channel 0
+        wait until rising_edge(clk);
+        adc_values(0) <= 0;
+        t0 := cycles;
+        for i in 1 to 4 * SWEEP loop
+            read_reg(REG_FILT + 0, data);
+            exit when data = 0;
+        end loop;
+        expect("ch0 after change", data, 0, errors);
+        report "LATENCY adc->filtered (osr 0): " & integer'image(cycles - t0) & " cycles";
+        if cycles - t0 > SWEEP + 8 * (ADC_WAIT + 1) + 8 then
+            report "filter latency too high" severity error;
+            errors := errors + 1;
+        end if;
+
+        ------------------------------------------------------------ enable
+        write_reg(REG_CONTROL, 0);
+        read_reg(REG_CONTROL, data); expect("control readback", data, 0, errors);
+        -- let a sweep in flight finish
+        settle(1);
+        read_reg(REG_COUNT, count);
+        adc_values(0) <= 4095;
+        settle(20);
+        read_reg(REG_COUNT, data); expect("count while stopped", data, count, errors);
+        read_reg(REG_FILT + 0, data); expect("ch0 holds while stopped", data, 0, errors);
+
+        write_reg(REG_CONTROL, 1);
+        settle(2);
+        read_reg(REG_FILT + 0, data); expect("ch0 after restart", data, 4095 * 16, errors);
+
+        report "CYCLES " & integer'image(cycles);
+        report "RESULT tb_adc_filter_avalon errors=" & integer'image(errors);
+        assert errors = 0 report "tb_adc_filter_avalon FAILED" severity failure;
+
+        done <= true;
+        wait;
+    end process stimulus;
+
+end architecture sim;
@@ -0,0 +1,252 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.tb_pkg.all;
+
+-- ledbus_avalon testbench
+--   - pattern writes reach led_out, bits 31..10 ignored
+--   - readback of the pattern register, sequencer registers idle at 0
+--   - reset clears the LEDs
+--   - per-LED brightness: on time per PWM cycle for each level
+--   - sequencer: each frame lasts exactly its time, one-shot stops on the
+--     last frame, loop starts over, a swap waits for the frame boundary
+--   - latency in clocks from the write to led_out, run to the first frame
+
+entity tb_ledbus_avalon is
+end entity tb_ledbus_avalon;
+
+architecture sim of tb_ledbus_avalon is
+
+    constant REG_PATTERN    : natural := 0;
+    constant REG_CONTROL    : natural := 1;
+    constant REG_LENGTH     : natural := 2;
+    constant REG_WR_ADDR    : natural := 3;
+    constant REG_LEVELS     : natural := 4;
+    constant REG_TIME       : natural := 5;
+    constant REG_STATUS     : natural := 6;
+    constant REG_BRIGHTNESS : natural := 7;
+
+    constant RUN            : natural := 1;
+    constant LOOP_MODE      : natural := 2;
+    constant SWAP           : natural := 4;
+    constant ST_BANK        : natural := 256;
+    constant ST_DONE        : natural := 512;
+    constant ST_PLAYING     : natural := 1024;
+
+    -- short enough to simulate; the DUT defaults are 6 / 50000 / 4096
+    constant FRAME_BITS     : natural := 3;
+    constant CLKS_PER_MS    : natural := 20;
+    constant PWM_DIV        : natural := 2;
+    constant PWM_CYCLE      : natural := 7 * PWM_DIV;
+
+    constant ALL_FULL       : natural := 16#3FFFFFFF#;
+
+    signal clk           : std_logic := '0';
+    signal rst           : std_logic := '1';
+    signal avs_read      : std_logic := '0';
+    signal avs_write     : std_logic := '0';
+    signal avs_address   : std_logic_vector(2 downto 0) := (others => '0');
+    signal avs_writedata : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_readdata  : std_logic_vector(31 downto 0);
+    signal led_out       : std_logic_vector(9 downto 0);
+
+    signal cycles        : natural := 0;
+    signal done          : boolean := false;
+
+begin
+
+    clk <= not clk after CLK_PERIOD / 2 when not done;
+
+    cycle_counter : process(clk)
+    begin
+        if rising_edge(clk) then
+            cycles <= cycles + 1;
+        end if;
+    end process cycle_counter;
+
+    dut : entity work.ledbus_avalon
+        generic map (
+            FRAME_BITS    => FRAME_BITS,
+            CLKS_PER_MS   => CLKS_PER_MS,
+            PWM_DIV       => PWM_DIV
+        )
+        port map (
+            clk           => clk,
+            rst           => rst,
+            avs_read      => avs_read,
+            avs_write     => avs_write,
+            avs_address   => avs_address,
+            avs_writedata => avs_writedata,
+            avs_readdata  => avs_readdata,
+            led_out       => led_out
+        );
+
+    stimulus : process
+
+        variable errors : natural := 0;
+        variable data   : natural;
+        variable t0     : natural;
+        variable t1     : natural;
+        variable high   : natural;
+
+        procedure write_reg (addr : natural; value : natural) is
+        begin
+            avalon_write(clk, avs_write, avs_address, avs_writedata, addr, value);
+        end procedure write_reg;
+
+        procedure read_reg (addr : natural; variable value : out natural) is
+        begin
+            avalon_read(clk, avs_read, avs_address, avs_readdata, addr, value);
+        end procedure read_reg;
+
+        procedure write_frame (levels : natural; ms : natural) is
+        begin
+            write_reg(REG_LEVELS, levels);
+            write_reg(REG_TIME, ms);
+        end procedure write_frame;
+
+    begin
+        wait for 5 * CLK_PERIOD;
+        rst <= '0';
+        wait until rising_edge(clk);
+
+        expect("reset leds", to_integer(unsigned(led_out)), 0, errors);
+
+        -- write -> led_out
+        t0 := cycles;
+        avalon_write(clk, avs_write, avs_address, avs_writedata, 0, 16#2A5#);
+        wait for 1 ns;
+        report "LATENCY write->LED: " & integer'image(cycles - t0) & " cycles";
+        expect("pattern", to_integer(unsigned(led_out)), 16#2A5#, errors);
+
+        avalon_read(clk, avs_read, avs_address, avs_readdata, 0, data);
+        expect("readback", data, 16#2A5#, errors);
+
+        -- upper bits are dropped on write and read back as 0
+        avalon_write(clk, avs_write, avs_address, avs_writedata, 0, 16#7FFFFC00# + 16#3FF#);
+        wait for 1 ns;
+        expect("all on", to_integer(unsigned(led_out)), 16#3FF#, errors);
+        avalon_read(clk, avs_read, avs_address, avs_readdata, 0, data);
+        expect("upper bits", data, 16#3FF#, errors);
+
+        -- a stopped sequencer leaves the pattern alone
+        write_reg(REG_CONTROL, 0);
+        wait for 1 ns;
+        expect("stopped", to_integer(unsigned(led_out)), 16#3FF#, errors);
+        read_reg(REG_LENGTH, data);
+        expect("empty back bank", data, 0, errors);
+        read_reg(REG_STATUS, data);
+        expect("idle status", data, FRAME_BITS * 65536, errors);
+        read_reg(REG_BRIGHTNESS, data);
+        expect("reset brightness", data, ALL_FULL, errors);
+
+        -- walking bit, the LED bar's most common pattern
+        for i in 0 to 9 loop
+            avalon_write(clk, avs_write, avs_address, avs_writedata, 0, 2 ** i);
+            wait for 1 ns;
+            expect("walk", to_integer(unsigned(led_out)), 2 ** i, errors);
+        end loop;
+
+        rst <= '1';
+        wait until rising_edge(clk);
+        rst <= '0';
+        wait for 1 ns;
+        expect("reset", to_integer(unsigned(led_out)), 0, errors);
+
+        ---------------------------------------------------------- brightness
+        -- LED 0 at each level: on for level of every 7 PWM steps
+        write_reg(REG_PATTERN, 1);
+        for level in 0 to 7 loop
+            write_reg(REG_BRIGHTNESS, ALL_FULL - 7 + level);
+            high := 0;
+            for i in 1 to 4 * PWM_CYCLE loop
+                wait until rising_edge(clk);
+                if led_out(0) = '1' then high := high + 1; end if;
+            end loop;
+            expect("level " & integer'image(level), high, 4 * level * PWM_DIV, errors);
+        end loop;
+        write_reg(REG_BRIGHTNESS, ALL_FULL);
+        write_reg(REG_PATTERN, 0);
+
+        ----------------------------------------------------------- sequencer
+        -- one-shot into the back bank (1): all on for 2 ms, off for 1 ms,
+        -- LED 0 alone for 1 ms (time 0 counts as 1), then stays
+        write_reg(REG_WR_ADDR, 0);
+        write_frame(ALL_FULL, 2);
+        write_frame(0, 1);
+        write_frame(7, 0);
+        write_reg(REG_LENGTH, 3);
+        read_reg(REG_WR_ADDR, data); expect("write address steps", data, 3, errors);
+        write_reg(REG_CONTROL, SWAP);
+        wait until rising_edge(clk);
+        read_reg(REG_CONTROL, data); expect("swap while stopped", data, 0, errors);
+        read_reg(REG_STATUS, data);
+        expect("front bank", data, FRAME_BITS * 65536 + ST_BANK, errors);
+
+        write_reg(REG_CONTROL, RUN);
+        t0 := cycles;
+        wait until rising_edge(clk) and led_out = "1111111111";
+        t1 := cycles;
+        report "LATENCY run->first frame: " & integer'image(t1 - t0) & " cycles";
+        wait until rising_edge(clk) and led_out = "0000000000";
+        expect("frame 0 clocks", cycles - t1, 2 * CLKS_PER_MS, errors);
+        t1 := cycles;
+        wait until rising_edge(clk) and led_out = "0000000001";
+        expect("frame 1 clocks", cycles - t1, CLKS_PER_MS, errors);
+        for i in 1 to 3 * CLKS_PER_MS loop
+            wait until rising_edge(clk);
+        end loop;
+        expect("one-shot holds", to_integer(unsigned(led_out)), 1, errors);
+        read_reg(REG_STATUS, data);
+        expect("one-shot done", data, FRAME_BITS * 65536 + ST_PLAYING + ST_DONE + ST_BANK + 2,
+               errors);
+
+        -- loop LED 1, LED 2 from bank 0; a finished sequence swaps at once
+        write_reg(REG_WR_ADDR, 0);
+        write_frame(7 * 8, 1);
+        write_frame(7 * 64, 1);
+        write_reg(REG_LENGTH, 2);
+        write_reg(REG_CONTROL, RUN + LOOP_MODE + SWAP);
+        wait until rising_edge(clk) and led_out = "0000000010";
+        t1 := cycles;
+        for i in 1 to 3 loop
+            wait until rising_edge(clk) and led_out = "0000000100";
+            expect("loop LED 2 at", cycles - t1, (2 * i - 1) * CLKS_PER_MS, errors);
+            wait until rising_edge(clk) and led_out = "0000000010";
+            expect("loop LED 1 at", cycles - t1, 2 * i * CLKS_PER_MS, errors);
+        end loop;
+
+        -- a swap requested mid-frame waits for that frame to end: LED 1
+        -- just came on, so LED 9 replaces it one full frame later
+        t0 := cycles;
+        write_reg(REG_WR_ADDR, 0);
+        write_frame(7 * 2 ** 27, 1);
+        write_reg(REG_LENGTH, 1);
+        write_reg(REG_CONTROL, RUN + LOOP_MODE + SWAP);
+        read_reg(REG_CONTROL, data);
+        expect("swap pending", data, RUN + LOOP_MODE + SWAP, errors);
+        expect("no tear", to_integer(unsigned(led_out)), 2, errors);
+        wait until rising_edge(clk) and led_out = "1000000000";
+        expect("swap at frame end", cycles - t0, CLKS_PER_MS, errors);
+        read_reg(REG_CONTROL, data); expect("swap done", data, RUN + LOOP_MODE, errors);
+        read_reg(REG_STATUS, data);
+        expect("swapped bank", data, FRAME_BITS * 65536 + ST_PLAYING + ST_BANK, errors);
+
+        -- stopping hands the LEDs back to the pattern
+        write_reg(REG_PATTERN, 16#155#);
+        write_reg(REG_CONTROL, 0);
+        wait until rising_edge(clk);
+        wait for 1 ns;
+        expect("pattern again", to_integer(unsigned(led_out)), 16#155#, errors);
+
+        report "CYCLES " & integer'image(cycles);
+        report "RESULT tb_ledbus_avalon errors=" & integer'image(errors);
+        assert errors = 0 report "tb_ledbus_avalon FAILED" severity failure;
+
+        done <= true;
+        wait;
+    end process stimulus;
+
+end architecture sim;
@@ -0,0 +1,141 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Shared testbench helpers
+--   - clock period and the fixed-point reference model used by pwm_controller
+--   - Avalon-MM slave bus functional model (word addresses). A read holds
+--     read for one clock and samples readdata just after that edge, so the
+--     slave must register readdata on the read edge.
+--   - expect, which reports a mismatch and counts it in the bench's errors
+
+package tb_pkg is
+
+    constant CLK_PERIOD    : time := 20 ns;          -- 50 MHz, like the board
+    constant CYCLES_PER_MS : natural := 50000;
+    constant PERIOD_SCALE  : natural := 32;          -- 11.5 fixed point
+    constant DUTY_SCALE    : natural := 131072;      -- 18.17 fixed point
+
+    -- clocks per PWM period for an 11.5 period register value
+    function expected_period_cycles (period : natural) return natural;
+
+    -- clocks the output is high per period, floor(cycles * duty / 2^17),
+    -- never more than the period
+    function expected_high_cycles (cycles : natural; duty : natural) return natural;
+
+    -- (high / cycles - duty) in ppm, duty clamped to 1.0
+    function ideal_error_ppm (high : natural; cycles : natural; duty : natural) return real;
+
+    procedure avalon_write (
+        signal clk       : in  std_logic;
+        signal write     : out std_logic;
+        signal address   : out std_logic_vector;
+        signal writedata : out std_logic_vector(31 downto 0);
+        constant addr    : in  natural;
+        constant data    : in  natural
+    );
+
+    procedure avalon_read (
+        signal clk      : in  std_logic;
+        signal read     : out std_logic;
+        signal address  : out std_logic_vector;
+        signal readdata : in  std_logic_vector(31 downto 0);
+        constant addr   : in  natural;
+        variable data   : out natural
+    );
+
+    -- report got /= want as an error and count it
+    procedure expect (
+        constant name   : in    string;
+        constant got    : in    natural;
+        constant want   : in    natural;
+        variable errors : inout natural
+    );
+
+end package tb_pkg;
+
+package body tb_pkg is
+
+    function expected_period_cycles (period : natural) return natural is
+        variable cycles : natural;
+    begin
+        cycles := (period * CYCLES_PER_MS) / PERIOD_SCALE;
+        if cycles < 1 then
+            cycles := 1;
+        elsif cycles > 2 ** 20 - 1 then
+            cycles := 2 ** 20 - 1;
+        end if;
+        return cycles;
+    end function expected_period_cycles;
+
+    function expected_high_cycles (cycles : natural; duty : natural) return natural is
+        variable product : unsigned(37 downto 0);
+        variable high    : natural;
+    begin
+        -- cycles * duty can overflow a VHDL integer, so do it in unsigned
+        product := to_unsigned(cycles, 20) * to_unsigned(duty, 18);
+        high := to_integer(product(37 downto 17));
+        if high > cycles then
+            high := cycles;
+        end if;
+        return high;
+    end function expected_high_cycles;
+
+    function ideal_error_ppm (high : natural; cycles : natural; duty : natural) return real is
+        variable d : natural := duty;
+    begin
+        if d > DUTY_SCALE then
+            d := DUTY_SCALE;
+        end if;
+        return (real(high) / real(cycles) - real(d) / real(DUTY_SCALE)) * 1.0e6;
+    end function ideal_error_ppm;
+
+    procedure avalon_write (
+        signal clk       : in  std_logic;
+        signal write     : out std_logic;
+        signal address   : out std_logic_vector;
+        signal writedata : out std_logic_vector(31 downto 0);
+        constant addr    : in  natural;
+        constant data    : in  natural
+    ) is
+    begin
+        address <= std_logic_vector(to_unsigned(addr, address'length));
+        writedata <= std_logic_vector(to_unsigned(data, 32));
+        write <= '1';
+        wait until rising_edge(clk);
+        write <= '0';
+    end procedure avalon_write;
+
+    procedure avalon_read (
+        signal clk      : in  std_logic;
+        signal read     : out std_logic;
+        signal address  : out std_logic_vector;
+        signal readdata : in  std_logic_vector(31 downto 0);
+        constant addr   : in  natural;
+        variable data   : out natural
+    ) is
+    begin
+        address <= std_logic_vector(to_unsigned(addr, address'length));
+        read <= '1';
+        wait until rising_edge(clk);
+        read <= '0';
+        -- readdata is registered on the same edge
+        wait for 1 ns;
+        data := to_integer(unsigned(readdata(30 downto 0)));
+    end procedure avalon_read;
+
+    procedure expect (
+        constant name   : in    string;
+        constant got    : in    natural;
+        constant want   : in    natural;
+        variable errors : inout natural
+    ) is
+    begin
+        if got /= want then
+            report name & ": got " & integer'image(got) &
+                   ", expected " & integer'image(want) severity error;
+            errors := errors + 1;
+        end if;
+    end procedure expect;
+
+end package body tb_pkg;
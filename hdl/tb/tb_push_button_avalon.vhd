@@ -0,0 +1,136 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.tb_pkg.all;
+
+-- push_button_avalon (led_patterns_avalon) testbench
+--   - reset values of button_status and irq_enable
+--   - a press sets button_status and, when enabled, raises irq
+--   - a held button does not re-trigger while the debounce timer runs
+--   - clearing button_status drops irq; irq_enable gates irq
+--   - latency in clocks from the button edge to irq
+--
+-- The debounce timer holds off new presses for 0.5 s (25M clocks), so only
+-- one physical press is simulated.
+
+entity tb_push_button_avalon is
+end entity tb_push_button_avalon;
+
+architecture sim of tb_push_button_avalon is
+
+    constant REG_STATUS    : natural := 0;
+    constant REG_IRQ_EN    : natural := 1;
+
+    signal clk           : std_logic := '0';
+    signal rst           : std_logic := '1';
+    signal avs_read      : std_logic := '0';
+    signal avs_write     : std_logic := '0';
+    signal avs_address   : std_logic_vector(1 downto 0) := (others => '0');
+    signal avs_writedata : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_readdata  : std_logic_vector(31 downto 0);
+    signal irq           : std_logic;
+    signal push_button   : std_logic := '0';
+
+    signal cycles        : natural := 0;
+    signal done          : boolean := false;
+
+begin
+
+    clk <= not clk after CLK_PERIOD / 2 when not done;
+
+    cycle_counter : process(clk)
+    begin
+        if rising_edge(clk) then
+            cycles <= cycles + 1;
+        end if;
+    end process cycle_counter;
+
+    dut : entity work.led_patterns_avalon
+        port map (
+            clk           => clk,
+            rst           => rst,
+            avs_read      => avs_read,
+            avs_write     => avs_write,
+            avs_address   => avs_address,
+            avs_readdata  => avs_readdata,
+            avs_writedata => avs_writedata,
+            irq           => irq,
+            push_button   => push_button
+        );
+
+    stimulus : process
+
+        variable errors : natural := 0;
+        variable data   : natural;
+        variable t0     : natural;
+
+        procedure expect_irq (name : string; want : std_logic) is
+        begin
+            if irq /= want then
+                report name & ": irq is " & std_logic'image(irq) severity error;
+                errors := errors + 1;
+            end if;
+        end procedure expect_irq;
+
+    begin
+        wait for 5 * CLK_PERIOD;
+        rst <= '0';
+        wait until rising_edge(clk);
+
+        avalon_read(clk, avs_read, avs_address, avs_readdata, REG_STATUS, data);
+        expect("reset status", data, 0, errors);
+        avalon_read(clk, avs_read, avs_address, avs_readdata, REG_IRQ_EN, data);
+        expect("reset irq_enable", data, 0, errors);
+        expect_irq("reset", '0');
+
+        -- irq_enable gates irq: a software-set status stays quiet until enabled
+        avalon_write(clk, avs_write, avs_address, avs_writedata, REG_STATUS, 1);
+        wait for 1 ns;
+        expect_irq("status set, irq disabled", '0');
+        avalon_write(clk, avs_write, avs_address, avs_writedata, REG_IRQ_EN, 1);
+        wait for 1 ns;
+        expect_irq("status set, irq enabled", '1');
+        avalon_read(clk, avs_read, avs_address, avs_readdata, REG_IRQ_EN, data);
+        expect("irq_enable readback", data, 1, errors);
+        avalon_write(clk, avs_write, avs_address, avs_writedata, REG_STATUS, 0);
+        wait for 1 ns;
+        expect_irq("status cleared", '0');
+
+        -- press -> status/irq
+        wait until rising_edge(clk);
+        push_button <= '1';
+        t0 := cycles;
+        wait until irq = '1' for 10 * CLK_PERIOD;
+        expect_irq("press", '1');
+        wait until rising_edge(clk);
+        report "LATENCY button->irq: " & integer'image(cycles - t0) & " cycles";
+
+        avalon_read(clk, avs_read, avs_address, avs_readdata, REG_STATUS, data);
+        expect("press status", data, 1, errors);
+
+        -- clear while the button is still held: no re-trigger
+        avalon_write(clk, avs_write, avs_address, avs_writedata, REG_STATUS, 0);
+        for i in 1 to 1000 loop
+            wait until rising_edge(clk);
+        end loop;
+        expect_irq("held", '0');
+        avalon_read(clk, avs_read, avs_address, avs_readdata, REG_STATUS, data);
+        expect("held status", data, 0, errors);
+
+        push_button <= '0';
+        for i in 1 to 100 loop
+            wait until rising_edge(clk);
+        end loop;
+        expect_irq("released", '0');
+
+        report "CYCLES " & integer'image(cycles);
+        report "RESULT tb_push_button_avalon errors=" & integer'image(errors);
+        assert errors = 0 report "tb_push_button_avalon FAILED" severity failure;
+
+        done <= true;
+        wait;
+    end process stimulus;
+
+end architecture sim;
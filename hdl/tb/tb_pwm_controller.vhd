@@ -0,0 +1,147 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.tb_pkg.all;
+
+-- pwm_controller testbench
+--   - period accuracy: period_end spacing vs floor(period * 50000 / 32)
+--   - duty accuracy:   high cycles per period vs floor(cycles * duty / 2^17)
+--   - latency:         clocks from a duty change to the output following it
+
+entity tb_pwm_controller is
+end entity tb_pwm_controller;
+
+architecture sim of tb_pwm_controller is
+
+    signal clk        : std_logic := '0';
+    signal rst        : std_logic := '1';
+    signal period     : unsigned(10 downto 0) := (others => '0');
+    signal duty_cycle : unsigned(17 downto 0) := (others => '0');
+    signal output     : std_logic;
+    signal period_end : std_logic;
+
+    signal cycles     : natural := 0;
+    signal done       : boolean := false;
+
+begin
+
+    clk <= not clk after CLK_PERIOD / 2 when not done;
+
+    cycle_counter : process(clk)
+    begin
+        if rising_edge(clk) then
+            cycles <= cycles + 1;
+        end if;
+    end process cycle_counter;
+
+    dut : entity work.pwm_controller
+        port map (
+            clk        => clk,
+            rst        => rst,
+            period     => period,
+            duty_cycle => duty_cycle,
+            output     => output,
+            period_end => period_end
+        );
+
+    stimulus : process
+
+        variable errors : natural := 0;
+
+        -- Set period/duty, let it settle, then measure NUM_PERIODS periods
+        -- starting right after a period_end pulse.
+        procedure check (p : natural; d : natural) is
+            constant NUM_PERIODS  : natural := 4;
+            variable exp_period   : natural;
+            variable exp_high     : natural;
+            variable got_period   : natural;
+            variable got_high     : natural;
+            variable err_ppm      : real;
+        begin
+            period <= to_unsigned(p, period'length);
+            duty_cycle <= to_unsigned(d, duty_cycle'length);
+
+            exp_period := expected_period_cycles(p);
+            exp_high := expected_high_cycles(exp_period, d);
+
+            -- two boundaries: the first may belong to the old period
+            for i in 1 to 2 loop
+                wait until rising_edge(clk) and period_end = '1';
+            end loop;
+
+            got_high := 0;
+            got_period := 0;
+            for i in 1 to NUM_PERIODS loop
+                loop
+                    wait until rising_edge(clk);
+                    got_period := got_period + 1;
+                    if output = '1' then
+                        got_high := got_high + 1;
+                    end if;
+                    exit when period_end = '1';
+                end loop;
+            end loop;
+
+            err_ppm := ideal_error_ppm(exp_high, exp_period, d);
+
+            report "period=" & integer'image(p) & " duty=" & integer'image(d) &
+                   " : cycles/period=" & integer'image(got_period / NUM_PERIODS) &
+                   " high=" & integer'image(got_high / NUM_PERIODS) &
+                   " (expect " & integer'image(exp_period) & "/" &
+                   integer'image(exp_high) & ", quantization " &
+                   real'image(err_ppm) & " ppm)";
+
+            if got_period /= exp_period * NUM_PERIODS then
+                report "period mismatch" severity error;
+                errors := errors + 1;
+            end if;
+            if got_high /= exp_high * NUM_PERIODS then
+                report "duty mismatch" severity error;
+                errors := errors + 1;
+            end if;
+        end procedure check;
+
+        variable t0 : natural;
+
+    begin
+        wait for 5 * CLK_PERIOD;
+        rst <= '0';
+        wait until rising_edge(clk);
+
+        -- 11.5 period: 1/32 ms steps, including ones that round
+        check(1, 65536);
+        check(3, 65536);
+        check(32, 65536);
+
+        -- 18.17 duty: endpoints, fractions, values that round, > 1.0
+        check(1, 0);
+        check(1, 131072);
+        check(1, 32768);
+        check(1, 98304);
+        check(1, 1);
+        check(1, 13107);
+        check(2, 87381);
+        check(1, 262143);
+
+        -- latency: duty 0 -> 1.0 shows up on the output regardless of where
+        -- the counter is
+        period <= to_unsigned(1, period'length);
+        duty_cycle <= (others => '0');
+        wait until rising_edge(clk) and period_end = '1';
+        wait until rising_edge(clk);
+        duty_cycle <= to_unsigned(131072, duty_cycle'length);
+        t0 := cycles;
+        wait until rising_edge(clk) and output = '1';
+        report "LATENCY duty->output: " & integer'image(cycles - t0) & " cycles";
+
+        report "CYCLES " & integer'image(cycles);
+        report "RESULT tb_pwm_controller errors=" & integer'image(errors);
+        assert errors = 0 report "tb_pwm_controller FAILED" severity failure;
+
+        done <= true;
+        wait;
+    end process stimulus;
+
+end architecture sim;
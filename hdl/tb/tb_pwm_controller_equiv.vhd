@@ -0,0 +1,209 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use ieee.math_real.all;
+
+library work;
+use work.tb_pkg.all;
+
+-- pwm_controller equivalence testbench
+-- Runs the pipelined pwm_controller next to pwm_controller_ref (the original
+-- single-stage core) on the same clock and inputs.
+--   - from reset with fixed inputs: output and period_end match clock for
+--     clock once both pipelines have filled
+--   - inputs changed while running: every later period has the same length
+--     and high time in both
+-- Vectors are the corner cases from tb_pwm_controller plus random ones.
+
+entity tb_pwm_controller_equiv is
+end entity tb_pwm_controller_equiv;
+
+architecture sim of tb_pwm_controller_equiv is
+
+    constant FILL_CYCLES    : natural := 8;         -- pipeline fill after reset
+    constant MAX_COMPARE    : natural := 40000;     -- clocks compared per vector
+    constant NUM_RANDOM     : natural := 200;
+
+    signal clk          : std_logic := '0';
+    signal rst          : std_logic := '1';
+    signal period       : unsigned(10 downto 0) := (others => '0');
+    signal duty_cycle   : unsigned(17 downto 0) := (others => '0');
+
+    signal output_new   : std_logic;
+    signal output_ref   : std_logic;
+    signal end_new      : std_logic;
+    signal end_ref      : std_logic;
+
+    signal cycles       : natural := 0;
+    signal done         : boolean := false;
+
+begin
+
+    clk <= not clk after CLK_PERIOD / 2 when not done;
+
+    cycle_counter : process(clk)
+    begin
+        if rising_edge(clk) then
+            cycles <= cycles + 1;
+        end if;
+    end process cycle_counter;
+
+    dut : entity work.pwm_controller
+        port map (
+            clk        => clk,
+            rst        => rst,
+            period     => period,
+            duty_cycle => duty_cycle,
+            output     => output_new,
+            period_end => end_new
+        );
+
+    ref : entity work.pwm_controller_ref
+        port map (
+            clk        => clk,
+            rst        => rst,
+            period     => period,
+            duty_cycle => duty_cycle,
+            output     => output_ref,
+            period_end => end_ref
+        );
+
+    stimulus : process
+
+        variable errors  : natural := 0;
+        variable vectors : natural := 0;
+        variable seed1   : positive := 17;
+        variable seed2   : positive := 4242;
+        variable r       : real;
+        variable p       : natural;
+        variable d       : natural;
+
+        -- reset both cores with the inputs already applied, then compare
+        -- clock for clock
+        procedure check_from_reset (p : natural; d : natural) is
+            variable n        : natural;
+            variable mismatch : natural := 0;
+        begin
+            rst <= '1';
+            period <= to_unsigned(p, period'length);
+            duty_cycle <= to_unsigned(d, duty_cycle'length);
+            wait until rising_edge(clk);
+            rst <= '0';
+
+            for i in 1 to FILL_CYCLES loop
+                wait until rising_edge(clk);
+            end loop;
+
+            n := 3 * expected_period_cycles(p) + FILL_CYCLES;
+            if n > MAX_COMPARE then
+                n := MAX_COMPARE;
+            end if;
+
+            for i in 1 to n loop
+                wait until rising_edge(clk);
+                if output_new /= output_ref or end_new /= end_ref then
+                    mismatch := mismatch + 1;
+                end if;
+            end loop;
+
+            vectors := vectors + 1;
+            if mismatch /= 0 then
+                report "reset p=" & integer'image(p) & " d=" & integer'image(d) &
+                       ": " & integer'image(mismatch) & " of " &
+                       integer'image(n) & " clocks differ" severity error;
+                errors := errors + 1;
+            end if;
+        end procedure check_from_reset;
+
+        -- change inputs on a running core, let both settle, then compare
+        -- three periods measured on each core's own period_end
+        procedure check_running (p : natural; d : natural) is
+            constant NUM_PERIODS : natural := 3;
+            variable seen_new    : natural := 0;
+            variable seen_ref    : natural := 0;
+            variable len_new     : natural := 0;
+            variable len_ref     : natural := 0;
+            variable high_new    : natural := 0;
+            variable high_ref    : natural := 0;
+        begin
+            period <= to_unsigned(p, period'length);
+            duty_cycle <= to_unsigned(d, duty_cycle'length);
+
+            -- boundaries 1 and 2 may still belong to the old settings
+            while seen_new < NUM_PERIODS + 2 or seen_ref < NUM_PERIODS + 2 loop
+                wait until rising_edge(clk);
+                if seen_new >= 2 and seen_new < NUM_PERIODS + 2 then
+                    len_new := len_new + 1;
+                    if output_new = '1' then high_new := high_new + 1; end if;
+                end if;
+                if seen_ref >= 2 and seen_ref < NUM_PERIODS + 2 then
+                    len_ref := len_ref + 1;
+                    if output_ref = '1' then high_ref := high_ref + 1; end if;
+                end if;
+                if end_new = '1' then seen_new := seen_new + 1; end if;
+                if end_ref = '1' then seen_ref := seen_ref + 1; end if;
+            end loop;
+
+            vectors := vectors + 1;
+            if len_new /= len_ref or high_new /= high_ref then
+                report "running p=" & integer'image(p) & " d=" & integer'image(d) &
+                       ": new " & integer'image(high_new) & "/" & integer'image(len_new) &
+                       ", ref " & integer'image(high_ref) & "/" & integer'image(len_ref)
+                       severity error;
+                errors := errors + 1;
+            end if;
+        end procedure check_running;
+
+    begin
+        wait for 5 * CLK_PERIOD;
+
+        -- corners: period 0 (1 clock), rounding periods, the 2^20 - 1
+        -- clamp, duty 0, 1.0, 1 LSB and above 1.0
+        check_from_reset(0, 65536);
+        check_from_reset(0, 131072);
+        check_from_reset(1, 65536);
+        check_from_reset(3, 13107);
+        check_from_reset(7, 87381);
+        check_from_reset(1, 0);
+        check_from_reset(1, 1);
+        check_from_reset(1, 131072);
+        check_from_reset(1, 262143);
+        check_from_reset(2047, 1310);
+        check_from_reset(2047, 262143);
+
+        for i in 1 to NUM_RANDOM loop
+            uniform(seed1, seed2, r);
+            p := integer(trunc(r * 8.0));
+            uniform(seed1, seed2, r);
+            d := integer(trunc(r * 262144.0));
+            check_from_reset(p, d);
+        end loop;
+
+        -- back-to-back changes without reset
+        rst <= '1';
+        wait until rising_edge(clk);
+        rst <= '0';
+        check_running(1, 65536);
+        check_running(2, 1000);
+        check_running(1, 131072);
+        check_running(0, 0);
+        check_running(3, 100000);
+
+        for i in 1 to NUM_RANDOM / 4 loop
+            uniform(seed1, seed2, r);
+            p := integer(trunc(r * 4.0));
+            uniform(seed1, seed2, r);
+            d := integer(trunc(r * 262144.0));
+            check_running(p, d);
+        end loop;
+
+        report "CYCLES " & integer'image(cycles);
+        report "RESULT tb_pwm_controller_equiv vectors=" & integer'image(vectors) &
+               " errors=" & integer'image(errors);
+        assert errors = 0 report "tb_pwm_controller_equiv FAILED" severity failure;
+
+        done <= true;
+        wait;
+    end process stimulus;
+
+end architecture sim;
@@ -0,0 +1,128 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.tb_pkg.all;
+
+-- pwm_rgb testbench
+--   - three channels share one period but keep independent duties
+--   - period_end marks the shared period boundary
+
+entity tb_pwm_rgb is
+end entity tb_pwm_rgb;
+
+architecture sim of tb_pwm_rgb is
+
+    signal clk        : std_logic := '0';
+    signal rst        : std_logic := '1';
+    signal duty_r     : unsigned(17 downto 0) := (others => '0');
+    signal duty_g     : unsigned(17 downto 0) := (others => '0');
+    signal duty_b     : unsigned(17 downto 0) := (others => '0');
+    signal period     : unsigned(10 downto 0) := (others => '0');
+    signal pwm_r      : std_logic;
+    signal pwm_g      : std_logic;
+    signal pwm_b      : std_logic;
+    signal period_end : std_logic;
+
+    signal cycles     : natural := 0;
+    signal done       : boolean := false;
+
+begin
+
+    clk <= not clk after CLK_PERIOD / 2 when not done;
+
+    cycle_counter : process(clk)
+    begin
+        if rising_edge(clk) then
+            cycles <= cycles + 1;
+        end if;
+    end process cycle_counter;
+
+    dut : entity work.pwm_rgb
+        port map (
+            clk        => clk,
+            rst        => rst,
+            duty_r     => duty_r,
+            duty_g     => duty_g,
+            duty_b     => duty_b,
+            period     => period,
+            pwm_r      => pwm_r,
+            pwm_g      => pwm_g,
+            pwm_b      => pwm_b,
+            period_end => period_end
+        );
+
+    stimulus : process
+
+        variable errors : natural := 0;
+
+        procedure check (p : natural; r : natural; g : natural; b : natural) is
+            constant NUM_PERIODS : natural := 4;
+            variable exp_period  : natural;
+            variable got_period  : natural;
+            variable high_r      : natural;
+            variable high_g      : natural;
+            variable high_b      : natural;
+        begin
+            period <= to_unsigned(p, period'length);
+            duty_r <= to_unsigned(r, 18);
+            duty_g <= to_unsigned(g, 18);
+            duty_b <= to_unsigned(b, 18);
+            exp_period := expected_period_cycles(p);
+
+            for i in 1 to 2 loop
+                wait until rising_edge(clk) and period_end = '1';
+            end loop;
+
+            got_period := 0;
+            high_r := 0;
+            high_g := 0;
+            high_b := 0;
+            for i in 1 to NUM_PERIODS loop
+                loop
+                    wait until rising_edge(clk);
+                    got_period := got_period + 1;
+                    if pwm_r = '1' then high_r := high_r + 1; end if;
+                    if pwm_g = '1' then high_g := high_g + 1; end if;
+                    if pwm_b = '1' then high_b := high_b + 1; end if;
+                    exit when period_end = '1';
+                end loop;
+            end loop;
+
+            report "period=" & integer'image(p) &
+                   " r/g/b high=" & integer'image(high_r / NUM_PERIODS) & "/" &
+                   integer'image(high_g / NUM_PERIODS) & "/" &
+                   integer'image(high_b / NUM_PERIODS) &
+                   " of " & integer'image(got_period / NUM_PERIODS);
+
+            if got_period /= exp_period * NUM_PERIODS then
+                report "period mismatch" severity error;
+                errors := errors + 1;
+            end if;
+            if high_r /= expected_high_cycles(exp_period, r) * NUM_PERIODS or
+               high_g /= expected_high_cycles(exp_period, g) * NUM_PERIODS or
+               high_b /= expected_high_cycles(exp_period, b) * NUM_PERIODS then
+                report "duty mismatch" severity error;
+                errors := errors + 1;
+            end if;
+        end procedure check;
+
+    begin
+        wait for 5 * CLK_PERIOD;
+        rst <= '0';
+        wait until rising_edge(clk);
+
+        check(1, 131072, 65536, 0);
+        check(1, 1000, 64000, 120000);
+        check(3, 43690, 87381, 131072);
+
+        report "CYCLES " & integer'image(cycles);
+        report "RESULT tb_pwm_rgb errors=" & integer'image(errors);
+        assert errors = 0 report "tb_pwm_rgb FAILED" severity failure;
+
+        done <= true;
+        wait;
+    end process stimulus;
+
+end architecture sim;
@@ -0,0 +1,686 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use ieee.math_real.all;
+
+library work;
+use work.tb_pkg.all;
+
+-- pwm_rgb_avalon testbench
+--   - reset values and register readback on both slaves
+--   - shadow duties: nothing reaches the LED until COMMIT
+--   - COMMIT latches all three channels together on a period boundary
+--   - duty accuracy through the register interface
+--   - direct mode against a simple ADC slave model with wait states
+--   - gamma LUT: power-up curve, table load with address auto-increment,
+--     intensity + commit and packed color writes through the tables
+--   - fades: status bits, duration in periods, shadow/committed duty after
+--     the fade, a rising fade passing through the middle, retargeting
+--   - frame FIFO: each frame shows for exactly hold periods (0 = 1), level,
+--     underrun, overflow, flush, and the irq against the watermark
+--   - latencies in clocks: commit -> LED, ADC change -> LED (direct mode),
+--     color write -> shadow duty, run -> first frame
+
+entity tb_pwm_rgb_avalon is
+end entity tb_pwm_rgb_avalon;
+
+architecture sim of tb_pwm_rgb_avalon is
+
+    constant REG_RED      : natural := 0;
+    constant REG_GREEN    : natural := 1;
+    constant REG_BLUE     : natural := 2;
+    constant REG_PERIOD   : natural := 3;
+    constant REG_COMMIT   : natural := 4;
+
+    constant REG_MODE     : natural := 0;
+    constant REG_GAIN_R   : natural := 1;
+    constant REG_GAIN_G   : natural := 2;
+    constant REG_GAIN_B   : natural := 3;
+
+    constant REG_INT_R    : natural := 0;
+    constant REG_INT_G    : natural := 1;
+    constant REG_INT_B    : natural := 2;
+    constant REG_COLOR    : natural := 3;
+    constant REG_LUT_COMMIT : natural := 4;
+    constant REG_LUT_ADDR : natural := 5;
+    constant REG_LUT_DATA : natural := 6;
+    constant REG_LUT_INFO : natural := 7;
+
+    constant LUT_BITS     : natural := 8;       -- the DUT's default
+    constant LUT_ENTRIES  : natural := 2 ** LUT_BITS;
+
+    constant REG_TARGET_R : natural := 0;
+    constant REG_TARGET_G : natural := 1;
+    constant REG_TARGET_B : natural := 2;
+    constant REG_STEPS_R  : natural := 3;
+    constant REG_STEPS_G  : natural := 4;
+    constant REG_STEPS_B  : natural := 5;
+    constant REG_FADE     : natural := 6;
+    constant FADE_DONE    : natural := 256;
+
+    constant REG_FRAME_R  : natural := 0;
+    constant REG_FRAME_G  : natural := 1;
+    constant REG_FRAME_B  : natural := 2;
+    constant REG_HOLD     : natural := 3;
+    constant REG_FIFO_CTRL : natural := 4;
+    constant REG_LEVEL    : natural := 5;
+    constant REG_WATERMARK : natural := 6;
+    constant REG_FIFO_STATUS : natural := 7;
+
+    constant FIFO_DEPTH   : natural := 512;     -- the DUT's default
+    constant FIFO_RUN     : natural := 1;
+    constant FIFO_FLUSH   : natural := 2;
+    constant FIFO_IRQ_EN  : natural := 4;
+    constant ST_LOW       : natural := 1;
+    constant ST_UNDERRUN  : natural := 2;
+    constant ST_OVERFLOW  : natural := 4;
+    constant ST_DEPTH     : natural := FIFO_DEPTH * 65536;
+
+    constant ADC_WAIT     : natural := 4;       -- wait states per ADC read
+
+    type adc_values_t is array (0 to 7) of natural;
+
+    signal clk                  : std_logic := '0';
+    signal rst                  : std_logic := '1';
+
+    signal avs_read             : std_logic := '0';
+    signal avs_write            : std_logic := '0';
+    signal avs_address          : std_logic_vector(2 downto 0) := (others => '0');
+    signal avs_writedata        : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_readdata         : std_logic_vector(31 downto 0);
+
+    signal avs_direct_read      : std_logic := '0';
+    signal avs_direct_write     : std_logic := '0';
+    signal avs_direct_address   : std_logic_vector(1 downto 0) := (others => '0');
+    signal avs_direct_writedata : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_direct_readdata  : std_logic_vector(31 downto 0);
+
+    signal avs_lut_read         : std_logic := '0';
+    signal avs_lut_write        : std_logic := '0';
+    signal avs_lut_address      : std_logic_vector(2 downto 0) := (others => '0');
+    signal avs_lut_writedata    : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_lut_readdata     : std_logic_vector(31 downto 0);
+
+    signal avs_fade_read        : std_logic := '0';
+    signal avs_fade_write       : std_logic := '0';
+    signal avs_fade_address     : std_logic_vector(2 downto 0) := (others => '0');
+    signal avs_fade_writedata   : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_fade_readdata    : std_logic_vector(31 downto 0);
+
+    signal avs_fifo_read        : std_logic := '0';
+    signal avs_fifo_write       : std_logic := '0';
+    signal avs_fifo_address     : std_logic_vector(2 downto 0) := (others => '0');
+    signal avs_fifo_writedata   : std_logic_vector(31 downto 0) := (others => '0');
+    signal avs_fifo_readdata    : std_logic_vector(31 downto 0);
+    signal irq                  : std_logic;
+
+    signal avm_adc_address      : std_logic_vector(31 downto 0);
+    signal avm_adc_read         : std_logic;
+    signal avm_adc_readdata     : std_logic_vector(31 downto 0);
+    signal avm_adc_waitrequest  : std_logic;
+
+    signal pwm_r                : std_logic;
+    signal pwm_g                : std_logic;
+    signal pwm_b                : std_logic;
+
+    signal adc_values           : adc_values_t := (others => 0);
+    signal adc_wait_count       : natural := 0;
+
+    signal cycles               : natural := 0;
+    signal done                 : boolean := false;
+
+begin
+
+    clk <= not clk after CLK_PERIOD / 2 when not done;
+
+    cycle_counter : process(clk)
+    begin
+        if rising_edge(clk) then
+            cycles <= cycles + 1;
+        end if;
+    end process cycle_counter;
+
+    dut : entity work.pwm_rgb_avalon
+        port map (
+            clk                  => clk,
+            rst                  => rst,
+            avs_read             => avs_read,
+            avs_write            => avs_write,
+            avs_address          => avs_address,
+            avs_writedata        => avs_writedata,
+            avs_readdata         => avs_readdata,
+            avs_direct_read      => avs_direct_read,
+            avs_direct_write     => avs_direct_write,
+            avs_direct_address   => avs_direct_address,
+            avs_direct_writedata => avs_direct_writedata,
+            avs_direct_readdata  => avs_direct_readdata,
+            avs_lut_read         => avs_lut_read,
+            avs_lut_write        => avs_lut_write,
+            avs_lut_address      => avs_lut_address,
+            avs_lut_writedata    => avs_lut_writedata,
+            avs_lut_readdata     => avs_lut_readdata,
+            avs_fade_read        => avs_fade_read,
+            avs_fade_write       => avs_fade_write,
+            avs_fade_address     => avs_fade_address,
+            avs_fade_writedata   => avs_fade_writedata,
+            avs_fade_readdata    => avs_fade_readdata,
+            avs_fifo_read        => avs_fifo_read,
+            avs_fifo_write       => avs_fifo_write,
+            avs_fifo_address     => avs_fifo_address,
+            avs_fifo_writedata   => avs_fifo_writedata,
+            avs_fifo_readdata    => avs_fifo_readdata,
+            irq                  => irq,
+            avm_adc_address      => avm_adc_address,
+            avm_adc_read         => avm_adc_read,
+            avm_adc_readdata     => avm_adc_readdata,
+            avm_adc_waitrequest  => avm_adc_waitrequest,
+            pwm_r                => pwm_r,
+            pwm_g                => pwm_g,
+            pwm_b                => pwm_b
+        );
+
+    -- ADC IP model: channel N at byte address N * 4, ADC_WAIT wait states
+    adc_slave : process(clk)
+    begin
+        if rising_edge(clk) then
+            if avm_adc_read = '1' and adc_wait_count < ADC_WAIT then
+                adc_wait_count <= adc_wait_count + 1;
+            else
+                adc_wait_count <= 0;
+            end if;
+        end if;
+    end process adc_slave;
+
+    avm_adc_waitrequest <= '1' when avm_adc_read = '1' and adc_wait_count < ADC_WAIT else '0';
+    avm_adc_readdata <= std_logic_vector(to_unsigned(
+        adc_values(to_integer(unsigned(avm_adc_address(4 downto 2)))), 32));
+
+    stimulus : process
+
+        variable errors : natural := 0;
+        variable data   : natural;
+        variable t0     : natural;
+        variable t_g    : natural;
+        variable t_r    : natural;
+        variable high   : natural;
+        variable prev   : natural;
+        variable middle : boolean;
+
+        procedure write_reg (addr : natural; value : natural) is
+        begin
+            avalon_write(clk, avs_write, avs_address, avs_writedata, addr, value);
+        end procedure write_reg;
+
+        procedure read_reg (addr : natural; variable value : out natural) is
+        begin
+            avalon_read(clk, avs_read, avs_address, avs_readdata, addr, value);
+        end procedure read_reg;
+
+        procedure write_direct (addr : natural; value : natural) is
+        begin
+            avalon_write(clk, avs_direct_write, avs_direct_address,
+                         avs_direct_writedata, addr, value);
+        end procedure write_direct;
+
+        procedure read_direct (addr : natural; variable value : out natural) is
+        begin
+            avalon_read(clk, avs_direct_read, avs_direct_address,
+                        avs_direct_readdata, addr, value);
+        end procedure read_direct;
+
+        procedure write_lut (addr : natural; value : natural) is
+        begin
+            avalon_write(clk, avs_lut_write, avs_lut_address,
+                         avs_lut_writedata, addr, value);
+        end procedure write_lut;
+
+        -- readLatency 1, but the data is combinational from registers set on
+        -- the read edge, so the usual sample just after that edge works
+        procedure read_lut (addr : natural; variable value : out natural) is
+        begin
+            avalon_read(clk, avs_lut_read, avs_lut_address,
+                        avs_lut_readdata, addr, value);
+        end procedure read_lut;
+
+        procedure write_fade (addr : natural; value : natural) is
+        begin
+            avalon_write(clk, avs_fade_write, avs_fade_address,
+                         avs_fade_writedata, addr, value);
+        end procedure write_fade;
+
+        procedure read_fade (addr : natural; variable value : out natural) is
+        begin
+            avalon_read(clk, avs_fade_read, avs_fade_address,
+                        avs_fade_readdata, addr, value);
+        end procedure read_fade;
+
+        procedure write_fifo (addr : natural; value : natural) is
+        begin
+            avalon_write(clk, avs_fifo_write, avs_fifo_address,
+                         avs_fifo_writedata, addr, value);
+        end procedure write_fifo;
+
+        procedure read_fifo (addr : natural; variable value : out natural) is
+        begin
+            avalon_read(clk, avs_fifo_read, avs_fifo_address,
+                        avs_fifo_readdata, addr, value);
+        end procedure read_fifo;
+
+        procedure push_frame (r : natural; g : natural; b : natural; hold : natural) is
+        begin
+            write_fifo(REG_FRAME_R, r);
+            write_fifo(REG_FRAME_G, g);
+            write_fifo(REG_FRAME_B, b);
+            write_fifo(REG_HOLD, hold);
+        end procedure push_frame;
+
+        -- power-up table contents
+        function gamma_duty (i : natural) return natural is
+        begin
+            return integer(round((real(i) / real(LUT_ENTRIES - 1)) ** 2.2 * 131072.0));
+        end function gamma_duty;
+
+        -- count high clocks per channel over NUM_PERIODS whole periods; in
+        -- steady state any window of whole periods gives exact counts
+        procedure check_duties (p : natural; r : natural; g : natural; b : natural;
+                                what : string) is
+            constant NUM_PERIODS : natural := 4;
+            variable exp_period  : natural;
+            variable high_r      : natural := 0;
+            variable high_g      : natural := 0;
+            variable high_b      : natural := 0;
+        begin
+            exp_period := expected_period_cycles(p);
+            for i in 1 to exp_period * NUM_PERIODS loop
+                wait until rising_edge(clk);
+                if pwm_r = '1' then high_r := high_r + 1; end if;
+                if pwm_g = '1' then high_g := high_g + 1; end if;
+                if pwm_b = '1' then high_b := high_b + 1; end if;
+            end loop;
+
+            report what & ": r/g/b high=" & integer'image(high_r / NUM_PERIODS) &
+                   "/" & integer'image(high_g / NUM_PERIODS) &
+                   "/" & integer'image(high_b / NUM_PERIODS) &
+                   " of " & integer'image(exp_period);
+
+            expect(what & " red", high_r, expected_high_cycles(exp_period, r) * NUM_PERIODS,
+                   errors);
+            expect(what & " green", high_g, expected_high_cycles(exp_period, g) * NUM_PERIODS,
+                   errors);
+            expect(what & " blue", high_b, expected_high_cycles(exp_period, b) * NUM_PERIODS,
+                   errors);
+        end procedure check_duties;
+
+        -- wait for two period boundaries so new settings are in steady state
+        procedure settle (p : natural) is
+        begin
+            for i in 1 to 2 * expected_period_cycles(p) + 4 loop
+                wait until rising_edge(clk);
+            end loop;
+        end procedure settle;
+
+        function direct_duty (adc : natural; gain : natural) return natural is
+            variable product : unsigned(29 downto 0);
+        begin
+            product := to_unsigned(adc, 12) * to_unsigned(gain, 18);
+            if to_integer(product(29 downto 12)) > DUTY_SCALE then
+                return DUTY_SCALE;
+            end if;
+            return to_integer(product(29 downto 12));
+        end function direct_duty;
+
+    begin
+        wait for 5 * CLK_PERIOD;
+        rst <= '0';
+        wait until rising_edge(clk);
+
+        ---------------------------------------------------------------- reset
+        read_reg(REG_RED, data);     expect("reset red", data, 0, errors);
+        read_reg(REG_PERIOD, data);  expect("reset period", data, 0, errors);
+        read_reg(REG_COMMIT, data);  expect("reset commit", data, 0, errors);
+        read_direct(REG_MODE, data); expect("reset mode", data, 0, errors);
+        read_direct(REG_GAIN_G, data); expect("reset gain", data, DUTY_SCALE, errors);
+
+        ------------------------------------------------------- shadow/commit
+        -- red at 50% is the reference: it rises at the start of every period
+        write_reg(REG_PERIOD, 1);
+        write_reg(REG_RED, 65536);
+        write_reg(REG_COMMIT, 1);
+        settle(1);
+        check_duties(1, 65536, 0, 0, "red only");
+
+        -- green/blue written but not committed must not show up
+        write_reg(REG_GREEN, 65536);
+        write_reg(REG_BLUE, 65536);
+        read_reg(REG_GREEN, data); expect("shadow readback", data, 65536, errors);
+        settle(1);
+        check_duties(1, 65536, 0, 0, "uncommitted");
+
+        -- commit: green and blue must turn on in the same clock, at the
+        -- start of a period (same clock red rises)
+        write_reg(REG_COMMIT, 1);
+        t0 := cycles;
+        read_reg(REG_COMMIT, data); expect("commit pending", data, 1, errors);
+
+        wait until rising_edge(clk) and pwm_g = '1';
+        t_g := cycles;
+        if pwm_b /= '1' then
+            report "green and blue did not latch together" severity error;
+            errors := errors + 1;
+        end if;
+        -- red is at 50% and rises on every period boundary
+        if pwm_r /= '1' then
+            report "commit did not land on a period boundary" severity error;
+            errors := errors + 1;
+        end if;
+        report "LATENCY commit->LED: " & integer'image(t_g - t0) &
+               " cycles (period " & integer'image(expected_period_cycles(1)) & ")";
+        if t_g - t0 > expected_period_cycles(1) + 4 then
+            report "commit took longer than one period" severity error;
+            errors := errors + 1;
+        end if;
+        read_reg(REG_COMMIT, data); expect("commit cleared", data, 0, errors);
+
+        settle(1);
+        check_duties(1, 65536, 65536, 65536, "committed");
+
+        -------------------------------------------------------- accuracy
+        write_reg(REG_PERIOD, 3);
+        write_reg(REG_RED, 131072);
+        write_reg(REG_GREEN, 13107);
+        write_reg(REG_BLUE, 1);
+        write_reg(REG_COMMIT, 1);
+        settle(3);
+        check_duties(3, 131072, 13107, 1, "period 3");
+
+        ------------------------------------------------------------ direct
+        write_reg(REG_PERIOD, 1);
+        write_reg(REG_RED, 0);
+        write_reg(REG_GREEN, 0);
+        write_reg(REG_BLUE, 0);
+        write_reg(REG_COMMIT, 1);
+        settle(1);
+
+        adc_values <= (0 => 4095, 1 => 2048, 2 => 100, others => 0);
+        write_direct(REG_GAIN_B, 262143);
+        write_direct(REG_MODE, 1);
+        read_direct(REG_MODE, data); expect("mode readback", data, 1, errors);
+        settle(1);
+        check_duties(1, direct_duty(4095, DUTY_SCALE), direct_duty(2048, DUTY_SCALE),
+                     direct_duty(100, 262143), "direct");
+
+        -- ADC change -> LED
+        adc_values(0) <= 0;
+        settle(1);
+        wait until rising_edge(clk);
+        adc_values(0) <= 4095;
+        t0 := cycles;
+        wait until rising_edge(clk) and pwm_r = '1';
+        t_r := cycles;
+        report "LATENCY adc->LED (direct): " & integer'image(t_r - t0) & " cycles";
+        if t_r - t0 > 3 * (ADC_WAIT + 1) + 8 then
+            report "direct mode latency too high" severity error;
+            errors := errors + 1;
+        end if;
+
+        -- back to software: the committed (all off) duties return
+        write_direct(REG_MODE, 0);
+        settle(1);
+        check_duties(1, 0, 0, 0, "software again");
+
+        ---------------------------------------------------------- gamma LUT
+        read_lut(REG_LUT_INFO, data); expect("lut info", data, LUT_BITS, errors);
+
+        -- power-up curve, read back through Table Data
+        write_lut(REG_LUT_ADDR, 0);
+        read_lut(REG_LUT_DATA, data); expect("gamma red 0", data, 0, errors);
+        read_lut(REG_LUT_DATA, data); expect("gamma red 1", data, gamma_duty(1), errors);
+        read_lut(REG_LUT_ADDR, data); expect("lut addr after reads", data, 2, errors);
+        write_lut(REG_LUT_ADDR, LUT_ENTRIES + 128);
+        read_lut(REG_LUT_DATA, data); expect("gamma green 128", data, gamma_duty(128), errors);
+        write_lut(REG_LUT_ADDR, 2 * LUT_ENTRIES + LUT_ENTRIES - 1);
+        read_lut(REG_LUT_DATA, data); expect("gamma blue max", data, DUTY_SCALE, errors);
+
+        -- intensities + commit: back to back, the commit must wait for the
+        -- lookups ahead of it
+        write_reg(REG_PERIOD, 3);
+        write_lut(REG_INT_R, LUT_ENTRIES - 1);
+        write_lut(REG_INT_G, 128);
+        write_lut(REG_INT_B, 0);
+        write_lut(REG_LUT_COMMIT, 1);
+        read_lut(REG_INT_G, data); expect("intensity readback", data, 128, errors);
+        settle(3);
+        read_reg(REG_GREEN, data); expect("looked up shadow", data, gamma_duty(128), errors);
+        check_duties(3, DUTY_SCALE, gamma_duty(128), 0, "intensity");
+
+        -- load entry 10 of each table; Table Address runs on from the last
+        -- red entry into green
+        write_lut(REG_LUT_ADDR, 10);
+        write_lut(REG_LUT_DATA, 65536);
+        write_lut(REG_LUT_ADDR, LUT_ENTRIES - 1);
+        write_lut(REG_LUT_DATA, DUTY_SCALE);
+        for i in 0 to 10 loop
+            if i = 10 then
+                write_lut(REG_LUT_DATA, 13107);
+            else
+                write_lut(REG_LUT_DATA, gamma_duty(i));
+            end if;
+        end loop;
+        read_lut(REG_LUT_ADDR, data);
+        expect("lut addr run-on", data, LUT_ENTRIES + 11, errors);
+        write_lut(REG_LUT_ADDR, 2 * LUT_ENTRIES + 10);
+        write_lut(REG_LUT_DATA, 1);
+
+        write_lut(REG_LUT_ADDR, 10);
+        read_lut(REG_LUT_DATA, data); expect("loaded red 10", data, 65536, errors);
+        write_lut(REG_LUT_ADDR, LUT_ENTRIES + 10);
+        read_lut(REG_LUT_DATA, data); expect("loaded green 10", data, 13107, errors);
+        write_lut(REG_LUT_ADDR, 2 * LUT_ENTRIES + 10);
+        read_lut(REG_LUT_DATA, data); expect("loaded blue 10", data, 1, errors);
+
+        -- one packed color write: look up and commit all three
+        wait until rising_edge(clk);
+        t0 := cycles;
+        write_lut(REG_COLOR, 16#0A0A0A#);
+        loop
+            read_reg(REG_RED, data);
+            exit when data = 65536;
+        end loop;
+        t_r := cycles;
+        report "LATENCY color->shadow: " & integer'image(t_r - t0) & " cycles";
+        if t_r - t0 > 4 then
+            report "lookup latency too high" severity error;
+            errors := errors + 1;
+        end if;
+        read_reg(REG_BLUE, data); expect("color blue shadow", data, 1, errors);
+        settle(3);
+        check_duties(3, 65536, 13107, 1, "color");
+
+        -- the duty registers still bypass the tables
+        write_reg(REG_RED, 10);
+        write_reg(REG_COMMIT, 1);
+        settle(3);
+        check_duties(3, 10, 13107, 1, "direct duty after lut");
+
+        --------------------------------------------------------------- fade
+        write_reg(REG_PERIOD, 1);
+        write_reg(REG_RED, 0);
+        write_reg(REG_GREEN, DUTY_SCALE);
+        write_reg(REG_BLUE, 0);
+        write_reg(REG_COMMIT, 1);
+        settle(1);
+        read_fade(REG_FADE, data); expect("fade idle", data, FADE_DONE, errors);
+
+        -- red up over 4 periods, green down over 8, one start write
+        write_fade(REG_TARGET_R, DUTY_SCALE);
+        write_fade(REG_STEPS_R, 4);
+        write_fade(REG_TARGET_G, 0);
+        write_fade(REG_STEPS_G, 8);
+        read_fade(REG_STEPS_G, data); expect("steps readback", data, 8, errors);
+        write_fade(REG_FADE, 3);
+        t0 := cycles;
+        read_fade(REG_FADE, data); expect("fade busy", data, 3, errors);
+        read_reg(REG_RED, data); expect("fade shadow", data, DUTY_SCALE, errors);
+
+        loop
+            read_fade(REG_FADE, data);
+            exit when data mod 2 = 0;
+        end loop;
+        t_r := cycles;
+        report "LATENCY fade 4 periods: " & integer'image(t_r - t0) &
+               " cycles (period " & integer'image(expected_period_cycles(1)) & ")";
+        if t_r - t0 < 3 * expected_period_cycles(1) or
+           t_r - t0 > 4 * expected_period_cycles(1) + 50 then
+            report "fade did not take 4 periods" severity error;
+            errors := errors + 1;
+        end if;
+
+        loop
+            read_fade(REG_FADE, data);
+            exit when data = FADE_DONE;
+        end loop;
+        settle(1);
+        check_duties(1, DUTY_SCALE, 0, 0, "faded");
+
+        -- commits work again once the fade is over
+        write_reg(REG_GREEN, 65536);
+        write_reg(REG_COMMIT, 1);
+        settle(1);
+        check_duties(1, DUTY_SCALE, 65536, 0, "commit after fade");
+
+        -- blue up over 8 periods: every period window sees at least as much
+        -- high time as the one before, and one lands near the middle
+        write_fade(REG_TARGET_B, DUTY_SCALE);
+        write_fade(REG_STEPS_B, 8);
+        write_fade(REG_FADE, 4);
+        prev := 0;
+        middle := false;
+        for w in 1 to 8 loop
+            high := 0;
+            for i in 1 to expected_period_cycles(1) loop
+                wait until rising_edge(clk);
+                if pwm_b = '1' then high := high + 1; end if;
+            end loop;
+            if high + 2 < prev then
+                report "fade not monotonic in window " & integer'image(w) severity error;
+                errors := errors + 1;
+            end if;
+            if high > expected_period_cycles(1) / 4 and
+               high < 3 * expected_period_cycles(1) / 4 then
+                middle := true;
+            end if;
+            prev := high;
+        end loop;
+        if not middle then
+            report "fade skipped the middle" severity error;
+            errors := errors + 1;
+        end if;
+
+        -- retarget mid-fade: blue down to 0 in one step from wherever it is
+        write_fade(REG_STEPS_B, 200);
+        write_fade(REG_TARGET_B, DUTY_SCALE);
+        write_fade(REG_FADE, 4);
+        settle(1);
+        write_fade(REG_TARGET_B, 0);
+        write_fade(REG_STEPS_B, 0);
+        write_fade(REG_FADE, 4);
+        loop
+            read_fade(REG_FADE, data);
+            exit when data = FADE_DONE;
+        end loop;
+        read_reg(REG_BLUE, data); expect("retarget shadow", data, 0, errors);
+        settle(1);
+        check_duties(1, DUTY_SCALE, 65536, 0, "retargeted");
+
+        ---------------------------------------------------------- frame FIFO
+        read_fifo(REG_FIFO_CTRL, data); expect("reset fifo control", data, FIFO_RUN, errors);
+        read_fifo(REG_WATERMARK, data);
+        expect("reset watermark", data, FIFO_DEPTH / 2, errors);
+        read_fifo(REG_FIFO_STATUS, data);
+        expect("reset fifo status", data, ST_DEPTH + ST_LOW, errors);
+
+        write_reg(REG_RED, 0);
+        write_reg(REG_GREEN, 0);
+        write_reg(REG_COMMIT, 1);
+        settle(1);
+
+        -- queue while paused: red 50% for 3 periods, off for 2, 50% for
+        -- one (hold 0 counts as 1), then off for good
+        write_fifo(REG_FIFO_CTRL, 0);
+        push_frame(65536, 0, 0, 3);
+        push_frame(0, 0, 0, 2);
+        push_frame(65536, 0, 0, 0);
+        push_frame(0, 0, 0, 1);
+        read_fifo(REG_LEVEL, data); expect("fifo level", data, 4, errors);
+        settle(1);
+        check_duties(1, 0, 0, 0, "paused");
+
+        -- red rises at the start of each 50% period, so sampling whole
+        -- periods from the first rise gives each frame's exact length
+        write_fifo(REG_FIFO_CTRL, FIFO_RUN);
+        t0 := cycles;
+        wait until rising_edge(clk) and pwm_r = '1';
+        t_r := cycles;
+        report "LATENCY run->first frame: " & integer'image(t_r - t0) &
+               " cycles (period " & integer'image(expected_period_cycles(1)) & ")";
+        for w in 1 to 8 loop
+            high := 0;
+            for i in 1 to expected_period_cycles(1) loop
+                if pwm_r = '1' then high := high + 1; end if;
+                wait until rising_edge(clk);
+            end loop;
+            if w <= 3 or w = 6 then
+                expect("frame period " & integer'image(w), high,
+                       expected_high_cycles(expected_period_cycles(1), 65536), errors);
+            else
+                expect("frame period " & integer'image(w), high, 0, errors);
+            end if;
+        end loop;
+
+        -- the last frame ran out with nothing behind it and stays on
+        read_fifo(REG_LEVEL, data); expect("fifo drained", data, 0, errors);
+        read_fifo(REG_FIFO_STATUS, data);
+        expect("underrun", data, ST_DEPTH + ST_UNDERRUN + ST_LOW, errors);
+        write_fifo(REG_FIFO_STATUS, ST_UNDERRUN);
+        read_fifo(REG_FIFO_STATUS, data);
+        expect("underrun cleared", data, ST_DEPTH + ST_LOW, errors);
+        read_reg(REG_RED, data); expect("frame shadow", data, 0, errors);
+
+        -- fill past full while paused: the extra push is dropped and flagged
+        write_fifo(REG_FIFO_CTRL, 0);
+        for i in 0 to FIFO_DEPTH loop
+            write_fifo(REG_HOLD, 1);
+        end loop;
+        read_fifo(REG_LEVEL, data); expect("fifo full", data, FIFO_DEPTH, errors);
+        read_fifo(REG_FIFO_STATUS, data);
+        expect("overflow", data, ST_DEPTH + ST_OVERFLOW, errors);
+        write_fifo(REG_FIFO_STATUS, ST_OVERFLOW);
+
+        -- irq follows low only while enabled
+        write_fifo(REG_FIFO_CTRL, FIFO_IRQ_EN);
+        wait until rising_edge(clk);
+        expect("irq while full", std_logic'pos(irq), std_logic'pos('0'), errors);
+        write_fifo(REG_FIFO_CTRL, FIFO_IRQ_EN + FIFO_FLUSH);
+        read_fifo(REG_LEVEL, data); expect("flushed", data, 0, errors);
+        expect("irq when low", std_logic'pos(irq), std_logic'pos('1'), errors);
+        write_fifo(REG_WATERMARK, 0);
+        write_fifo(REG_HOLD, 1);
+        read_fifo(REG_FIFO_STATUS, data); expect("above watermark", data, ST_DEPTH, errors);
+        expect("irq above watermark", std_logic'pos(irq), std_logic'pos('0'), errors);
+        write_fifo(REG_WATERMARK, FIFO_DEPTH / 2);
+        wait until rising_edge(clk);
+        expect("irq below watermark", std_logic'pos(irq), std_logic'pos('1'), errors);
+        write_fifo(REG_FIFO_CTRL, FIFO_RUN + FIFO_FLUSH);
+        wait until rising_edge(clk);
+        expect("irq disabled", std_logic'pos(irq), std_logic'pos('0'), errors);
+        check_duties(1, 0, 0, 0, "flushed");
+
+        report "CYCLES " & integer'image(cycles);
+        report "RESULT tb_pwm_rgb_avalon errors=" & integer'image(errors);
+        assert errors = 0 report "tb_pwm_rgb_avalon FAILED" severity failure;
+
+        done <= true;
+        wait;
+    end process stimulus;
+
+end architecture sim;
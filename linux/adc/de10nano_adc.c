@@ -2,11 +2,27 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/mod_devicetable.h>
-#include <linux/io.h>
 #include <linux/types.h>
 #include <linux/mutex.h>
 #include <linux/miscdevice.h>
 #include <linux/fs.h>
+#include <linux/bitops.h>
+#include <linux/uaccess.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/regmap.h>
+#include <linux/log2.h>
+
+#define FPGA_TRACE_SYSTEM adc
+#include "fpga_regmap.h"
+#include "fpga_instance.h"
+#include "de10nano_adc.h"
+
+#define CREATE_TRACE_POINTS
+#include "fpga_trace.h"
 
 // ADC channel register addresses
 static u32 CH0 = 0x0;
@@ -22,31 +38,268 @@ static u32 CH7 = 0x1c;
 #define UPDATE 0x0
 #define AUTO_UPDATE 0x4
 
-#define SPAN 32
-
 // ADC values are in the 12 least-significant bits of the registers
 #define ADC_VALUE_BITMASK 0xfff
 
+/*
+ * Oversampling filter registers (optional second reg window, see
+ * hdl/adc-filter). The filtered channels sit at the same offsets as the raw
+ * ones, followed by the per-channel log2 oversampling ratios.
+ */
+#define FILTER_OSR(ch) (0x20 + (ch) * 4)
+#define FILTER_CONTROL 0x40
+#define FILTER_SWEEP_PERIOD 0x44
+#define FILTER_COUNT 0x48
+#define FILTER_ENABLE BIT(0)
+#define FILTER_OSR_MAX 8
+#define FILTER_VALUE_BITMASK 0xffff
+
+// The sweep period counts clocks of the 50 MHz fabric clock
+#define FILTER_CLK_HZ 50000000
+
 static unsigned long VOLTAGE_SCALE_MV = 1;
 
+// Sampler limits; the FIFO holds one second of samples at 1 kHz
+#define ADC_MAX_SAMPLE_RATE_HZ 10000
+#define ADC_FIFO_RECORDS 1024
+
 /**
  * struct adc_dev - Private led patterns device struct.
- * @base_addr: Pointer to the component's base address 
- * @hps_led_control: Pointer to the hps_led_control register 
- * @base_period: Pointer to the base_period register 
- * @led_reg: Pointer to the led_reg register 
+ * @regs: The register window
+ * @filter: Oversampling filter window; filter.map is NULL if the device
+ *          tree only lists one reg
+ * @inst: Instance number and char device name (adcN)
+ * @stats: Op counters and latency histograms, see fpga_stats.h
+ * @auto_update: Shadow of the write-only auto_update register
  * @miscdev: miscdevice used to create a character device
  * @lock: mutex used to prevent concurrent writes to memory 
+ * @ch_mask: Channels returned by a packed read(); 0 selects offset mode.
+ *           See ADC_IOC_SET_CHMASK in de10nano_adc.h.
+ * @timer: hrtimer that drives the in-kernel sampler.
+ * @period: Sampler period; only valid while @sample_rate_hz is non-zero.
+ * @sample_rate_hz: Sampler rate, 0 when the sampler is stopped.
+ * @fifo: Timestamped records produced by @timer, drained by read().
+ * @wq: Readers/pollers waiting for records.
+ * @seq: Sequence number of the next record.
+ * @overruns: Records dropped because @fifo was full.
  *
  * An adc_dev struct gets created for each led patterns component.
  */
 struct adc_dev {
-	void __iomem *base_addr;
+	struct fpga_regmap regs;
+	struct fpga_regmap filter;
+	struct fpga_instance inst;
+	struct fpga_stats stats;
 	bool auto_update;
 	struct miscdevice miscdev;
 	struct mutex lock;
+	u32 ch_mask;
+	struct hrtimer timer;
+	ktime_t period;
+	unsigned int sample_rate_hz;
+	DECLARE_KFIFO(fifo, struct adc_sample, ADC_FIFO_RECORDS);
+	wait_queue_head_t wq;
+	u32 seq;
+	unsigned long overruns;
+};
+
+// Instance numbers, see fpga_instance.h
+static DEFINE_IDA(adc_ida);
+
+// Used by the timed sysfs and file operation wrappers
+static struct fpga_stats *adc_stats(struct device *dev)
+{
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	return &priv->stats;
+}
+
+/*
+ * The channel registers change on their own and update/auto_update share
+ * their addresses with CH0/CH1 (reads return the channel, writes hit the
+ * control register), so nothing here can be cached. regmap still gives us
+ * bulk reads under one lock and the debugfs register dump. fast_io makes it
+ * safe to use from the sampler's hrtimer.
+ */
+static bool adc_writeable_reg(struct device *dev, unsigned int reg)
+{
+	return reg == UPDATE || reg == AUTO_UPDATE;
+}
+
+static const struct regmap_config adc_regmap_config = {
+	FPGA_REGMAP_COMMON,
+	.name = "adc",
+	.max_register = 0x1c,
+	.writeable_reg = adc_writeable_reg,
+	.cache_type = REGCACHE_NONE,
+};
+
+/*
+ * The filtered channels and the result count change on their own; the
+ * settings only change when we write them, so they are cached.
+ */
+static bool adc_filter_volatile_reg(struct device *dev, unsigned int reg)
+{
+	return reg < FILTER_OSR(0) || reg == FILTER_COUNT;
+}
+
+static bool adc_filter_writeable_reg(struct device *dev, unsigned int reg)
+{
+	return reg >= FILTER_OSR(0) && reg <= FILTER_SWEEP_PERIOD;
+}
+
+static const struct regmap_config adc_filter_regmap_config = {
+	FPGA_REGMAP_COMMON,
+	.name = "filter",
+	.max_register = FILTER_COUNT,
+	.volatile_reg = adc_filter_volatile_reg,
+	.writeable_reg = adc_filter_writeable_reg,
+	.cache_type = REGCACHE_MAPLE,
 };
 
+/**
+ * adc_read_channels() - Read a set of channels with one bulk read
+ * @priv: The ADC device.
+ * @mask: Channels to read, non-zero.
+ * @vals: Returns the channel values, indexed by channel number.
+ *
+ * Reads every register from the lowest to the highest channel in @mask in a
+ * single regmap_bulk_read(), so the values form one snapshot.
+ *
+ * Return: 0 on success, a negative error value otherwise.
+ */
+static int adc_read_channels(struct adc_dev *priv, unsigned long mask,
+	u32 vals[ADC_NUM_CHANNELS])
+{
+	unsigned int first = __ffs(mask);
+	unsigned int last = __fls(mask);
+	unsigned int ch;
+	int ret;
+
+	ret = regmap_bulk_read(priv->regs.map, first * sizeof(u32),
+		&vals[first], last - first + 1);
+	if (ret)
+		return ret;
+
+	for (ch = first; ch <= last; ch++)
+		vals[ch] &= ADC_VALUE_BITMASK;
+
+	return 0;
+}
+
+/**
+ * adc_sample_timer() - hrtimer callback for the in-kernel sampler
+ * @timer: The sampler timer embedded in struct adc_dev.
+ *
+ * Reads the enabled channels (the ADC_IOC_SET_CHMASK mask, or all of them if
+ * no mask is set) into one timestamped record and pushes it into the FIFO.
+ * This is the FIFO's only producer, so no lock is needed on this side.
+ *
+ * Return: HRTIMER_RESTART, the timer is stopped with hrtimer_cancel().
+ */
+static enum hrtimer_restart adc_sample_timer(struct hrtimer *timer)
+{
+	struct adc_dev *priv = container_of(timer, struct adc_dev, timer);
+	struct adc_sample sample = { };
+	unsigned long mask = READ_ONCE(priv->ch_mask);
+	u32 vals[ADC_NUM_CHANNELS];
+	unsigned int ch;
+
+	if (!mask)
+		mask = ADC_CHMASK_ALL;
+
+	sample.timestamp_ns = ktime_get_ns();
+	sample.seq = priv->seq++;
+	sample.mask = mask;
+	if (!adc_read_channels(priv, mask, vals)) {
+		for_each_set_bit(ch, &mask, ADC_NUM_CHANNELS)
+			sample.ch[ch] = vals[ch];
+	}
+
+	if (!kfifo_put(&priv->fifo, sample))
+		priv->overruns++;
+	else
+		wake_up_interruptible(&priv->wq);
+
+	hrtimer_forward_now(timer, priv->period);
+	return HRTIMER_RESTART;
+}
+
+/**
+ * adc_sampler_set_rate() - Start, stop or retune the sampler
+ * @priv: The adc device.
+ * @rate_hz: New rate; 0 stops the sampler.
+ *
+ * Any records still in the FIFO are discarded. Must be called with
+ * @priv->lock held.
+ */
+static void adc_sampler_set_rate(struct adc_dev *priv, unsigned int rate_hz)
+{
+	hrtimer_cancel(&priv->timer);
+
+	// The timer is stopped and readers hold the lock, so nobody touches the FIFO.
+	kfifo_reset(&priv->fifo);
+	priv->seq = 0;
+	priv->overruns = 0;
+
+	WRITE_ONCE(priv->sample_rate_hz, rate_hz);
+	if (rate_hz) {
+		priv->period = ns_to_ktime(NSEC_PER_SEC / rate_hz);
+		hrtimer_start(&priv->timer, priv->period, HRTIMER_MODE_REL);
+	}
+
+	// Let blocked readers re-check which mode we're in.
+	wake_up_interruptible(&priv->wq);
+}
+
+/**
+ * adc_read_samples() - Drain sampler records from the FIFO
+ * @priv: The adc device.
+ * @file: Pointer to the char device file struct (for O_NONBLOCK).
+ * @buf: User-space buffer to copy struct adc_sample records into.
+ * @count: Size of @buf; only whole records are copied.
+ *
+ * Blocks until at least one record is available unless the file was opened
+ * with O_NONBLOCK.
+ *
+ * Return: The number of bytes copied, or a negative error value.
+ */
+static ssize_t adc_read_samples(struct adc_dev *priv, struct file *file,
+	char __user *buf, size_t count)
+{
+	unsigned int copied;
+	int ret;
+
+	if (count < sizeof(struct adc_sample))
+		return -EINVAL;
+
+	mutex_lock(&priv->lock);
+	while (kfifo_is_empty(&priv->fifo)) {
+		mutex_unlock(&priv->lock);
+
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(priv->wq,
+			!kfifo_is_empty(&priv->fifo) ||
+			!READ_ONCE(priv->sample_rate_hz));
+		if (ret)
+			return ret;
+
+		// The sampler was stopped while we slept; nothing more is coming.
+		if (!READ_ONCE(priv->sample_rate_hz))
+			return 0;
+
+		mutex_lock(&priv->lock);
+	}
+
+	ret = kfifo_to_user(&priv->fifo, buf,
+		rounddown(count, sizeof(struct adc_sample)), &copied);
+	mutex_unlock(&priv->lock);
+
+	return ret ? ret : copied;
+}
+
 /**
  * adc_read() - Read method for the adc char device
  * @file: Pointer to the char device file struct.
@@ -54,15 +307,32 @@ struct adc_dev {
  * @count: The number of bytes being requested.
  * @offset: The byte offset in the file being read from.
  *
- * Return: On success, the number of bytes written is returned and the
- * offset @offset is advanced by this number. On error, a negative error
- * value is returned.
+ * In offset mode (no channel mask set), up to @count bytes worth of
+ * consecutive channel registers are returned starting at @offset, so a single
+ * 32-byte read at offset 0 returns CH0 through CH7.
+ *
+ * In packed mode (see ADC_IOC_SET_CHMASK), one value per selected channel is
+ * returned, lowest channel first, and @offset is left untouched.
+ *
+ * All channels in one call are read with one regmap_bulk_read() so the
+ * caller gets a coherent snapshot.
+ *
+ * While the sampler is running (sample_rate_hz != 0), read() instead drains
+ * struct adc_sample records from the sampler FIFO; see adc_read_samples().
+ *
+ * Return: On success, the number of bytes written is returned and, in offset
+ * mode, the offset @offset is advanced by this number. On error, a negative
+ * error value is returned.
  */
 static ssize_t adc_read(struct file *file, char __user *buf,
 	size_t count, loff_t *offset)
 {
-	size_t ret;
-	u32 val;
+	u32 vals[ADC_NUM_CHANNELS];
+	unsigned int n = 0;
+	unsigned int ch;
+	unsigned long mask;
+	ssize_t len;
+	int ret = 0;
 
 	/*
 	 * Get the device's private data from the file struct's private_data
@@ -73,34 +343,55 @@ static ssize_t adc_read(struct file *file, char __user *buf,
 	struct adc_dev *priv = container_of(file->private_data,
 	                            struct adc_dev, miscdev);
 
-	// Check file offset to make sure we are reading from a valid location.
-	if (*offset < 0) {
-		// We can't read from a negative file position.
-		return -EINVAL;
-	}
-	if (*offset >= SPAN) {
-		// We can't read from a position past the end of our device.
-		return 0;
-	}
-	if ((*offset % 0x4) != 0) {
-		// Prevent unaligned access.
-		pr_warn("adc_read: unaligned access\n");
-		return -EFAULT;
+	if (READ_ONCE(priv->sample_rate_hz))
+		return adc_read_samples(priv, file, buf, count);
+
+	mutex_lock(&priv->lock);
+	mask = priv->ch_mask;
+
+	if (mask) {
+		u32 all[ADC_NUM_CHANNELS];
+
+		if (count < hweight_long(mask) * sizeof(u32)) {
+			// The whole record has to fit; we don't do partial records.
+			mutex_unlock(&priv->lock);
+			return -EINVAL;
+		}
+
+		ret = adc_read_channels(priv, mask, all);
+		if (!ret) {
+			for_each_set_bit(ch, &mask, ADC_NUM_CHANNELS)
+				vals[n++] = all[ch];
+		}
+	} else {
+		// Check the offset and clamp to whole registers inside the span.
+		len = fpga_regmap_count(&priv->regs, count, *offset);
+		if (len <= 0) {
+			mutex_unlock(&priv->lock);
+			return len;
+		}
+
+		ret = regmap_bulk_read(priv->regs.map, *offset, vals, len);
+		for (n = 0; n < len; n++)
+			vals[n] &= ADC_VALUE_BITMASK;
 	}
 
-	val = ioread32(priv->base_addr + *offset) & ADC_VALUE_BITMASK;
+	mutex_unlock(&priv->lock);
+
+	if (ret)
+		return ret;
 
-	// Copy the value to userspace.
-	ret = copy_to_user(buf, &val, sizeof(val));
-	if (ret == sizeof(val)) {
-		pr_warn("adc_read: nothing copied\n");
+	// Copy the values to userspace in one go.
+	if (copy_to_user(buf, vals, n * sizeof(u32))) {
+		pr_warn("adc_read: copy_to_user failed\n");
 		return -EFAULT;
 	}
 
-	// Increment the file offset by the number of bytes we read.
-	*offset = *offset + sizeof(val);
+	// Only offset mode moves the file position.
+	if (!mask)
+		*offset = *offset + n * sizeof(u32);
 
-	return sizeof(val);
+	return n * sizeof(u32);
 }
 
 /**
@@ -117,46 +408,104 @@ static ssize_t adc_read(struct file *file, char __user *buf,
 static ssize_t adc_write(struct file *file, const char __user *buf,
 	size_t count, loff_t *offset)
 {
-	size_t ret;
-	u32 val;
-
 	struct adc_dev *priv = container_of(file->private_data,
 	                              struct adc_dev, miscdev);
 
-	if (*offset < 0) {
-		return -EINVAL;
-	}
+	// Only update is writable here; auto_update goes through sysfs so the
+	// shadow copy stays right.
 	if (*offset >= AUTO_UPDATE) {
 		// can't write past to the read-only adc channel registers
 		return -EINVAL;
 	}
-	if ((*offset % 0x4) != 0) {
-		pr_warn("adc_write: unaligned access\n");
-		return -EFAULT;
-	}
 
-	mutex_lock(&priv->lock);
+	return fpga_regmap_write_user(&priv->regs, buf,
+		min_t(size_t, count, AUTO_UPDATE), offset);
+}
+
+/**
+ * adc_ioctl() - ioctl method for the adc char device
+ * @file: Pointer to the char device file struct.
+ * @cmd: ADC_IOC_SET_CHMASK or ADC_IOC_GET_CHMASK.
+ * @arg: User-space pointer to a __u32 channel mask.
+ *
+ * Return: 0 on success, a negative error value otherwise.
+ */
+static long adc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	u32 mask;
 
-	// Get the value from userspace.
-	ret = copy_from_user(&val, buf, sizeof(val));
-	if (ret != sizeof(val)) {
-		iowrite32(val, priv->base_addr + *offset);
+	struct adc_dev *priv = container_of(file->private_data,
+	                              struct adc_dev, miscdev);
 
-		// Increment the file offset by the number of bytes we wrote.
-		*offset = *offset + sizeof(val);
+	switch (cmd) {
+	case ADC_IOC_SET_CHMASK:
+		if (get_user(mask, (u32 __user *)arg))
+			return -EFAULT;
+		if (mask & ~ADC_CHMASK_ALL)
+			return -EINVAL;
 
-		// Return the number of bytes we wrote.
-		ret = sizeof(val);
-	}
-	else {
-		pr_warn("adc_write: nothing copied from user space\n");
-		ret = -EFAULT;
+		mutex_lock(&priv->lock);
+		priv->ch_mask = mask;
+		mutex_unlock(&priv->lock);
+		return 0;
+
+	case ADC_IOC_GET_CHMASK:
+		return put_user(READ_ONCE(priv->ch_mask), (u32 __user *)arg);
+
+	default:
+		return -ENOTTY;
 	}
+}
 
-	mutex_unlock(&priv->lock);
-	return ret;
+/**
+ * adc_poll() - poll method for the adc char device
+ * @file: Pointer to the char device file struct.
+ * @wait: Poll table.
+ *
+ * With the sampler running, the device is readable when the FIFO holds at
+ * least one record. Without it, register reads never block, so the device is
+ * always readable.
+ *
+ * Return: The poll event mask.
+ */
+static __poll_t adc_poll(struct file *file, poll_table *wait)
+{
+	struct adc_dev *priv = container_of(file->private_data,
+	                              struct adc_dev, miscdev);
+
+	poll_wait(file, &priv->wq, wait);
+
+	if (!READ_ONCE(priv->sample_rate_hz) || !kfifo_is_empty(&priv->fifo))
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+/**
+ * adc_mmap() - mmap method for the adc char device
+ * @file: Pointer to the char device file struct.
+ * @vma: The userspace mapping being created.
+ *
+ * Maps the page holding the ADC registers, uncached, into userspace. The
+ * registers start at (physical base & ~PAGE_MASK) within the mapping. The
+ * channel registers are read-only to us, so only read-only mappings are
+ * allowed, and mprotect() can't upgrade them later.
+ *
+ * Return: 0 on success, a negative error value otherwise.
+ */
+static int adc_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct adc_dev *priv = container_of(file->private_data,
+	                              struct adc_dev, miscdev);
+
+	return fpga_regmap_mmap(&priv->regs, vma, false);
 }
 
+FPGA_STATS_READ(adc_read, adc_stats)
+FPGA_STATS_WRITE(adc_write, adc_stats)
+FPGA_STATS_IOCTL(adc_ioctl, adc_stats)
+FPGA_STATS_MMAP(adc_mmap, adc_stats)
+
 /** 
  *  adc_fops - File operations supported by the  
  *                          adc driver
@@ -165,13 +514,20 @@ static ssize_t adc_write(struct file *file, const char __user *buf,
  *         character device is still in use.
  * @read: The read function.
  * @write: The write function.
+ * @unlocked_ioctl: Channel mask selection for packed reads.
+ * @poll: Readiness for the sampler FIFO.
+ * @mmap: Read-only, uncached mapping of the channel registers.
  * @llseek: We use the kernel's default_llseek() function; this allows 
  *          users to change what position they are writing/reading to/from.
  */
 static const struct file_operations  adc_fops = {
 	.owner = THIS_MODULE,
-	.read = adc_read,
-	.write = adc_write,
+	.read = adc_read_timed,
+	.write = adc_write_timed,
+	.unlocked_ioctl = adc_ioctl_timed,
+	.compat_ioctl = compat_ptr_ioctl,
+	.poll = adc_poll,
+	.mmap = adc_mmap_timed,
 	.llseek = default_llseek,
 };
 
@@ -203,15 +559,18 @@ static ssize_t update_store(struct device *dev,
 	struct device_attribute *attr, const char *buf, size_t size)
 {
 	struct adc_dev *priv = dev_get_drvdata(dev);
+	int ret;
 
 	/* 
 	 * Since writing any value to the update register triggers an update,
 	 * it doesn't matter what we write or what the user writes. So we ignore
 	 * what the user wants to write and just write a 1 :)
 	 */
-	iowrite32(1, priv->base_addr + UPDATE);
+	ret = regmap_write(priv->regs.map, UPDATE, 1);
+	if (ret)
+		return ret;
 
-	return 4;
+	return size;
 }
 
 /**
@@ -236,7 +595,10 @@ static ssize_t auto_update_store(struct device *dev,
 		return ret;
 	}
 
-	iowrite32(priv->auto_update, priv->base_addr + AUTO_UPDATE);
+	ret = regmap_write(priv->regs.map, AUTO_UPDATE, priv->auto_update);
+	if (ret < 0) {
+		return ret;
+	}
 
 	return size;
 }
@@ -273,7 +635,8 @@ static ssize_t auto_update_show(struct device *dev,
 static ssize_t adc_ch_show(struct device *dev,
 	struct device_attribute *attr, char *buf)
 {
-	u16 adc_value;
+	unsigned int adc_value;
+	int ret;
 	struct adc_dev *priv = dev_get_drvdata(dev);
 
 	struct dev_ext_attribute *ch_attr = container_of(attr, 
@@ -281,9 +644,368 @@ static ssize_t adc_ch_show(struct device *dev,
 
 	u32 ch_offset = *(u32 *)(ch_attr->var);
 
-	adc_value = ioread32(priv->base_addr + ch_offset) & ADC_VALUE_BITMASK;
+	ret = regmap_read(priv->regs.map, ch_offset, &adc_value);
+	if (ret)
+		return ret;
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", adc_value & ADC_VALUE_BITMASK);
+}
+
+/**
+ * sample_rate_hz_show() - Read the sampler rate.
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t sample_rate_hz_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(priv->sample_rate_hz));
+}
+
+/**
+ * sample_rate_hz_store() - Start, stop or retune the in-kernel sampler.
+ *
+ * Writing 0 stops the sampler and /dev/adcN goes back to register reads.
+ * Any other value (up to ADC_MAX_SAMPLE_RATE_HZ) (re)starts it at that rate
+ * with an empty FIFO.
+ *
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that contains the value being written.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t sample_rate_hz_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t size)
+{
+	unsigned int rate;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	ret = kstrtouint(buf, 0, &rate);
+	if (ret < 0) {
+		return ret;
+	}
+	if (rate > ADC_MAX_SAMPLE_RATE_HZ) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&priv->lock);
+	adc_sampler_set_rate(priv, rate);
+	mutex_unlock(&priv->lock);
+
+	return size;
+}
+
+/**
+ * sample_overruns_show() - Number of sampler records dropped on a full FIFO.
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t sample_overruns_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%lu\n", READ_ONCE(priv->overruns));
+}
+
+/**
+ * sample_fifo_level_show() - Number of records waiting in the sampler FIFO.
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t sample_fifo_level_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", kfifo_len(&priv->fifo));
+}
+
+/**
+ * instance_show() - Report N of /dev/adcN
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t instance_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", priv->inst.id);
+}
+
+/**
+ * adc_filt_show() - Read a filtered ADC channel value.
+ * @dev: Device structure for the adc component.
+ * @attr: Which filtered channel attribute we're reading from.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * The value is the channel's mean over its oversampling window scaled to 16
+ * bits (raw * 16 with no averaging), updated by the fabric.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t adc_filt_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	unsigned int value;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+	struct dev_ext_attribute *ch_attr = container_of(attr,
+		struct dev_ext_attribute, attr);
+
+	if (!priv->filter.map)
+		return -ENODEV;
+
+	// The filtered channels use the same offsets as the raw ones
+	ret = regmap_read(priv->filter.map, *(u32 *)(ch_attr->var), &value);
+	if (ret)
+		return ret;
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", value & FILTER_VALUE_BITMASK);
+}
+
+/**
+ * filter_osr_show() - Read the oversampling ratio of every channel.
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t filter_osr_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	u32 osr[ADC_NUM_CHANNELS];
+	unsigned int ch;
+	int len = 0;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	if (!priv->filter.map)
+		return -ENODEV;
+
+	ret = regmap_bulk_read(priv->filter.map, FILTER_OSR(0), osr,
+		ADC_NUM_CHANNELS);
+	if (ret)
+		return ret;
+
+	for (ch = 0; ch < ADC_NUM_CHANNELS; ch++)
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%u%c",
+			1u << osr[ch], ch == ADC_NUM_CHANNELS - 1 ? '\n' : ' ');
+
+	return len;
+}
+
+/**
+ * filter_osr_store() - Set the oversampling ratio.
+ *
+ * Takes either one ratio for every channel or eight ratios, channel 0 first.
+ * Ratios are powers of two from 1 to 256; each channel produces one filtered
+ * value per that many samples.
+ *
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that contains the value being written.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t filter_osr_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t size)
+{
+	unsigned int ratio[ADC_NUM_CHANNELS];
+	u32 osr[ADC_NUM_CHANNELS];
+	unsigned int ch;
+	int n;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	if (!priv->filter.map)
+		return -ENODEV;
+
+	n = sscanf(buf, "%u %u %u %u %u %u %u %u", &ratio[0], &ratio[1],
+		&ratio[2], &ratio[3], &ratio[4], &ratio[5], &ratio[6], &ratio[7]);
+	if (n != 1 && n != ADC_NUM_CHANNELS) {
+		return -EINVAL;
+	}
+
+	for (ch = 0; ch < ADC_NUM_CHANNELS; ch++) {
+		unsigned int r = ratio[n == 1 ? 0 : ch];
+
+		if (!is_power_of_2(r) || ilog2(r) > FILTER_OSR_MAX) {
+			return -EINVAL;
+		}
+		osr[ch] = ilog2(r);
+	}
+
+	n = regmap_bulk_write(priv->filter.map, FILTER_OSR(0), osr,
+		ADC_NUM_CHANNELS);
+	return n ? n : size;
+}
+
+/**
+ * filter_enable_show() - Read whether the fabric filter is sweeping the ADC.
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t filter_enable_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	unsigned int control;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	if (!priv->filter.map)
+		return -ENODEV;
+
+	ret = regmap_read(priv->filter.map, FILTER_CONTROL, &control);
+	if (ret)
+		return ret;
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", !!(control & FILTER_ENABLE));
+}
+
+/**
+ * filter_enable_store() - Start or stop the fabric filter.
+ *
+ * While stopped the filter doesn't touch the ADC and the filtered channels
+ * hold their last values.
+ *
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that contains the value being written.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t filter_enable_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t size)
+{
+	bool enable;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	if (!priv->filter.map)
+		return -ENODEV;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = regmap_write(priv->filter.map, FILTER_CONTROL,
+		enable ? FILTER_ENABLE : 0);
+	return ret ? ret : size;
+}
+
+/**
+ * filter_sweep_hz_show() - Read how often the filter samples every channel.
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t filter_sweep_hz_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	unsigned int period;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	if (!priv->filter.map)
+		return -ENODEV;
 
-	return scnprintf(buf, PAGE_SIZE, "%u\n", adc_value);
+	ret = regmap_read(priv->filter.map, FILTER_SWEEP_PERIOD, &period);
+	if (ret)
+		return ret;
+
+	// A period of 0 starts the next sweep as soon as the last one ends
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+		FILTER_CLK_HZ / max(period, 1u));
+}
+
+/**
+ * filter_sweep_hz_store() - Set how often the filter samples every channel.
+ *
+ * Each channel then produces a filtered value at this rate divided by its
+ * oversampling ratio. The period is rounded to whole fabric clocks.
+ *
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that contains the value being written.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t filter_sweep_hz_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t size)
+{
+	unsigned int rate;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	if (!priv->filter.map)
+		return -ENODEV;
+
+	ret = kstrtouint(buf, 0, &rate);
+	if (ret < 0) {
+		return ret;
+	}
+	if (rate == 0 || rate > FILTER_CLK_HZ) {
+		return -EINVAL;
+	}
+
+	ret = regmap_write(priv->filter.map, FILTER_SWEEP_PERIOD,
+		DIV_ROUND_CLOSEST(FILTER_CLK_HZ, rate));
+	return ret ? ret : size;
+}
+
+/**
+ * filter_count_show() - Number of filtered values produced, all channels.
+ * @dev: Device structure for the adc component.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Wraps at 2^32. Two reads tell how many new values arrived in between.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t filter_count_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	unsigned int count;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	if (!priv->filter.map)
+		return -ENODEV;
+
+	ret = regmap_read(priv->filter.map, FILTER_COUNT, &count);
+	if (ret)
+		return ret;
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", count);
 }
 
 /*
@@ -293,16 +1015,31 @@ static ssize_t adc_ch_show(struct device *dev,
  * https://elixir.bootlin.com/linux/v6.12/source/include/linux/device.h#L118
  * https://stackoverflow.com/questions/48540242/how-can-i-create-lots-of-similar-functions-for-sysfs-attributes
  */
+FPGA_STATS_SHOW(adc_ch, adc_stats)
+FPGA_STATS_SHOW(adc_filt, adc_stats)
+
 #define DEVICE_ADC_CH_ATTR(_name, _reg_offset) \
 	struct dev_ext_attribute dev_attr_##_name = \
-		{ __ATTR(_name, 0444, adc_ch_show, NULL), &(_reg_offset) }
+		{ __ATTR(_name, 0444, adc_ch_show_timed, NULL), &(_reg_offset) }
+
+#define DEVICE_ADC_FILT_ATTR(_name, _reg_offset) \
+	struct dev_ext_attribute dev_attr_##_name = \
+		{ __ATTR(_name, 0444, adc_filt_show_timed, NULL), &(_reg_offset) }
 
 #define DEVICE_ULONG_ATTR_RO(_name, _var) \
 	struct dev_ext_attribute dev_attr_##_name = \
 		{ __ATTR(_name, 0444, device_show_ulong, NULL), &(_var) }
 
-static DEVICE_ATTR_WO(update);
-static DEVICE_ATTR_RW(auto_update);
+FPGA_DEVICE_ATTR_WO(update, adc_stats);
+FPGA_DEVICE_ATTR_RW(auto_update, adc_stats);
+FPGA_DEVICE_ATTR_RW(sample_rate_hz, adc_stats);
+FPGA_DEVICE_ATTR_RO(sample_overruns, adc_stats);
+FPGA_DEVICE_ATTR_RO(sample_fifo_level, adc_stats);
+FPGA_DEVICE_ATTR_RO(instance, adc_stats);
+FPGA_DEVICE_ATTR_RW(filter_osr, adc_stats);
+FPGA_DEVICE_ATTR_RW(filter_enable, adc_stats);
+FPGA_DEVICE_ATTR_RW(filter_sweep_hz, adc_stats);
+FPGA_DEVICE_ATTR_RO(filter_count, adc_stats);
 static DEVICE_ADC_CH_ATTR(ch0_raw, CH0);
 static DEVICE_ADC_CH_ATTR(ch1_raw, CH1);
 static DEVICE_ADC_CH_ATTR(ch2_raw, CH2);
@@ -311,6 +1048,14 @@ static DEVICE_ADC_CH_ATTR(ch4_raw, CH4);
 static DEVICE_ADC_CH_ATTR(ch5_raw, CH5);
 static DEVICE_ADC_CH_ATTR(ch6_raw, CH6);
 static DEVICE_ADC_CH_ATTR(ch7_raw, CH7);
+static DEVICE_ADC_FILT_ATTR(ch0_filtered, CH0);
+static DEVICE_ADC_FILT_ATTR(ch1_filtered, CH1);
+static DEVICE_ADC_FILT_ATTR(ch2_filtered, CH2);
+static DEVICE_ADC_FILT_ATTR(ch3_filtered, CH3);
+static DEVICE_ADC_FILT_ATTR(ch4_filtered, CH4);
+static DEVICE_ADC_FILT_ATTR(ch5_filtered, CH5);
+static DEVICE_ADC_FILT_ATTR(ch6_filtered, CH6);
+static DEVICE_ADC_FILT_ATTR(ch7_filtered, CH7);
 static DEVICE_ULONG_ATTR_RO(voltage_scale_mv, VOLTAGE_SCALE_MV);
 
 static struct attribute *adc_attrs[] = {
@@ -325,6 +1070,22 @@ static struct attribute *adc_attrs[] = {
 	&dev_attr_ch6_raw.attr.attr,
 	&dev_attr_ch7_raw.attr.attr,
 	&dev_attr_voltage_scale_mv.attr.attr,
+	&dev_attr_sample_rate_hz.attr,
+	&dev_attr_sample_overruns.attr,
+	&dev_attr_sample_fifo_level.attr,
+	&dev_attr_instance.attr,
+	&dev_attr_ch0_filtered.attr.attr,
+	&dev_attr_ch1_filtered.attr.attr,
+	&dev_attr_ch2_filtered.attr.attr,
+	&dev_attr_ch3_filtered.attr.attr,
+	&dev_attr_ch4_filtered.attr.attr,
+	&dev_attr_ch5_filtered.attr.attr,
+	&dev_attr_ch6_filtered.attr.attr,
+	&dev_attr_ch7_filtered.attr.attr,
+	&dev_attr_filter_osr.attr,
+	&dev_attr_filter_enable.attr,
+	&dev_attr_filter_sweep_hz.attr,
+	&dev_attr_filter_count.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(adc);
@@ -342,7 +1103,7 @@ ATTRIBUTE_GROUPS(adc);
 static int adc_probe(struct platform_device *pdev)
 {
 	struct adc_dev *priv;
-	size_t ret;
+	int ret;
 
 	/*
 	 * Allocate kernel memory for the led patterns device and set it to 0.
@@ -357,38 +1118,69 @@ static int adc_probe(struct platform_device *pdev)
 		return -ENOMEM;
 	}
 
+	// Pick the instance number that names /dev/adcN
+	ret = fpga_instance_init(&pdev->dev, &adc_ida, "adc", "adc", &priv->inst);
+	if (ret) {
+		pr_err("Failed to get an adc instance number\n");
+		return ret;
+	}
+
+	// Counters and histograms under /sys/kernel/debug/adcN
+	ret = fpga_stats_init(&pdev->dev, &priv->stats, priv->inst.name);
+	if (ret)
+		return ret;
+
 	/*
-	 * Request and remap the device's memory region. Requesting the region
-	 * make sure nobody else can use that memory. The memory is remapped
-	 * into the kernel's virtual address space because we don't have access
-	 * to physical memory locations.
+	 * Request and remap the device's memory region and put a regmap on top
+	 * of it. Requesting the region make sure nobody else can use that
+	 * memory.
 	 */
-	priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-	if (IS_ERR(priv->base_addr)) {
-		pr_err("Failed to request/remap platform device resource\n");
-		return PTR_ERR(priv->base_addr);
+	ret = fpga_regmap_init(pdev, 0, &adc_regmap_config, &priv->stats,
+		&priv->regs);
+	if (ret) {
+		pr_err("Failed to map adc registers\n");
+		return ret;
+	}
+
+	// The filter window is optional; older device trees only list one reg
+	if (platform_get_resource(pdev, IORESOURCE_MEM, 1)) {
+		ret = fpga_regmap_init(pdev, 1, &adc_filter_regmap_config,
+			&priv->stats, &priv->filter);
+		if (ret) {
+			pr_err("Failed to map adc filter registers\n");
+			return ret;
+		}
 	}
 
+	mutex_init(&priv->lock);
+
+	// Set up the sampler; it stays stopped until sample_rate_hz is written.
+	INIT_KFIFO(priv->fifo);
+	init_waitqueue_head(&priv->wq);
+	hrtimer_init(&priv->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	priv->timer.function = adc_sample_timer;
+
+	/*
+	 * Attach the led patterns's private data to the platform device's struct.
+	 * This is so we can access our state container in the other functions.
+	 * The timed file operations need it as soon as the char dev exists.
+	 */
+	platform_set_drvdata(pdev, priv);
+
 	// Initialize the misc device parameters
 	priv->miscdev.minor = MISC_DYNAMIC_MINOR;
-	priv->miscdev.name = "adc";
+	priv->miscdev.name = priv->inst.name;
 	priv->miscdev.fops = &adc_fops;
 	priv->miscdev.parent = &pdev->dev;
 
-	// Register the misc device; this creates a char dev at /dev/adc
+	// Register the misc device; this creates a char dev at /dev/adcN
 	ret = misc_register(&priv->miscdev);
 	if (ret) {
 		pr_err("Failed to register misc device");
 		return ret;
 	}
 
-	/*
-	 * Attach the led patterns's private data to the platform device's struct.
-	 * This is so we can access our state container in the other functions.
-	 */
-	platform_set_drvdata(pdev, priv);
-
-	pr_info("adc_probe successful\n");
+	pr_info("adc_probe successful: %s\n", priv->inst.name);
 
 	return 0;
 }
@@ -405,10 +1197,13 @@ static void adc_remove(struct platform_device *pdev)
 	// Get the led patterns's private data from the platform device.
 	struct adc_dev *priv = platform_get_drvdata(pdev);
 
-	// Deregister the misc device and remove the /dev/adc file.
+	// Stop the sampler before the device goes away.
+	hrtimer_cancel(&priv->timer);
+
+	// Deregister the misc device and remove the /dev/adcN file.
 	misc_deregister(&priv->miscdev);
 
-	pr_info("adc_remove successful\n");
+	pr_info("adc_remove successful: %s\n", priv->inst.name);
 
 }
 
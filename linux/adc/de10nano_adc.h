@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Userspace interface for the de10nano_adc char device (/dev/adcN).
+ *
+ * This header is shared by the driver and by userspace programs (sw/hwio.c),
+ * so it only uses types from <linux/types.h> and <linux/ioctl.h>.
+ */
+#ifndef DE10NANO_ADC_H
+#define DE10NANO_ADC_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define ADC_NUM_CHANNELS	8
+
+/* All channel bits set */
+#define ADC_CHMASK_ALL		((1u << ADC_NUM_CHANNELS) - 1)
+
+#define ADC_IOC_MAGIC		'A'
+
+/*
+ * struct adc_sample - One record from the in-kernel sampler.
+ * @timestamp_ns: CLOCK_MONOTONIC time the channels were read.
+ * @seq: Increments by one per timer tick; resets when the rate changes.
+ * @mask: Channels filled in @ch (the ADC_IOC_SET_CHMASK mask, or all).
+ * @ch: 12-bit channel values; unselected channels read 0.
+ *
+ * While the sampler runs (sysfs sample_rate_hz != 0), read() on /dev/adcN
+ * returns whole struct adc_sample records and poll() reports EPOLLIN when at
+ * least one is queued.
+ */
+struct adc_sample {
+	__u64 timestamp_ns;
+	__u32 seq;
+	__u32 mask;
+	__u16 ch[ADC_NUM_CHANNELS];
+};
+
+/*
+ * ADC_IOC_SET_CHMASK - Select the channels returned by read().
+ *
+ * 0 (the default) selects offset mode: read() returns consecutive 32-bit
+ * channel registers starting at the file offset, up to 32 bytes per call.
+ *
+ * A non-zero mask selects packed mode: every read() returns one 32-bit value
+ * per set bit, lowest channel first, sampled back-to-back under the device
+ * lock. The file offset is ignored and not advanced, so a consumer can read
+ * the same record over and over without seeking.
+ */
+#define ADC_IOC_SET_CHMASK	_IOW(ADC_IOC_MAGIC, 1, __u32)
+#define ADC_IOC_GET_CHMASK	_IOR(ADC_IOC_MAGIC, 2, __u32)
+
+#endif /* DE10NANO_ADC_H */
@@ -0,0 +1,283 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * IIO front end for the DE10-Nano LTC2308 ADC.
+ *
+ * This is an alternative to de10nano_adc.ko that binds to the same device
+ * tree node but registers with the IIO subsystem instead of inventing its own
+ * sysfs layout. Load one or the other, not both.
+ *
+ * Channels show up as in_voltage0_raw .. in_voltage7_raw plus a shared
+ * in_voltage_scale (mV per LSB). Buffered capture works with any IIO trigger,
+ * e.g. iio-trig-hrtimer or iio-trig-sysfs, and streams through
+ * /dev/iio:deviceN so libiio / iio_readdev can be used directly.
+ */
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/mod_devicetable.h>
+#include <linux/types.h>
+#include <linux/bitops.h>
+#include <linux/regmap.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#define FPGA_TRACE_SYSTEM adc_iio
+#include "fpga_regmap.h"
+#include "fpga_instance.h"
+
+#define CREATE_TRACE_POINTS
+#include "fpga_trace.h"
+
+#define ADC_NUM_CHANNELS 8
+
+// ADC values are in the 12 least-significant bits of the registers
+#define ADC_RESOLUTION_BITS 12
+#define ADC_VALUE_BITMASK 0xfff
+
+/*
+ * The LTC2308's unipolar input range is 0 to VREFCOMP = 4.096 V (not the 5 V
+ * the Intel UP documentation claims; see README.md), so one LSB is 1 mV.
+ */
+#define ADC_VREF_MV 4096
+
+/**
+ * struct adc_iio_dev - Private IIO adc device struct.
+ * @regs: The channel registers
+ * @inst: Instance number; the IIO label is "adcN"
+ * @stats: Op counters and latency histograms, see fpga_stats.h
+ * @scan: Buffer for one triggered scan; the timestamp has to be 8-byte
+ *        aligned after the packed channel values.
+ */
+struct adc_iio_dev {
+	struct fpga_regmap regs;
+	struct fpga_instance inst;
+	struct fpga_stats stats;
+	struct {
+		u16 ch[ADC_NUM_CHANNELS];
+		s64 timestamp __aligned(8);
+	} scan;
+};
+
+// Instance numbers, shared numbering scheme with de10nano_adc.ko
+static DEFINE_IDA(adc_iio_ida);
+
+static bool adc_iio_writeable_reg(struct device *dev, unsigned int reg)
+{
+	return false;
+}
+
+// Channels are read-only and change on their own: no cache
+static const struct regmap_config adc_iio_regmap_config = {
+	FPGA_REGMAP_COMMON,
+	.name = "adc",
+	.max_register = (ADC_NUM_CHANNELS - 1) * sizeof(u32),
+	.writeable_reg = adc_iio_writeable_reg,
+	.cache_type = REGCACHE_NONE,
+};
+
+#define ADC_IIO_CHAN(_index) {					\
+	.type = IIO_VOLTAGE,					\
+	.indexed = 1,						\
+	.channel = (_index),					\
+	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),		\
+	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),	\
+	.scan_index = (_index),					\
+	.scan_type = {						\
+		.sign = 'u',					\
+		.realbits = ADC_RESOLUTION_BITS,		\
+		.storagebits = 16,				\
+		.endianness = IIO_CPU,				\
+	},							\
+}
+
+static const struct iio_chan_spec adc_iio_channels[] = {
+	ADC_IIO_CHAN(0),
+	ADC_IIO_CHAN(1),
+	ADC_IIO_CHAN(2),
+	ADC_IIO_CHAN(3),
+	ADC_IIO_CHAN(4),
+	ADC_IIO_CHAN(5),
+	ADC_IIO_CHAN(6),
+	ADC_IIO_CHAN(7),
+	IIO_CHAN_SOFT_TIMESTAMP(ADC_NUM_CHANNELS),
+};
+
+/**
+ * adc_iio_read_raw() - Read a channel value or the shared scale
+ * @indio_dev: The IIO device.
+ * @chan: Channel being read.
+ * @val: First part of the returned value.
+ * @val2: Second part of the returned value.
+ * @mask: Which IIO_CHAN_INFO_* is being read.
+ *
+ * Return: An IIO_VAL_* format code on success, a negative error otherwise.
+ */
+static int adc_iio_read_raw(struct iio_dev *indio_dev,
+	struct iio_chan_spec const *chan, int *val, int *val2, long mask)
+{
+	struct adc_iio_dev *priv = iio_priv(indio_dev);
+	unsigned int raw;
+	u64 t0;
+	int ret;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		// Timed like the sysfs shows of de10nano_adc.ko
+		t0 = fpga_op_begin(&priv->stats);
+		ret = regmap_read(priv->regs.map, chan->channel * sizeof(u32),
+			&raw);
+		fpga_op_end(&priv->stats, FPGA_OP_SHOW, "in_voltage_raw", t0,
+			ret);
+		if (ret)
+			return ret;
+		*val = raw & ADC_VALUE_BITMASK;
+		return IIO_VAL_INT;
+
+	case IIO_CHAN_INFO_SCALE:
+		// mV per LSB = VREF / 2^12
+		*val = ADC_VREF_MV;
+		*val2 = ADC_RESOLUTION_BITS;
+		return IIO_VAL_FRACTIONAL_LOG2;
+
+	default:
+		return -EINVAL;
+	}
+}
+
+static const struct iio_info adc_iio_info = {
+	.read_raw = adc_iio_read_raw,
+};
+
+/**
+ * adc_iio_trigger_handler() - Capture one scan for the triggered buffer
+ * @irq: Unused.
+ * @p: The poll function that fired.
+ *
+ * Reads all channel registers in one regmap_bulk_read() and pushes the ones
+ * enabled in the active scan mask, packed, along with the trigger timestamp.
+ *
+ * Return: IRQ_HANDLED.
+ */
+static irqreturn_t adc_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct adc_iio_dev *priv = iio_priv(indio_dev);
+	u32 vals[ADC_NUM_CHANNELS];
+	unsigned int bit;
+	unsigned int i = 0;
+
+	if (regmap_bulk_read(priv->regs.map, 0, vals, ADC_NUM_CHANNELS))
+		goto done;
+
+	iio_for_each_active_channel(indio_dev, bit)
+		priv->scan.ch[i++] = vals[bit] & ADC_VALUE_BITMASK;
+
+	iio_push_to_buffers_with_timestamp(indio_dev, &priv->scan, pf->timestamp);
+done:
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * adc_iio_probe() - Initialize device when a match is found
+ * @pdev: Platform device structure associated with our adc device.
+ *
+ * Return: 0 on success, a negative error value otherwise.
+ */
+static int adc_iio_probe(struct platform_device *pdev)
+{
+	struct iio_dev *indio_dev;
+	struct adc_iio_dev *priv;
+	int ret;
+
+	indio_dev = devm_iio_device_alloc(&pdev->dev, sizeof(*priv));
+	if (!indio_dev) {
+		pr_err("Failed to allocate memory\n");
+		return -ENOMEM;
+	}
+	priv = iio_priv(indio_dev);
+
+	ret = fpga_instance_init(&pdev->dev, &adc_iio_ida, "adc", "adc",
+		&priv->inst);
+	if (ret) {
+		pr_err("Failed to get an adc instance number\n");
+		return ret;
+	}
+
+	// Counters and histograms under /sys/kernel/debug/adcN
+	ret = fpga_stats_init(&pdev->dev, &priv->stats, priv->inst.name);
+	if (ret)
+		return ret;
+
+	ret = fpga_regmap_init(pdev, 0, &adc_iio_regmap_config, &priv->stats,
+		&priv->regs);
+	if (ret) {
+		pr_err("Failed to map adc registers\n");
+		return ret;
+	}
+
+	indio_dev->name = "de10nano_adc";
+	// iio:deviceX/label tells several ADCs apart
+	indio_dev->label = priv->inst.name;
+	indio_dev->info = &adc_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = adc_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(adc_iio_channels);
+
+	/*
+	 * iio_pollfunc_store_time grabs the timestamp in the trigger's top half,
+	 * our handler does the register reads in the threaded bottom half.
+	 */
+	ret = devm_iio_triggered_buffer_setup(&pdev->dev, indio_dev,
+		iio_pollfunc_store_time, adc_iio_trigger_handler, NULL);
+	if (ret) {
+		pr_err("Failed to set up triggered buffer\n");
+		return ret;
+	}
+
+	ret = devm_iio_device_register(&pdev->dev, indio_dev);
+	if (ret) {
+		pr_err("Failed to register iio device\n");
+		return ret;
+	}
+
+	pr_info("adc_iio_probe successful\n");
+
+	return 0;
+}
+
+/*
+ * Same compatible string as de10nano_adc.ko: this is a drop-in replacement.
+ */
+static const struct of_device_id adc_iio_of_match[] = {
+	{ .compatible = "weizenegger,de10nano_adc", },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, adc_iio_of_match);
+
+/**
+ * struct adc_iio_driver - Platform driver struct for the IIO adc driver
+ * @probe: Function that's called when a device is found
+ * @driver.name: Name of the driver
+ * @driver.of_match_table: Device tree match table
+ *
+ * Everything is devm-managed, so there is no remove callback.
+ */
+static struct platform_driver adc_iio_driver = {
+	.probe = adc_iio_probe,
+	.driver = {
+		.owner = THIS_MODULE,
+		.name = "adc_iio",
+		.of_match_table = adc_iio_of_match,
+	},
+};
+
+module_platform_driver(adc_iio_driver);
+
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Benton Weizenegger");
+MODULE_DESCRIPTION("de10nano adc IIO driver");
+MODULE_VERSION("1.0");
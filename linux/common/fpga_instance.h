@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Instance numbering for the FPGA peripheral drivers.
+ *
+ * soc_system.qsys can hold several copies of a peripheral, each with its own
+ * device tree node. Every copy gets a number N and its char device is named
+ * <name>N (/dev/rgb_pwm0, /dev/rgb_pwm1, ...). The number comes from a device
+ * tree alias when there is one, so it stays the same across boots and probe
+ * orders:
+ *
+ *	aliases {
+ *		rgb-pwm0 = &rgb_pwm;
+ *		rgb-pwm1 = &rgb_pwm_b;
+ *	};
+ *
+ * Nodes without an alias get the lowest free number above every alias.
+ * Userspace enumerates instances through /sys/class/misc/<name>N; the
+ * device link there leads to the platform device and its attributes.
+ */
+#ifndef FPGA_INSTANCE_H
+#define FPGA_INSTANCE_H
+
+#include <linux/device.h>
+#include <linux/idr.h>
+#include <linux/minmax.h>
+#include <linux/of.h>
+
+/**
+ * struct fpga_instance - Number and name of one peripheral copy
+ * @ida: The driver's number allocator
+ * @id: Instance number
+ * @name: "<name><id>", used for the misc device
+ */
+struct fpga_instance {
+	struct ida *ida;
+	int id;
+	const char *name;
+};
+
+static inline void fpga_instance_release(void *data)
+{
+	struct fpga_instance *inst = data;
+
+	ida_free(inst->ida, inst->id);
+}
+
+/**
+ * fpga_instance_init() - Number and name a new device
+ * @dev: The platform device.
+ * @ida: The driver's allocator, one per driver (DEFINE_IDA).
+ * @alias: Device tree alias stem, e.g. "rgb-pwm" (aliases can't use '_').
+ * @name: Name stem, e.g. "rgb_pwm".
+ * @inst: Filled in on success.
+ *
+ * The number is released when @dev is unbound.
+ *
+ * Return: 0 on success, -EBUSY if the aliased number is already taken, or
+ * another negative error value.
+ */
+static inline int fpga_instance_init(struct device *dev, struct ida *ida,
+	const char *alias, const char *name, struct fpga_instance *inst)
+{
+	int id;
+
+	id = of_alias_get_id(dev->of_node, alias);
+	if (id >= 0)
+		id = ida_alloc_range(ida, id, id, GFP_KERNEL);
+	else
+		id = ida_alloc_min(ida, max(of_alias_get_highest_id(alias) + 1, 0),
+			GFP_KERNEL);
+	if (id == -ENOSPC)
+		return -EBUSY;
+	if (id < 0)
+		return id;
+
+	inst->ida = ida;
+	inst->id = id;
+
+	id = devm_add_action_or_reset(dev, fpga_instance_release, inst);
+	if (id)
+		return id;
+
+	inst->name = devm_kasprintf(dev, GFP_KERNEL, "%s%d", name, inst->id);
+	if (!inst->name)
+		return -ENOMEM;
+
+	return 0;
+}
+
+#endif /* FPGA_INSTANCE_H */
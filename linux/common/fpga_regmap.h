@@ -0,0 +1,475 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Shared regmap plumbing for the FPGA peripheral drivers.
+ *
+ * Every peripheral is a small block of 32-bit registers on the lightweight
+ * HPS-to-FPGA bridge, exposed through sysfs, a misc char device that reads
+ * and writes registers at the file offset, and mmap. This header covers the
+ * parts that used to be copied into each driver:
+ *   - mapping a reg window and wrapping it in a regmap (fpga_regmap_init)
+ *   - timed register accessors feeding fpga_stats.h and the fpga_reg_*
+ *     tracepoints
+ *   - char device offset checks and bulk register transfers
+ *     (fpga_regmap_count, fpga_regmap_read_user, fpga_regmap_write_user)
+ *   - mmap of the register page (fpga_regmap_mmap)
+ *
+ * Each driver picks the cache policy per register in its regmap_config:
+ * registers that only change when we write them (duties, period, LED
+ * pattern, irq enable) are cached so sysfs reads don't cross the bridge;
+ * registers the hardware changes (ADC channels, button status, commit
+ * pending) are volatile. The regmap lock serializes register access, and
+ * regmap_multi_reg_write() / regmap_bulk_*() make multi-register updates a
+ * single locked call. With CONFIG_DEBUG_FS, every window also shows up under
+ * /sys/kernel/debug/regmap/.
+ *
+ * All windows use fast_io (a spinlock), so registers can be accessed from
+ * timer and interrupt context.
+ *
+ * Userspace stores through mmap() bypass the regmap, so the cache is
+ * bypassed while a window has live mappings and dropped when the last one
+ * goes away. Mappings are zapped when the device goes away. A mapping covers whole pages, so when a window shares its page
+ * with other peripherals only CAP_SYS_RAWIO may map it writable: their
+ * registers, and their drivers' caches, are outside this window's reach.
+ *
+ * The regmap's reg_read/reg_write are plain readl()/writel(), like
+ * regmap-mmio's, wrapped so every access that reaches the bridge can be
+ * counted and traced. The kernel must be built with CONFIG_REGMAP.
+ */
+#ifndef FPGA_REGMAP_H
+#define FPGA_REGMAP_H
+
+#include <linux/platform_device.h>
+#include <linux/capability.h>
+#include <linux/regmap.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/minmax.h>
+#include <linux/io.h>
+
+#include "fpga_stats.h"
+
+#define FPGA_REG_BYTES		4
+
+/*
+ * Largest window: the ADC filter's 0x80 span. Bulk transfers use on-stack
+ * buffers of this many registers.
+ */
+#define FPGA_REGMAP_MAX_REGS	32
+
+/* regmap_config fields every window shares */
+#define FPGA_REGMAP_COMMON			\
+	.reg_bits = 32,				\
+	.val_bits = 32,				\
+	.reg_stride = FPGA_REG_BYTES,		\
+	.fast_io = true
+
+struct fpga_regmap;
+
+/* A char device inode a window was mmapped through */
+struct fpga_regmap_inode {
+	struct list_head node;
+	struct inode *inode;
+};
+
+/**
+ * struct fpga_regmap_mmap - Userspace mapping state of a register window
+ * @ref: Held by the window and by every vma
+ * @lock: Serializes everything below with the cache bypass switch
+ * @regs: The window, NULL once the device is gone
+ * @mappings: Live userspace mappings; the cache is bypassed while non-zero
+ * @inodes: Pinned inodes the window was mmapped through, zapped on teardown
+ */
+struct fpga_regmap_mmap {
+	struct kref ref;
+	struct mutex lock;
+	struct fpga_regmap *regs;
+	unsigned int mappings;
+	struct list_head inodes;
+};
+
+/**
+ * struct fpga_regmap - One register window of an FPGA peripheral
+ * @map: regmap over the window
+ * @base: The mapped registers
+ * @window: Window name for tracepoints, from the regmap_config
+ * @stats: The owning device's counters
+ * @res: Physical region, used by mmap
+ * @span: Bytes of registers reachable through the char device
+ * @mmap: Userspace mapping state, may outlive the window
+ */
+struct fpga_regmap {
+	struct regmap *map;
+	void __iomem *base;
+	const char *window;
+	struct fpga_stats *stats;
+	struct resource *res;
+	unsigned int span;
+	struct fpga_regmap_mmap *mmap;
+};
+
+static inline int fpga_regmap_reg_read(void *context, unsigned int reg,
+	unsigned int *val)
+{
+	struct fpga_regmap *regs = context;
+	u64 t0, ns;
+
+	if (!fpga_stats_enabled(regs->stats) && !trace_fpga_reg_read_enabled()) {
+		*val = readl(regs->base + reg);
+		return 0;
+	}
+
+	t0 = ktime_get_ns();
+	*val = readl(regs->base + reg);
+	ns = ktime_get_ns() - t0;
+
+	trace_fpga_reg_read(regs->stats->name, regs->window, reg, *val, ns);
+	if (fpga_stats_enabled(regs->stats))
+		fpga_stats_add(regs->stats, FPGA_OP_REG_READ, ns, false);
+
+	return 0;
+}
+
+static inline int fpga_regmap_reg_write(void *context, unsigned int reg,
+	unsigned int val)
+{
+	struct fpga_regmap *regs = context;
+	u64 t0, ns;
+
+	if (!fpga_stats_enabled(regs->stats) && !trace_fpga_reg_write_enabled()) {
+		writel(val, regs->base + reg);
+		return 0;
+	}
+
+	t0 = ktime_get_ns();
+	writel(val, regs->base + reg);
+	ns = ktime_get_ns() - t0;
+
+	trace_fpga_reg_write(regs->stats->name, regs->window, reg, val, ns);
+	if (fpga_stats_enabled(regs->stats))
+		fpga_stats_add(regs->stats, FPGA_OP_REG_WRITE, ns, false);
+
+	return 0;
+}
+
+/*
+ * Userspace mappings can outlive the device: a sysfs unbind frees the devm
+ * state while a process still has the registers mapped. The mmap state is
+ * therefore refcounted by the window and every vma. On teardown the window
+ * detaches from it and zaps the mappings through the char device inodes
+ * that were mmapped, so later accesses fault (SIGBUS) instead of reaching
+ * the hardware, and vma close no longer touches the freed regmap.
+ */
+static inline void fpga_regmap_mmap_release(struct kref *ref)
+{
+	struct fpga_regmap_mmap *mm = container_of(ref, struct fpga_regmap_mmap,
+		ref);
+
+	mutex_destroy(&mm->lock);
+	kfree(mm);
+}
+
+static inline void fpga_regmap_vma_open(struct vm_area_struct *vma)
+{
+	struct fpga_regmap_mmap *mm = vma->vm_private_data;
+
+	kref_get(&mm->ref);
+	mutex_lock(&mm->lock);
+	if (mm->regs && mm->mappings++ == 0)
+		regcache_cache_bypass(mm->regs->map, true);
+	mutex_unlock(&mm->lock);
+}
+
+static inline void fpga_regmap_vma_close(struct vm_area_struct *vma)
+{
+	struct fpga_regmap_mmap *mm = vma->vm_private_data;
+	struct fpga_regmap *regs;
+
+	mutex_lock(&mm->lock);
+	regs = mm->regs;
+	if (regs && --mm->mappings == 0) {
+		// userspace may have changed anything; re-read on next access
+		regcache_drop_region(regs->map, 0, regs->span - FPGA_REG_BYTES);
+		regcache_cache_bypass(regs->map, false);
+	}
+	mutex_unlock(&mm->lock);
+	kref_put(&mm->ref, fpga_regmap_mmap_release);
+}
+
+static const struct vm_operations_struct fpga_regmap_vm_ops = {
+	.open = fpga_regmap_vma_open,
+	.close = fpga_regmap_vma_close,
+};
+
+/*
+ * devm action, runs before the regmap is freed: detach the window from its
+ * mappings and zap them. The inodes were pinned when first mmapped.
+ */
+static inline void fpga_regmap_mmap_teardown(void *data)
+{
+	struct fpga_regmap_mmap *mm = data;
+	struct fpga_regmap_inode *node, *tmp;
+	LIST_HEAD(inodes);
+
+	mutex_lock(&mm->lock);
+	mm->regs = NULL;
+	list_splice_init(&mm->inodes, &inodes);
+	mutex_unlock(&mm->lock);
+
+	list_for_each_entry_safe(node, tmp, &inodes, node) {
+		unmap_mapping_range(node->inode->i_mapping, 0, 0, 1);
+		iput(node->inode);
+		kfree(node);
+	}
+
+	kref_put(&mm->ref, fpga_regmap_mmap_release);
+}
+
+/*
+ * Pin the inode a mapping goes through, once per inode, so teardown can zap
+ * it. Called with mm->lock held.
+ */
+static inline int fpga_regmap_track_inode(struct fpga_regmap_mmap *mm,
+	struct inode *inode)
+{
+	struct fpga_regmap_inode *node;
+
+	list_for_each_entry(node, &mm->inodes, node) {
+		if (node->inode == inode)
+			return 0;
+	}
+
+	node = kmalloc(sizeof(*node), GFP_KERNEL);
+	if (!node)
+		return -ENOMEM;
+
+	ihold(inode);
+	node->inode = inode;
+	list_add(&node->node, &mm->inodes);
+	return 0;
+}
+
+/**
+ * fpga_regmap_init() - Map a reg window and create its regmap
+ * @pdev: Platform device that owns the window.
+ * @index: Which reg entry of the device tree node.
+ * @config: Register layout and cache policy.
+ * @stats: Counters that register accesses are accounted to; must already
+ *         be set up with fpga_stats_init().
+ * @regs: Filled in on success.
+ *
+ * Everything is devm-managed. The reg entry must cover every register of
+ * @config.
+ *
+ * Return: 0 on success, a negative error value otherwise.
+ */
+static inline int fpga_regmap_init(struct platform_device *pdev,
+	unsigned int index, const struct regmap_config *config,
+	struct fpga_stats *stats, struct fpga_regmap *regs)
+{
+	struct regmap_config cfg = *config;
+
+	if (config->max_register / FPGA_REG_BYTES >= FPGA_REGMAP_MAX_REGS)
+		return -EINVAL;
+
+	regs->base = devm_platform_get_and_ioremap_resource(pdev, index,
+		&regs->res);
+	if (IS_ERR(regs->base))
+		return PTR_ERR(regs->base);
+
+	if (resource_size(regs->res) < config->max_register + FPGA_REG_BYTES) {
+		dev_err(&pdev->dev, "%s: reg %u spans %pR, needs %u bytes\n",
+			config->name, index, regs->res,
+			config->max_register + FPGA_REG_BYTES);
+		return -EINVAL;
+	}
+
+	regs->window = config->name;
+	regs->stats = stats;
+
+	cfg.reg_read = fpga_regmap_reg_read;
+	cfg.reg_write = fpga_regmap_reg_write;
+	regs->map = devm_regmap_init(&pdev->dev, NULL, regs, &cfg);
+	if (IS_ERR(regs->map))
+		return PTR_ERR(regs->map);
+
+	regs->span = config->max_register + FPGA_REG_BYTES;
+
+	regs->mmap = kzalloc(sizeof(*regs->mmap), GFP_KERNEL);
+	if (!regs->mmap)
+		return -ENOMEM;
+	kref_init(&regs->mmap->ref);
+	mutex_init(&regs->mmap->lock);
+	INIT_LIST_HEAD(&regs->mmap->inodes);
+	regs->mmap->regs = regs;
+
+	// registered after the regmap, so it runs before the regmap is freed
+	return devm_add_action_or_reset(&pdev->dev, fpga_regmap_mmap_teardown,
+		regs->mmap);
+}
+
+/**
+ * fpga_regmap_count() - Check a char device access and size it
+ * @regs: The register window.
+ * @count: Bytes requested.
+ * @offset: File offset, the byte address of the first register.
+ *
+ * Return: The number of whole registers to transfer, 0 at end of file, or
+ * -EINVAL for a negative/unaligned offset or less than one register.
+ */
+static inline ssize_t fpga_regmap_count(const struct fpga_regmap *regs,
+	size_t count, loff_t offset)
+{
+	if (offset < 0 || offset % FPGA_REG_BYTES)
+		return -EINVAL;
+	if (offset >= regs->span)
+		return 0;
+
+	count = min_t(size_t, count, regs->span - offset) / FPGA_REG_BYTES;
+	return count ? count : -EINVAL;
+}
+
+/**
+ * fpga_regmap_read_user() - Char device read of consecutive registers
+ * @regs: The register window.
+ * @buf: User-space buffer.
+ * @count: Bytes requested; only whole registers are returned.
+ * @offset: File offset; advanced past the registers read.
+ *
+ * All registers are read in one regmap_bulk_read(), so cached registers
+ * cost no bus cycles and the values are read under one lock.
+ *
+ * Return: Bytes read, or a negative error value.
+ */
+static inline ssize_t fpga_regmap_read_user(struct fpga_regmap *regs,
+	char __user *buf, size_t count, loff_t *offset)
+{
+	u32 vals[FPGA_REGMAP_MAX_REGS];
+	ssize_t n;
+	int ret;
+
+	n = fpga_regmap_count(regs, count, *offset);
+	if (n <= 0)
+		return n;
+
+	ret = regmap_bulk_read(regs->map, *offset, vals, n);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(buf, vals, n * FPGA_REG_BYTES))
+		return -EFAULT;
+
+	*offset += n * FPGA_REG_BYTES;
+	return n * FPGA_REG_BYTES;
+}
+
+/**
+ * fpga_regmap_write_user() - Char device write of consecutive registers
+ * @regs: The register window.
+ * @buf: User-space buffer.
+ * @count: Bytes to write; only whole registers are written.
+ * @offset: File offset; advanced past the registers written.
+ *
+ * Return: Bytes written, or a negative error value (-EIO if the range
+ * includes a register the regmap_config doesn't mark writeable).
+ */
+static inline ssize_t fpga_regmap_write_user(struct fpga_regmap *regs,
+	const char __user *buf, size_t count, loff_t *offset)
+{
+	u32 vals[FPGA_REGMAP_MAX_REGS];
+	ssize_t n;
+	int ret;
+
+	n = fpga_regmap_count(regs, count, *offset);
+	if (n <= 0)
+		return n;
+
+	if (copy_from_user(vals, buf, n * FPGA_REG_BYTES))
+		return -EFAULT;
+
+	ret = regmap_bulk_write(regs->map, *offset, vals, n);
+	if (ret)
+		return ret;
+
+	*offset += n * FPGA_REG_BYTES;
+	return n * FPGA_REG_BYTES;
+}
+
+/**
+ * fpga_regmap_shares_page() - Check if a window's pages hold other registers
+ * @regs: The register window.
+ *
+ * The region is requested exclusively, so a window that starts on a page
+ * boundary and covers whole pages has them to itself.
+ *
+ * Return: true if a mapping of the window reaches past its own registers.
+ */
+static inline bool fpga_regmap_shares_page(const struct fpga_regmap *regs)
+{
+	return offset_in_page(regs->res->start) ||
+		offset_in_page(resource_size(regs->res));
+}
+
+/**
+ * fpga_regmap_mmap() - Map the page holding a register window
+ * @regs: The register window.
+ * @vma: The userspace mapping being created.
+ * @writable: false for windows userspace may only read; the mapping is
+ *            then read-only and mprotect() can't upgrade it.
+ *
+ * The mapping is uncached. The registers start at (physical base &
+ * ~PAGE_MASK) within it. A writable window that shares its page with other
+ * peripherals is only mapped writable for CAP_SYS_RAWIO, and read-only for
+ * everyone else. The mapping is zapped when the device goes away.
+ *
+ * Return: 0 on success, -EPERM for a refused PROT_WRITE mapping, another
+ * negative error value otherwise.
+ */
+static inline int fpga_regmap_mmap(struct fpga_regmap *regs,
+	struct vm_area_struct *vma, bool writable)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	phys_addr_t page = regs->res->start & PAGE_MASK;
+	unsigned long span = PAGE_ALIGN(offset_in_page(regs->res->start) +
+		resource_size(regs->res));
+	struct fpga_regmap_mmap *mm = regs->mmap;
+	int ret;
+
+	if (vma->vm_pgoff != 0 || size > span)
+		return -EINVAL;
+
+	// stores could reach the neighbours' registers behind their drivers
+	if (writable && fpga_regmap_shares_page(regs) && !capable(CAP_SYS_RAWIO))
+		writable = false;
+
+	if (!writable) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vm_flags_clear(vma, VM_MAYWRITE);
+	}
+
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	// held across the remap so teardown either refuses or zaps it
+	mutex_lock(&mm->lock);
+	ret = mm->regs ? fpga_regmap_track_inode(mm, file_inode(vma->vm_file)) :
+		-ENODEV;
+	if (!ret)
+		ret = io_remap_pfn_range(vma, vma->vm_start, page >> PAGE_SHIFT,
+			size, vma->vm_page_prot);
+	mutex_unlock(&mm->lock);
+	if (ret)
+		return ret;
+
+	// .open isn't called for the first mapping
+	vma->vm_ops = &fpga_regmap_vm_ops;
+	vma->vm_private_data = mm;
+	fpga_regmap_vma_open(vma);
+	return 0;
+}
+
+#endif /* FPGA_REGMAP_H */
@@ -0,0 +1,370 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Operation counters and latency histograms for the FPGA peripheral drivers.
+ *
+ * Every device keeps, per kind of operation (register read/write over the
+ * bridge, sysfs show/store, char device read/write/ioctl/mmap), a count, an
+ * error count, the total and worst time, and a log2 histogram of the time
+ * taken. They live in debugfs under the device's instance name:
+ *
+ *	/sys/kernel/debug/rgb_pwm0/enable	1 to start collecting (default 0)
+ *	/sys/kernel/debug/rgb_pwm0/stats	per-op table; write to reset
+ *	/sys/kernel/debug/rgb_pwm0/histogram	per-op log2(ns) buckets
+ *
+ * Collection is off by default, so an untraced register access only adds a
+ * flag check. With it (or the matching tracepoint, see fpga_trace.h) on,
+ * every operation costs two ktime_get_ns() calls and a few atomic adds. Times are
+ * wall clock, so a char device read that blocks waiting for data counts the
+ * wait, and register times include any contention on the bridge.
+ *
+ * Sysfs attributes and file operations are timed by wrapping them:
+ * FPGA_DEVICE_ATTR_RW(red, rgb_pwm_stats) is DEVICE_ATTR_RW(red) with
+ * red_show()/red_store() timed, and FPGA_STATS_READ(rgb_pwm_read,
+ * rgb_pwm_stats) defines rgb_pwm_read_timed() for the file_operations.
+ * The lookup function takes the platform device and returns its stats, so
+ * drvdata must be set before the misc device is registered.
+ */
+#ifndef FPGA_STATS_H
+#define FPGA_STATS_H
+
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/seq_file.h>
+
+#include "fpga_trace.h"
+
+enum fpga_op {
+	FPGA_OP_REG_READ,
+	FPGA_OP_REG_WRITE,
+	FPGA_OP_SHOW,
+	FPGA_OP_STORE,
+	FPGA_OP_READ,
+	FPGA_OP_WRITE,
+	FPGA_OP_IOCTL,
+	FPGA_OP_MMAP,
+	FPGA_NUM_OPS,
+};
+
+static const char *const fpga_op_names[FPGA_NUM_OPS] = {
+	[FPGA_OP_REG_READ] = "reg_read",
+	[FPGA_OP_REG_WRITE] = "reg_write",
+	[FPGA_OP_SHOW] = "show",
+	[FPGA_OP_STORE] = "store",
+	[FPGA_OP_READ] = "read",
+	[FPGA_OP_WRITE] = "write",
+	[FPGA_OP_IOCTL] = "ioctl",
+	[FPGA_OP_MMAP] = "mmap",
+};
+
+/* Bucket i counts [2^i, 2^(i+1)) ns; the last one everything from ~2 s up */
+#define FPGA_STATS_BUCKETS	32
+
+/**
+ * struct fpga_op_stats - Counters for one kind of operation
+ * @count: Operations seen
+ * @errors: Operations that returned a negative value
+ * @total_ns: Time spent in all of them
+ * @max_ns: The slowest one
+ * @hist: log2 histogram of the time taken
+ */
+struct fpga_op_stats {
+	atomic64_t count;
+	atomic64_t errors;
+	atomic64_t total_ns;
+	atomic64_t max_ns;
+	atomic64_t hist[FPGA_STATS_BUCKETS];
+};
+
+/**
+ * struct fpga_stats - Counters for one device
+ * @name: Instance name, used for the debugfs directory and tracepoints
+ * @enabled: Collect counters; toggled through debugfs
+ * @dir: debugfs directory
+ * @op: Counters, indexed by enum fpga_op
+ */
+struct fpga_stats {
+	const char *name;
+	bool enabled;
+	struct dentry *dir;
+	struct fpga_op_stats op[FPGA_NUM_OPS];
+};
+
+static inline bool fpga_stats_enabled(const struct fpga_stats *stats)
+{
+	return READ_ONCE(stats->enabled);
+}
+
+/* Account one operation; safe from any context */
+static inline void fpga_stats_add(struct fpga_stats *stats, enum fpga_op op,
+	u64 ns, bool error)
+{
+	struct fpga_op_stats *s = &stats->op[op];
+	unsigned int bucket = ns ? min_t(unsigned int, ilog2(ns),
+		FPGA_STATS_BUCKETS - 1) : 0;
+	s64 max = atomic64_read(&s->max_ns);
+
+	atomic64_inc(&s->count);
+	if (error)
+		atomic64_inc(&s->errors);
+	atomic64_add(ns, &s->total_ns);
+	atomic64_inc(&s->hist[bucket]);
+
+	while ((s64)ns > max && !atomic64_try_cmpxchg(&s->max_ns, &max, ns))
+		;
+}
+
+/**
+ * fpga_op_begin() - Start timing a sysfs or char device operation
+ * @stats: The device's counters.
+ *
+ * Return: The start time for fpga_op_end(), or 0 if neither the counters
+ * nor the fpga_op tracepoint are on.
+ */
+static inline u64 fpga_op_begin(const struct fpga_stats *stats)
+{
+	if (!fpga_stats_enabled(stats) && !trace_fpga_op_enabled())
+		return 0;
+
+	return ktime_get_ns();
+}
+
+/**
+ * fpga_op_end() - Account an operation started with fpga_op_begin()
+ * @stats: The device's counters.
+ * @op: What kind of operation it was.
+ * @what: Detail for the tracepoint, e.g. the attribute name, or NULL.
+ * @t0: Return value of fpga_op_begin().
+ * @ret: The operation's return value; negative counts as an error.
+ *
+ * Return: @ret, so it can wrap a return statement.
+ */
+static inline long fpga_op_end(struct fpga_stats *stats, enum fpga_op op,
+	const char *what, u64 t0, long ret)
+{
+	u64 ns;
+
+	if (!t0)
+		return ret;
+
+	ns = ktime_get_ns() - t0;
+	trace_fpga_op(stats->name, fpga_op_names[op], what, ret, ns);
+	if (fpga_stats_enabled(stats))
+		fpga_stats_add(stats, op, ns, ret < 0);
+
+	return ret;
+}
+
+static inline void fpga_stats_clear(struct fpga_stats *stats)
+{
+	struct fpga_op_stats *s;
+	unsigned int i;
+
+	for (s = stats->op; s < stats->op + FPGA_NUM_OPS; s++) {
+		atomic64_set(&s->count, 0);
+		atomic64_set(&s->errors, 0);
+		atomic64_set(&s->total_ns, 0);
+		atomic64_set(&s->max_ns, 0);
+		for (i = 0; i < FPGA_STATS_BUCKETS; i++)
+			atomic64_set(&s->hist[i], 0);
+	}
+}
+
+static inline int fpga_stats_show(struct seq_file *m, void *unused)
+{
+	struct fpga_stats *stats = m->private;
+	unsigned int op;
+
+	seq_printf(m, "%-10s %12s %8s %10s %10s\n",
+		"op", "count", "errors", "avg_ns", "max_ns");
+
+	for (op = 0; op < FPGA_NUM_OPS; op++) {
+		struct fpga_op_stats *s = &stats->op[op];
+		u64 count = atomic64_read(&s->count);
+
+		seq_printf(m, "%-10s %12llu %8llu %10llu %10llu\n",
+			fpga_op_names[op], count, atomic64_read(&s->errors),
+			count ? div64_u64(atomic64_read(&s->total_ns), count) : 0,
+			atomic64_read(&s->max_ns));
+	}
+
+	return 0;
+}
+
+static inline int fpga_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fpga_stats_show, inode->i_private);
+}
+
+/* Any write resets the counters */
+static inline ssize_t fpga_stats_write(struct file *file,
+	const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+
+	fpga_stats_clear(m->private);
+	return count;
+}
+
+static const struct file_operations fpga_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = fpga_stats_open,
+	.read = seq_read,
+	.write = fpga_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static inline int fpga_histogram_show(struct seq_file *m, void *unused)
+{
+	struct fpga_stats *stats = m->private;
+	unsigned int op, i;
+
+	for (op = 0; op < FPGA_NUM_OPS; op++) {
+		struct fpga_op_stats *s = &stats->op[op];
+
+		if (!atomic64_read(&s->count))
+			continue;
+
+		seq_printf(m, "%s:\n", fpga_op_names[op]);
+		for (i = 0; i < FPGA_STATS_BUCKETS; i++) {
+			u64 n = atomic64_read(&s->hist[i]);
+
+			if (n)
+				seq_printf(m, "  %10llu .. %10llu ns: %llu\n",
+					i ? 1ull << i : 0, (2ull << i) - 1, n);
+		}
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fpga_histogram);
+
+static inline void fpga_stats_release(void *data)
+{
+	struct fpga_stats *stats = data;
+
+	debugfs_remove_recursive(stats->dir);
+}
+
+/**
+ * fpga_stats_init() - Set up a device's counters and debugfs files
+ * @dev: The platform device; the files go away when it is unbound.
+ * @stats: Counters to set up, zeroed.
+ * @name: Instance name, e.g. "rgb_pwm0".
+ *
+ * Return: 0 on success, a negative error value otherwise. A missing debugfs
+ * is not an error.
+ */
+static inline int fpga_stats_init(struct device *dev, struct fpga_stats *stats,
+	const char *name)
+{
+	stats->name = name;
+	stats->dir = debugfs_create_dir(name, NULL);
+	debugfs_create_bool("enable", 0600, stats->dir, &stats->enabled);
+	debugfs_create_file("stats", 0600, stats->dir, stats, &fpga_stats_fops);
+	debugfs_create_file("histogram", 0400, stats->dir, stats,
+		&fpga_histogram_fops);
+
+	return devm_add_action_or_reset(dev, fpga_stats_release, stats);
+}
+
+/* The platform device behind one of our misc devices */
+static inline struct device *fpga_stats_file_dev(struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+
+	return misc->parent;
+}
+
+/*
+ * Timed wrappers. _stats is a driver function that maps the platform
+ * device to its struct fpga_stats.
+ */
+#define FPGA_STATS_SHOW(_name, _stats)					\
+static ssize_t _name##_show_timed(struct device *dev,			\
+	struct device_attribute *attr, char *buf)			\
+{									\
+	struct fpga_stats *stats = _stats(dev);				\
+	u64 t0 = fpga_op_begin(stats);					\
+	ssize_t ret = _name##_show(dev, attr, buf);			\
+									\
+	return fpga_op_end(stats, FPGA_OP_SHOW, attr->attr.name, t0, ret); \
+}
+
+#define FPGA_STATS_STORE(_name, _stats)					\
+static ssize_t _name##_store_timed(struct device *dev,			\
+	struct device_attribute *attr, const char *buf, size_t size)	\
+{									\
+	struct fpga_stats *stats = _stats(dev);				\
+	u64 t0 = fpga_op_begin(stats);					\
+	ssize_t ret = _name##_store(dev, attr, buf, size);		\
+									\
+	return fpga_op_end(stats, FPGA_OP_STORE, attr->attr.name, t0, ret); \
+}
+
+#define FPGA_DEVICE_ATTR_RW(_name, _stats)				\
+	FPGA_STATS_SHOW(_name, _stats)					\
+	FPGA_STATS_STORE(_name, _stats)					\
+	static struct device_attribute dev_attr_##_name =		\
+		__ATTR(_name, 0644, _name##_show_timed, _name##_store_timed)
+
+#define FPGA_DEVICE_ATTR_RO(_name, _stats)				\
+	FPGA_STATS_SHOW(_name, _stats)					\
+	static struct device_attribute dev_attr_##_name =		\
+		__ATTR(_name, 0444, _name##_show_timed, NULL)
+
+#define FPGA_DEVICE_ATTR_WO(_name, _stats)				\
+	FPGA_STATS_STORE(_name, _stats)					\
+	static struct device_attribute dev_attr_##_name =		\
+		__ATTR(_name, 0200, NULL, _name##_store_timed)
+
+#define FPGA_STATS_READ(_fn, _stats)					\
+static ssize_t _fn##_timed(struct file *file, char __user *buf,		\
+	size_t count, loff_t *offset)					\
+{									\
+	struct fpga_stats *stats = _stats(fpga_stats_file_dev(file));	\
+	u64 t0 = fpga_op_begin(stats);					\
+	ssize_t ret = _fn(file, buf, count, offset);			\
+									\
+	return fpga_op_end(stats, FPGA_OP_READ, NULL, t0, ret);		\
+}
+
+#define FPGA_STATS_WRITE(_fn, _stats)					\
+static ssize_t _fn##_timed(struct file *file, const char __user *buf,	\
+	size_t count, loff_t *offset)					\
+{									\
+	struct fpga_stats *stats = _stats(fpga_stats_file_dev(file));	\
+	u64 t0 = fpga_op_begin(stats);					\
+	ssize_t ret = _fn(file, buf, count, offset);			\
+									\
+	return fpga_op_end(stats, FPGA_OP_WRITE, NULL, t0, ret);	\
+}
+
+#define FPGA_STATS_IOCTL(_fn, _stats)					\
+static long _fn##_timed(struct file *file, unsigned int cmd,		\
+	unsigned long arg)						\
+{									\
+	struct fpga_stats *stats = _stats(fpga_stats_file_dev(file));	\
+	u64 t0 = fpga_op_begin(stats);					\
+	long ret = _fn(file, cmd, arg);					\
+									\
+	return fpga_op_end(stats, FPGA_OP_IOCTL, NULL, t0, ret);	\
+}
+
+#define FPGA_STATS_MMAP(_fn, _stats)					\
+static int _fn##_timed(struct file *file, struct vm_area_struct *vma)	\
+{									\
+	struct fpga_stats *stats = _stats(fpga_stats_file_dev(file));	\
+	u64 t0 = fpga_op_begin(stats);					\
+	int ret = _fn(file, vma);					\
+									\
+	return fpga_op_end(stats, FPGA_OP_MMAP, NULL, t0, ret);		\
+}
+
+#endif /* FPGA_STATS_H */
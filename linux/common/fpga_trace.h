@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Tracepoints for the FPGA peripheral drivers.
+ *
+ * Every module gets its own trace system, named by FPGA_TRACE_SYSTEM, which
+ * the driver defines before including any of the common headers:
+ *
+ *	#define FPGA_TRACE_SYSTEM rgb_pwm
+ *	#include "fpga_regmap.h"
+ *	...
+ *	#define CREATE_TRACE_POINTS
+ *	#include "fpga_trace.h"
+ *
+ * so the events show up as rgb_pwm:fpga_reg_read, led_bar:fpga_op, ... and
+ * modules loaded side by side don't register the same event twice.
+ *
+ *	fpga_reg_read, fpga_reg_write: one per register access that crosses
+ *		the bridge (cache hits don't), with the time it took
+ *	fpga_op: one per sysfs show/store and char device call, with the
+ *		return value and the time spent in the driver
+ *
+ * e.g. a latency histogram of PWM register writes:
+ *
+ *	echo 'hist:keys=reg:vals=ns' > \
+ *		/sys/kernel/tracing/events/rgb_pwm/fpga_reg_write/trigger
+ */
+#ifndef FPGA_TRACE_SYSTEM
+#error "define FPGA_TRACE_SYSTEM before including fpga_trace.h"
+#endif
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM FPGA_TRACE_SYSTEM
+
+#if !defined(FPGA_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define FPGA_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(fpga_reg,
+
+	TP_PROTO(const char *dev, const char *window, unsigned int reg,
+		unsigned int val, u64 ns),
+
+	TP_ARGS(dev, window, reg, val, ns),
+
+	TP_STRUCT__entry(
+		__string(dev, dev)
+		__string(window, window)
+		__field(unsigned int, reg)
+		__field(unsigned int, val)
+		__field(u64, ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__assign_str(window);
+		__entry->reg = reg;
+		__entry->val = val;
+		__entry->ns = ns;
+	),
+
+	TP_printk("%s %s reg=0x%02x val=0x%08x ns=%llu", __get_str(dev),
+		__get_str(window), __entry->reg, __entry->val, __entry->ns)
+);
+
+DEFINE_EVENT(fpga_reg, fpga_reg_read,
+	TP_PROTO(const char *dev, const char *window, unsigned int reg,
+		unsigned int val, u64 ns),
+	TP_ARGS(dev, window, reg, val, ns)
+);
+
+DEFINE_EVENT(fpga_reg, fpga_reg_write,
+	TP_PROTO(const char *dev, const char *window, unsigned int reg,
+		unsigned int val, u64 ns),
+	TP_ARGS(dev, window, reg, val, ns)
+);
+
+TRACE_EVENT(fpga_op,
+
+	TP_PROTO(const char *dev, const char *op, const char *what, long ret,
+		u64 ns),
+
+	TP_ARGS(dev, op, what, ret, ns),
+
+	TP_STRUCT__entry(
+		__string(dev, dev)
+		__string(op, op)
+		__string(what, what ? what : "")
+		__field(long, ret)
+		__field(u64, ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__assign_str(op);
+		__assign_str(what);
+		__entry->ret = ret;
+		__entry->ns = ns;
+	),
+
+	TP_printk("%s %s %s ret=%ld ns=%llu", __get_str(dev), __get_str(op),
+		__get_str(what), __entry->ret, __entry->ns)
+);
+
+#endif /* FPGA_TRACE_H */
+
+/* Found through the -I$(src)/../common every module Makefile adds */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fpga_trace
+#include <trace/define_trace.h>
@@ -1,32 +1,357 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/mod_devicetable.h>
-#include <linux/io.h>
+#include <linux/of.h>
 #include <linux/mutex.h>
 #include <linux/miscdevice.h>
 #include <linux/types.h>
 #include <linux/fs.h>
 #include <linux/kstrtox.h>
+#include <linux/regmap.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/cpumask.h>
+#include <linux/kernel_stat.h>
+#include <linux/tick.h>
+#include <linux/math64.h>
+#include <linux/sched/loadavg.h>
+
+#define FPGA_TRACE_SYSTEM led_bar
+#include "fpga_regmap.h"
+#include "fpga_instance.h"
+#include "led_bar.h"
+
+#define CREATE_TRACE_POINTS
+#include "fpga_trace.h"
 
 #define SW_LED_CONTROL_OFFSET 0
-#define SPAN 16
+#define SEQ_CONTROL_OFFSET 0x04
+#define SEQ_LENGTH_OFFSET 0x08
+#define SEQ_WR_ADDR_OFFSET 0x0C
+#define SEQ_LEVELS_OFFSET 0x10
+#define SEQ_TIME_OFFSET 0x14
+#define SEQ_STATUS_OFFSET 0x18
+#define BRIGHTNESS_OFFSET 0x1C
+
+#define SEQ_RUN 0x1
+#define SEQ_LOOP 0x2
+#define SEQ_SWAP 0x4
+
+#define SEQ_STATUS_FRAME 0xFF
+#define SEQ_STATUS_DONE 0x200
+#define SEQ_STATUS_BITS_SHIFT 16
+#define SEQ_STATUS_BITS_MASK 0xF
+#define SEQ_MAX_FRAME_BITS 8
+
+#define SEQ_MAX_LEVELS 0x3FFFFFFF
+#define SEQ_MAX_MS 0xFFFF
+// Frames per regmap call in the upload path
+#define SEQ_CHUNK 8
+
+#define NUM_LEDS 10
+
+/*
+* Kernel visualizer: in "kernel" mode a delayed work item samples a load
+* metric and writes a bar graph to sw_led_control, so no userspace process
+* is needed. It runs on system_highpri_wq, whose workers are nice -20, so
+* the bar keeps moving when userspace is overloaded. Userspace writes to the
+* pattern register get -EBUSY while it runs, and it stops the sequencer.
+*
+* Sequencer: the FPGA plays frames (per-LED brightness levels and a time in
+* ms) from one bank of its frame RAM while userspace uploads the next
+* sequence to the other bank with a single write() at
+* LED_BAR_FRAMES_OFFSET (see led_bar.h). seq_swap makes the new bank the
+* front one at the next frame boundary. Only nodes that are also
+* compatible with "sdc,led_bar-seq" have the sequencer: older bitstreams
+* decode just the pattern register, and a read past it faults on the
+* bridge, so it is never probed for. Without it the regmap only covers the
+* pattern register, and the seq_* attributes and frame writes return
+* -ENODEV.
+*/
+#define VIS_DEFAULT_RATE 10
+#define VIS_MAX_RATE 100
+
+enum led_bar_mode {
+    LED_BAR_MODE_SOFTWARE,
+    LED_BAR_MODE_KERNEL,
+};
+
+/*
+* nr_running() and nr_processes() aren't exported to modules; avenrun is,
+* and load1 is the decayed number of running + uninterruptible tasks.
+*/
+enum led_bar_metric {
+    LED_BAR_METRIC_LOAD1,
+    LED_BAR_METRIC_LOAD5,
+    LED_BAR_METRIC_CPU,
+    LED_BAR_NUM_METRICS,
+};
+
+static const char *const led_bar_metric_names[LED_BAR_NUM_METRICS] = {
+    [LED_BAR_METRIC_LOAD1] = "load1",
+    [LED_BAR_METRIC_LOAD5] = "load5",
+    [LED_BAR_METRIC_CPU] = "cpu",
+};
 
 /**
 * struct led_patterns_dev - Private led patterns device struct.
-* @base_addr: Pointer to the component's base address
-* @sw_led_control: Address of the sw_led_control register
-* @base_period: Address of the base_period register
-* @led_reg: Address of the led_reg register
+* @regs: The register window; the pattern register is cached
+* @inst: Instance number and char device name (led_barN)
+* @stats: Op counters and latency histograms, see fpga_stats.h
+* @miscdev: miscdevice used to create a character device
+* @lock: Serializes mode/metric/rate changes with pattern writes
+* @vis_work: Kernel visualizer work item
+* @mode: Who drives the LEDs, userspace or the visualizer
+* @metric: What the visualizer shows
+* @rate: Visualizer refresh rate in Hz
+* @pattern: Last pattern the visualizer wrote
+* @cpu_busy: CPU busy time at the previous sample, in ns
+* @cpu_total: CPU busy + idle time at the previous sample, in ns
+* @seq_frames: Frames per sequencer bank, 0 if the FPGA has no sequencer
 *
 * An led_patterns_dev struct gets created for each led patterns component.
 */
 struct led_patterns_dev {
-    void __iomem *base_addr;
-    void __iomem *sw_led_control;
+    struct fpga_regmap regs;
+    struct fpga_instance inst;
+    struct fpga_stats stats;
     struct miscdevice miscdev;
     struct mutex lock;
+    struct delayed_work vis_work;
+    enum led_bar_mode mode;
+    enum led_bar_metric metric;
+    unsigned int rate;
+    u32 pattern;
+    u64 cpu_busy;
+    u64 cpu_total;
+    unsigned int seq_frames;
+};
+
+// Instance numbers, see fpga_instance.h
+static DEFINE_IDA(led_bar_ida);
+
+// Used by the timed sysfs and file operation wrappers
+static struct fpga_stats *led_bar_stats(struct device *dev)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+    return &priv->stats;
+}
+
+/*
+* The pattern, staged levels and brightness registers only change when we
+* write them, so they are cached and sysfs/chardev reads don't cross the
+* bridge. The hardware clears the swap request, steps the write address and
+* swaps which bank the length register reads, and the status and frame time
+* registers have no stored value.
+*/
+static bool led_bar_volatile_reg(struct device *dev, unsigned int reg)
+{
+    switch (reg) {
+    case SEQ_CONTROL_OFFSET:
+    case SEQ_LENGTH_OFFSET:
+    case SEQ_WR_ADDR_OFFSET:
+    case SEQ_TIME_OFFSET:
+    case SEQ_STATUS_OFFSET:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static const struct regmap_config led_bar_seq_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name = "led_bar",
+    .max_register = BRIGHTNESS_OFFSET,
+    .volatile_reg = led_bar_volatile_reg,
+    .cache_type = REGCACHE_MAPLE,
+};
+
+// Bitstreams without the sequencer only have the pattern register
+static const struct regmap_config led_bar_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name = "led_bar",
+    .max_register = SW_LED_CONTROL_OFFSET,
+    .cache_type = REGCACHE_MAPLE,
 };
 
+/**
+* led_bar_seq_control() - Change the sequencer's run and loop bits
+* @priv: LED bar device, with @priv->lock held
+* @clear: SEQ_RUN and/or SEQ_LOOP to clear
+* @set: Bits to set, may include SEQ_SWAP to request a swap
+*
+* The swap bit reads back as pending, so it is never written back: that
+* could request a second swap right after the first one lands.
+*
+* Return: 0 on success, a negative error value otherwise.
+*/
+static int led_bar_seq_control(struct led_patterns_dev *priv, u32 clear,
+    u32 set)
+{
+    unsigned int control;
+    int ret;
+
+    ret = regmap_read(priv->regs.map, SEQ_CONTROL_OFFSET, &control);
+    if (ret)
+        return ret;
+
+    control = (control & (SEQ_RUN | SEQ_LOOP) & ~clear) | set;
+    return regmap_write(priv->regs.map, SEQ_CONTROL_OFFSET, control);
+}
+
+/**
+* led_bar_cpu_times() - Sum busy and total CPU time over online CPUs
+* @busy: Returns user + nice + system + irq + softirq + steal, in ns
+* @total: Returns busy + idle + iowait, in ns
+*
+* Same accounting as the first line of /proc/stat.
+*/
+static void led_bar_cpu_times(u64 *busy, u64 *total)
+{
+    struct kernel_cpustat kcs;
+    u64 idle_sum = 0;
+    u64 busy_sum = 0;
+    u64 idle;
+    int cpu;
+
+    for_each_online_cpu(cpu) {
+        kcpustat_cpu_fetch(&kcs, cpu);
+
+        busy_sum += kcs.cpustat[CPUTIME_USER] + kcs.cpustat[CPUTIME_NICE] +
+            kcs.cpustat[CPUTIME_SYSTEM] + kcs.cpustat[CPUTIME_IRQ] +
+            kcs.cpustat[CPUTIME_SOFTIRQ] + kcs.cpustat[CPUTIME_STEAL];
+
+        // With NO_HZ the idle time lives in the tick code, like /proc/stat
+        idle = get_cpu_idle_time_us(cpu, NULL);
+        if (idle == -1ULL)
+            idle = kcs.cpustat[CPUTIME_IDLE];
+        else
+            idle *= NSEC_PER_USEC;
+        idle_sum += idle + kcs.cpustat[CPUTIME_IOWAIT];
+    }
+
+    *busy = busy_sum;
+    *total = busy_sum + idle_sum;
+}
+
+/**
+* led_bar_sample() - Sample the selected metric
+* @priv: LED bar device
+* @max: Returns the value that lights the whole bar
+*
+* Load averages are returned x100 and fill the bar at one task per online
+* CPU; CPU utilization is in percent since the previous sample.
+*
+* Return: The metric value.
+*/
+static u32 led_bar_sample(struct led_patterns_dev *priv, u32 *max)
+{
+    unsigned long load;
+    u64 busy, total, d_busy, d_total;
+
+    switch (priv->metric) {
+    case LED_BAR_METRIC_CPU:
+        led_bar_cpu_times(&busy, &total);
+        d_busy = busy - priv->cpu_busy;
+        d_total = total - priv->cpu_total;
+        priv->cpu_busy = busy;
+        priv->cpu_total = total;
+        *max = 100;
+        return d_total ? div64_u64(d_busy * 100, d_total) : 0;
+    case LED_BAR_METRIC_LOAD5:
+        load = avenrun[1];
+        break;
+    case LED_BAR_METRIC_LOAD1:
+    default:
+        load = avenrun[0];
+        break;
+    }
+
+    *max = num_online_cpus() * 100;
+    // avenrun is 11-bit fixed point, see fs/proc/loadavg.c
+    return (load * 100 + FIXED_1 / 200) >> FSHIFT;
+}
+
+/**
+* led_bar_vis_work() - Kernel visualizer tick
+* @work: The vis_work member of an led_patterns_dev
+*
+* Writes a bar graph of the metric, rounded to the nearest LED, and only
+* touches the register when the pattern changes.
+*/
+static void led_bar_vis_work(struct work_struct *work)
+{
+    struct led_patterns_dev *priv = container_of(to_delayed_work(work),
+        struct led_patterns_dev, vis_work);
+    u32 value, max, leds, pattern;
+
+    mutex_lock(&priv->lock);
+
+    // mode went back to software while we waited for the lock
+    if (priv->mode != LED_BAR_MODE_KERNEL) {
+        mutex_unlock(&priv->lock);
+        return;
+    }
+
+    value = led_bar_sample(priv, &max);
+    if (value >= max)
+        leds = NUM_LEDS;
+    else
+        leds = (value * NUM_LEDS + max / 2) / max;
+    pattern = (1U << leds) - 1;
+
+    if (pattern != priv->pattern &&
+        !regmap_write(priv->regs.map, SW_LED_CONTROL_OFFSET, pattern)) {
+        priv->pattern = pattern;
+    }
+
+    queue_delayed_work(system_highpri_wq, &priv->vis_work,
+        msecs_to_jiffies(1000 / priv->rate));
+
+    mutex_unlock(&priv->lock);
+}
+
+/**
+* led_bar_vis_start() - Switch to kernel mode and start the visualizer
+* @priv: LED bar device, with @priv->lock held
+*/
+static void led_bar_vis_start(struct led_patterns_dev *priv)
+{
+    if (priv->mode == LED_BAR_MODE_KERNEL)
+        return;
+
+    priv->mode = LED_BAR_MODE_KERNEL;
+    // the pattern register only shows while the sequencer is stopped
+    if (priv->seq_frames)
+        led_bar_seq_control(priv, SEQ_RUN, 0);
+    // force the first write and start the CPU delta from now
+    priv->pattern = U32_MAX;
+    led_bar_cpu_times(&priv->cpu_busy, &priv->cpu_total);
+    queue_delayed_work(system_highpri_wq, &priv->vis_work, 0);
+}
+
+/**
+* led_bar_vis_stop() - Stop the visualizer and hand the LEDs to userspace
+* @priv: LED bar device, with @priv->lock held
+*
+* Drops the lock while waiting for a running tick to finish, since the
+* tick takes it too. If another writer switched back to kernel mode in the
+* meantime, its queued tick was cancelled with ours, so queue it again.
+*/
+static void led_bar_vis_stop(struct led_patterns_dev *priv)
+{
+    if (priv->mode == LED_BAR_MODE_SOFTWARE)
+        return;
+
+    priv->mode = LED_BAR_MODE_SOFTWARE;
+    mutex_unlock(&priv->lock);
+    cancel_delayed_work_sync(&priv->vis_work);
+    mutex_lock(&priv->lock);
+
+    if (priv->mode == LED_BAR_MODE_KERNEL)
+        queue_delayed_work(system_highpri_wq, &priv->vis_work, 0);
+}
+
 /**
 * sw_led_control_show() - Return the sw_led_control value
 * to user-space via sysfs.
@@ -40,10 +365,15 @@ struct led_patterns_dev {
 static ssize_t sw_led_control_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
-    bool sw_control;
+    unsigned int sw_control;
+    int ret;
     // Get the private led_patterns data out of the dev struct
     struct led_patterns_dev *priv = dev_get_drvdata(dev);
-    sw_control = ioread32(priv->sw_led_control);
+    // Served from the register cache
+    ret = regmap_read(priv->regs.map, SW_LED_CONTROL_OFFSET, &sw_control);
+    if (ret) {
+        return ret;
+    }
     return scnprintf(buf, PAGE_SIZE, "%u\n", sw_control);
 }
 /**
@@ -60,51 +390,577 @@ static ssize_t sw_led_control_show(struct device *dev,
 static ssize_t sw_led_control_store(struct device *dev,
     struct device_attribute *attr, const char *buf, size_t size)
 {
-    u8 led_reg;
+    u32 led_reg;
     int ret;
     struct led_patterns_dev *priv = dev_get_drvdata(dev);
-    // Parse the string we received as a bool
+    // Parse the string we received as a 32-bit pattern; a u8 couldn't
+    // light LEDs 8 and 9. The hardware ignores bits above 9.
     // See https://elixir.bootlin.com/linux/latest/source/lib/kstrtox.c#L289
-    ret = kstrtou8(buf, 0, &led_reg);
+    ret = kstrtou32(buf, 0, &led_reg);
     if (ret < 0) {
         // kstrtobool returned an error
         return ret;
     }
-    iowrite32(led_reg, priv->sw_led_control);
+
+    mutex_lock(&priv->lock);
+    // The kernel visualizer owns the LEDs until mode goes back to software
+    if (priv->mode == LED_BAR_MODE_KERNEL) {
+        mutex_unlock(&priv->lock);
+        return -EBUSY;
+    }
+    ret = regmap_write(priv->regs.map, SW_LED_CONTROL_OFFSET, led_reg);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
     // Write was successful, so we return the number of bytes we wrote.
     return size;
 }
 
-static ssize_t led_patterns_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
+/**
+* mode_show() - Report who drives the LEDs
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t mode_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
 {
-    size_t ret;
-    u32 val;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
 
-    struct led_patterns_dev *priv = container_of(file->private_data, struct led_patterns_dev, miscdev);
+    return scnprintf(buf, PAGE_SIZE, "%s\n",
+        (priv->mode == LED_BAR_MODE_KERNEL) ? "kernel" : "software");
+}
+
+/**
+* mode_store() - Hand the LEDs to userspace or to the kernel visualizer
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: "software" or "kernel".
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t mode_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    if (sysfs_streq(buf, "kernel")) {
+        led_bar_vis_start(priv);
+    } else if (sysfs_streq(buf, "software")) {
+        led_bar_vis_stop(priv);
+    } else {
+        mutex_unlock(&priv->lock);
+        return -EINVAL;
+    }
+    mutex_unlock(&priv->lock);
+
+    return size;
+}
+
+/**
+* metric_show() - Report what the kernel visualizer shows
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t metric_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%s\n",
+        led_bar_metric_names[priv->metric]);
+}
+
+/**
+* metric_store() - Select what the kernel visualizer shows
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: "load1", "load5" or "cpu".
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t metric_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+    int metric;
+
+    metric = sysfs_match_string(led_bar_metric_names, buf);
+    if (metric < 0)
+        return metric;
+
+    mutex_lock(&priv->lock);
+    priv->metric = metric;
+    // restart the CPU delta so the first sample isn't against stale totals
+    led_bar_cpu_times(&priv->cpu_busy, &priv->cpu_total);
+    mutex_unlock(&priv->lock);
+
+    return size;
+}
+
+/**
+* rate_show() - Report the kernel visualizer refresh rate
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t rate_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->rate);
+}
 
-    if (*offset < 0) {
+/**
+* rate_store() - Set the kernel visualizer refresh rate
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Refresh rate in Hz, 1 to VIS_MAX_RATE.
+* @size: The number of bytes being written.
+*
+* Takes effect at the next tick.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t rate_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+    unsigned int rate;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &rate);
+    if (ret < 0)
+        return ret;
+    if (rate < 1 || rate > VIS_MAX_RATE)
         return -EINVAL;
+
+    mutex_lock(&priv->lock);
+    priv->rate = rate;
+    mutex_unlock(&priv->lock);
+
+    return size;
+}
+
+/**
+* seq_run_show() - Report whether the sequencer is playing frames
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t seq_run_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    unsigned int control;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = regmap_read(priv->regs.map, SEQ_CONTROL_OFFSET, &control);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(control & SEQ_RUN));
+}
+
+/**
+* seq_run_store() - Start or stop the sequencer
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: 1 plays the front bank from its first frame, 0 goes back to the
+* pattern register.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t seq_run_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool run;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = kstrtobool(buf, &run);
+    if (ret < 0)
+        return ret;
+
+    mutex_lock(&priv->lock);
+    // The kernel visualizer owns the LEDs until mode goes back to software
+    if (priv->mode == LED_BAR_MODE_KERNEL && run) {
+        mutex_unlock(&priv->lock);
+        return -EBUSY;
     }
-    if (*offset >= SPAN) {
-        return 0;
+    ret = led_bar_seq_control(priv, SEQ_RUN, run ? SEQ_RUN : 0);
+    mutex_unlock(&priv->lock);
+
+    return ret ? ret : size;
+}
+
+/**
+* seq_loop_show() - Report whether sequences start over after the last frame
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t seq_loop_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    unsigned int control;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = regmap_read(priv->regs.map, SEQ_CONTROL_OFFSET, &control);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(control & SEQ_LOOP));
+}
+
+/**
+* seq_loop_store() - Choose loop or one-shot playback
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: 1 loops, 0 stops on the last frame.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t seq_loop_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool loop;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = kstrtobool(buf, &loop);
+    if (ret < 0)
+        return ret;
+
+    mutex_lock(&priv->lock);
+    ret = led_bar_seq_control(priv, SEQ_LOOP, loop ? SEQ_LOOP : 0);
+    mutex_unlock(&priv->lock);
+
+    return ret ? ret : size;
+}
+
+/**
+* seq_swap_show() - Report whether a bank swap is still waiting
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t seq_swap_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    unsigned int control;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = regmap_read(priv->regs.map, SEQ_CONTROL_OFFSET, &control);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(control & SEQ_SWAP));
+}
+
+/**
+* seq_swap_store() - Swap the sequencer banks
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: 1 makes the uploaded bank the front one at the next frame boundary,
+* or at once while stopped or after a one-shot sequence.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t seq_swap_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool swap;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = kstrtobool(buf, &swap);
+    if (ret < 0)
+        return ret;
+    if (!swap)
+        return size;
+
+    mutex_lock(&priv->lock);
+    ret = led_bar_seq_control(priv, 0, SEQ_SWAP);
+    mutex_unlock(&priv->lock);
+
+    return ret ? ret : size;
+}
+
+/**
+* seq_frame_show() - Report the frame on the LEDs
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t seq_frame_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    unsigned int status;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = regmap_read(priv->regs.map, SEQ_STATUS_OFFSET, &status);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", status & SEQ_STATUS_FRAME);
+}
+
+/**
+* seq_done_show() - Report whether a one-shot sequence has finished
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t seq_done_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    unsigned int status;
+    int ret;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    ret = regmap_read(priv->regs.map, SEQ_STATUS_OFFSET, &status);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(status & SEQ_STATUS_DONE));
+}
+
+/**
+* seq_frames_show() - Report how many frames a bank holds
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t seq_frames_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->seq_frames);
+}
+
+/**
+* brightness_show() - Return the pattern register's per-LED levels
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t brightness_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    unsigned int levels;
+    int ret, i;
+    size_t len = 0;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    // Served from the register cache
+    ret = regmap_read(priv->regs.map, BRIGHTNESS_OFFSET, &levels);
+    if (ret)
+        return ret;
+
+    for (i = 0; i < NUM_LEDS; i++) {
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%u%c",
+            (levels >> (3 * i)) & LED_BAR_LEVEL_MAX,
+            (i == NUM_LEDS - 1) ? '\n' : ' ');
     }
-    if ((*offset % 0x4) != 0) {
-        pr_warn("led_bar_read: unaligned access\n");
-        return -EFAULT;
+    return len;
+}
+
+/**
+* brightness_store() - Set the pattern register's per-LED levels
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Ten levels, LED 0 first, each 0 (off) to 7 (fully on).
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t brightness_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    unsigned int level[NUM_LEDS];
+    u32 levels = 0;
+    int ret, i;
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    if (sscanf(buf, "%u %u %u %u %u %u %u %u %u %u",
+               &level[0], &level[1], &level[2], &level[3], &level[4],
+               &level[5], &level[6], &level[7], &level[8], &level[9]) != NUM_LEDS)
+        return -EINVAL;
+
+    for (i = 0; i < NUM_LEDS; i++) {
+        if (level[i] > LED_BAR_LEVEL_MAX)
+            return -ERANGE;
+        levels |= LED_BAR_LEVEL(i, level[i]);
     }
 
-    val = ioread32(priv->base_addr + *offset);
+    ret = regmap_write(priv->regs.map, BRIGHTNESS_OFFSET, levels);
+    return ret ? ret : size;
+}
+
+static ssize_t led_patterns_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
+{
+    struct led_patterns_dev *priv = container_of(file->private_data, struct led_patterns_dev, miscdev);
+
+    return fpga_regmap_read_user(&priv->regs, buf, count, offset);
+}
 
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
-        pr_warn("led_bar_read: nothing copied\n");
-        return -EFAULT;
+/**
+* led_bar_write_frames() - Upload sequencer frames to the back bank
+* @priv: LED bar device, with @priv->lock held
+* @buf: User-space array of struct led_bar_frame.
+* @count: The number of bytes being written.
+* @offset: LED_BAR_FRAMES_OFFSET plus the first frame's byte offset.
+*
+* Stores the frames from frame k = (@offset - LED_BAR_FRAMES_OFFSET) /
+* sizeof(struct led_bar_frame) on, SEQ_CHUNK per regmap call, and sets the
+* back bank's length to k plus the frames stored. The write address steps
+* by itself, so only the first call sets it. Frames past the end of the
+* bank are dropped. Fails with -EBUSY while a swap is pending, since the
+* back bank is about to go on show. A bad frame (-ERANGE) or buffer
+* (-EFAULT) after the first chunk ends the write short: the length then
+* covers the frames stored so far, like a short write().
+*
+* Return: The number of bytes stored, or a negative error value if no
+* frame was.
+*/
+static ssize_t led_bar_write_frames(struct led_patterns_dev *priv,
+    const char __user *buf, size_t count, loff_t *offset)
+{
+    struct led_bar_frame frames[SEQ_CHUNK];
+    struct reg_sequence seq[2 * SEQ_CHUNK + 1];
+    loff_t pos = *offset - LED_BAR_FRAMES_OFFSET;
+    unsigned int control, first, total, done, n, len, i;
+    int ret = 0;
+
+    if (!priv->seq_frames)
+        return -ENODEV;
+
+    if (pos >= priv->seq_frames * sizeof(struct led_bar_frame))
+        return -ENOSPC;
+    // pos fits in 32 bits now, so no 64-bit division on the ARM
+    if ((unsigned int)pos % sizeof(struct led_bar_frame) ||
+        count % sizeof(struct led_bar_frame) || !count)
+        return -EINVAL;
+
+    first = (unsigned int)pos / sizeof(struct led_bar_frame);
+    total = min_t(size_t, count / sizeof(struct led_bar_frame),
+        priv->seq_frames - first);
+
+    ret = regmap_read(priv->regs.map, SEQ_CONTROL_OFFSET, &control);
+    if (ret)
+        return ret;
+    if (control & SEQ_SWAP)
+        return -EBUSY;
+
+    for (done = 0; done < total; done += n) {
+        n = min_t(unsigned int, total - done, SEQ_CHUNK);
+        if (copy_from_user(frames, buf + done * sizeof(*frames),
+                n * sizeof(*frames))) {
+            ret = -EFAULT;
+            break;
+        }
+
+        // check the whole chunk first, so the bank only gets whole chunks
+        for (i = 0; i < n; i++) {
+            if (frames[i].levels > SEQ_MAX_LEVELS || frames[i].ms > SEQ_MAX_MS)
+                break;
+        }
+        if (i < n) {
+            ret = -ERANGE;
+            break;
+        }
+
+        len = 0;
+        if (!done)
+            seq[len++] = (struct reg_sequence){ SEQ_WR_ADDR_OFFSET, first };
+        for (i = 0; i < n; i++) {
+            seq[len++] = (struct reg_sequence){ SEQ_LEVELS_OFFSET,
+                frames[i].levels };
+            seq[len++] = (struct reg_sequence){ SEQ_TIME_OFFSET,
+                frames[i].ms };
+        }
+
+        ret = regmap_multi_reg_write(priv->regs.map, seq, len);
+        if (ret)
+            return ret;
     }
 
+    if (!done)
+        return ret;
 
-    *offset = *offset + sizeof(val);
+    ret = regmap_write(priv->regs.map, SEQ_LENGTH_OFFSET, first + done);
+    if (ret)
+        return ret;
 
-    return sizeof(val);
+    *offset += done * sizeof(struct led_bar_frame);
+    return done * sizeof(struct led_bar_frame);
 }
 
 /**
@@ -114,6 +970,9 @@ static ssize_t led_patterns_read(struct file *file, char __user *buf, size_t cou
 * @count: The number of bytes being written.
 * @offset: The byte offset in the file being written to.
 *
+* Offsets from LED_BAR_FRAMES_OFFSET up upload sequencer frames, see
+* led_bar_write_frames().
+*
 * Return: On success, the number of bytes written is returned and the
 * offset @offset is advanced by this number. On error, a negative error
 * value is returned.
@@ -121,52 +980,94 @@ static ssize_t led_patterns_read(struct file *file, char __user *buf, size_t cou
 static ssize_t led_patterns_write(struct file *file, const char __user *buf,
     size_t count, loff_t *offset)
 {
-    size_t ret;
-    u32 val;
+    ssize_t ret;
 
     struct led_patterns_dev *priv = container_of(file->private_data,
         struct led_patterns_dev, miscdev);
 
-    if (*offset < 0) {
-        return -EINVAL;
-    }
-    if (*offset >= SPAN) {
-        return 0;
-    }
-    if ((*offset % 0x4) != 0) {
-        pr_warn("led_bar_write: unaligned access\n");
-        return -EFAULT;
-    }
-
     mutex_lock(&priv->lock);
-    // Get the value from userspace.
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret != sizeof(val)) {
-        iowrite32(val, priv->base_addr + *offset);
-        // Increment the file offset by the number of bytes we wrote.
-        *offset = *offset + sizeof(val);
-        // Return the number of bytes we wrote.
-        ret = sizeof(val);
-    }
-    else {
-        pr_warn("led_bar_write: nothing copied from user space\n");
-        ret = -EFAULT;
+    if (priv->mode == LED_BAR_MODE_KERNEL) {
+        ret = -EBUSY;
+    } else if (*offset >= LED_BAR_FRAMES_OFFSET) {
+        ret = led_bar_write_frames(priv, buf, count, offset);
+    } else {
+        ret = fpga_regmap_write_user(&priv->regs, buf, count, offset);
     }
-
     mutex_unlock(&priv->lock);
+
     return ret;
 }
 
-// Define sysfs attributes
-static DEVICE_ATTR_RW(sw_led_control);
+/**
+* instance_show() - Report N of /dev/led_barN
+* @dev: Device structure for the led_patterns component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t instance_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct led_patterns_dev *priv = dev_get_drvdata(dev);
+    return scnprintf(buf, PAGE_SIZE, "%d\n", priv->inst.id);
+}
+
+// Define sysfs attributes, timed for the op counters
+FPGA_DEVICE_ATTR_RW(sw_led_control, led_bar_stats);
+FPGA_DEVICE_ATTR_RW(mode, led_bar_stats);
+FPGA_DEVICE_ATTR_RW(metric, led_bar_stats);
+FPGA_DEVICE_ATTR_RW(rate, led_bar_stats);
+FPGA_DEVICE_ATTR_RW(seq_run, led_bar_stats);
+FPGA_DEVICE_ATTR_RW(seq_loop, led_bar_stats);
+FPGA_DEVICE_ATTR_RW(seq_swap, led_bar_stats);
+FPGA_DEVICE_ATTR_RO(seq_frame, led_bar_stats);
+FPGA_DEVICE_ATTR_RO(seq_done, led_bar_stats);
+FPGA_DEVICE_ATTR_RO(seq_frames, led_bar_stats);
+FPGA_DEVICE_ATTR_RW(brightness, led_bar_stats);
+FPGA_DEVICE_ATTR_RO(instance, led_bar_stats);
 // Create an attribute group so the device core can
 // export the attributes for us.
 static struct attribute *led_patterns_attrs[] = {
     &dev_attr_sw_led_control.attr,
+    &dev_attr_mode.attr,
+    &dev_attr_metric.attr,
+    &dev_attr_rate.attr,
+    &dev_attr_seq_run.attr,
+    &dev_attr_seq_loop.attr,
+    &dev_attr_seq_swap.attr,
+    &dev_attr_seq_frame.attr,
+    &dev_attr_seq_done.attr,
+    &dev_attr_seq_frames.attr,
+    &dev_attr_brightness.attr,
+    &dev_attr_instance.attr,
     NULL,
 };
 ATTRIBUTE_GROUPS(led_patterns);
 
+/**
+* led_patterns_mmap() - mmap method for the led_bar char device
+* @file: Pointer to the char device file struct.
+* @vma: The userspace mapping being created.
+*
+* Maps the page holding the registers, uncached, into userspace. The
+* registers start at (physical base & ~PAGE_MASK) within the mapping.
+* The register cache is bypassed while the mapping exists.
+*
+* Return: 0 on success, a negative error value otherwise.
+*/
+static int led_patterns_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct led_patterns_dev *priv = container_of(file->private_data,
+        struct led_patterns_dev, miscdev);
+
+    return fpga_regmap_mmap(&priv->regs, vma, true);
+}
+
+FPGA_STATS_READ(led_patterns_read, led_bar_stats)
+FPGA_STATS_WRITE(led_patterns_write, led_bar_stats)
+FPGA_STATS_MMAP(led_patterns_mmap, led_bar_stats)
+
 /**
 * led_patterns_fops - File operations supported by the
 * led_patterns driver
@@ -175,13 +1076,15 @@ ATTRIBUTE_GROUPS(led_patterns);
 * character device is still in use.
 * @read: The read function.
 * @write: The write function.
+* @mmap: Uncached mapping of the registers.
 * @llseek: We use the kernel's default_llseek() function; this allows
 * users to change what position they are writing/reading to/from.
 */
 static const struct file_operations led_patterns_fops = {
     .owner = THIS_MODULE,
-    .read = led_patterns_read,
-    .write = led_patterns_write,
+    .read = led_patterns_read_timed,
+    .write = led_patterns_write_timed,
+    .mmap = led_patterns_mmap_timed,
     .llseek = default_llseek,
 };
 
@@ -199,7 +1102,9 @@ static const struct file_operations led_patterns_fops = {
 static int led_patterns_probe(struct platform_device *pdev)
 {
    struct led_patterns_dev *priv;
-   size_t ret;
+   unsigned int status, frame_bits;
+   bool has_seq;
+   int ret;
 
     /*
     * Allocate kernel memory for the led patterns device and set it to 0.
@@ -214,48 +1119,85 @@ static int led_patterns_probe(struct platform_device *pdev)
         return -ENOMEM;
     }
 
+    // Pick the instance number that names /dev/led_barN
+    ret = fpga_instance_init(&pdev->dev, &led_bar_ida, "led-bar", "led_bar",
+        &priv->inst);
+    if (ret) {
+        pr_err("Failed to get an led bar instance number\n");
+        return ret;
+    }
+
+    // Counters and histograms under /sys/kernel/debug/led_barN
+    ret = fpga_stats_init(&pdev->dev, &priv->stats, priv->inst.name);
+    if (ret) {
+        return ret;
+    }
+
     /*
-    * Request and remap the device's memory region. Requesting the region
-    * make sure nobody else can use that memory. The memory is remapped
-    * into the kernel's virtual address space because we don't have access
-    * to physical memory locations.
+    * Request and remap the device's memory region and put a regmap on top
+    * of it. Requesting the region make sure nobody else can use that
+    * memory.
     */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource\n");
-        return PTR_ERR(priv->base_addr);
+    has_seq = of_device_is_compatible(pdev->dev.of_node, "sdc,led_bar-seq");
+    ret = fpga_regmap_init(pdev, 0, has_seq ? &led_bar_seq_regmap_config :
+        &led_bar_regmap_config, &priv->stats, &priv->regs);
+    if (ret) {
+        pr_err("Failed to map led bar registers\n");
+        return ret;
     }
 
-    // Set the memory addresses for each register.
-    priv->sw_led_control = priv->base_addr + SW_LED_CONTROL_OFFSET;
+    // The status register reports the frame RAM size
+    if (has_seq) {
+        ret = regmap_read(priv->regs.map, SEQ_STATUS_OFFSET, &status);
+        if (ret) {
+            return ret;
+        }
+        frame_bits = (status >> SEQ_STATUS_BITS_SHIFT) & SEQ_STATUS_BITS_MASK;
+        if (!frame_bits || frame_bits > SEQ_MAX_FRAME_BITS) {
+            pr_err("Unexpected led bar sequencer size %u bits\n", frame_bits);
+            return -ENODEV;
+        }
+        priv->seq_frames = 1U << frame_bits;
+    }
+
+    // Userspace drives the LEDs until mode is set to kernel
+    mutex_init(&priv->lock);
+    INIT_DELAYED_WORK(&priv->vis_work, led_bar_vis_work);
+    priv->mode = LED_BAR_MODE_SOFTWARE;
+    priv->metric = LED_BAR_METRIC_LOAD1;
+    priv->rate = VIS_DEFAULT_RATE;
 
+    /*
+    * Attach the led patterns's private data to the platform device's struct.
+    * This is so we can access our state container in the other functions.
+    * The timed file operations need it as soon as the char dev exists.
+    */
+    platform_set_drvdata(pdev, priv);
 
     // Initialize the misc device parameters
     priv->miscdev.minor = MISC_DYNAMIC_MINOR;
-    priv->miscdev.name = "led_bar";
+    priv->miscdev.name = priv->inst.name;
     priv->miscdev.fops = &led_patterns_fops;
     priv->miscdev.parent = &pdev->dev;
-    // Register the misc device; this creates a char dev at /dev/led_patterns
+    // Register the misc device; this creates a char dev at /dev/led_barN
     ret = misc_register(&priv->miscdev);
     if (ret) {
         pr_err("Failed to register misc device");
         return ret;
     }
-    /*
-    * Attach the led patterns's private data to the platform device's struct.
-    * This is so we can access our state container in the other functions.
-    */
-    platform_set_drvdata(pdev, priv);
 
     // Enable software-control mode and turn all the LEDs off, just for fun.
-    iowrite32(0, priv->sw_led_control);
-
-    /* Attach the led patterns's private data to the platform device's struct.
-    * This is so we can access our state container in the other functions.
-    */
-    platform_set_drvdata(pdev, priv);
+    regmap_write(priv->regs.map, SW_LED_CONTROL_OFFSET, 0);
+    // Stop the sequencer with both banks empty, every LED at full brightness
+    if (priv->seq_frames) {
+        regmap_write(priv->regs.map, SEQ_CONTROL_OFFSET, 0);
+        regmap_write(priv->regs.map, SEQ_LENGTH_OFFSET, 0);
+        regmap_write(priv->regs.map, SEQ_CONTROL_OFFSET, SEQ_SWAP);
+        regmap_write(priv->regs.map, SEQ_LENGTH_OFFSET, 0);
+        regmap_write(priv->regs.map, BRIGHTNESS_OFFSET, SEQ_MAX_LEVELS);
+    }
 
-    pr_info("led bar probe successful\n");
+    pr_info("led bar probe successful: %s\n", priv->inst.name);
 
     return 0;
 }
@@ -271,13 +1213,21 @@ static void led_patterns_remove(struct platform_device *pdev)
 {
     // Get the led patterns's private data from the platform device.
     struct led_patterns_dev *priv = platform_get_drvdata(pdev);
+
+    // Stop the kernel visualizer before the registers go away
+    mutex_lock(&priv->lock);
+    led_bar_vis_stop(priv);
+    mutex_unlock(&priv->lock);
+
     // Disable software-control mode, just for kicks.
-    iowrite32(0, priv->sw_led_control);
+    if (priv->seq_frames)
+        regmap_write(priv->regs.map, SEQ_CONTROL_OFFSET, 0);
+    regmap_write(priv->regs.map, SW_LED_CONTROL_OFFSET, 0);
 
     // Deregister the misc device and remove the /dev/led_patterns file.
     misc_deregister(&priv->miscdev);
 
-    pr_info("led bar remove successful\n");
+    pr_info("led bar remove successful: %s\n", priv->inst.name);
 }
 
 
@@ -288,6 +1238,7 @@ static void led_patterns_remove(struct platform_device *pdev)
 * compatible string as defined here.
 */
 static const struct of_device_id led_patterns_of_match[] = {
+    { .compatible = "sdc,led_bar-seq", },
     { .compatible = "sdc,led_bar", },
     { }
 };
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Userspace interface for the led_bar char device (/dev/led_barN).
+ *
+ * This header is shared by the driver and by userspace programs, so it
+ * only uses types from <linux/types.h>.
+ */
+#ifndef LED_BAR_H
+#define LED_BAR_H
+
+#include <linux/types.h>
+
+/*
+ * Sequencer frames are written at this file offset and above; offset 0 and
+ * up reach the registers.
+ */
+#define LED_BAR_FRAMES_OFFSET	0x1000
+
+/* brightness levels: 0 is off, LED_BAR_LEVEL_MAX is fully on */
+#define LED_BAR_LEVEL_MAX	7
+#define LED_BAR_LEVEL(led, level)	((__u32)(level) << (3 * (led)))
+
+/*
+ * struct led_bar_frame - One frame of the LED bar sequencer.
+ * @levels: Brightness of each LED, 3 bits per LED, LED n in bits
+ *          3n+2..3n; build it with LED_BAR_LEVEL().
+ * @ms: How long to show the frame, in ms (1 to 65535, 0 = 1).
+ *
+ * write() an array of frames at LED_BAR_FRAMES_OFFSET + k * sizeof(struct
+ * led_bar_frame) to store them from frame k on in the back bank, which
+ * then holds a sequence of k + n frames. Nothing changes on the LEDs until
+ * the banks are swapped through sysfs (seq_swap), and the swap waits for
+ * the end of the frame showing, so a new sequence never tears.
+ */
+struct led_bar_frame {
+	__u32 levels;
+	__u32 ms;
+};
+
+#endif /* LED_BAR_H */
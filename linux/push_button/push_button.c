@@ -1,30 +1,133 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/mod_devicetable.h>
-#include <linux/io.h>
-#include <linux/mutex.h>
 #include <linux/miscdevice.h>
 #include <linux/types.h>
 #include <linux/fs.h>
 #include <linux/kstrtox.h>
+#include <linux/interrupt.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/regmap.h>
 
-#define SPAN 16
+#define FPGA_TRACE_SYSTEM push_button
+#include "fpga_regmap.h"
+#include "fpga_instance.h"
 
+#define CREATE_TRACE_POINTS
+#include "fpga_trace.h"
 
+#define BUTTON_STATUS_OFFSET 0x0
+#define IRQ_ENABLE_OFFSET    0x4
+
+/**
+* struct push_button_dev - Private push button device struct.
+* @regs: The register window
+* @inst: Instance number and char device name (push_buttonN)
+* @stats: Op counters and latency histograms, see fpga_stats.h
+* @miscdev: miscdevice used to create a character device
+* @irq: Linux irq number, or 0 when the device tree node has no interrupt
+* @pending: A press has been seen and not yet cleared by software
+* @presses: Total number of presses seen by the interrupt handler
+* @wq: poll()ers waiting for a press
+*/
 struct push_button_dev {
-    void __iomem *base_addr;
-    void __iomem *button_reg;
+    struct fpga_regmap regs;
+    struct fpga_instance inst;
+    struct fpga_stats stats;
     struct miscdevice miscdev;
-    struct mutex lock;
+    int irq;
+    bool pending;
+    unsigned long presses;
+    wait_queue_head_t wq;
+};
+
+// Instance numbers, see fpga_instance.h
+static DEFINE_IDA(push_button_ida);
+
+// Used by the timed sysfs and file operation wrappers
+static struct fpga_stats *push_button_stats(struct device *dev)
+{
+    struct push_button_dev *priv = dev_get_drvdata(dev);
+    return &priv->stats;
+}
+
+/*
+* button_status is set by the hardware, so it is volatile; irq_enable only
+* changes when we write it and is cached.
+*/
+static bool push_button_volatile_reg(struct device *dev, unsigned int reg)
+{
+    return reg == BUTTON_STATUS_OFFSET;
+}
+
+static const struct regmap_config push_button_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name = "push_button",
+    .max_register = IRQ_ENABLE_OFFSET,
+    .volatile_reg = push_button_volatile_reg,
+    .cache_type = REGCACHE_MAPLE,
 };
 
+/**
+* push_button_irq_thread() - Threaded interrupt handler for a press
+* @irq: Unused.
+* @dev_id: The push_button_dev.
+*
+* The hardware irq is level-sensitive and held until button_status is
+* cleared, so we latch the press in @pending, clear the hardware status to
+* drop the line, and wake anyone waiting in poll() on /dev/push_buttonN or on
+* the push_button_reg sysfs attribute. This runs in a thread (IRQF_ONESHOT
+* keeps the line masked until we return) because sysfs_notify() can sleep.
+*
+* Return: IRQ_HANDLED, or IRQ_NONE if the button wasn't the source.
+*/
+static irqreturn_t push_button_irq_thread(int irq, void *dev_id)
+{
+    struct push_button_dev *priv = dev_id;
+    unsigned int status;
+
+    if (regmap_read(priv->regs.map, BUTTON_STATUS_OFFSET, &status) ||
+        !(status & 0x1)) {
+        return IRQ_NONE;
+    }
+
+    // Latch first so readers never see neither the register nor pending set.
+    WRITE_ONCE(priv->pending, true);
+    priv->presses++;
+
+    regmap_write(priv->regs.map, BUTTON_STATUS_OFFSET, 0);
 
+    wake_up_interruptible(&priv->wq);
+    sysfs_notify(&priv->miscdev.parent->kobj, NULL, "push_button_reg");
+
+    return IRQ_HANDLED;
+}
+
+
+/**
+* push_button_reg_show() - Return 1 if a press is pending.
+* @dev: Device structure for the push button component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* With the interrupt in use, the hardware status is cleared by the irq
+* handler and the press is latched in software, so report both.
+* This attribute supports poll(POLLPRI): read it, then poll until a press.
+*
+* Return: The number of bytes read.
+*/
 static ssize_t push_button_reg_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
-    u8 button_reg;
+    unsigned int button_reg;
+    int ret;
     struct push_button_dev *priv = dev_get_drvdata(dev);
-    button_reg = ioread32(priv->button_reg);
+    ret = regmap_read(priv->regs.map, BUTTON_STATUS_OFFSET, &button_reg);
+    if (ret) {
+        return ret;
+    }
+    button_reg = (button_reg & 0x1) | READ_ONCE(priv->pending);
     return scnprintf(buf, PAGE_SIZE, "%u\n", button_reg);
 }
 
@@ -41,93 +144,179 @@ static ssize_t push_button_reg_store(struct device *dev,
     if (ret < 0) {
         return ret;
     }
-    iowrite32(button_reg, priv->button_reg);
+    WRITE_ONCE(priv->pending, button_reg & 0x1);
+    ret = regmap_write(priv->regs.map, BUTTON_STATUS_OFFSET, button_reg);
+    if (ret) {
+        return ret;
+    }
     // Write was successful, so we return the number of bytes we wrote.
     return size;
 }
 
-// Define sysfs attributes
-static DEVICE_ATTR_RW(push_button_reg);
+/**
+* presses_show() - Number of presses seen by the interrupt handler.
+* @dev: Device structure for the push button component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t presses_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct push_button_dev *priv = dev_get_drvdata(dev);
+    return scnprintf(buf, PAGE_SIZE, "%lu\n", READ_ONCE(priv->presses));
+}
+
+/**
+* has_irq_show() - Report whether presses are interrupt-driven.
+* @dev: Device structure for the push button component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Without the interrupt, poll() on /dev/push_buttonN and POLLPRI on
+* push_button_reg never wake up, so userspace has to read the status
+* register itself.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t has_irq_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct push_button_dev *priv = dev_get_drvdata(dev);
+    return scnprintf(buf, PAGE_SIZE, "%d\n", priv->irq > 0);
+}
+
+/**
+* instance_show() - Report N of /dev/push_buttonN
+* @dev: Device structure for the push button component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t instance_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct push_button_dev *priv = dev_get_drvdata(dev);
+    return scnprintf(buf, PAGE_SIZE, "%d\n", priv->inst.id);
+}
+
+// Define sysfs attributes, timed for the op counters
+FPGA_DEVICE_ATTR_RW(push_button_reg, push_button_stats);
+FPGA_DEVICE_ATTR_RO(presses, push_button_stats);
+FPGA_DEVICE_ATTR_RO(has_irq, push_button_stats);
+FPGA_DEVICE_ATTR_RO(instance, push_button_stats);
 // Create an attribute group so the device core can
 // export the attributes for us.
 static struct attribute *push_button_attrs[] = {
     &dev_attr_push_button_reg.attr,
+    &dev_attr_presses.attr,
+    &dev_attr_has_irq.attr,
+    &dev_attr_instance.attr,
     NULL,
 };
 ATTRIBUTE_GROUPS(push_button);
 
 static ssize_t push_button_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
 {
-    size_t ret;
-    u32 val;
+    u32 vals[FPGA_REGMAP_MAX_REGS];
+    ssize_t n;
+    int ret;
 
     struct push_button_dev *priv = container_of(file->private_data, struct push_button_dev, miscdev);
 
-    if (*offset < 0) {
-        return -EINVAL;
+    n = fpga_regmap_count(&priv->regs, count, *offset);
+    if (n <= 0) {
+        return n;
     }
-    if (*offset >= SPAN) {
-        return 0;
+
+    ret = regmap_bulk_read(priv->regs.map, *offset, vals, n);
+    if (ret) {
+        return ret;
     }
-    if ((*offset % 0x4) != 0) {
-        pr_warn("push_button_read: unaligned access\n");
-        return -EFAULT;
+    if (*offset == BUTTON_STATUS_OFFSET) {
+        // The irq handler moves presses from the register into pending.
+        vals[0] |= READ_ONCE(priv->pending);
     }
 
-    val = ioread32(priv->base_addr + *offset);
-
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
+    if (copy_to_user(buf, vals, n * sizeof(u32))) {
         pr_warn("push_button_read: nothing copied\n");
         return -EFAULT;
     }
 
+    *offset = *offset + n * sizeof(u32);
 
-    *offset = *offset + sizeof(val);
-
-    return sizeof(val);
+    return n * sizeof(u32);
 }
 
 static ssize_t push_button_write(struct file *file, const char __user *buf,
     size_t count, loff_t *offset)
 {
-    size_t ret;
     u32 val;
 
     struct push_button_dev *priv = container_of(file->private_data,
         struct push_button_dev, miscdev);
 
-    if (*offset < 0) {
-        return -EINVAL;
-    }
-    if (*offset >= SPAN) {
-        return 0;
-    }
-    if ((*offset % 0x4) != 0) {
-        pr_warn("push_button_write: unaligned access\n");
-        return -EFAULT;
+    // Keep pending in step with a write to button_status, like sysfs does.
+    if (*offset == BUTTON_STATUS_OFFSET && count >= sizeof(val)) {
+        if (get_user(val, (const u32 __user *)buf)) {
+            pr_warn("push_button_write: nothing copied from user space\n");
+            return -EFAULT;
+        }
+        WRITE_ONCE(priv->pending, val & 0x1);
     }
 
-    mutex_lock(&priv->lock);
-    // Get the value from userspace.
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret != sizeof(val)) {
-        iowrite32(val, priv->base_addr + *offset);
-        // Increment the file offset by the number of bytes we wrote.
-        *offset = *offset + sizeof(val);
-        // Return the number of bytes we wrote.
-        ret = sizeof(val);
-    }
-    else {
-        pr_warn("push_button_write: nothing copied from user space\n");
-        ret = -EFAULT;
+    return fpga_regmap_write_user(&priv->regs, buf, count, offset);
+}
+
+
+
+/**
+* push_button_poll() - poll method for the push_button char device
+* @file: Pointer to the char device file struct.
+* @wait: Poll table.
+*
+* Readable (EPOLLIN | EPOLLPRI) while a press is pending, i.e. until software
+* clears button_status by writing 0 to offset 0 or to push_button_reg.
+*
+* Return: The poll event mask.
+*/
+static __poll_t push_button_poll(struct file *file, poll_table *wait)
+{
+    struct push_button_dev *priv = container_of(file->private_data,
+        struct push_button_dev, miscdev);
+
+    poll_wait(file, &priv->wq, wait);
+
+    if (READ_ONCE(priv->pending)) {
+        return EPOLLIN | EPOLLRDNORM | EPOLLPRI;
     }
 
-    mutex_unlock(&priv->lock);
-    return ret;
+    return 0;
 }
 
+/**
+* push_button_mmap() - mmap method for the push_button char device
+* @file: Pointer to the char device file struct.
+* @vma: The userspace mapping being created.
+*
+* Maps the page holding the registers, uncached, into userspace. The
+* registers start at (physical base & ~PAGE_MASK) within the mapping.
+*
+* Return: 0 on success, a negative error value otherwise.
+*/
+static int push_button_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct push_button_dev *priv = container_of(file->private_data,
+        struct push_button_dev, miscdev);
+
+    return fpga_regmap_mmap(&priv->regs, vma, true);
+}
 
+FPGA_STATS_READ(push_button_read, push_button_stats)
+FPGA_STATS_WRITE(push_button_write, push_button_stats)
+FPGA_STATS_MMAP(push_button_mmap, push_button_stats)
 
 /**
 * led_patterns_fops - File operations supported by the
@@ -137,13 +326,17 @@ static ssize_t push_button_write(struct file *file, const char __user *buf,
 * character device is still in use.
 * @read: The read function.
 * @write: The write function.
+* @poll: Wakes up when the button is pressed.
+* @mmap: Uncached mapping of the registers.
 * @llseek: We use the kernel's default_llseek() function; this allows
 * users to change what position they are writing/reading to/from.
 */
 static const struct file_operations push_button_fops = {
     .owner = THIS_MODULE,
-    .read = push_button_read,
-    .write = push_button_write,
+    .read = push_button_read_timed,
+    .write = push_button_write_timed,
+    .poll = push_button_poll,
+    .mmap = push_button_mmap_timed,
     .llseek = default_llseek,
 };
 
@@ -161,7 +354,7 @@ static const struct file_operations push_button_fops = {
 static int push_button_probe(struct platform_device *pdev)
 {
    struct push_button_dev *priv;
-   size_t ret;
+   int ret;
 
     /*
     * Allocate kernel memory for the led patterns device and set it to 0.
@@ -176,40 +369,85 @@ static int push_button_probe(struct platform_device *pdev)
         return -ENOMEM;
     }
 
+    // Pick the instance number that names /dev/push_buttonN
+    ret = fpga_instance_init(&pdev->dev, &push_button_ida, "push-button",
+        "push_button", &priv->inst);
+    if (ret) {
+        pr_err("Failed to get a push button instance number\n");
+        return ret;
+    }
+
+    // Counters and histograms under /sys/kernel/debug/push_buttonN
+    ret = fpga_stats_init(&pdev->dev, &priv->stats, priv->inst.name);
+    if (ret) {
+        return ret;
+    }
+
     /*
-    * Request and remap the device's memory region. Requesting the region
-    * make sure nobody else can use that memory. The memory is remapped
-    * into the kernel's virtual address space because we don't have access
-    * to physical memory locations.
+    * Request and remap the device's memory region and put a regmap on top
+    * of it. Requesting the region make sure nobody else can use that
+    * memory.
     */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource\n");
-        return PTR_ERR(priv->base_addr);
+    ret = fpga_regmap_init(pdev, 0, &push_button_regmap_config,
+        &priv->stats, &priv->regs);
+    if (ret) {
+        pr_err("Failed to map push button registers\n");
+        return ret;
     }
 
-    // Set the memory addresses for each register.
-    priv->button_reg = priv->base_addr;
+    init_waitqueue_head(&priv->wq);
 
+    /*
+    * Attach the led patterns's private data to the platform device's struct.
+    * This is so we can access our state container in the other functions.
+    * The timed file operations need it as soon as the char dev exists.
+    */
+    platform_set_drvdata(pdev, priv);
 
-    // Initialize the misc device parameters
+    // Initialize the misc device parameters; the irq handler notifies parent
     priv->miscdev.minor = MISC_DYNAMIC_MINOR;
-    priv->miscdev.name = "push_button";
+    priv->miscdev.name = priv->inst.name;
     priv->miscdev.fops = &push_button_fops;
     priv->miscdev.parent = &pdev->dev;
-    // Register the misc device; this creates a char dev at /dev/push_button
+
+    /*
+    * Older bitstreams / device trees don't have the interrupt; the register
+    * interface still works, poll() just never wakes up. Only -ENXIO means
+    * there is none: anything else, -EPROBE_DEFER included, fails the probe
+    * so we don't bind for good without it.
+    */
+    priv->irq = platform_get_irq_optional(pdev, 0);
+    if (priv->irq > 0) {
+        // Start clean so a stale press doesn't fire right away.
+        regmap_write(priv->regs.map, BUTTON_STATUS_OFFSET, 0);
+
+        ret = devm_request_threaded_irq(&pdev->dev, priv->irq, NULL,
+            push_button_irq_thread, IRQF_ONESHOT, priv->inst.name, priv);
+        if (ret) {
+            return dev_err_probe(&pdev->dev, ret, "Failed to request irq %d\n",
+                priv->irq);
+        }
+
+        regmap_write(priv->regs.map, IRQ_ENABLE_OFFSET, 1);
+    } else if (priv->irq == -ENXIO) {
+        pr_warn("push button: no irq in device tree, poll() is disabled\n");
+        priv->irq = 0;
+    } else {
+        return dev_err_probe(&pdev->dev, priv->irq, "Failed to get irq\n");
+    }
+
+    /*
+    * Register the misc device last, so /dev/push_buttonN and has_irq only
+    * appear once the irq is settled.
+    */
     ret = misc_register(&priv->miscdev);
     if (ret) {
         pr_err("Failed to register misc device");
+        regmap_write(priv->regs.map, IRQ_ENABLE_OFFSET, 0);
         return ret;
     }
-    /*
-    * Attach the led patterns's private data to the platform device's struct.
-    * This is so we can access our state container in the other functions.
-    */
-    platform_set_drvdata(pdev, priv);
 
-    pr_info("push button probe successful\n");
+    pr_info("push button probe successful: %s\n", priv->inst.name);
 
     return 0;
 }
@@ -225,12 +463,13 @@ static void push_button_remove(struct platform_device *pdev)
 {
     // Get the led patterns's private data from the platform device.
     struct push_button_dev *priv = platform_get_drvdata(pdev);
-    // Disable software-control mode, just for kicks.
+    // Stop the hardware from raising the irq before it gets freed.
+    regmap_write(priv->regs.map, IRQ_ENABLE_OFFSET, 0);
 
     // Deregister the misc device and remove the /dev/led_patterns file.
     misc_deregister(&priv->miscdev);
 
-    pr_info("push button remove successful\n");
+    pr_info("push button remove successful: %s\n", priv->inst.name);
 }
 
 
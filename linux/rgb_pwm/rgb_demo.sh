@@ -25,4 +25,14 @@ sleep 1
 # white
 echo 65535 > red
 echo 65535 > green
-echo 65535 > blue
\ No newline at end of file
+echo 65535 > blue
+
+# the same colors again as smooth fades: one write each, the FPGA does
+# every step (fade_done fails without the fade registers)
+if cat fade_done > /dev/null 2>&1; then
+    sleep 1
+    for color in "65535 0 0" "0 65535 0" "0 0 65535" "65535 65535 65535"; do
+        echo "$color 1000" > fade_to
+        sleep 2
+    done
+fi
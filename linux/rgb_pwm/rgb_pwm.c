@@ -1,12 +1,25 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/mod_devicetable.h>
-#include <linux/io.h>
-#include <linux/mutex.h>
 #include <linux/miscdevice.h>
 #include <linux/types.h>
 #include <linux/fs.h>
 #include <linux/kstrtox.h>
+#include <linux/regmap.h>
+#include <linux/mutex.h>
+#include <linux/sysfs.h>
+#include <linux/math.h>
+#include <linux/interrupt.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+
+#define FPGA_TRACE_SYSTEM rgb_pwm
+#include "fpga_regmap.h"
+#include "fpga_instance.h"
+#include "rgb_pwm.h"
+
+#define CREATE_TRACE_POINTS
+#include "fpga_trace.h"
 
 /*
  * RGB PWM Driver
@@ -14,22 +27,95 @@
  * Device Tree:
  *   rgb_pwm@ff37f430 {
  *       compatible = "weizenegger,rgb-pwm";
- *       reg = <0xff37f430 0x10>;
+ *       reg = <0xff37f430 0x20>,
+ *             <0xff37f480 0x10>,
+ *             <0xff37f4a0 0x20>,
+ *             <0xff37f4c0 0x20>,
+ *             <0xff37f4e0 0x20>;
+ *       interrupt-parent = <&intc>;
+ *       interrupts = <0 41 4>;
  *   };
  *
  * Role:
  *   - Binds to DT node with compatible "weizenegger,rgb-pwm".
- *   - Ioremaps the 4 RGB PWM registers:
+ *   - Maps the RGB PWM registers through a regmap (see fpga_regmap.h):
  *       RED_OFFSET   = 0x00
  *       GREEN_OFFSET = 0x04
  *       BLUE_OFFSET  = 0x08
  *       PERIOD_OFFSET= 0x0C
- *  - Exposes each register as a sysfs attribute (red/green/blue/period).
- *  - Registers a misc char device rgb_pwm that allows read/write access
- *    to all 4 registers via offsets.
+ *       COMMIT_OFFSET= 0x10
+ *  - Exposes each register as a sysfs attribute (red/green/blue/period),
+ *    plus color ("r g b") to set all three duties at once.
+ *  - Registers a misc char device rgb_pwmN that allows read/write access
+ *    to all registers via offsets, or direct access through mmap. N is
+ *    the instance number (see fpga_instance.h), so any number of PWM
+ *    blocks can be driven at once.
  *
+ * The optional second reg window holds the direct mode registers:
+ *       DIRECT_MODE_OFFSET   = 0x00
+ *       DIRECT_GAIN_R_OFFSET = 0x04
+ *       DIRECT_GAIN_G_OFFSET = 0x08
+ *       DIRECT_GAIN_B_OFFSET = 0x0C
+ * In direct mode the FPGA reads the ADC and drives the PWM on its own;
+ * sysfs mode and direct_gain control it.
  *
+ * The optional third reg window holds the gamma LUT registers:
+ *       LUT_INT_R_OFFSET  = 0x00   intensity -> table -> shadow duty
+ *       LUT_INT_G_OFFSET  = 0x04
+ *       LUT_INT_B_OFFSET  = 0x08
+ *       LUT_COLOR_OFFSET  = 0x0C   0x00BBGGRR, looked up and committed
+ *       LUT_COMMIT_OFFSET = 0x10   commit behind the lookups
+ *       LUT_ADDR_OFFSET   = 0x14   table address (channel, entry)
+ *       LUT_DATA_OFFSET   = 0x18   table entry, steps the address
+ *       LUT_INFO_OFFSET   = 0x1C   LUT_BITS
+ * sysfs intensity writes through the tables and lut reads or reloads them.
  *
+ * The optional fourth reg window holds the fade registers:
+ *       FADE_TARGET_R_OFFSET = 0x00   duty to fade to
+ *       FADE_TARGET_G_OFFSET = 0x04
+ *       FADE_TARGET_B_OFFSET = 0x08
+ *       FADE_STEPS_R_OFFSET  = 0x0C   fade length in PWM periods
+ *       FADE_STEPS_G_OFFSET  = 0x10
+ *       FADE_STEPS_B_OFFSET  = 0x14
+ *       FADE_CONTROL_OFFSET  = 0x18   start / fading and done status
+ * sysfs fade_to starts a fade on all three channels with one write; the
+ * FPGA steps the duties every period with no further bus traffic.
+ *
+ * The optional fifth reg window holds the frame FIFO registers:
+ *       FIFO_FRAME_R_OFFSET   = 0x00   staged frame
+ *       FIFO_FRAME_G_OFFSET   = 0x04
+ *       FIFO_FRAME_B_OFFSET   = 0x08
+ *       FIFO_HOLD_OFFSET      = 0x0C   hold in periods, pushes the frame
+ *       FIFO_CONTROL_OFFSET   = 0x10   run / flush / irq enable
+ *       FIFO_LEVEL_OFFSET     = 0x14   frames queued
+ *       FIFO_WATERMARK_OFFSET = 0x18   low at or below this level
+ *       FIFO_STATUS_OFFSET    = 0x1C   low / underrun / overflow / depth
+ * write() at RGB_PWM_FRAMES_OFFSET queues struct rgb_pwm_frame arrays (see
+ * rgb_pwm.h) and the FPGA plays them; the fifo_* attributes control it.
+ * The FIFO raises the interrupt while it is low and the enable is set, so
+ * a writer waiting for room enables it and sleeps, and the handler turns
+ * it off again. Without the interrupt, writers check the level every
+ * FIFO_POLL_MS instead.
+ *
+ * The duty registers are shadowed in hardware: nothing reaches the LED until
+ * COMMIT is written, and then all three duties latch together at the end of
+ * the current PWM period. Every path here that writes duties finishes with
+ * exactly one commit.
+ *
+ * Register cache: the duties and period only change when we write them and
+ * the shadow registers read back what was written, so they are cached and
+ * sysfs reads never touch the bus. COMMIT is volatile (it reads back the
+ * pending latch). The direct mode window is fully cached. Multi-register
+ * updates go through regmap_multi_reg_write(), which holds the regmap lock
+ * for the whole sequence. The LUT window is not cached: a lookup changes
+ * the shadow duties behind the PWM window's back, so intensity writes drop
+ * the cached duties. lut_lock keeps a table transfer's address and data
+ * accesses together. Fades set the shadow duties to their targets in
+ * hardware, so fade_to drops the cached duties too; the fade window is
+ * cached except for FADE_CONTROL. Frames change the duties whenever the
+ * FPGA plays one, so with the FIFO present the duties are volatile. The
+ * FIFO window is not cached; fifo_lock keeps each writer's frames together
+ * and in order.
 */
 
 
@@ -37,42 +123,237 @@
 #define GREEN_OFFSET     0x04
 #define BLUE_OFFSET      0x08
 #define PERIOD_OFFSET    0x0C
-#define SPAN             0x10
+#define COMMIT_OFFSET    0x10
+
+#define COMMIT_LATCH     0x1
+
+#define DIRECT_MODE_OFFSET      0x00
+#define DIRECT_GAIN_R_OFFSET    0x04
+#define DIRECT_GAIN_G_OFFSET    0x08
+#define DIRECT_GAIN_B_OFFSET    0x0C
+
+#define MODE_SOFTWARE    0x0
+#define MODE_DIRECT      0x1
+
+#define LUT_INT_R_OFFSET     0x00
+#define LUT_INT_G_OFFSET     0x04
+#define LUT_INT_B_OFFSET     0x08
+#define LUT_COLOR_OFFSET     0x0C
+#define LUT_COMMIT_OFFSET    0x10
+#define LUT_ADDR_OFFSET      0x14
+#define LUT_DATA_OFFSET      0x18
+#define LUT_INFO_OFFSET      0x1C
+
+#define FADE_TARGET_R_OFFSET    0x00
+#define FADE_TARGET_G_OFFSET    0x04
+#define FADE_TARGET_B_OFFSET    0x08
+#define FADE_STEPS_R_OFFSET     0x0C
+#define FADE_STEPS_G_OFFSET     0x10
+#define FADE_STEPS_B_OFFSET     0x14
+#define FADE_CONTROL_OFFSET     0x18
+
+#define FADE_START_ALL   0x7
+#define FADE_DONE        0x100
+#define FADE_MAX_STEPS   0xFFFF
+
+#define FIFO_FRAME_R_OFFSET     0x00
+#define FIFO_FRAME_G_OFFSET     0x04
+#define FIFO_FRAME_B_OFFSET     0x08
+#define FIFO_HOLD_OFFSET        0x0C
+#define FIFO_CONTROL_OFFSET     0x10
+#define FIFO_LEVEL_OFFSET       0x14
+#define FIFO_WATERMARK_OFFSET   0x18
+#define FIFO_STATUS_OFFSET      0x1C
+
+#define FIFO_RUN         0x1
+#define FIFO_FLUSH       0x2
+#define FIFO_IRQ_EN      0x4
+#define FIFO_LOW         0x1
+#define FIFO_UNDERRUN    0x2
+#define FIFO_DEPTH_SHIFT 16
+#define FIFO_MAX_HOLD    0xFFFF
+
+/* frames per regmap call in the write path */
+#define FIFO_CHUNK       8
+/* how often a writer without the interrupt rechecks the FIFO */
+#define FIFO_POLL_MS     10
+
+/* period is 11.5 fixed point ms */
+#define PERIOD_PER_MS    32
+
+#define LUT_MIN_BITS     8
+#define LUT_MAX_BITS     12
+#define LUT_CHANNELS     3
+
+/* duties are 18 bits wide (18.17), period is narrower still */
+#define REG_MASK         0x0003FFFF
+
+/* struct rgb_pwm_color must mirror the registers below COMMIT */
+static_assert(sizeof(struct rgb_pwm_color) == COMMIT_OFFSET);
 
 /* struct rgb_pwm_dev - private rgb_pwm device struct
  *
- * @base_addr:   Kernel virtual base address of the mapped reg block.
- * @red_reg:     address of red reg
- * @green_reg:   address of green reg
- * @blue_reg:    address of blue reg
- * @period_reg:  address of period reg
+ * @regs:        PWM register window (duties, period, commit)
+ * @direct:      direct mode register window; direct.map is NULL if the
+ *               device tree doesn't list it
+ * @lut:         gamma LUT register window; lut.map is NULL if the device
+ *               tree doesn't list it
+ * @lut_bits:    intensity width, read from the hardware at probe
+ * @lut_lock:    serializes table transfers (Table Address + Table Data)
+ * @fade:        fade register window; fade.map is NULL if the device tree
+ *               doesn't list it
+ * @fifo:        frame FIFO register window; fifo.map is NULL if the device
+ *               tree doesn't list it
+ * @fifo_depth:  frames the FIFO holds, read from the hardware at probe
+ * @fifo_lock:   serializes frame writers
+ * @fifo_wq:     writers and poll()ers waiting for the FIFO to go low
+ * @irq:         Linux irq number for FIFO low, or 0 if there is none
+ * @inst:        instance number and char device name
+ * @stats:       op counters and latency histograms, see fpga_stats.h
  * @miscdev:     miscdevice used to create char device
- * @lock:        prevent concurrent access to device
  *
  * struct created for each rgb_pwm device
  */
 
 struct rgb_pwm_dev {
-    void __iomem *base_addr;
-    void __iomem *red_reg;
-    void __iomem *green_reg;
-    void __iomem *blue_reg;
-    void __iomem *period_reg;
+    struct fpga_regmap regs;
+    struct fpga_regmap direct;
+    struct fpga_regmap lut;
+    unsigned int lut_bits;
+    struct mutex lut_lock;
+    struct fpga_regmap fade;
+    struct fpga_regmap fifo;
+    unsigned int fifo_depth;
+    struct mutex fifo_lock;
+    wait_queue_head_t fifo_wq;
+    int irq;
+    struct fpga_instance inst;
+    struct fpga_stats stats;
     struct miscdevice miscdev;
-    struct mutex lock;
 };
 
+static DEFINE_IDA(rgb_pwm_ida);
+
+/* used by the timed sysfs and file operation wrappers */
+static struct fpga_stats *rgb_pwm_stats(struct device *dev)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    return &priv->stats;
+}
+
+/* ------------------------- regmap ----------------------------- */
+
+static bool rgb_pwm_volatile_reg(struct device *dev, unsigned int reg)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    /* frames from the FIFO land in the duties; priv is NULL during probe */
+    if (priv && priv->fifo.map && reg <= BLUE_OFFSET)
+        return true;
+
+    return reg == COMMIT_OFFSET;
+}
+
+static const struct regmap_config rgb_pwm_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name         = "pwm",
+    .max_register = COMMIT_OFFSET,
+    .volatile_reg = rgb_pwm_volatile_reg,
+    .cache_type   = REGCACHE_MAPLE,
+};
+
+static const struct regmap_config rgb_pwm_direct_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name         = "direct",
+    .max_register = DIRECT_GAIN_B_OFFSET,
+    .cache_type   = REGCACHE_MAPLE,
+};
+
+/* reading Table Data steps the table address */
+static bool rgb_pwm_lut_precious_reg(struct device *dev, unsigned int reg)
+{
+    return reg == LUT_DATA_OFFSET;
+}
+
+static const struct regmap_config rgb_pwm_lut_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name         = "lut",
+    .max_register = LUT_INFO_OFFSET,
+    .precious_reg = rgb_pwm_lut_precious_reg,
+    .cache_type   = REGCACHE_NONE,
+};
+
+static bool rgb_pwm_fade_volatile_reg(struct device *dev, unsigned int reg)
+{
+    return reg == FADE_CONTROL_OFFSET;
+}
+
+static const struct regmap_config rgb_pwm_fade_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name         = "fade",
+    .max_register = FADE_CONTROL_OFFSET,
+    .volatile_reg = rgb_pwm_fade_volatile_reg,
+    .cache_type   = REGCACHE_MAPLE,
+};
+
+/* every FIFO register either has side effects or changes by itself */
+static const struct regmap_config rgb_pwm_fifo_regmap_config = {
+    FPGA_REGMAP_COMMON,
+    .name         = "fifo",
+    .max_register = FIFO_STATUS_OFFSET,
+    .cache_type   = REGCACHE_NONE,
+};
+
+/*
+ * Write one duty register and commit it, under a single regmap lock.
+ */
+static int rgb_pwm_set_duty(struct rgb_pwm_dev *priv, unsigned int reg, u32 val)
+{
+    const struct reg_sequence seq[] = {
+        { reg,           val & REG_MASK },
+        { COMMIT_OFFSET, COMMIT_LATCH },
+    };
+
+    return regmap_multi_reg_write(priv->regs.map, seq, ARRAY_SIZE(seq));
+}
+
+static ssize_t rgb_pwm_show_reg(struct regmap *map, unsigned int reg, char *buf)
+{
+    unsigned int val;
+    int ret;
+
+    ret = regmap_read(map, reg, &val);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", val);
+}
+
+/*
+ * Show three consecutive registers as "r g b".
+ */
+static ssize_t rgb_pwm_show_rgb(struct regmap *map, unsigned int reg, char *buf)
+{
+    u32 rgb[3];
+    int ret;
+
+    ret = regmap_bulk_read(map, reg, rgb, ARRAY_SIZE(rgb));
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%u %u %u\n", rgb[0], rgb[1], rgb[2]);
+}
+
 /* ------------------------- sysfs: red ------------------------- */
 
 static ssize_t red_show(struct device *dev,
                         struct device_attribute *attr,
                         char *buf)
 {
-    u32 red;
     struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
 
-    red = ioread32(priv->red_reg);
-    return scnprintf(buf, PAGE_SIZE, "%u\n", red);
+    return rgb_pwm_show_reg(priv->regs.map, RED_OFFSET, buf);
 }
 
 static ssize_t red_store(struct device *dev,
@@ -87,8 +368,8 @@ static ssize_t red_store(struct device *dev,
     if (ret < 0)
         return ret;
 
-    iowrite32(red, priv->red_reg);
-    return size;
+    ret = rgb_pwm_set_duty(priv, RED_OFFSET, red);
+    return ret ? ret : size;
 }
 
 /* ------------------------- sysfs: green ----------------------- */
@@ -97,11 +378,9 @@ static ssize_t green_show(struct device *dev,
                           struct device_attribute *attr,
                           char *buf)
 {
-    u32 green;
     struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
 
-    green = ioread32(priv->green_reg);
-    return scnprintf(buf, PAGE_SIZE, "%u\n", green);
+    return rgb_pwm_show_reg(priv->regs.map, GREEN_OFFSET, buf);
 }
 
 static ssize_t green_store(struct device *dev,
@@ -116,8 +395,8 @@ static ssize_t green_store(struct device *dev,
     if (ret < 0)
         return ret;
 
-    iowrite32(green, priv->green_reg);
-    return size;
+    ret = rgb_pwm_set_duty(priv, GREEN_OFFSET, green);
+    return ret ? ret : size;
 }
 
 /* ------------------------- sysfs: blue ------------------------ */
@@ -126,11 +405,9 @@ static ssize_t blue_show(struct device *dev,
                          struct device_attribute *attr,
                          char *buf)
 {
-    u32 blue;
     struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
 
-    blue = ioread32(priv->blue_reg);
-    return scnprintf(buf, PAGE_SIZE, "%u\n", blue);
+    return rgb_pwm_show_reg(priv->regs.map, BLUE_OFFSET, buf);
 }
 
 static ssize_t blue_store(struct device *dev,
@@ -145,8 +422,8 @@ static ssize_t blue_store(struct device *dev,
     if (ret < 0)
         return ret;
 
-    iowrite32(blue, priv->blue_reg);
-    return size;
+    ret = rgb_pwm_set_duty(priv, BLUE_OFFSET, blue);
+    return ret ? ret : size;
 }
 
 /* ------------------------- sysfs: period ---------------------- */
@@ -155,11 +432,9 @@ static ssize_t period_show(struct device *dev,
                            struct device_attribute *attr,
                            char *buf)
 {
-    u32 period;
     struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
 
-    period = ioread32(priv->period_reg);
-    return scnprintf(buf, PAGE_SIZE, "%u\n", period);
+    return rgb_pwm_show_reg(priv->regs.map, PERIOD_OFFSET, buf);
 }
 
 static ssize_t period_store(struct device *dev,
@@ -174,113 +449,933 @@ static ssize_t period_store(struct device *dev,
     if (ret < 0)
         return ret;
 
-    iowrite32(period, priv->period_reg);
+    ret = regmap_write(priv->regs.map, PERIOD_OFFSET, period);
+    return ret ? ret : size;
+}
+
+/* ------------------------- sysfs: color ----------------------- */
+
+/*
+ * "r g b" - all three duties, committed together so the LED goes straight
+ * to the new color at the next period boundary.
+ */
+static ssize_t color_show(struct device *dev,
+                          struct device_attribute *attr,
+                          char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    return rgb_pwm_show_rgb(priv->regs.map, RED_OFFSET, buf);
+}
+
+static ssize_t color_store(struct device *dev,
+                           struct device_attribute *attr,
+                           const char *buf, size_t size)
+{
+    u32 red, green, blue;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+    struct reg_sequence seq[] = {
+        { RED_OFFSET },
+        { GREEN_OFFSET },
+        { BLUE_OFFSET },
+        { COMMIT_OFFSET, COMMIT_LATCH },
+    };
+
+    if (sscanf(buf, "%u %u %u", &red, &green, &blue) != 3)
+        return -EINVAL;
+
+    seq[0].def = red & REG_MASK;
+    seq[1].def = green & REG_MASK;
+    seq[2].def = blue & REG_MASK;
+
+    ret = regmap_multi_reg_write(priv->regs.map, seq, ARRAY_SIZE(seq));
+    return ret ? ret : size;
+}
+
+/* ------------------------- sysfs: mode ------------------------ */
+
+/*
+ * "software": duties come from red/green/blue/color.
+ * "direct":   the FPGA maps ADC channels 0-2 straight to red/green/blue.
+ */
+static ssize_t mode_show(struct device *dev,
+                         struct device_attribute *attr,
+                         char *buf)
+{
+    unsigned int mode;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->direct.map)
+        return -ENODEV;
+
+    ret = regmap_read(priv->direct.map, DIRECT_MODE_OFFSET, &mode);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%s\n",
+                     (mode & MODE_DIRECT) ? "direct" : "software");
+}
+
+static ssize_t mode_store(struct device *dev,
+                          struct device_attribute *attr,
+                          const char *buf, size_t size)
+{
+    u32 mode;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->direct.map)
+        return -ENODEV;
+
+    if (sysfs_streq(buf, "software"))
+        mode = MODE_SOFTWARE;
+    else if (sysfs_streq(buf, "direct"))
+        mode = MODE_DIRECT;
+    else
+        return -EINVAL;
+
+    ret = regmap_write(priv->direct.map, DIRECT_MODE_OFFSET, mode);
+    return ret ? ret : size;
+}
+
+/* ---------------------- sysfs: direct_gain -------------------- */
+
+/*
+ * "r g b" - per-channel 18.17 gains used in direct mode,
+ * duty = adc * gain / 4096 (so 131072 maps full-scale ADC to 100%).
+ */
+static ssize_t direct_gain_show(struct device *dev,
+                                struct device_attribute *attr,
+                                char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->direct.map)
+        return -ENODEV;
+
+    return rgb_pwm_show_rgb(priv->direct.map, DIRECT_GAIN_R_OFFSET, buf);
+}
+
+static ssize_t direct_gain_store(struct device *dev,
+                                 struct device_attribute *attr,
+                                 const char *buf, size_t size)
+{
+    u32 gain[3];
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->direct.map)
+        return -ENODEV;
+
+    if (sscanf(buf, "%u %u %u", &gain[0], &gain[1], &gain[2]) != 3)
+        return -EINVAL;
+
+    gain[0] &= REG_MASK;
+    gain[1] &= REG_MASK;
+    gain[2] &= REG_MASK;
+
+    ret = regmap_bulk_write(priv->direct.map, DIRECT_GAIN_R_OFFSET,
+                            gain, ARRAY_SIZE(gain));
+    return ret ? ret : size;
+}
+
+/* ------------------------- sysfs: intensity ------------------- */
+
+/*
+ * "r g b" - linear intensities, 0 to 2^lut_bits - 1, looked up in the
+ * gamma tables and committed together. With 8-bit tables the whole color
+ * is one bus write.
+ */
+static ssize_t intensity_show(struct device *dev,
+                              struct device_attribute *attr,
+                              char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->lut.map)
+        return -ENODEV;
+
+    return rgb_pwm_show_rgb(priv->lut.map, LUT_INT_R_OFFSET, buf);
+}
+
+static ssize_t intensity_store(struct device *dev,
+                               struct device_attribute *attr,
+                               const char *buf, size_t size)
+{
+    u32 rgb[3];
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->lut.map)
+        return -ENODEV;
+
+    if (sscanf(buf, "%u %u %u", &rgb[0], &rgb[1], &rgb[2]) != 3)
+        return -EINVAL;
+
+    if ((rgb[0] | rgb[1] | rgb[2]) >> priv->lut_bits)
+        return -ERANGE;
+
+    if (priv->lut_bits == 8) {
+        ret = regmap_write(priv->lut.map, LUT_COLOR_OFFSET,
+                           rgb[0] | rgb[1] << 8 | rgb[2] << 16);
+    } else {
+        const struct reg_sequence seq[] = {
+            { LUT_INT_R_OFFSET,  rgb[0] },
+            { LUT_INT_G_OFFSET,  rgb[1] },
+            { LUT_INT_B_OFFSET,  rgb[2] },
+            { LUT_COMMIT_OFFSET, COMMIT_LATCH },
+        };
+
+        ret = regmap_multi_reg_write(priv->lut.map, seq, ARRAY_SIZE(seq));
+    }
+    if (ret)
+        return ret;
+
+    /* the hardware changed the shadow duties; read them back next time */
+    regcache_drop_region(priv->regs.map, RED_OFFSET, BLUE_OFFSET);
     return size;
 }
 
+/* ------------------------- sysfs: lut_bits -------------------- */
+
+static ssize_t lut_bits_show(struct device *dev,
+                             struct device_attribute *attr,
+                             char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->lut.map)
+        return -ENODEV;
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->lut_bits);
+}
+
+/* ------------------------- sysfs: fade_to --------------------- */
+
+/*
+ * "r g b ms" - fade all three duties from where they are now to r g b over
+ * ms milliseconds, rounded to whole PWM periods. One regmap call starts it;
+ * the FPGA does every step. Reading returns the last targets.
+ */
+static ssize_t fade_to_show(struct device *dev,
+                            struct device_attribute *attr,
+                            char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fade.map)
+        return -ENODEV;
+
+    return rgb_pwm_show_rgb(priv->fade.map, FADE_TARGET_R_OFFSET, buf);
+}
+
+static ssize_t fade_to_store(struct device *dev,
+                             struct device_attribute *attr,
+                             const char *buf, size_t size)
+{
+    u32 red, green, blue, ms;
+    unsigned int period;
+    u64 steps;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+    struct reg_sequence seq[] = {
+        { FADE_TARGET_R_OFFSET },
+        { FADE_TARGET_G_OFFSET },
+        { FADE_TARGET_B_OFFSET },
+        { FADE_STEPS_R_OFFSET },
+        { FADE_STEPS_G_OFFSET },
+        { FADE_STEPS_B_OFFSET },
+        { FADE_CONTROL_OFFSET, FADE_START_ALL },
+    };
+
+    if (!priv->fade.map)
+        return -ENODEV;
+
+    if (sscanf(buf, "%u %u %u %u", &red, &green, &blue, &ms) != 4)
+        return -EINVAL;
+
+    ret = regmap_read(priv->regs.map, PERIOD_OFFSET, &period);
+    if (ret)
+        return ret;
+    if (!period)
+        return -EINVAL;
+
+    steps = DIV_ROUND_CLOSEST_ULL((u64)ms * PERIOD_PER_MS, period);
+    if (steps > FADE_MAX_STEPS)
+        return -ERANGE;
+
+    seq[0].def = red & REG_MASK;
+    seq[1].def = green & REG_MASK;
+    seq[2].def = blue & REG_MASK;
+    seq[3].def = steps;
+    seq[4].def = steps;
+    seq[5].def = steps;
+
+    ret = regmap_multi_reg_write(priv->fade.map, seq, ARRAY_SIZE(seq));
+    if (ret)
+        return ret;
+
+    /* the hardware set the shadow duties to the targets */
+    regcache_drop_region(priv->regs.map, RED_OFFSET, BLUE_OFFSET);
+    return size;
+}
+
+/* ------------------------- sysfs: fade_done ------------------- */
+
+/*
+ * 1 once every channel has reached its target, 0 while any is fading
+ */
+static ssize_t fade_done_show(struct device *dev,
+                              struct device_attribute *attr,
+                              char *buf)
+{
+    unsigned int status;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fade.map)
+        return -ENODEV;
+
+    ret = regmap_read(priv->fade.map, FADE_CONTROL_OFFSET, &status);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(status & FADE_DONE));
+}
+
+/* ------------------------- sysfs: fifo_level ------------------ */
+
+/*
+ * frames queued, not counting the one on the LED
+ */
+static ssize_t fifo_level_show(struct device *dev,
+                               struct device_attribute *attr,
+                               char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    return rgb_pwm_show_reg(priv->fifo.map, FIFO_LEVEL_OFFSET, buf);
+}
+
+/* ------------------------- sysfs: fifo_depth ------------------ */
+
+static ssize_t fifo_depth_show(struct device *dev,
+                               struct device_attribute *attr,
+                               char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->fifo_depth);
+}
+
+/* ------------------------- sysfs: fifo_watermark -------------- */
+
+/*
+ * The FIFO is low, and wakes writers, at or below this many frames.
+ * A higher watermark refills sooner, a lower one in bigger batches.
+ */
+static ssize_t fifo_watermark_show(struct device *dev,
+                                   struct device_attribute *attr,
+                                   char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    return rgb_pwm_show_reg(priv->fifo.map, FIFO_WATERMARK_OFFSET, buf);
+}
+
+static ssize_t fifo_watermark_store(struct device *dev,
+                                    struct device_attribute *attr,
+                                    const char *buf, size_t size)
+{
+    u32 watermark;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    ret = kstrtou32(buf, 0, &watermark);
+    if (ret < 0)
+        return ret;
+
+    /* at depth the FIFO is always low and writers would never wait */
+    if (watermark >= priv->fifo_depth)
+        return -ERANGE;
+
+    ret = regmap_write(priv->fifo.map, FIFO_WATERMARK_OFFSET, watermark);
+    if (ret)
+        return ret;
+
+    /* writers may be waiting for a level that is now low */
+    wake_up_interruptible(&priv->fifo_wq);
+    return size;
+}
+
+/* ------------------------- sysfs: fifo_run -------------------- */
+
+/*
+ * 1 plays queued frames, 0 pauses on the frame showing now
+ */
+static ssize_t fifo_run_show(struct device *dev,
+                             struct device_attribute *attr,
+                             char *buf)
+{
+    unsigned int control;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    ret = regmap_read(priv->fifo.map, FIFO_CONTROL_OFFSET, &control);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(control & FIFO_RUN));
+}
+
+static ssize_t fifo_run_store(struct device *dev,
+                              struct device_attribute *attr,
+                              const char *buf, size_t size)
+{
+    bool run;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    ret = kstrtobool(buf, &run);
+    if (ret < 0)
+        return ret;
+
+    ret = regmap_update_bits(priv->fifo.map, FIFO_CONTROL_OFFSET, FIFO_RUN,
+                             run ? FIFO_RUN : 0);
+    return ret ? ret : size;
+}
+
+/* ------------------------- sysfs: fifo_flush ------------------ */
+
+/*
+ * writing 1 drops every queued frame; the LED keeps its current color
+ */
+static ssize_t fifo_flush_store(struct device *dev,
+                                struct device_attribute *attr,
+                                const char *buf, size_t size)
+{
+    bool flush;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    ret = kstrtobool(buf, &flush);
+    if (ret < 0)
+        return ret;
+    if (!flush)
+        return size;
+
+    /* flush is a pulse; write the other bits back as they are */
+    ret = regmap_write_bits(priv->fifo.map, FIFO_CONTROL_OFFSET,
+                            FIFO_FLUSH, FIFO_FLUSH);
+    if (ret)
+        return ret;
+
+    wake_up_interruptible(&priv->fifo_wq);
+    return size;
+}
+
+/* ------------------------- sysfs: fifo_underrun --------------- */
+
+/*
+ * 1 if a frame ran out with nothing queued behind it since this was last
+ * cleared; write 0 to clear
+ */
+static ssize_t fifo_underrun_show(struct device *dev,
+                                  struct device_attribute *attr,
+                                  char *buf)
+{
+    unsigned int status;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    ret = regmap_read(priv->fifo.map, FIFO_STATUS_OFFSET, &status);
+    if (ret)
+        return ret;
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(status & FIFO_UNDERRUN));
+}
+
+static ssize_t fifo_underrun_store(struct device *dev,
+                                   struct device_attribute *attr,
+                                   const char *buf, size_t size)
+{
+    bool underrun;
+    int ret;
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    ret = kstrtobool(buf, &underrun);
+    if (ret < 0)
+        return ret;
+    if (underrun)
+        return -EINVAL;
+
+    ret = regmap_write(priv->fifo.map, FIFO_STATUS_OFFSET, FIFO_UNDERRUN);
+    return ret ? ret : size;
+}
+
+/* ------------------------- sysfs: instance -------------------- */
+
+/*
+ * N of /dev/rgb_pwmN
+ */
+static ssize_t instance_show(struct device *dev,
+                             struct device_attribute *attr,
+                             char *buf)
+{
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", priv->inst.id);
+}
+
 /*
  * Sysfs attributes
 */
-static DEVICE_ATTR_RW(red);
-static DEVICE_ATTR_RW(green);
-static DEVICE_ATTR_RW(blue);
-static DEVICE_ATTR_RW(period);
+FPGA_DEVICE_ATTR_RW(red, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(green, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(blue, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(period, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(color, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(mode, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(direct_gain, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(intensity, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RO(lut_bits, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(fade_to, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RO(fade_done, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RO(fifo_level, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RO(fifo_depth, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(fifo_watermark, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(fifo_run, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_WO(fifo_flush, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RW(fifo_underrun, rgb_pwm_stats);
+FPGA_DEVICE_ATTR_RO(instance, rgb_pwm_stats);
+
+/* ------------------------- sysfs: lut ------------------------- */
+
+/*
+ * Binary: the three gamma tables as u32 18.17 duties, red then green then
+ * blue, 2^lut_bits entries each. Any whole number of entries can be read
+ * or written at any entry offset, so a table can be reloaded in place.
+ * The entries stream through Table Data, which steps the address itself.
+ */
+static ssize_t rgb_pwm_lut_xfer(struct rgb_pwm_dev *priv, u32 *vals,
+                                loff_t off, size_t count, bool write)
+{
+    size_t size = (size_t)LUT_CHANNELS << priv->lut_bits;
+    size_t i, n;
+    int ret;
+
+    if (!priv->lut.map)
+        return -ENODEV;
+
+    if (off % sizeof(u32))
+        return -EINVAL;
+    if (off >= size * sizeof(u32))
+        return 0;
+
+    n = min_t(size_t, count / sizeof(u32), size - off / sizeof(u32));
+    if (!n)
+        return -EINVAL;
+
+    mutex_lock(&priv->lut_lock);
+    ret = regmap_write(priv->lut.map, LUT_ADDR_OFFSET, off / sizeof(u32));
+    for (i = 0; i < n && !ret; i++) {
+        if (write)
+            ret = regmap_write(priv->lut.map, LUT_DATA_OFFSET,
+                               vals[i] & REG_MASK);
+        else
+            ret = regmap_read(priv->lut.map, LUT_DATA_OFFSET, &vals[i]);
+    }
+    mutex_unlock(&priv->lut_lock);
+
+    return ret ? ret : n * sizeof(u32);
+}
+
+static ssize_t lut_read(struct file *filp, struct kobject *kobj,
+                        struct bin_attribute *attr, char *buf,
+                        loff_t off, size_t count)
+{
+    struct device *dev = kobj_to_dev(kobj);
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+    u64 t0 = fpga_op_begin(&priv->stats);
+
+    return fpga_op_end(&priv->stats, FPGA_OP_SHOW, attr->attr.name, t0,
+                       rgb_pwm_lut_xfer(priv, (u32 *)buf, off, count, false));
+}
+
+static ssize_t lut_write(struct file *filp, struct kobject *kobj,
+                         struct bin_attribute *attr, char *buf,
+                         loff_t off, size_t count)
+{
+    struct device *dev = kobj_to_dev(kobj);
+    struct rgb_pwm_dev *priv = dev_get_drvdata(dev);
+    u64 t0 = fpga_op_begin(&priv->stats);
+
+    return fpga_op_end(&priv->stats, FPGA_OP_STORE, attr->attr.name, t0,
+                       rgb_pwm_lut_xfer(priv, (u32 *)buf, off, count, true));
+}
+
+/* size 0: the table size depends on the hardware's LUT_BITS */
+static BIN_ATTR_RW(lut, 0);
 
 static struct attribute *rgb_pwm_attrs[] = {
     &dev_attr_red.attr,
     &dev_attr_green.attr,
     &dev_attr_blue.attr,
     &dev_attr_period.attr,
+    &dev_attr_color.attr,
+    &dev_attr_mode.attr,
+    &dev_attr_direct_gain.attr,
+    &dev_attr_intensity.attr,
+    &dev_attr_lut_bits.attr,
+    &dev_attr_fade_to.attr,
+    &dev_attr_fade_done.attr,
+    &dev_attr_fifo_level.attr,
+    &dev_attr_fifo_depth.attr,
+    &dev_attr_fifo_watermark.attr,
+    &dev_attr_fifo_run.attr,
+    &dev_attr_fifo_flush.attr,
+    &dev_attr_fifo_underrun.attr,
+    &dev_attr_instance.attr,
+    NULL,
+};
+
+static struct bin_attribute *rgb_pwm_bin_attrs[] = {
+    &bin_attr_lut,
     NULL,
 };
 
-ATTRIBUTE_GROUPS(rgb_pwm);
+static const struct attribute_group rgb_pwm_group = {
+    .attrs     = rgb_pwm_attrs,
+    .bin_attrs = rgb_pwm_bin_attrs,
+};
+
+__ATTRIBUTE_GROUPS(rgb_pwm);
 
 /* ----------------- char device: read/write -------------------- */
 
 static ssize_t rgb_pwm_read(struct file *file, char __user *buf,
                             size_t count, loff_t *offset)
 {
-    size_t ret;
-    u32 val;
-
     struct rgb_pwm_dev *priv = container_of(file->private_data,
                                struct rgb_pwm_dev, miscdev);
 
-    if (*offset < 0) {
-        return -EINVAL;
+    return fpga_regmap_read_user(&priv->regs, buf, count, offset);
+}
+
+/* ----------------- char device: frame FIFO ------------------- */
+
+static bool rgb_pwm_fifo_low(struct rgb_pwm_dev *priv)
+{
+    unsigned int status;
+
+    /* a failed read wakes the writer, which then sees the error itself */
+    if (regmap_read(priv->fifo.map, FIFO_STATUS_OFFSET, &status))
+        return true;
+
+    return status & FIFO_LOW;
+}
+
+/*
+ * Sleep until the FIFO is low. With the interrupt, the FPGA wakes us;
+ * without it, return after FIFO_POLL_MS so the caller checks again.
+ */
+static int rgb_pwm_fifo_wait(struct rgb_pwm_dev *priv)
+{
+    long ret;
+
+    if (priv->irq) {
+        ret = regmap_update_bits(priv->fifo.map, FIFO_CONTROL_OFFSET,
+                                 FIFO_IRQ_EN, FIFO_IRQ_EN);
+        if (ret)
+            return ret;
+
+        ret = wait_event_interruptible(priv->fifo_wq, rgb_pwm_fifo_low(priv));
+    } else {
+        ret = wait_event_interruptible_timeout(priv->fifo_wq,
+                                               rgb_pwm_fifo_low(priv),
+                                               msecs_to_jiffies(FIFO_POLL_MS));
     }
-    if (*offset >= SPAN) {
-        return 0;
+
+    return ret < 0 ? ret : 0;
+}
+
+/*
+ * Queue up to FIFO_CHUNK frames in one regmap call. Each Frame Hold write
+ * pushes the frame staged ahead of it.
+ */
+static int rgb_pwm_push_frames(struct rgb_pwm_dev *priv,
+                               const struct rgb_pwm_frame *frames, size_t n)
+{
+    struct reg_sequence seq[FIFO_CHUNK * 4];
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (frames[i].hold > FIFO_MAX_HOLD)
+            return -ERANGE;
+
+        seq[4 * i + 0] = (struct reg_sequence){ FIFO_FRAME_R_OFFSET,
+                                                frames[i].red & REG_MASK };
+        seq[4 * i + 1] = (struct reg_sequence){ FIFO_FRAME_G_OFFSET,
+                                                frames[i].green & REG_MASK };
+        seq[4 * i + 2] = (struct reg_sequence){ FIFO_FRAME_B_OFFSET,
+                                                frames[i].blue & REG_MASK };
+        seq[4 * i + 3] = (struct reg_sequence){ FIFO_HOLD_OFFSET,
+                                                frames[i].hold };
     }
-    if ((*offset % 0x04) != 0) {
-        pr_warn("rgb_pwm_read: unaligned access\n");
+
+    return regmap_multi_reg_write(priv->fifo.map, seq, 4 * n);
+}
+
+/*
+ * write at RGB_PWM_FRAMES_OFFSET: an array of struct rgb_pwm_frame. Frames
+ * go in as fast as there is room; when the FIFO is full a blocking writer
+ * sleeps until it drains to the watermark. Returns the bytes queued, which
+ * is short only after a signal or error with some frames already in.
+ */
+static ssize_t rgb_pwm_write_frames(struct rgb_pwm_dev *priv,
+                                    struct file *file,
+                                    const char __user *buf, size_t count)
+{
+    struct rgb_pwm_frame frames[FIFO_CHUNK];
+    size_t total = count / sizeof(struct rgb_pwm_frame);
+    size_t done = 0;
+    unsigned int level;
+    int ret = 0;
+
+    if (!priv->fifo.map)
+        return -ENODEV;
+
+    if (!total || count % sizeof(struct rgb_pwm_frame))
         return -EINVAL;
-    }
 
-    val = ioread32(priv->base_addr + *offset);
+    if (mutex_lock_interruptible(&priv->fifo_lock))
+        return -ERESTARTSYS;
 
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
-        pr_warn("rgb_pwm_read: nothing copied\n");
-        return -EFAULT;
+    while (done < total) {
+        size_t n;
+
+        ret = regmap_read(priv->fifo.map, FIFO_LEVEL_OFFSET, &level);
+        if (ret)
+            break;
+
+        if (level >= priv->fifo_depth) {
+            if (file->f_flags & O_NONBLOCK) {
+                ret = -EAGAIN;
+                break;
+            }
+
+            ret = rgb_pwm_fifo_wait(priv);
+            if (ret)
+                break;
+            continue;
+        }
+
+        n = min3(total - done, (size_t)(priv->fifo_depth - level),
+                 (size_t)FIFO_CHUNK);
+
+        if (copy_from_user(frames, buf + done * sizeof(*frames),
+                           n * sizeof(*frames))) {
+            ret = -EFAULT;
+            break;
+        }
+
+        ret = rgb_pwm_push_frames(priv, frames, n);
+        if (ret)
+            break;
+
+        done += n;
     }
 
-    *offset += sizeof(val);
-    return sizeof(val);
+    mutex_unlock(&priv->fifo_lock);
+
+    return done ? done * sizeof(struct rgb_pwm_frame) : ret;
 }
 
+/*
+ * write: any whole number of 32-bit registers starting at the file offset,
+ * e.g. a struct rgb_pwm_color at offset 0. If any duty register was written,
+ * a single commit follows so the new duties latch together, unless the range
+ * already included COMMIT. Offsets from RGB_PWM_FRAMES_OFFSET up queue
+ * frames instead.
+ */
 static ssize_t rgb_pwm_write(struct file *file, const char __user *buf,
                              size_t count, loff_t *offset)
 {
-    size_t ret;
-    u32 val;
+    u32 vals[FPGA_REGMAP_MAX_REGS];
+    struct reg_sequence seq[FPGA_REGMAP_MAX_REGS + 1];
+    ssize_t i, n;
+    size_t len = 0;
+    bool duty_written = false;
+    bool commit_written = false;
+    int ret;
 
     struct rgb_pwm_dev *priv = container_of(file->private_data,
                                struct rgb_pwm_dev, miscdev);
 
-    if (*offset < 0) {
-        return -EINVAL;
-    }
-    if (*offset >= SPAN) {
-        return 0;
-    }
-    if ((*offset % 0x04) != 0) {
-        pr_warn("rgb_pwm_write: unaligned access\n");
-        return -EINVAL;
+    if (*offset >= RGB_PWM_FRAMES_OFFSET)
+        return rgb_pwm_write_frames(priv, file, buf, count);
+
+    n = fpga_regmap_count(&priv->regs, count, *offset);
+    if (n <= 0)
+        return n;
+
+    if (copy_from_user(vals, buf, n * sizeof(u32))) {
+        pr_warn("rgb_pwm_write: nothing copied from user space\n");
+        return -EFAULT;
     }
 
-    mutex_lock(&priv->lock);
+    for (i = 0; i < n; i++) {
+        unsigned int reg = *offset + i * sizeof(u32);
 
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret != sizeof(val)) {
-        val &= 0x0000FFFF;
-        iowrite32(val, priv->base_addr + *offset);
+        if (reg == COMMIT_OFFSET) {
+            seq[len++] = (struct reg_sequence){ reg, vals[i] };
+            commit_written = true;
+            continue;
+        }
 
-        *offset += sizeof(val);
-        ret = sizeof(val);
-    } else {
-        pr_warn("rgb_pwm_write: nothing copied from user space\n");
-        ret = -EFAULT;
+        seq[len++] = (struct reg_sequence){ reg, vals[i] & REG_MASK };
+        if (reg <= BLUE_OFFSET)
+            duty_written = true;
     }
 
-    mutex_unlock(&priv->lock);
-    return ret;
+    if (duty_written && !commit_written)
+        seq[len++] = (struct reg_sequence){ COMMIT_OFFSET, COMMIT_LATCH };
+
+    ret = regmap_multi_reg_write(priv->regs.map, seq, len);
+    if (ret)
+        return ret;
+
+    *offset += n * sizeof(u32);
+    return n * sizeof(u32);
+}
+
+/*
+ * mmap: map the page holding the registers, uncached, so userspace can update
+ * duties with plain stores. The registers start at (base & ~PAGE_MASK) within
+ * the mapping. The PWM register cache is bypassed while the mapping exists.
+ */
+static int rgb_pwm_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct rgb_pwm_dev *priv = container_of(file->private_data,
+                               struct rgb_pwm_dev, miscdev);
+
+    return fpga_regmap_mmap(&priv->regs, vma, true);
+}
+
+/*
+ * poll: writable while the frame FIFO is at or below its watermark, so a
+ * frame writer knows a write() won't block. Without the FIFO the registers
+ * are always writable. Without the interrupt nothing would wake a poller
+ * when the FIFO drains, so it always reports writable; a blocking write()
+ * then polls the level itself and O_NONBLOCK gets EAGAIN while it's full.
+ */
+static __poll_t rgb_pwm_poll(struct file *file, poll_table *wait)
+{
+    struct rgb_pwm_dev *priv = container_of(file->private_data,
+                               struct rgb_pwm_dev, miscdev);
+
+    if (!priv->fifo.map || !priv->irq)
+        return EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file, &priv->fifo_wq, wait);
+
+    if (rgb_pwm_fifo_low(priv))
+        return EPOLLOUT | EPOLLWRNORM;
+
+    /* have the FPGA wake us when it drains */
+    regmap_update_bits(priv->fifo.map, FIFO_CONTROL_OFFSET,
+                       FIFO_IRQ_EN, FIFO_IRQ_EN);
+
+    return 0;
+}
+
+/*
+ * The FIFO irq is level-sensitive and stays up while the FIFO is low, so
+ * the handler turns the enable off before waking the waiters; whoever
+ * sleeps next turns it back on.
+ */
+static irqreturn_t rgb_pwm_fifo_irq_thread(int irq, void *dev_id)
+{
+    struct rgb_pwm_dev *priv = dev_id;
+    unsigned int control;
+
+    if (regmap_read(priv->fifo.map, FIFO_CONTROL_OFFSET, &control) ||
+        !(control & FIFO_IRQ_EN))
+        return IRQ_NONE;
+
+    regmap_update_bits(priv->fifo.map, FIFO_CONTROL_OFFSET, FIFO_IRQ_EN, 0);
+    wake_up_interruptible(&priv->fifo_wq);
+
+    return IRQ_HANDLED;
 }
 
+FPGA_STATS_READ(rgb_pwm_read, rgb_pwm_stats)
+FPGA_STATS_WRITE(rgb_pwm_write, rgb_pwm_stats)
+FPGA_STATS_MMAP(rgb_pwm_mmap, rgb_pwm_stats)
+
 static const struct file_operations rgb_pwm_fops = {
     .owner  = THIS_MODULE,
-    .read   = rgb_pwm_read,
-    .write  = rgb_pwm_write,
+    .read   = rgb_pwm_read_timed,
+    .write  = rgb_pwm_write_timed,
+    .mmap   = rgb_pwm_mmap_timed,
+    .poll   = rgb_pwm_poll,
     .llseek = default_llseek,
 };
 
 /* ----------------- probe / remove / of_match ------------------ */
 
+/* Initial state: LEDs off, full-scale period */
+static const struct reg_sequence rgb_pwm_init[] = {
+    { RED_OFFSET,    0 },
+    { GREEN_OFFSET,  0 },
+    { BLUE_OFFSET,   0 },
+    { COMMIT_OFFSET, COMMIT_LATCH },
+    { PERIOD_OFFSET, 0x0FFF },
+};
+
+/*
+ * Start under software control with unity gains. Writing the gains, rather
+ * than relying on their reset value, also fills the register cache.
+ */
+static const struct reg_sequence rgb_pwm_direct_init[] = {
+    { DIRECT_MODE_OFFSET,   MODE_SOFTWARE },
+    { DIRECT_GAIN_R_OFFSET, 1 << 17 },
+    { DIRECT_GAIN_G_OFFSET, 1 << 17 },
+    { DIRECT_GAIN_B_OFFSET, 1 << 17 },
+};
+
 static int rgb_pwm_probe(struct platform_device *pdev)
 {
     struct rgb_pwm_dev *priv;
-    struct resource *res;
     int ret;
 
     priv = devm_kzalloc(&pdev->dev, sizeof(struct rgb_pwm_dev), GFP_KERNEL);
@@ -289,46 +1384,148 @@ static int rgb_pwm_probe(struct platform_device *pdev)
         return -ENOMEM;
     }
 
-    res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+    // Pick the instance number that names /dev/rgb_pwmN
+    ret = fpga_instance_init(&pdev->dev, &rgb_pwm_ida, "rgb-pwm", "rgb_pwm",
+                             &priv->inst);
+    if (ret) {
+        pr_err("rgb_pwm: Failed to get an instance number\n");
+        return ret;
+    }
+
+    /* counters and histograms under /sys/kernel/debug/rgb_pwmN */
+    ret = fpga_stats_init(&pdev->dev, &priv->stats, priv->inst.name);
+    if (ret)
+        return ret;
+
     /*
-     * Request and remap the device's memory region. Requesting the region
-     * make sure nobody else can use that memory. The memory is remapped
-     * into the kernel's virtual address space because we don't have access
-     * to physical memory locations.
-   */
-    priv->base_addr = devm_ioremap_resource(&pdev->dev, res);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("rgb_pwm: Failed to request/remap platform device resource\n");
-        return PTR_ERR(priv->base_addr);
+     * Request and remap the device's memory region and put a regmap on
+     * top of it. Requesting the region make sure nobody else can use that
+     * memory.
+     */
+    ret = fpga_regmap_init(pdev, 0, &rgb_pwm_regmap_config, &priv->stats,
+                           &priv->regs);
+    if (ret) {
+        pr_err("rgb_pwm: Failed to map registers\n");
+        return ret;
     }
 
-    priv->red_reg    = priv->base_addr + RED_OFFSET;
-    priv->green_reg  = priv->base_addr + GREEN_OFFSET;
-    priv->blue_reg   = priv->base_addr + BLUE_OFFSET;
-    priv->period_reg = priv->base_addr + PERIOD_OFFSET;
+    /* Direct mode registers are optional; older device trees only list one reg */
+    if (platform_get_resource(pdev, IORESOURCE_MEM, 1)) {
+        ret = fpga_regmap_init(pdev, 1, &rgb_pwm_direct_regmap_config,
+                               &priv->stats, &priv->direct);
+        if (ret) {
+            pr_err("rgb_pwm: Failed to map direct mode registers\n");
+            return ret;
+        }
+
+        ret = regmap_multi_reg_write(priv->direct.map, rgb_pwm_direct_init,
+                                     ARRAY_SIZE(rgb_pwm_direct_init));
+        if (ret)
+            return ret;
+    }
+
+    /* The gamma LUT is optional too; its tables power up as gamma 2.2 */
+    mutex_init(&priv->lut_lock);
+    if (platform_get_resource(pdev, IORESOURCE_MEM, 2)) {
+        ret = fpga_regmap_init(pdev, 2, &rgb_pwm_lut_regmap_config,
+                               &priv->stats, &priv->lut);
+        if (ret) {
+            pr_err("rgb_pwm: Failed to map gamma LUT registers\n");
+            return ret;
+        }
+
+        ret = regmap_read(priv->lut.map, LUT_INFO_OFFSET, &priv->lut_bits);
+        if (ret)
+            return ret;
+
+        if (priv->lut_bits < LUT_MIN_BITS || priv->lut_bits > LUT_MAX_BITS) {
+            pr_err("rgb_pwm: Unexpected gamma LUT size %u bits\n",
+                   priv->lut_bits);
+            return -ENODEV;
+        }
+    }
+
+    /* So are the fade registers */
+    if (platform_get_resource(pdev, IORESOURCE_MEM, 3)) {
+        ret = fpga_regmap_init(pdev, 3, &rgb_pwm_fade_regmap_config,
+                               &priv->stats, &priv->fade);
+        if (ret) {
+            pr_err("rgb_pwm: Failed to map fade registers\n");
+            return ret;
+        }
+    }
+
+    /* And the frame FIFO, which starts empty, running, irq off */
+    mutex_init(&priv->fifo_lock);
+    init_waitqueue_head(&priv->fifo_wq);
+    if (platform_get_resource(pdev, IORESOURCE_MEM, 4)) {
+        unsigned int status;
+
+        ret = fpga_regmap_init(pdev, 4, &rgb_pwm_fifo_regmap_config,
+                               &priv->stats, &priv->fifo);
+        if (ret) {
+            pr_err("rgb_pwm: Failed to map frame FIFO registers\n");
+            return ret;
+        }
+
+        ret = regmap_write(priv->fifo.map, FIFO_CONTROL_OFFSET,
+                           FIFO_RUN | FIFO_FLUSH);
+        if (ret)
+            return ret;
+
+        ret = regmap_read(priv->fifo.map, FIFO_STATUS_OFFSET, &status);
+        if (ret)
+            return ret;
+
+        priv->fifo_depth = status >> FIFO_DEPTH_SHIFT;
+        if (!priv->fifo_depth) {
+            pr_err("rgb_pwm: Unexpected frame FIFO depth 0\n");
+            return -ENODEV;
+        }
+
+        /*
+         * Older device trees have no interrupt (-ENXIO); frame writers then
+         * poll the level instead of sleeping until the FIFO is low. Other
+         * errors, -EPROBE_DEFER included, fail the probe.
+         */
+        priv->irq = platform_get_irq_optional(pdev, 0);
+        if (priv->irq > 0) {
+            ret = devm_request_threaded_irq(&pdev->dev, priv->irq, NULL,
+                                            rgb_pwm_fifo_irq_thread,
+                                            IRQF_ONESHOT, priv->inst.name,
+                                            priv);
+            if (ret)
+                return dev_err_probe(&pdev->dev, ret,
+                                     "rgb_pwm: Failed to request irq %d\n",
+                                     priv->irq);
+        } else if (priv->irq == -ENXIO) {
+            priv->irq = 0;
+        } else {
+            return dev_err_probe(&pdev->dev, priv->irq,
+                                 "rgb_pwm: Failed to get irq\n");
+        }
+    }
 
-    /* Initialize: LEDs off, full-scale period */
-    iowrite32(0, priv->red_reg);
-    iowrite32(0, priv->green_reg);
-    iowrite32(0, priv->blue_reg);
-    iowrite32(0x0FFF, priv->period_reg);
+    ret = regmap_multi_reg_write(priv->regs.map, rgb_pwm_init,
+                                 ARRAY_SIZE(rgb_pwm_init));
+    if (ret)
+        return ret;
+
+    /* the timed file operations need drvdata as soon as the char dev exists */
+    platform_set_drvdata(pdev, priv);
 
     priv->miscdev.minor  = MISC_DYNAMIC_MINOR;
-    priv->miscdev.name   = "rgb_pwm";
+    priv->miscdev.name   = priv->inst.name;
     priv->miscdev.fops   = &rgb_pwm_fops;
     priv->miscdev.parent = &pdev->dev;
 
-    mutex_init(&priv->lock);
-
     ret = misc_register(&priv->miscdev);
     if (ret) {
         pr_err("rgb_pwm: Failed to register misc device\n");
         return ret;
     }
 
-    platform_set_drvdata(pdev, priv);
-
-    pr_info("rgb_pwm_probe successful\n");
+    pr_info("rgb_pwm_probe successful: %s\n", priv->inst.name);
     return 0;
 }
 
@@ -336,9 +1533,14 @@ static void rgb_pwm_remove(struct platform_device *pdev)
 {
     struct rgb_pwm_dev *priv = platform_get_drvdata(pdev);
 
+    /* stop the FIFO from raising the irq before it gets freed */
+    if (priv->fifo.map)
+        regmap_update_bits(priv->fifo.map, FIFO_CONTROL_OFFSET,
+                           FIFO_IRQ_EN, 0);
+
     misc_deregister(&priv->miscdev);
 
-    pr_info("rgb_pwm_remove\n");
+    pr_info("rgb_pwm_remove: %s\n", priv->inst.name);
 }
 
 /*
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Userspace interface for the rgb_pwm char device (/dev/rgb_pwmN).
+ *
+ * This header is shared by the driver and by userspace programs (sw/hwio.c),
+ * so it only uses types from <linux/types.h>.
+ */
+#ifndef RGB_PWM_H
+#define RGB_PWM_H
+
+#include <linux/types.h>
+
+/*
+ * struct rgb_pwm_color - Register block as seen by write() at offset 0.
+ * @red: Red duty, 18.17 fixed point (1 << 17 = 100%).
+ * @green: Green duty.
+ * @blue: Blue duty.
+ * @period: PWM period, 11.5 fixed point ms.
+ *
+ * The fields follow the register map, so one write() of the whole struct
+ * updates every register, and one write() of the first three fields (12
+ * bytes) sets a color and leaves the period alone. Either way the driver
+ * issues a single commit after the duties are written, and the hardware
+ * applies the new color at the next PWM period boundary.
+ */
+struct rgb_pwm_color {
+	__u32 red;
+	__u32 green;
+	__u32 blue;
+	__u32 period;
+};
+
+/*
+ * Frames are written at this file offset and above (see below); a write()
+ * there never reaches the registers at offset 0.
+ */
+#define RGB_PWM_FRAMES_OFFSET	0x1000
+
+/*
+ * struct rgb_pwm_frame - One entry of the hardware frame FIFO.
+ * @red: Red duty, 18.17 fixed point.
+ * @green: Green duty.
+ * @blue: Blue duty.
+ * @hold: How long to show the frame, in PWM periods (1 to 65535, 0 = 1).
+ *
+ * write() an array of frames at RGB_PWM_FRAMES_OFFSET (e.g. with pwrite())
+ * and the FPGA plays them back to back, changing color on PWM period
+ * boundaries, with no further software involvement. A blocking write()
+ * sleeps until the FIFO drains to its watermark whenever it fills, and
+ * returns once every frame is queued; with O_NONBLOCK it queues what fits
+ * and fails with EAGAIN if nothing did. poll() reports POLLOUT while the
+ * FIFO is at or below its watermark, or always when the device has no
+ * interrupt to wake it. The file offset doesn't move.
+ */
+struct rgb_pwm_frame {
+	__u32 red;
+	__u32 green;
+	__u32 blue;
+	__u32 hold;
+};
+
+#endif /* RGB_PWM_H */
@@ -0,0 +1,1045 @@
+// board_sim.c
+// Simulated DE10-Nano peripherals, so pot_to_rgb and friends can be run and
+// benchmarked on a plain Linux box.
+//
+// board_sim creates the sysfs attributes and /dev nodes the drivers would,
+// as ordinary files under a root directory (CLASS = ROOT/sys/class/misc):
+//   CLASS/adc0/device/{ch0_raw..ch7_raw,auto_update,instance}
+//   CLASS/rgb_pwmN/device/{red,green,blue,period,color,mode,direct_gain,
+//                          instance}
+//   CLASS/led_barN/device/{sw_led_control,instance}
+//   CLASS/push_button0/device/{push_button_reg,presses,has_irq,instance}
+//   ROOT/dev/{adc0,rgb_pwmN,led_barN,push_button0}   (binary register images)
+// with N = 0..count-1 from -n (default 1), and then runs a register model at
+// --rate Hz:
+//   - ADC channels follow scripted waveforms (sysfs text and /dev/adc0),
+//     plus optional uniform noise of +/- -N codes like a real pot
+//   - RGB PWM: sysfs and /dev/rgb_pwmN are two views of one register file;
+//     a duty write commits and the color latches at the next PWM period
+//     boundary, like pwm_rgb_avalon. Direct mode follows the ADC.
+//   - LED bar: writes are mirrored between views and counted
+//   - push button: scripted presses latch until software writes 0
+//
+// Programs pick the simulated tree up through hwio's root prefix:
+//   ./board_sim -R /tmp/de10nano &
+//   HWIO_ROOT=/tmp/de10nano ./pot_to_rgb -c --rate 10000 --stats
+//
+// On exit (SIGINT/SIGTERM or -t) board_sim prints what it saw, including the
+// latency from an ADC value change to the matching color reaching the LED
+// of rgb_pwm0 (pot mode only) and from a button press to software clearing
+// it.
+//
+// Script format (-s), one event per line, times in ms from start:
+//   <t_ms> adc <ch> const <value>
+//   <t_ms> adc <ch> sine|ramp|square|triangle <period_ms> <min> <max>
+//   <t_ms> button
+//   <t_ms> end
+// '#' starts a comment. Without -s, ch0-2 get a sine, a triangle and a
+// square wave and board_sim runs until it is stopped.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hwio.h"
+
+// duty is 18.17 => scale by 2^17
+#define DUTY_SCALE       (1u << 17)
+
+#define DEFAULT_ROOT     "/tmp/de10nano"
+#define DEFAULT_RATE_HZ  10000
+
+#define MAX_EVENTS       256
+#define PROBES           64         // outstanding ADC changes per channel
+#define MAX_LATENCIES    (1 << 20)
+
+#define RGB_REGS         (0x20 / 4)
+#define RGB_COMMIT_REG   4
+
+enum wave {
+    WAVE_CONST,
+    WAVE_SINE,
+    WAVE_RAMP,
+    WAVE_SQUARE,
+    WAVE_TRIANGLE,
+};
+
+enum event_kind {
+    EV_ADC,
+    EV_BUTTON,
+    EV_END,
+};
+
+struct event {
+    double t_ms;
+    enum event_kind kind;
+    unsigned int ch;
+    enum wave wave;
+    double period_ms;
+    double lo, hi;
+};
+
+struct channel {
+    enum wave wave;
+    double start_ms;
+    double period_ms;
+    double lo, hi;
+    uint32_t value;
+};
+
+// an ADC value the LED should eventually show, and when it appeared
+struct probe {
+    uint64_t t_ns;
+    uint32_t duty;
+};
+
+struct latencies {
+    uint32_t *ns;
+    unsigned long n;
+};
+
+// a text attribute: fd plus the last contents we wrote or saw
+struct attr {
+    int fd;
+    char last[64];
+    int len;
+};
+
+// one RGB PWM instance
+struct sim_rgb {
+    struct attr attr[HWIO_RGB_NUM_REGS];
+    struct attr color;
+    struct attr mode;
+    struct attr gain_attr;
+    int dev;
+    uint32_t dev_last[RGB_REGS];
+    uint32_t shadow[3];
+    uint32_t period;
+    uint32_t gain[3];
+    int direct;
+    int commit_pending;
+    uint64_t latch_ns;
+    uint32_t out[3];                // duties driving the LED
+};
+
+// one LED bar instance
+struct sim_bar {
+    struct attr attr;
+    int dev;
+    uint32_t value;
+    uint32_t dev_last;
+};
+
+struct sim {
+    char root[HWIO_PATH_MAX];
+    unsigned int count;             // RGB PWM and LED bar instances
+
+    struct attr adc_ch[HWIO_ADC_CHANNELS];
+    struct attr adc_auto;
+    int adc_dev;
+    struct channel ch[HWIO_ADC_CHANNELS];
+
+    struct sim_rgb rgb[HWIO_MAX_INSTANCES];
+    struct sim_bar bar[HWIO_MAX_INSTANCES];
+
+    struct attr btn_attr;
+    struct attr btn_presses;
+    struct attr btn_has_irq;
+    int btn_dev;
+    uint32_t btn_status;
+    uint32_t btn_dev_last;
+    unsigned long presses;
+    uint64_t press_ns;
+
+    unsigned int noise;             // ADC noise amplitude in codes
+    uint32_t rng;                   // xorshift32 state for the noise
+
+    struct probe probes[3][PROBES];
+    unsigned int probe_head[3];
+    unsigned int probe_count[3];
+
+    struct event events[MAX_EVENTS];
+    int num_events;
+    int next_event;
+
+    struct {
+        unsigned long ticks;
+        unsigned long missed;
+        unsigned long adc_updates;
+        unsigned long rgb_writes;
+        unsigned long rgb_latches;
+        unsigned long bar_updates;
+        unsigned long presses_cleared;
+    } st;
+    struct latencies adc_lat;
+    struct latencies btn_lat;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------------------------- files ---------------------------- */
+
+// mkdir -p
+static int make_dirs(const char *path)
+{
+    char tmp[HWIO_PATH_MAX * 2];
+    char *p;
+
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (p = tmp + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) != 0 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    if (mkdir(tmp, 0755) != 0 && errno != EEXIST)
+        return -1;
+
+    return 0;
+}
+
+static int open_file(const struct sim *sim, const char *dir, const char *name)
+{
+    char path[HWIO_PATH_MAX * 2];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s%s", sim->root, dir);
+    if (make_dirs(path) != 0) {
+        fprintf(stderr, "board_sim: mkdir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s%s/%s", sim->root, dir, name);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        fprintf(stderr, "board_sim: open %s: %s\n", path, strerror(errno));
+
+    return fd;
+}
+
+static int attr_write(struct attr *a, const char *text)
+{
+    int len = (int)strlen(text);
+
+    if (pwrite(a->fd, text, len, 0) != len || ftruncate(a->fd, len) != 0)
+        return -1;
+
+    snprintf(a->last, sizeof(a->last), "%s", text);
+    a->len = len;
+    return 0;
+}
+
+static int attr_write_u32(struct attr *a, uint32_t value)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%u\n", value);
+    return attr_write(a, buf);
+}
+
+static int attr_open(struct attr *a, const struct sim *sim, const char *dir,
+                     const char *name, const char *initial)
+{
+    a->fd = open_file(sim, dir, name);
+    if (a->fd < 0)
+        return -1;
+
+    return attr_write(a, initial);
+}
+
+// return 1 if the attribute changed since we last looked, copying it to buf
+static int attr_changed(struct attr *a, char *buf, int size)
+{
+    ssize_t n = pread(a->fd, buf, size - 1, 0);
+
+    if (n < 0)
+        return 0;
+    buf[n] = '\0';
+
+    if (n == a->len && memcmp(buf, a->last, n) == 0)
+        return 0;
+
+    snprintf(a->last, sizeof(a->last), "%s", buf);
+    a->len = (int)n;
+    return 1;
+}
+
+static int dev_open(const struct sim *sim, const char *name, size_t size)
+{
+    char zero[0x20] = { 0 };
+    int fd = open_file(sim, "/dev", name);
+
+    if (fd < 0)
+        return -1;
+    if (pwrite(fd, zero, size, 0) != (ssize_t)size)
+        return -1;
+
+    return fd;
+}
+
+/* --------------------------- latency --------------------------- */
+
+static void record_latency(struct latencies *l, uint64_t ns)
+{
+    if (l->n < MAX_LATENCIES)
+        l->ns[l->n++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_latencies(const char *name, struct latencies *l)
+{
+    double sum = 0;
+    unsigned long i;
+
+    if (l->n == 0) {
+        printf("  %-18s no samples\n", name);
+        return;
+    }
+
+    qsort(l->ns, l->n, sizeof(l->ns[0]), cmp_u32);
+    for (i = 0; i < l->n; i++)
+        sum += l->ns[i];
+
+    printf("  %-18s n=%lu min=%.1fus avg=%.1fus p50=%.1fus p99=%.1fus max=%.1fus\n",
+           name, l->n, l->ns[0] / 1e3, sum / l->n / 1e3,
+           l->ns[l->n / 2] / 1e3, l->ns[(l->n * 99) / 100] / 1e3,
+           l->ns[l->n - 1] / 1e3);
+}
+
+// rounded like color_map's level_to_duty(), so -g 1 colors match exactly
+static uint32_t adc_to_duty(uint32_t adc)
+{
+    return (adc * DUTY_SCALE + 4095u / 2) / 4095u;
+}
+
+static void probe_push(struct sim *sim, unsigned int ch, uint64_t t, uint32_t duty)
+{
+    unsigned int slot = (sim->probe_head[ch] + sim->probe_count[ch]) % PROBES;
+
+    sim->probes[ch][slot].t_ns = t;
+    sim->probes[ch][slot].duty = duty;
+    if (sim->probe_count[ch] < PROBES)
+        sim->probe_count[ch]++;
+    else
+        sim->probe_head[ch] = (sim->probe_head[ch] + 1) % PROBES;
+}
+
+// the LED now shows duty on ch: match it against the newest ADC change that
+// asked for it, and forget everything older
+static void probe_match(struct sim *sim, unsigned int ch, uint64_t t, uint32_t duty)
+{
+    int i;
+
+    for (i = (int)sim->probe_count[ch] - 1; i >= 0; i--) {
+        unsigned int slot = (sim->probe_head[ch] + i) % PROBES;
+
+        if (sim->probes[ch][slot].duty != duty)
+            continue;
+
+        record_latency(&sim->adc_lat, t - sim->probes[ch][slot].t_ns);
+        sim->probe_head[ch] = (slot + 1) % PROBES;
+        sim->probe_count[ch] -= i + 1;
+        return;
+    }
+}
+
+/* ---------------------------- script ---------------------------- */
+
+static int parse_wave(const char *name, enum wave *wave)
+{
+    static const char *const names[] = {
+        [WAVE_CONST] = "const",
+        [WAVE_SINE] = "sine",
+        [WAVE_RAMP] = "ramp",
+        [WAVE_SQUARE] = "square",
+        [WAVE_TRIANGLE] = "triangle",
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *wave = (enum wave)i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int add_event(struct sim *sim, const struct event *ev)
+{
+    if (sim->num_events >= MAX_EVENTS) {
+        fprintf(stderr, "board_sim: more than %d events\n", MAX_EVENTS);
+        return -1;
+    }
+
+    sim->events[sim->num_events++] = *ev;
+    return 0;
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+    const struct event *x = a;
+    const struct event *y = b;
+
+    return (x->t_ms > y->t_ms) - (x->t_ms < y->t_ms);
+}
+
+static int load_script(struct sim *sim, const char *path)
+{
+    char line[256];
+    char kind[16], wave[16];
+    struct event ev;
+    int lineno = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        fprintf(stderr, "board_sim: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        int n;
+
+        lineno++;
+        if (hash)
+            *hash = '\0';
+
+        memset(&ev, 0, sizeof(ev));
+        n = sscanf(line, "%lf %15s %u %15s %lf %lf %lf", &ev.t_ms, kind,
+                   &ev.ch, wave, &ev.period_ms, &ev.lo, &ev.hi);
+        if (n <= 0)
+            continue;
+
+        if (n >= 2 && strcmp(kind, "button") == 0) {
+            ev.kind = EV_BUTTON;
+        } else if (n >= 2 && strcmp(kind, "end") == 0) {
+            ev.kind = EV_END;
+        } else if (n >= 4 && strcmp(kind, "adc") == 0 &&
+                   ev.ch < HWIO_ADC_CHANNELS && parse_wave(wave, &ev.wave) == 0 &&
+                   (ev.wave == WAVE_CONST ? n >= 5 : n == 7)) {
+            ev.kind = EV_ADC;
+            if (ev.wave == WAVE_CONST)
+                ev.lo = ev.hi = ev.period_ms;
+        } else {
+            fprintf(stderr, "board_sim: %s:%d: bad event\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+
+        if (add_event(sim, &ev) != 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void default_script(struct sim *sim)
+{
+    const struct event evs[] = {
+        { .kind = EV_ADC, .ch = 0, .wave = WAVE_SINE,     .period_ms = 2000, .hi = 4095 },
+        { .kind = EV_ADC, .ch = 1, .wave = WAVE_TRIANGLE, .period_ms = 3000, .hi = 4095 },
+        { .kind = EV_ADC, .ch = 2, .wave = WAVE_SQUARE,   .period_ms = 1000, .hi = 4095 },
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(evs) / sizeof(evs[0]); i++)
+        add_event(sim, &evs[i]);
+}
+
+static uint32_t wave_value(const struct channel *c, double t_ms)
+{
+    double phase, v;
+
+    if (c->wave == WAVE_CONST || c->period_ms <= 0)
+        return (uint32_t)c->lo;
+
+    phase = fmod(t_ms - c->start_ms, c->period_ms) / c->period_ms;
+
+    switch (c->wave) {
+        case WAVE_SINE:
+            v = 0.5 - 0.5 * cos(2 * M_PI * phase);
+            break;
+        case WAVE_RAMP:
+            v = phase;
+            break;
+        case WAVE_SQUARE:
+            v = phase < 0.5 ? 0.0 : 1.0;
+            break;
+        case WAVE_TRIANGLE:
+            v = phase < 0.5 ? 2 * phase : 2 - 2 * phase;
+            break;
+        default:
+            v = 0;
+            break;
+    }
+
+    v = c->lo + v * (c->hi - c->lo);
+    if (v < 0)
+        v = 0;
+    if (v > 4095)
+        v = 4095;
+    return (uint32_t)(v + 0.5);
+}
+
+/* ---------------------------- model ---------------------------- */
+
+// v plus uniform noise in [-noise, noise], clamped to 12 bits
+static uint32_t add_noise(struct sim *sim, uint32_t v)
+{
+    int32_t n;
+
+    if (sim->noise == 0)
+        return v;
+
+    sim->rng ^= sim->rng << 13;
+    sim->rng ^= sim->rng >> 17;
+    sim->rng ^= sim->rng << 5;
+    n = (int32_t)v + (int32_t)(sim->rng % (2 * sim->noise + 1)) - (int32_t)sim->noise;
+    if (n < 0)
+        n = 0;
+    if (n > 4095)
+        n = 4095;
+    return n;
+}
+
+static void adc_tick(struct sim *sim, double t_ms, uint64_t t_ns)
+{
+    uint32_t regs[HWIO_ADC_CHANNELS];
+    int changed = 0;
+    unsigned int ch;
+
+    for (ch = 0; ch < HWIO_ADC_CHANNELS; ch++) {
+        uint32_t v = add_noise(sim, wave_value(&sim->ch[ch], t_ms));
+
+        regs[ch] = v;
+        if (v == sim->ch[ch].value)
+            continue;
+
+        sim->ch[ch].value = v;
+        attr_write_u32(&sim->adc_ch[ch], v);
+        if (ch < 3)
+            probe_push(sim, ch, t_ns, adc_to_duty(v));
+        changed = 1;
+    }
+
+    if (changed) {
+        pwrite(sim->adc_dev, regs, sizeof(regs), 0);
+        sim->st.adc_updates++;
+    }
+}
+
+// push the shadow duties and period back out to every view
+static void rgb_mirror(struct sim_rgb *rgb)
+{
+    char buf[48];
+    unsigned int i;
+
+    for (i = 0; i < 3; i++) {
+        attr_write_u32(&rgb->attr[i], rgb->shadow[i]);
+        rgb->dev_last[i] = rgb->shadow[i];
+    }
+    attr_write_u32(&rgb->attr[HWIO_RGB_PERIOD], rgb->period);
+    rgb->dev_last[HWIO_RGB_PERIOD] = rgb->period;
+    rgb->dev_last[RGB_COMMIT_REG] = 0;
+
+    snprintf(buf, sizeof(buf), "%u %u %u\n",
+             rgb->shadow[0], rgb->shadow[1], rgb->shadow[2]);
+    attr_write(&rgb->color, buf);
+
+    pwrite(rgb->dev, rgb->dev_last, sizeof(rgb->dev_last), 0);
+}
+
+// the commit latches at the end of the current PWM period
+static uint64_t next_period_boundary(const struct sim_rgb *rgb, uint64_t t_ns,
+                                     uint64_t start_ns)
+{
+    // 11.5 fixed point ms
+    uint64_t period_ns = (uint64_t)rgb->period * 1000000ull / 32;
+    uint64_t elapsed = t_ns - start_ns;
+
+    if (period_ns == 0)
+        return t_ns;
+
+    return start_ns + (elapsed / period_ns + 1) * period_ns;
+}
+
+// probes are only matched for rgb_pwm0; the others get the same colors
+static void rgb_tick(struct sim *sim, unsigned int idx, uint64_t t_ns,
+                     uint64_t start_ns)
+{
+    struct sim_rgb *rgb = &sim->rgb[idx];
+    char buf[64];
+    uint32_t dev[RGB_REGS];
+    uint32_t r, g, b, v;
+    int written = 0;
+    int changed = 0;
+    unsigned int i;
+
+    // sysfs single registers
+    for (i = 0; i < HWIO_RGB_NUM_REGS; i++) {
+        if (!attr_changed(&rgb->attr[i], buf, sizeof(buf)))
+            continue;
+        changed = 1;
+        if (hwio_parse_u32(buf, (int)strlen(buf), &v) != 0)
+            continue;
+        if (i == HWIO_RGB_PERIOD) {
+            rgb->period = v & 0x7FF;
+        } else {
+            rgb->shadow[i] = v & 0x3FFFF;
+            written = 1;
+        }
+        sim->st.rgb_writes++;
+    }
+
+    // sysfs color
+    if (attr_changed(&rgb->color, buf, sizeof(buf))) {
+        changed = 1;
+        if (sscanf(buf, "%u %u %u", &r, &g, &b) == 3) {
+            rgb->shadow[0] = r & 0x3FFFF;
+            rgb->shadow[1] = g & 0x3FFFF;
+            rgb->shadow[2] = b & 0x3FFFF;
+            written = 1;
+            sim->st.rgb_writes++;
+        }
+    }
+
+    // /dev/rgb_pwmN
+    if (pread(rgb->dev, dev, sizeof(dev), 0) == sizeof(dev) &&
+        memcmp(dev, rgb->dev_last, sizeof(dev)) != 0) {
+        changed = 1;
+        for (i = 0; i < 3; i++) {
+            if (dev[i] != rgb->dev_last[i]) {
+                rgb->shadow[i] = dev[i] & 0x3FFFF;
+                written = 1;
+            }
+        }
+        if (dev[HWIO_RGB_PERIOD] != rgb->dev_last[HWIO_RGB_PERIOD])
+            rgb->period = dev[HWIO_RGB_PERIOD] & 0x7FF;
+        if (dev[RGB_COMMIT_REG] & 1)
+            written = 1;
+        sim->st.rgb_writes++;
+    }
+
+    // every view reads back the same registers, like the real driver
+    if (changed)
+        rgb_mirror(rgb);
+
+    if (written && !rgb->commit_pending) {
+        rgb->commit_pending = 1;
+        rgb->latch_ns = next_period_boundary(rgb, t_ns, start_ns);
+    }
+
+    // direct mode controls
+    if (attr_changed(&rgb->mode, buf, sizeof(buf)))
+        rgb->direct = strncmp(buf, "direct", 6) == 0;
+    if (attr_changed(&rgb->gain_attr, buf, sizeof(buf)) &&
+        sscanf(buf, "%u %u %u", &r, &g, &b) == 3) {
+        rgb->gain[0] = r;
+        rgb->gain[1] = g;
+        rgb->gain[2] = b;
+    }
+
+    if (rgb->direct) {
+        for (i = 0; i < 3; i++) {
+            uint64_t d = (uint64_t)sim->ch[i].value * rgb->gain[i] / 4096;
+
+            rgb->out[i] = d > DUTY_SCALE ? DUTY_SCALE : (uint32_t)d;
+        }
+        return;
+    }
+
+    if (rgb->commit_pending && t_ns >= rgb->latch_ns) {
+        rgb->commit_pending = 0;
+        sim->st.rgb_latches++;
+        for (i = 0; i < 3; i++) {
+            if (rgb->out[i] == rgb->shadow[i])
+                continue;
+            rgb->out[i] = rgb->shadow[i];
+            if (idx == 0)
+                probe_match(sim, i, rgb->latch_ns, rgb->out[i]);
+        }
+    }
+}
+
+static void bar_tick(struct sim *sim, struct sim_bar *bar)
+{
+    char buf[64];
+    uint32_t v;
+
+    if (attr_changed(&bar->attr, buf, sizeof(buf)) &&
+        hwio_parse_u32(buf, (int)strlen(buf), &v) == 0) {
+        bar->value = v & 0x3FF;
+        bar->dev_last = bar->value;
+        pwrite(bar->dev, &bar->value, sizeof(bar->value), 0);
+        sim->st.bar_updates++;
+    }
+
+    if (pread(bar->dev, &v, sizeof(v), 0) == sizeof(v) &&
+        v != bar->dev_last) {
+        bar->value = v & 0x3FF;
+        bar->dev_last = v;
+        attr_write_u32(&bar->attr, bar->value);
+        sim->st.bar_updates++;
+    }
+}
+
+static void button_press(struct sim *sim, uint64_t t_ns)
+{
+    sim->btn_status = 1;
+    sim->btn_dev_last = 1;
+    sim->presses++;
+    sim->press_ns = t_ns;
+    attr_write_u32(&sim->btn_attr, 1);
+    attr_write_u32(&sim->btn_presses, (uint32_t)sim->presses);
+    pwrite(sim->btn_dev, &sim->btn_status, sizeof(sim->btn_status), 0);
+}
+
+static void button_tick(struct sim *sim, uint64_t t_ns)
+{
+    char buf[64];
+    uint32_t v;
+    int cleared = 0;
+
+    if (attr_changed(&sim->btn_attr, buf, sizeof(buf)) &&
+        hwio_parse_u32(buf, (int)strlen(buf), &v) == 0 && (v & 1) == 0)
+        cleared = 1;
+
+    if (pread(sim->btn_dev, &v, sizeof(v), 0) == sizeof(v) &&
+        v != sim->btn_dev_last) {
+        sim->btn_dev_last = v;
+        if ((v & 1) == 0)
+            cleared = 1;
+    }
+
+    if (cleared && sim->btn_status) {
+        sim->btn_status = 0;
+        sim->btn_dev_last = 0;
+        attr_write_u32(&sim->btn_attr, 0);
+        pwrite(sim->btn_dev, &sim->btn_status, sizeof(sim->btn_status), 0);
+        record_latency(&sim->btn_lat, t_ns - sim->press_ns);
+        sim->st.presses_cleared++;
+    }
+}
+
+// run script events that are due; return 0 once an end event is reached
+static int run_events(struct sim *sim, double t_ms, uint64_t t_ns)
+{
+    while (sim->next_event < sim->num_events &&
+           sim->events[sim->next_event].t_ms <= t_ms) {
+        const struct event *ev = &sim->events[sim->next_event++];
+        struct channel *c;
+
+        switch (ev->kind) {
+            case EV_ADC:
+                c = &sim->ch[ev->ch];
+                c->wave = ev->wave;
+                c->start_ms = ev->t_ms;
+                c->period_ms = ev->period_ms;
+                c->lo = ev->lo;
+                c->hi = ev->hi;
+                break;
+            case EV_BUTTON:
+                button_press(sim, t_ns);
+                break;
+            case EV_END:
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* ---------------------------- setup ---------------------------- */
+
+// sysfs directory of instance id, relative to the root
+static void class_dir(char *buf, size_t size, const char *name, unsigned int id)
+{
+    snprintf(buf, size, HWIO_CLASS_DIR "/%s%u/device", name, id);
+}
+
+static int dev_open_instance(const struct sim *sim, const char *name,
+                             unsigned int id, size_t size)
+{
+    char dev[32];
+
+    snprintf(dev, sizeof(dev), "%s%u", name, id);
+    return dev_open(sim, dev, size);
+}
+
+static int instance_attr(const struct sim *sim, const char *dir, unsigned int id)
+{
+    struct attr a;
+
+    if (attr_open(&a, sim, dir, "instance", "") != 0 || attr_write_u32(&a, id) != 0)
+        return -1;
+
+    close(a.fd);
+    return 0;
+}
+
+static int rgb_create(struct sim *sim, unsigned int id)
+{
+    static const char *const rgb_names[HWIO_RGB_NUM_REGS] = {
+        "red", "green", "blue", "period",
+    };
+    struct sim_rgb *rgb = &sim->rgb[id];
+    char dir[HWIO_PATH_MAX];
+    unsigned int i;
+
+    class_dir(dir, sizeof(dir), HWIO_RGB_NAME, id);
+    for (i = 0; i < HWIO_RGB_NUM_REGS; i++) {
+        if (attr_open(&rgb->attr[i], sim, dir, rgb_names[i], "0\n") != 0)
+            return -1;
+    }
+    if (attr_open(&rgb->color, sim, dir, "color", "0 0 0\n") != 0 ||
+        attr_open(&rgb->mode, sim, dir, "mode", "software\n") != 0 ||
+        attr_open(&rgb->gain_attr, sim, dir, "direct_gain",
+                  "131072 131072 131072\n") != 0 ||
+        instance_attr(sim, dir, id) != 0)
+        return -1;
+    rgb->gain[0] = rgb->gain[1] = rgb->gain[2] = DUTY_SCALE;
+
+    rgb->dev = dev_open_instance(sim, HWIO_RGB_NAME, id, sizeof(rgb->dev_last));
+    if (rgb->dev < 0)
+        return -1;
+
+    // same reset state as rgb_pwm_probe
+    rgb->period = 0x0FFF & 0x7FF;
+    rgb_mirror(rgb);
+
+    return 0;
+}
+
+static int bar_create(struct sim *sim, unsigned int id)
+{
+    struct sim_bar *bar = &sim->bar[id];
+    char dir[HWIO_PATH_MAX];
+
+    class_dir(dir, sizeof(dir), HWIO_LED_BAR_NAME, id);
+    if (attr_open(&bar->attr, sim, dir, "sw_led_control", "0\n") != 0 ||
+        instance_attr(sim, dir, id) != 0)
+        return -1;
+
+    bar->dev = dev_open_instance(sim, HWIO_LED_BAR_NAME, id, 0x10);
+    return bar->dev < 0 ? -1 : 0;
+}
+
+static int sim_create(struct sim *sim)
+{
+    char name[16];
+    unsigned int i;
+
+    for (i = 0; i < HWIO_ADC_CHANNELS; i++) {
+        snprintf(name, sizeof(name), "ch%u_raw", i);
+        if (attr_open(&sim->adc_ch[i], sim, HWIO_ADC_SYSFS_BASE, name, "0\n") != 0)
+            return -1;
+    }
+    if (attr_open(&sim->adc_auto, sim, HWIO_ADC_SYSFS_BASE, "auto_update", "0\n") != 0 ||
+        instance_attr(sim, HWIO_ADC_SYSFS_BASE, 0) != 0)
+        return -1;
+
+    for (i = 0; i < sim->count; i++) {
+        if (rgb_create(sim, i) != 0 || bar_create(sim, i) != 0)
+            return -1;
+    }
+
+    if (attr_open(&sim->btn_attr, sim, HWIO_BUTTON_SYSFS_BASE, "push_button_reg", "0\n") != 0 ||
+        attr_open(&sim->btn_presses, sim, HWIO_BUTTON_SYSFS_BASE, "presses", "0\n") != 0 ||
+        attr_open(&sim->btn_has_irq, sim, HWIO_BUTTON_SYSFS_BASE, "has_irq", "1\n") != 0 ||
+        instance_attr(sim, HWIO_BUTTON_SYSFS_BASE, 0) != 0)
+        return -1;
+
+    sim->adc_dev = dev_open_instance(sim, HWIO_ADC_NAME, 0,
+                                     HWIO_ADC_CHANNELS * sizeof(uint32_t));
+    sim->btn_dev = dev_open_instance(sim, HWIO_BUTTON_NAME, 0, 0x10);
+    if (sim->adc_dev < 0 || sim->btn_dev < 0)
+        return -1;
+
+    return 0;
+}
+
+static void print_stats(const struct sim *sim, double elapsed_s)
+{
+    unsigned int i;
+
+    printf("board_sim: %.1fs ticks=%lu (%.0f/s) missed=%lu\n",
+           elapsed_s, sim->st.ticks, sim->st.ticks / elapsed_s, sim->st.missed);
+    printf("  adc updates=%lu rgb writes=%lu latches=%lu led bar updates=%lu\n",
+           sim->st.adc_updates, sim->st.rgb_writes, sim->st.rgb_latches,
+           sim->st.bar_updates);
+    printf("  button presses=%lu cleared=%lu\n",
+           sim->presses, sim->st.presses_cleared);
+    for (i = 0; i < sim->count; i++) {
+        const struct sim_rgb *rgb = &sim->rgb[i];
+
+        printf("  [%u] rgb out=%u %u %u period=%u mode=%s led bar=0x%03x\n",
+               i, rgb->out[0], rgb->out[1], rgb->out[2], rgb->period,
+               rgb->direct ? "direct" : "software", sim->bar[i].value);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-R root] [-n count] [-r HZ] [-t seconds] [-s script] [-p ms]\n"
+            "       [-N codes]\n"
+            "  -R root     directory to create the simulated tree in (default %s)\n"
+            "  -n count    RGB PWM and LED bar instances (default 1, max %d)\n"
+            "  -r HZ       model update rate (default %d)\n"
+            "  -t seconds  stop after this long (default: run until SIGINT)\n"
+            "  -s script   waveform/button script, see the top of board_sim.c\n"
+            "  -p ms       also press the button every ms milliseconds\n"
+            "  -N codes    add uniform noise of +/- codes to every ADC channel\n",
+            prog, DEFAULT_ROOT, HWIO_MAX_INSTANCES, DEFAULT_RATE_HZ);
+}
+
+int main(int argc, char **argv)
+{
+    static struct sim sim;
+    const char *script = NULL;
+    unsigned long rate = DEFAULT_RATE_HZ;
+    double duration_s = 0;
+    double press_ms = 0, next_press_ms;
+    struct sigaction sa;
+    struct timespec next;
+    uint64_t start, tick_ns, t;
+    double t_ms;
+    unsigned int i;
+    int opt;
+
+    snprintf(sim.root, sizeof(sim.root), "%s", DEFAULT_ROOT);
+    sim.count = 1;
+    sim.rng = 0x2545f491;
+
+    while ((opt = getopt(argc, argv, "R:n:r:t:s:p:N:h")) != -1) {
+        switch (opt) {
+            case 'R': snprintf(sim.root, sizeof(sim.root), "%s", optarg); break;
+            case 'n': sim.count = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'r': rate = strtoul(optarg, NULL, 0); break;
+            case 't': duration_s = strtod(optarg, NULL); break;
+            case 's': script = optarg; break;
+            case 'p': press_ms = strtod(optarg, NULL); break;
+            case 'N': sim.noise = (unsigned int)strtoul(optarg, NULL, 0); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (rate == 0 || rate > 1000000 || sim.noise > 4095 ||
+        sim.count == 0 || sim.count > HWIO_MAX_INSTANCES) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (script ? load_script(&sim, script) != 0 : (default_script(&sim), 0))
+        return 1;
+    qsort(sim.events, sim.num_events, sizeof(sim.events[0]), cmp_event);
+
+    sim.adc_lat.ns = calloc(MAX_LATENCIES, sizeof(uint32_t));
+    sim.btn_lat.ns = calloc(MAX_LATENCIES, sizeof(uint32_t));
+    if (!sim.adc_lat.ns || !sim.btn_lat.ns) {
+        fprintf(stderr, "board_sim: out of memory\n");
+        return 1;
+    }
+
+    if (sim_create(&sim) != 0)
+        return 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("board_sim: root %s, %lu Hz, %u RGB/LED bar instance%s\n",
+           sim.root, rate, sim.count, sim.count == 1 ? "" : "s");
+    fflush(stdout);
+
+    tick_ns = 1000000000ull / rate;
+    start = now_ns();
+    next.tv_sec = start / 1000000000ull;
+    next.tv_nsec = start % 1000000000ull;
+    next_press_ms = press_ms;
+
+    while (!stop) {
+        t = now_ns();
+        t_ms = (t - start) / 1e6;
+
+        if (duration_s > 0 && t_ms >= duration_s * 1000)
+            break;
+        if (!run_events(&sim, t_ms, t))
+            break;
+        if (press_ms > 0 && t_ms >= next_press_ms) {
+            button_press(&sim, t);
+            next_press_ms += press_ms;
+        }
+
+        adc_tick(&sim, t_ms, t);
+        for (i = 0; i < sim.count; i++) {
+            rgb_tick(&sim, i, t, start);
+            bar_tick(&sim, &sim.bar[i]);
+        }
+        button_tick(&sim, t);
+        sim.st.ticks++;
+
+        // absolute deadlines so the rate doesn't drift; skip ticks we missed
+        next.tv_nsec += tick_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        t = now_ns();
+        while ((uint64_t)next.tv_sec * 1000000000ull + next.tv_nsec < t) {
+            sim.st.missed++;
+            next.tv_nsec += tick_ns;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    print_stats(&sim, (now_ns() - start) / 1e9);
+    print_latencies("adc->led latency", &sim.adc_lat);
+    print_latencies("button->clear", &sim.btn_lat);
+
+    free(sim.adc_lat.ns);
+    free(sim.btn_lat.ns);
+    return 0;
+}
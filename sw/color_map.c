@@ -0,0 +1,124 @@
+// color_map.c
+// Table construction for color_map.h. Everything here runs once at startup,
+// so it uses floating point freely; color_map_apply() only reads the tables.
+
+#include <math.h>
+#include <string.h>
+
+#include "color_map.h"
+
+static const char *const mode_names[] = {
+    [CMAP_RGB] = "rgb",
+    [CMAP_HSV] = "hsv",
+    [CMAP_HSL] = "hsl",
+};
+
+void color_map_default_cal(struct cmap_cal *cal)
+{
+    int i;
+
+    for (i = 0; i < CMAP_CHANNELS; i++) {
+        cal->lo[i] = 0;
+        cal->hi[i] = CMAP_ADC_CODES - 1;
+        cal->gain[i] = 1.0;
+    }
+}
+
+int color_map_parse_mode(const char *name, enum cmap_mode *mode)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(mode_names) / sizeof(mode_names[0]); i++) {
+        if (strcmp(name, mode_names[i]) == 0) {
+            *mode = (enum cmap_mode)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *color_map_mode_name(enum cmap_mode mode)
+{
+    return mode <= CMAP_HSL ? mode_names[mode] : "?";
+}
+
+// pot reading -> 0..1 over the pot's calibrated range
+static double pot_fraction(const struct cmap_cal *cal, int pot, unsigned int adc)
+{
+    double x = ((double)adc - cal->lo[pot]) / (cal->hi[pot] - cal->lo[pot]);
+
+    if (x < 0)
+        return 0;
+    if (x > 1)
+        return 1;
+    return x;
+}
+
+static uint16_t to_q16(double x)
+{
+    return (uint16_t)(x * CMAP_ONE + 0.5);
+}
+
+// 0..1 channel level -> duty, with gamma and the channel's gain
+static uint32_t level_to_duty(double x, double gamma, double gain)
+{
+    return (uint32_t)(pow(x, gamma) * gain * CMAP_DUTY_SCALE + 0.5);
+}
+
+// fully saturated, full value color of hue h (0..1, 0 and 1 are red)
+static void hue_to_rgb(double h, double rgb[CMAP_CHANNELS])
+{
+    double h6 = h * 6;
+
+    rgb[0] = fabs(h6 - 3) - 1;
+    rgb[1] = 2 - fabs(h6 - 2);
+    rgb[2] = 2 - fabs(h6 - 4);
+}
+
+int color_map_build(struct color_map *map, enum cmap_mode mode, double gamma,
+                    const struct cmap_cal *cal)
+{
+    double rgb[CMAP_CHANNELS];
+    unsigned int i;
+    int ch;
+
+    if (mode > CMAP_HSL || !(gamma > 0) || gamma > CMAP_MAX_GAMMA)
+        return -1;
+    for (ch = 0; ch < CMAP_CHANNELS; ch++) {
+        if (cal->lo[ch] >= cal->hi[ch] || cal->hi[ch] >= CMAP_ADC_CODES ||
+            !(cal->gain[ch] >= 0) || cal->gain[ch] > 1)
+            return -1;
+    }
+
+    memset(map, 0, sizeof(*map));
+    map->mode = mode;
+
+    if (mode == CMAP_RGB) {
+        for (ch = 0; ch < CMAP_CHANNELS; ch++) {
+            for (i = 0; i < CMAP_ADC_CODES; i++)
+                map->duty[ch][i] = level_to_duty(pot_fraction(cal, ch, i),
+                                                 gamma, cal->gain[ch]);
+        }
+        return 0;
+    }
+
+    // color_map_apply() indexes these with the mixed Q16 level >> 4
+    for (ch = 0; ch < CMAP_CHANNELS; ch++) {
+        for (i = 0; i < CMAP_ADC_CODES; i++)
+            map->duty[ch][i] = level_to_duty(i / (double)(CMAP_ADC_CODES - 1),
+                                             gamma, cal->gain[ch]);
+    }
+
+    for (i = 0; i < CMAP_ADC_CODES; i++) {
+        double l = pot_fraction(cal, 2, i);
+
+        hue_to_rgb(pot_fraction(cal, 0, i), rgb);
+        for (ch = 0; ch < CMAP_CHANNELS; ch++)
+            map->hue[i][ch] = to_q16(fmin(fmax(rgb[ch], 0), 1));
+        map->sat[i] = to_q16(pot_fraction(cal, 1, i));
+        map->level[i] = to_q16(l);
+        map->chroma[i] = to_q16(1 - fabs(2 * l - 1));
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+// color_map.h
+// Table-driven mapping from 12-bit pot readings to 18.17 PWM duties.
+//
+// color_map_build() precomputes 4096-entry tables once at startup, so
+// color_map_apply() does no division and no floating point:
+//   CMAP_RGB : pot N drives LED channel N. One table load per channel; the
+//              table already holds the calibration, gamma and gain.
+//   CMAP_HSV : pot 0 = hue, pot 1 = saturation, pot 2 = value
+//   CMAP_HSL : pot 0 = hue, pot 1 = saturation, pot 2 = lightness
+//              One load per pot, two multiply/shifts per channel to mix
+//              them, then one load per channel for gamma and gain.
+//
+// Calibration (struct cmap_cal):
+//   lo/hi : usable ADC range of each pot; readings outside it clamp, so a
+//           pot that never quite reaches 0 or 4095 still covers 0..100%
+//   gain  : full-scale duty of each LED channel (0..1), e.g. to white
+//           balance an LED whose green is brighter than its red
+// gamma is applied to each LED channel's output; 1.0 is linear.
+
+#ifndef COLOR_MAP_H
+#define COLOR_MAP_H
+
+#include <stdint.h>
+
+// duty is 18.17 => scale by 2^17
+#define CMAP_DUTY_SCALE      (1u << 17)
+
+#define CMAP_ADC_CODES       4096
+#define CMAP_CHANNELS        3
+
+// fractions are Q16 with 65535 as 1.0 so they fit a uint16_t
+#define CMAP_ONE             65535
+
+#define CMAP_DEFAULT_GAMMA   2.2
+#define CMAP_MAX_GAMMA       5.0
+
+enum cmap_mode {
+    CMAP_RGB,
+    CMAP_HSV,
+    CMAP_HSL,
+};
+
+struct cmap_cal {
+    uint16_t lo[CMAP_CHANNELS];     // per pot
+    uint16_t hi[CMAP_CHANNELS];
+    double gain[CMAP_CHANNELS];     // per LED channel
+};
+
+struct color_map {
+    enum cmap_mode mode;
+    // RGB: pot reading -> duty. HSV/HSL: 12-bit channel level -> duty.
+    uint32_t duty[CMAP_CHANNELS][CMAP_ADC_CODES];
+    // HSV/HSL inputs, all Q16
+    uint16_t hue[CMAP_ADC_CODES][CMAP_CHANNELS];    // fully saturated color
+    uint16_t sat[CMAP_ADC_CODES];
+    uint16_t level[CMAP_ADC_CODES];                 // value or lightness
+    uint16_t chroma[CMAP_ADC_CODES];                // HSL: 1 - |2L - 1|
+};
+
+// Full pot range and unity gain.
+void color_map_default_cal(struct cmap_cal *cal);
+
+// Fill every table for mode. return 0 if successful, -1 if gamma or the
+// calibration is out of range.
+int color_map_build(struct color_map *map, enum cmap_mode mode, double gamma,
+                    const struct cmap_cal *cal);
+
+// "rgb", "hsv" or "hsl"; return 0 if successful
+int color_map_parse_mode(const char *name, enum cmap_mode *mode);
+const char *color_map_mode_name(enum cmap_mode mode);
+
+// Map one record of pot readings (12-bit, pot 0 first) to red/green/blue
+// duties. Inline, since it is the whole per-sample cost of the mapping.
+static inline void color_map_apply(const struct color_map *map,
+                                   const uint16_t adc[CMAP_CHANNELS],
+                                   uint32_t duty[CMAP_CHANNELS])
+{
+    const uint16_t *hue;
+    uint32_t s, l, c;
+    int32_t v;
+    int ch;
+
+    switch (map->mode) {
+        case CMAP_HSV:
+            // v * (1 - s * (1 - hue))
+            hue = map->hue[adc[0] & 0xfff];
+            s = map->sat[adc[1] & 0xfff];
+            l = map->level[adc[2] & 0xfff];
+            for (ch = 0; ch < CMAP_CHANNELS; ch++) {
+                v = (l * (CMAP_ONE - ((s * (CMAP_ONE - hue[ch])) >> 16))) >> 16;
+                duty[ch] = map->duty[ch][v >> 4];
+            }
+            break;
+
+        case CMAP_HSL:
+            // l + chroma(l) * s * (hue - 1/2)
+            hue = map->hue[adc[0] & 0xfff];
+            s = map->sat[adc[1] & 0xfff];
+            l = map->level[adc[2] & 0xfff];
+            c = (map->chroma[adc[2] & 0xfff] * s) >> 16;
+            for (ch = 0; ch < CMAP_CHANNELS; ch++) {
+                v = (int32_t)l + (((int32_t)c * ((int32_t)hue[ch] - 32768)) >> 16);
+                if (v < 0)
+                    v = 0;
+                else if (v > CMAP_ONE)
+                    v = CMAP_ONE;
+                duty[ch] = map->duty[ch][v >> 4];
+            }
+            break;
+
+        default:
+            for (ch = 0; ch < CMAP_CHANNELS; ch++)
+                duty[ch] = map->duty[ch][adc[ch] & 0xfff];
+            break;
+    }
+}
+
+#endif // COLOR_MAP_H
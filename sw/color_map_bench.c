@@ -0,0 +1,194 @@
+// color_map_bench.c
+// Microbenchmark for the pot -> duty mapping in pot_to_rgb: the old
+// per-channel multiply and divide against the color_map tables.
+//
+// Every path maps the same pseudo-random pot readings and sums the duties,
+// so the compiler can't drop the work. Reports ns per sample (3 channels)
+// and checks that the linear table agrees with the arithmetic path.
+//   ./color_map_bench -n 10000000
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "color_map.h"
+
+// readings cycled through by every path; a power of two
+#define NUM_READINGS     4096
+
+struct bench_result {
+    double ns_per_sample;
+    uint64_t checksum;
+};
+
+static uint16_t readings[NUM_READINGS][CMAP_CHANNELS];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// pot_to_rgb's mapping before color_map
+static uint32_t adc_to_duty(uint16_t adc)
+{
+    return (uint32_t)adc * CMAP_DUTY_SCALE / 4095u;
+}
+
+// what a gamma curve costs without tables
+static uint32_t adc_to_duty_pow(uint16_t adc, double gamma)
+{
+    return (uint32_t)(pow(adc / 4095.0, gamma) * CMAP_DUTY_SCALE + 0.5);
+}
+
+static void bench_arith(unsigned long n, struct bench_result *res)
+{
+    uint64_t sum = 0, start;
+    unsigned long i;
+    int ch;
+
+    start = now_ns();
+    for (i = 0; i < n; i++) {
+        const uint16_t *adc = readings[i & (NUM_READINGS - 1)];
+
+        for (ch = 0; ch < CMAP_CHANNELS; ch++)
+            sum += adc_to_duty(adc[ch]);
+    }
+    res->ns_per_sample = (double)(now_ns() - start) / n;
+    res->checksum = sum;
+}
+
+static void bench_pow(unsigned long n, double gamma, struct bench_result *res)
+{
+    uint64_t sum = 0, start;
+    unsigned long i;
+    int ch;
+
+    start = now_ns();
+    for (i = 0; i < n; i++) {
+        const uint16_t *adc = readings[i & (NUM_READINGS - 1)];
+
+        for (ch = 0; ch < CMAP_CHANNELS; ch++)
+            sum += adc_to_duty_pow(adc[ch], gamma);
+    }
+    res->ns_per_sample = (double)(now_ns() - start) / n;
+    res->checksum = sum;
+}
+
+static void bench_map(unsigned long n, const struct color_map *map,
+                      struct bench_result *res)
+{
+    uint32_t duty[CMAP_CHANNELS];
+    uint64_t sum = 0, start;
+    unsigned long i;
+
+    start = now_ns();
+    for (i = 0; i < n; i++) {
+        color_map_apply(map, readings[i & (NUM_READINGS - 1)], duty);
+        sum += duty[0] + duty[1] + duty[2];
+    }
+    res->ns_per_sample = (double)(now_ns() - start) / n;
+    res->checksum = sum;
+}
+
+static void print_result(const char *name, const struct bench_result *res,
+                         double baseline_ns)
+{
+    printf("%-14s %12.2f %9.1fx %20llu\n", name, res->ns_per_sample,
+           res->ns_per_sample > 0 ? baseline_ns / res->ns_per_sample : 0.0,
+           (unsigned long long)res->checksum);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n samples] [-g gamma]\n"
+            "  -n samples  samples per path (default 10000000)\n"
+            "  -g gamma    gamma for the curved paths (default %.1f)\n",
+            prog, CMAP_DEFAULT_GAMMA);
+}
+
+int main(int argc, char **argv)
+{
+    static struct color_map map;
+    struct cmap_cal cal;
+    struct bench_result res;
+    unsigned long n = 10000000;
+    double gamma = CMAP_DEFAULT_GAMMA;
+    double baseline_ns;
+    uint32_t max_diff = 0;
+    uint32_t rng = 0x2545f491;
+    unsigned int i;
+    int opt, ch;
+
+    while ((opt = getopt(argc, argv, "n:g:h")) != -1) {
+        switch (opt) {
+            case 'n': n = strtoul(optarg, NULL, 0); break;
+            case 'g': gamma = strtod(optarg, NULL); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (n == 0 || !(gamma > 0) || gamma > CMAP_MAX_GAMMA) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < NUM_READINGS; i++) {
+        for (ch = 0; ch < CMAP_CHANNELS; ch++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            readings[i][ch] = rng & 0xfff;
+        }
+    }
+    color_map_default_cal(&cal);
+
+    // the linear table should only differ from the old integer math by the
+    // rounding (it rounds, the divide truncates)
+    color_map_build(&map, CMAP_RGB, 1.0, &cal);
+    for (i = 0; i < CMAP_ADC_CODES; i++) {
+        uint32_t a = adc_to_duty(i), t = map.duty[0][i];
+        uint32_t d = a > t ? a - t : t - a;
+
+        if (d > max_diff)
+            max_diff = d;
+    }
+
+    printf("color_map_bench: %lu samples (3 channels each), gamma %.2f\n", n, gamma);
+    printf("linear table vs arithmetic: max difference %u (of %u)\n",
+           max_diff, CMAP_DUTY_SCALE);
+    printf("%-14s %12s %10s %20s\n", "path", "ns/sample", "speedup", "checksum");
+
+    bench_arith(n, &res);
+    baseline_ns = res.ns_per_sample;
+    print_result("arith linear", &res, baseline_ns);
+
+    bench_map(n, &map, &res);
+    print_result("lut linear", &res, baseline_ns);
+
+    // pow() is much slower, so it gets fewer samples
+    bench_pow(n / 10 ? n / 10 : 1, gamma, &res);
+    print_result("arith gamma", &res, baseline_ns);
+
+    color_map_build(&map, CMAP_RGB, gamma, &cal);
+    bench_map(n, &map, &res);
+    print_result("lut gamma", &res, baseline_ns);
+
+    color_map_build(&map, CMAP_HSV, gamma, &cal);
+    bench_map(n, &map, &res);
+    print_result("lut hsv", &res, baseline_ns);
+
+    color_map_build(&map, CMAP_HSL, gamma, &cal);
+    bench_map(n, &map, &res);
+    print_result("lut hsl", &res, baseline_ns);
+
+    return max_diff > 1;
+}
@@ -0,0 +1,659 @@
+// hwio.c
+// Persistent-descriptor access to the FPGA peripherals. See hwio.h.
+
+#include "hwio.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "de10nano_adc.h"
+#include "rgb_pwm.h"
+
+// largest text we ever exchange: 10 digits + newline
+#define HWIO_TEXT_MAX    16
+
+// "r g b\n" for the rgb_pwm color attribute
+#define HWIO_COLOR_TEXT_MAX    (3 * HWIO_TEXT_MAX)
+
+static const char *const rgb_attr_names[HWIO_RGB_NUM_REGS] = {
+    "red", "green", "blue", "period",
+};
+
+// prefix for every default path; "" means the real board
+static char hwio_root_path[HWIO_PATH_MAX];
+static int hwio_root_set;
+
+void hwio_set_root(const char *root)
+{
+    snprintf(hwio_root_path, sizeof(hwio_root_path), "%s", root ? root : "");
+    hwio_root_set = 1;
+}
+
+const char *hwio_root(void)
+{
+    const char *env;
+
+    if (!hwio_root_set) {
+        env = getenv("HWIO_ROOT");
+        hwio_set_root(env);
+    }
+
+    return hwio_root_path;
+}
+
+int hwio_path(char *buf, size_t size, const char *path)
+{
+    int n = snprintf(buf, size, "%s%s", hwio_root(), path);
+
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    return 0;
+}
+
+int hwio_instance_path(char *buf, size_t size, const char *name,
+                       unsigned int instance, enum hwio_backend backend)
+{
+    char path[HWIO_PATH_MAX];
+
+    if (backend == HWIO_BACKEND_SYSFS)
+        snprintf(path, sizeof(path), HWIO_CLASS_DIR "/%s%u/device", name, instance);
+    else
+        snprintf(path, sizeof(path), "/dev/%s%u", name, instance);
+
+    return hwio_path(buf, size, path);
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+
+    return (x > y) - (x < y);
+}
+
+int hwio_instances(const char *name, unsigned int *ids, int max)
+{
+    char dir_path[HWIO_PATH_MAX];
+    size_t len = strlen(name);
+    struct dirent *de;
+    DIR *dir;
+    int n = 0;
+
+    if (hwio_path(dir_path, sizeof(dir_path), HWIO_CLASS_DIR) != 0)
+        return 0;
+
+    dir = opendir(dir_path);
+    if (!dir)
+        return 0;
+
+    // entries are <name><digits>; "led_bar" must not match "led_bar_x1"
+    while (n < max && (de = readdir(dir)) != NULL) {
+        const char *p = de->d_name + len;
+        uint32_t id;
+
+        if (strncmp(de->d_name, name, len) != 0 || *p < '0' || *p > '9')
+            continue;
+        if (strspn(p, "0123456789") != strlen(p) ||
+            hwio_parse_u32(p, (int)strlen(p), &id) != 0)
+            continue;
+
+        ids[n++] = id;
+    }
+    closedir(dir);
+
+    qsort(ids, n, sizeof(ids[0]), cmp_uint);
+    return n;
+}
+
+int hwio_parse_instances(const char *list, const char *name,
+                         unsigned int *ids, int max)
+{
+    const char *p = list;
+    int n = 0;
+
+    if (strcmp(list, "all") == 0) {
+        n = hwio_instances(name, ids, max);
+        if (n == 0) {
+            errno = ENODEV;
+            return -1;
+        }
+        return n;
+    }
+
+    while (*p) {
+        int len = (int)strcspn(p, ",");
+        uint32_t id;
+
+        if (n == max) {
+            errno = E2BIG;
+            return -1;
+        }
+        if (len == 0 || hwio_parse_u32(p, len, &id) != 0 ||
+            strspn(p, "0123456789") != (size_t)len) {
+            errno = EINVAL;
+            return -1;
+        }
+        ids[n++] = id;
+
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+
+    if (n == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return n;
+}
+
+int hwio_format_u32(char *buf, uint32_t value)
+{
+    char tmp[HWIO_TEXT_MAX];
+    int n = 0;
+    int len = 0;
+
+    // emit digits least-significant first, then reverse into buf
+    do {
+        tmp[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (n > 0)
+        buf[len++] = tmp[--n];
+
+    buf[len++] = '\n';
+    return len;
+}
+
+int hwio_parse_u32(const char *buf, int len, uint32_t *out)
+{
+    uint32_t value = 0;
+    int i = 0;
+    int digits = 0;
+
+    while (i < len && (buf[i] == ' ' || buf[i] == '\t'))
+        i++;
+
+    for (; i < len && buf[i] >= '0' && buf[i] <= '9'; i++, digits++) {
+        uint32_t d = (uint32_t)(buf[i] - '0');
+
+        if (value > (UINT32_MAX - d) / 10) {
+            errno = ERANGE;
+            return -1;
+        }
+        value = value * 10 + d;
+    }
+
+    if (digits == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *out = value;
+    return 0;
+}
+
+int hwio_read_u32(int fd, uint32_t *out)
+{
+    char buf[HWIO_TEXT_MAX];
+    ssize_t n;
+
+    // sysfs regenerates the attribute on every read at offset 0
+    n = pread(fd, buf, sizeof(buf), 0);
+    if (n < 0)
+        return -1;
+
+    return hwio_parse_u32(buf, (int)n, out);
+}
+
+int hwio_write_u32(int fd, uint32_t value)
+{
+    char buf[HWIO_TEXT_MAX];
+    int len = hwio_format_u32(buf, value);
+    ssize_t n;
+
+    n = pwrite(fd, buf, len, 0);
+    if (n < 0)
+        return -1;
+    if (n != len) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+// open base/name once and cache the fd in *fd
+// return 0 if successful
+static int open_attr(int *fd, const char *base, const char *name, int flags,
+                     unsigned long *syscalls)
+{
+    char path[HWIO_PATH_MAX + 32];
+
+    if (*fd >= 0)
+        return 0;
+
+    snprintf(path, sizeof(path), "%s/%s", base, name);
+    (*syscalls)++;
+    *fd = open(path, flags | O_CLOEXEC);
+    if (*fd < 0) {
+        fprintf(stderr, "hwio: failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void close_fd(int *fd)
+{
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/* ----------------------------- ADC ----------------------------- */
+
+int hwio_adc_open(struct hwio_adc *adc, enum hwio_backend backend, const char *path)
+{
+    int i;
+
+    memset(adc, 0, sizeof(*adc));
+    adc->backend = backend;
+    adc->dev_fd = -1;
+    for (i = 0; i < HWIO_ADC_CHANNELS; i++)
+        adc->ch_fd[i] = -1;
+
+    if (path)
+        snprintf(adc->base, sizeof(adc->base), "%s", path);
+    else if (hwio_path(adc->base, sizeof(adc->base),
+                       (backend == HWIO_BACKEND_SYSFS) ? HWIO_ADC_SYSFS_BASE
+                                                       : HWIO_ADC_CHARDEV) != 0)
+        return -1;
+
+    if (backend == HWIO_BACKEND_CHARDEV) {
+        adc->syscalls++;
+        adc->dev_fd = open(adc->base, O_RDWR | O_CLOEXEC);
+        if (adc->dev_fd < 0) {
+            fprintf(stderr, "hwio: failed to open %s: %s\n",
+                    adc->base, strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int hwio_adc_read(struct hwio_adc *adc, unsigned int ch, uint16_t *out)
+{
+    uint32_t val;
+
+    if (ch >= HWIO_ADC_CHANNELS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (adc->backend == HWIO_BACKEND_CHARDEV) {
+        // single-channel reads need offset mode
+        if (adc->ch_mask != 0) {
+            uint32_t mask = 0;
+
+            adc->syscalls++;
+            if (ioctl(adc->dev_fd, ADC_IOC_SET_CHMASK, &mask) != 0)
+                return -1;
+            adc->ch_mask = 0;
+        }
+
+        adc->syscalls++;
+        if (pread(adc->dev_fd, &val, sizeof(val), ch * sizeof(val)) != sizeof(val))
+            return -1;
+    } else {
+        char name[] = "chX_raw";
+
+        name[2] = (char)('0' + ch);
+        if (open_attr(&adc->ch_fd[ch], adc->base, name, O_RDONLY, &adc->syscalls) != 0)
+            return -1;
+
+        adc->syscalls++;
+        if (hwio_read_u32(adc->ch_fd[ch], &val) != 0)
+            return -1;
+    }
+
+    // ADC is 12-bit, 16 bits is plenty
+    if (val > 0xFFFF)
+        val = 0xFFFF;
+
+    *out = (uint16_t)val;
+    return 0;
+}
+
+int hwio_adc_read_channels(struct hwio_adc *adc, uint32_t mask, uint16_t *out)
+{
+    uint32_t vals[HWIO_ADC_CHANNELS];
+    unsigned int ch;
+    int n = 0;
+    int len;
+
+    if (mask == 0 || (mask & ~ADC_CHMASK_ALL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (adc->backend == HWIO_BACKEND_SYSFS) {
+        for (ch = 0; ch < HWIO_ADC_CHANNELS; ch++) {
+            if ((mask & (1u << ch)) && hwio_adc_read(adc, ch, &out[n++]) != 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    // switch the driver to packed mode once, then every call is one read
+    if (adc->ch_mask != mask && !adc->offset_only) {
+        adc->syscalls++;
+        if (ioctl(adc->dev_fd, ADC_IOC_SET_CHMASK, &mask) == 0) {
+            adc->ch_mask = mask;
+        } else if (errno == ENOTTY) {
+            // a plain file (board_sim) or an old driver: no packed mode
+            adc->offset_only = 1;
+        } else {
+            return -1;
+        }
+    }
+
+    // offset mode: one read covering the lowest to highest selected channel
+    if (adc->offset_only) {
+        unsigned int first = __builtin_ctz(mask);
+        unsigned int last = 31 - __builtin_clz(mask);
+
+        len = (last - first + 1) * sizeof(uint32_t);
+        adc->syscalls++;
+        if (pread(adc->dev_fd, vals, len, first * sizeof(uint32_t)) != len)
+            return -1;
+
+        for (ch = first; ch <= last; ch++) {
+            uint32_t v = vals[ch - first];
+
+            if (mask & (1u << ch))
+                out[n++] = (uint16_t)(v > 0xFFFF ? 0xFFFF : v);
+        }
+        return 0;
+    }
+
+    len = __builtin_popcount(mask) * sizeof(uint32_t);
+    adc->syscalls++;
+    if (pread(adc->dev_fd, vals, len, 0) != len)
+        return -1;
+
+    for (n = 0; n < len / (int)sizeof(uint32_t); n++)
+        out[n] = (uint16_t)(vals[n] > 0xFFFF ? 0xFFFF : vals[n]);
+
+    return 0;
+}
+
+int hwio_adc_set_auto_update(struct hwio_adc *adc, int enable)
+{
+    int fd = -1;
+    int ret;
+
+    // /dev/adcN rejects writes to the auto_update offset, and the ADC always
+    // updates on read anyway (see linux/adc/README.md), so nothing to do.
+    if (adc->backend == HWIO_BACKEND_CHARDEV)
+        return 0;
+
+    // written once at startup, so don't keep this one open
+    if (open_attr(&fd, adc->base, "auto_update", O_WRONLY, &adc->syscalls) != 0)
+        return -1;
+
+    adc->syscalls += 2;
+    ret = hwio_write_u32(fd, enable ? 1 : 0);
+    close(fd);
+
+    return ret;
+}
+
+void hwio_adc_close(struct hwio_adc *adc)
+{
+    int i;
+
+    for (i = 0; i < HWIO_ADC_CHANNELS; i++)
+        close_fd(&adc->ch_fd[i]);
+    close_fd(&adc->dev_fd);
+}
+
+/* --------------------------- RGB PWM --------------------------- */
+
+int hwio_rgb_open(struct hwio_rgb *rgb, enum hwio_backend backend, const char *path)
+{
+    int i;
+
+    memset(rgb, 0, sizeof(*rgb));
+    rgb->backend = backend;
+    rgb->dev_fd = -1;
+    rgb->color_fd = -1;
+    for (i = 0; i < HWIO_RGB_NUM_REGS; i++)
+        rgb->reg_fd[i] = -1;
+
+    if (path)
+        snprintf(rgb->base, sizeof(rgb->base), "%s", path);
+    else if (hwio_path(rgb->base, sizeof(rgb->base),
+                       (backend == HWIO_BACKEND_SYSFS) ? HWIO_RGB_SYSFS_BASE
+                                                       : HWIO_RGB_CHARDEV) != 0)
+        return -1;
+
+    if (backend == HWIO_BACKEND_CHARDEV) {
+        rgb->syscalls++;
+        rgb->dev_fd = open(rgb->base, O_RDWR | O_CLOEXEC);
+        if (rgb->dev_fd < 0) {
+            fprintf(stderr, "hwio: failed to open %s: %s\n",
+                    rgb->base, strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int hwio_rgb_write(struct hwio_rgb *rgb, enum hwio_rgb_reg reg, uint32_t value)
+{
+    if (reg >= HWIO_RGB_NUM_REGS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (rgb->backend == HWIO_BACKEND_CHARDEV) {
+        rgb->syscalls++;
+        if (pwrite(rgb->dev_fd, &value, sizeof(value), reg * sizeof(value)) != sizeof(value))
+            return -1;
+        return 0;
+    }
+
+    if (open_attr(&rgb->reg_fd[reg], rgb->base, rgb_attr_names[reg],
+                  O_WRONLY, &rgb->syscalls) != 0)
+        return -1;
+
+    rgb->syscalls++;
+    return hwio_write_u32(rgb->reg_fd[reg], value);
+}
+
+// One syscall per color either way: the chardev takes the first three
+// fields of struct rgb_pwm_color, sysfs takes "r g b" on the color attribute.
+// The driver commits once, so the LED never shows a partial color.
+int hwio_rgb_set(struct hwio_rgb *rgb, uint32_t red, uint32_t green, uint32_t blue)
+{
+    char buf[HWIO_COLOR_TEXT_MAX];
+    int len = 0;
+    ssize_t n;
+
+    if (rgb->backend == HWIO_BACKEND_CHARDEV) {
+        struct rgb_pwm_color color = {
+            .red = red,
+            .green = green,
+            .blue = blue,
+        };
+        const size_t size = offsetof(struct rgb_pwm_color, period);
+
+        rgb->syscalls++;
+        if (pwrite(rgb->dev_fd, &color, size, 0) != (ssize_t)size)
+            return -1;
+        return 0;
+    }
+
+    if (open_attr(&rgb->color_fd, rgb->base, "color", O_WRONLY,
+                  &rgb->syscalls) != 0)
+        return -1;
+
+    // hwio_format_u32 ends each value with '\n'; turn the first two into
+    // separators
+    len += hwio_format_u32(buf + len, red);
+    buf[len - 1] = ' ';
+    len += hwio_format_u32(buf + len, green);
+    buf[len - 1] = ' ';
+    len += hwio_format_u32(buf + len, blue);
+
+    rgb->syscalls++;
+    n = pwrite(rgb->color_fd, buf, len, 0);
+    if (n < 0)
+        return -1;
+    if (n != len) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+// One channel is a single register write (and commit) in either backend.
+// Otherwise the chardev writes the registers from the lowest to the highest
+// channel in mask, and sysfs falls back to the color attribute.
+int hwio_rgb_set_channels(struct hwio_rgb *rgb, unsigned int mask,
+                          const uint32_t duty[3])
+{
+    int first, last;
+    size_t size;
+
+    mask &= 0x7;
+    if (mask == 0)
+        return 0;
+
+    first = __builtin_ctz(mask);
+    last = 31 - __builtin_clz(mask);
+    if (first == last)
+        return hwio_rgb_write(rgb, HWIO_RGB_RED + first, duty[first]);
+
+    if (rgb->backend != HWIO_BACKEND_CHARDEV)
+        return hwio_rgb_set(rgb, duty[0], duty[1], duty[2]);
+
+    size = (last - first + 1) * sizeof(duty[0]);
+    rgb->syscalls++;
+    if (pwrite(rgb->dev_fd, &duty[first], size, first * sizeof(duty[0])) !=
+        (ssize_t)size)
+        return -1;
+    return 0;
+}
+
+void hwio_rgb_close(struct hwio_rgb *rgb)
+{
+    int i;
+
+    for (i = 0; i < HWIO_RGB_NUM_REGS; i++)
+        close_fd(&rgb->reg_fd[i]);
+    close_fd(&rgb->color_fd);
+    close_fd(&rgb->dev_fd);
+}
+
+/* --------------------------- LED bar --------------------------- */
+
+int hwio_led_bar_open(struct hwio_led_bar *bar, enum hwio_backend backend,
+                      const char *path)
+{
+    memset(bar, 0, sizeof(*bar));
+    bar->backend = backend;
+    bar->fd = -1;
+
+    if (path)
+        snprintf(bar->base, sizeof(bar->base), "%s", path);
+    else if (hwio_path(bar->base, sizeof(bar->base),
+                       (backend == HWIO_BACKEND_SYSFS) ? HWIO_LED_BAR_SYSFS_BASE
+                                                       : HWIO_LED_BAR_CHARDEV) != 0)
+        return -1;
+
+    if (backend == HWIO_BACKEND_SYSFS)
+        return open_attr(&bar->fd, bar->base, "sw_led_control", O_WRONLY,
+                         &bar->syscalls);
+
+    bar->syscalls++;
+    bar->fd = open(bar->base, O_WRONLY | O_CLOEXEC);
+    if (bar->fd < 0) {
+        fprintf(stderr, "hwio: failed to open %s: %s\n", bar->base, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int hwio_led_bar_write(struct hwio_led_bar *bar, uint32_t pattern)
+{
+    bar->syscalls++;
+
+    if (bar->backend == HWIO_BACKEND_CHARDEV) {
+        if (pwrite(bar->fd, &pattern, sizeof(pattern), 0) != sizeof(pattern))
+            return -1;
+        return 0;
+    }
+
+    return hwio_write_u32(bar->fd, pattern);
+}
+
+void hwio_led_bar_close(struct hwio_led_bar *bar)
+{
+    close_fd(&bar->fd);
+}
+
+/* ---------------------------- mmap ---------------------------- */
+
+volatile uint32_t *hwio_map_regs(const char *dev, unsigned long page_offset,
+                                 int writable)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+    void *map;
+    int fd;
+
+    fd = open(dev, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "hwio: failed to open %s: %s\n", dev, strerror(errno));
+        return NULL;
+    }
+
+    map = mmap(NULL, page_size, prot, MAP_SHARED, fd, 0);
+
+    // the mapping stays valid after the fd is closed
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "hwio: failed to mmap %s: %s\n", dev, strerror(errno));
+        return NULL;
+    }
+
+    return (volatile uint32_t *)((char *)map + page_offset);
+}
+
+void hwio_unmap_regs(volatile uint32_t *regs)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t page = (uintptr_t)regs & ~(uintptr_t)(page_size - 1);
+
+    munmap((void *)page, page_size);
+}
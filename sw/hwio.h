@@ -0,0 +1,181 @@
+// hwio.h
+// Persistent-descriptor access to the FPGA peripherals.
+//
+// Every attribute / device node is opened once and then accessed with
+// pread/pwrite at a fixed offset, so a sample costs exactly one syscall
+// instead of fopen + stdio buffering + fscanf/fprintf + fclose.
+//
+// Two backends:
+//   HWIO_BACKEND_SYSFS   : text attributes, e.g. adc0/device/ch0_raw
+//                          (pread/pwrite at offset 0, hand-rolled parse/format)
+//   HWIO_BACKEND_CHARDEV : binary 32-bit registers through /dev/adc0 and
+//                          /dev/rgb_pwm0 (pread/pwrite at the register offset)
+//
+// Every peripheral can have several copies in the FPGA. Instance N of a
+// driver is the char device /dev/<name>N; its sysfs attributes are in
+// /sys/class/misc/<name>N/device, a link to the platform device. Passing a
+// NULL path to an open function selects instance 0; hwio_instance_path()
+// builds the path of any other one and hwio_instances() lists them.
+//
+// Default paths are prefixed with a root directory, taken from the HWIO_ROOT
+// environment variable or hwio_set_root(). It is empty on the board; point
+// it at a tree created by board_sim to run against the simulated peripherals.
+
+#ifndef HWIO_H
+#define HWIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Driver names, i.e. the char device and misc class entry without the number
+#define HWIO_ADC_NAME            "adc"
+#define HWIO_RGB_NAME            "rgb_pwm"
+#define HWIO_LED_BAR_NAME        "led_bar"
+#define HWIO_BUTTON_NAME         "push_button"
+
+#define HWIO_CLASS_DIR           "/sys/class/misc"
+
+// Instance 0 of each driver, the default
+#define HWIO_ADC_SYSFS_BASE      HWIO_CLASS_DIR "/" HWIO_ADC_NAME "0/device"
+#define HWIO_RGB_SYSFS_BASE      HWIO_CLASS_DIR "/" HWIO_RGB_NAME "0/device"
+#define HWIO_LED_BAR_SYSFS_BASE  HWIO_CLASS_DIR "/" HWIO_LED_BAR_NAME "0/device"
+#define HWIO_BUTTON_SYSFS_BASE   HWIO_CLASS_DIR "/" HWIO_BUTTON_NAME "0/device"
+#define HWIO_ADC_CHARDEV         "/dev/" HWIO_ADC_NAME "0"
+#define HWIO_RGB_CHARDEV         "/dev/" HWIO_RGB_NAME "0"
+#define HWIO_LED_BAR_CHARDEV     "/dev/" HWIO_LED_BAR_NAME "0"
+#define HWIO_BUTTON_CHARDEV      "/dev/" HWIO_BUTTON_NAME "0"
+
+// Most instances of one driver hwio_instances() reports
+#define HWIO_MAX_INSTANCES       64
+
+// Offset of each instance-0 register block within the page mmap()ed from
+// its char device (physical base & (page size - 1)); all four share page
+// 0xff37f000
+#define HWIO_ADC_PAGE_OFFSET      0x400
+#define HWIO_RGB_PAGE_OFFSET      0x430
+#define HWIO_LED_BAR_PAGE_OFFSET  0x450
+#define HWIO_BUTTON_PAGE_OFFSET   0x470
+
+#define HWIO_ADC_CHANNELS     8
+#define HWIO_LED_BAR_LEDS     10
+#define HWIO_PATH_MAX         256
+
+enum hwio_backend {
+    HWIO_BACKEND_SYSFS,
+    HWIO_BACKEND_CHARDEV,
+};
+
+// RGB PWM registers, in register-map order (offset = index * 4)
+enum hwio_rgb_reg {
+    HWIO_RGB_RED,
+    HWIO_RGB_GREEN,
+    HWIO_RGB_BLUE,
+    HWIO_RGB_PERIOD,
+    HWIO_RGB_NUM_REGS,
+};
+
+// ADC handle
+// sysfs:   one fd per chN_raw attribute, opened on first use
+// chardev: dev_fd is /dev/adcN, channel C lives at offset C * 4
+struct hwio_adc {
+    enum hwio_backend backend;
+    char base[HWIO_PATH_MAX];
+    int ch_fd[HWIO_ADC_CHANNELS];
+    int dev_fd;
+    uint32_t ch_mask;           // chardev: mask currently set in the driver
+    int offset_only;            // chardev: no ADC_IOC_SET_CHMASK (plain file)
+    unsigned long syscalls;     // number of syscalls issued through this handle
+};
+
+// RGB PWM handle
+// sysfs:   one fd per red/green/blue/period attribute plus color, opened on
+//          first use
+// chardev: dev_fd is /dev/rgb_pwmN
+struct hwio_rgb {
+    enum hwio_backend backend;
+    char base[HWIO_PATH_MAX];
+    int reg_fd[HWIO_RGB_NUM_REGS];
+    int color_fd;
+    int dev_fd;
+    unsigned long syscalls;
+};
+
+// LED bar handle
+// sysfs:   fd is the sw_led_control attribute
+// chardev: fd is /dev/led_barN, the pattern register is at offset 0
+// Either way the fd is opened by hwio_led_bar_open and held until close.
+struct hwio_led_bar {
+    enum hwio_backend backend;
+    char base[HWIO_PATH_MAX];
+    int fd;
+    unsigned long syscalls;
+};
+
+// Root prefix for default paths (see top of file).
+void hwio_set_root(const char *root);
+const char *hwio_root(void);
+// buf = root + path; return 0 if successful, -1 with errno set if it won't fit
+int hwio_path(char *buf, size_t size, const char *path);
+
+// buf = root + the sysfs directory or char device of instance N of driver
+// name (e.g. HWIO_RGB_NAME); return 0 if successful, -1 with errno set
+int hwio_instance_path(char *buf, size_t size, const char *name,
+                       unsigned int instance, enum hwio_backend backend);
+// Fill ids[] with the instance numbers of driver name found under
+// root + HWIO_CLASS_DIR, in ascending order, at most max of them.
+// Returns how many were found (0 if the directory is missing).
+int hwio_instances(const char *name, unsigned int *ids, int max);
+// Parse "all" or a comma-separated list of instance numbers ("0,2") into
+// ids[]; "all" is expanded with hwio_instances(). Returns the number of
+// ids, or -1 with errno set if the list is malformed or empty.
+int hwio_parse_instances(const char *list, const char *name,
+                         unsigned int *ids, int max);
+
+// Low-level helpers for a single text attribute fd.
+// return 0 if successful, -1 with errno set otherwise
+int hwio_read_u32(int fd, uint32_t *out);
+int hwio_write_u32(int fd, uint32_t value);
+
+// Format/parse an unsigned decimal without stdio.
+// hwio_format_u32 writes "<value>\n" (no terminator) and returns its length.
+int hwio_format_u32(char *buf, uint32_t value);
+int hwio_parse_u32(const char *buf, int len, uint32_t *out);
+
+// path is the sysfs directory (sysfs backend) or device node (chardev);
+// NULL selects the default for the backend.
+int hwio_adc_open(struct hwio_adc *adc, enum hwio_backend backend, const char *path);
+int hwio_adc_read(struct hwio_adc *adc, unsigned int ch, uint16_t *out);
+// Read every channel in mask (bit N = channel N) into out[], lowest channel
+// first. The chardev backend does this in a single packed read().
+int hwio_adc_read_channels(struct hwio_adc *adc, uint32_t mask, uint16_t *out);
+int hwio_adc_set_auto_update(struct hwio_adc *adc, int enable);
+void hwio_adc_close(struct hwio_adc *adc);
+
+int hwio_rgb_open(struct hwio_rgb *rgb, enum hwio_backend backend, const char *path);
+int hwio_rgb_write(struct hwio_rgb *rgb, enum hwio_rgb_reg reg, uint32_t value);
+// Set all three duties in one syscall; the hardware latches them together at
+// the next PWM period boundary.
+int hwio_rgb_set(struct hwio_rgb *rgb, uint32_t red, uint32_t green, uint32_t blue);
+// Set only the duties whose bit is in mask (bit 0 red, 1 green, 2 blue), in
+// one syscall. duty[] holds all three; a backend that can't skip a channel
+// inside the written range rewrites it with its duty[] value, so pass the
+// current duty for channels outside mask.
+int hwio_rgb_set_channels(struct hwio_rgb *rgb, unsigned int mask,
+                          const uint32_t duty[3]);
+void hwio_rgb_close(struct hwio_rgb *rgb);
+
+int hwio_led_bar_open(struct hwio_led_bar *bar, enum hwio_backend backend,
+                      const char *path);
+// bit N lights LED N; bits above HWIO_LED_BAR_LEDS are ignored by the hardware
+int hwio_led_bar_write(struct hwio_led_bar *bar, uint32_t pattern);
+void hwio_led_bar_close(struct hwio_led_bar *bar);
+
+// Map a device's registers with mmap() for syscall-free access.
+// Returns a pointer to the first register (page_offset into the mapping),
+// or NULL with errno set. /dev/adcN only allows read-only mappings, and the
+// other devices need CAP_SYS_RAWIO for writable ones while they share a page.
+volatile uint32_t *hwio_map_regs(const char *dev, unsigned long page_offset,
+                                 int writable);
+void hwio_unmap_regs(volatile uint32_t *regs);
+
+#endif // HWIO_H
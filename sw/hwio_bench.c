@@ -0,0 +1,260 @@
+// hwio_bench.c
+// Microbenchmark for the pot_to_rgb loop body: 3 ADC reads + an RGB color update.
+//
+// Compares the legacy fopen/fscanf/fprintf/fclose path against the hwio
+// sysfs (persistent fd + pread/pwrite) and chardev backends and reports
+// ns and syscalls per sample.
+//
+// The paths are configurable, so on an x86 host the benchmark can be pointed
+// at a directory of plain files that stands in for the sysfs attributes:
+//   mkdir -p /tmp/adc /tmp/rgb
+//   for i in 0 1 2 3 4 5 6 7; do echo 1234 > /tmp/adc/ch${i}_raw; done
+//   touch /tmp/rgb/red /tmp/rgb/green /tmp/rgb/blue /tmp/rgb/period /tmp/rgb/color
+//   ./hwio_bench -a /tmp/adc -r /tmp/rgb -b stdio,sysfs
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hwio.h"
+
+// duty is 18.17 => scale by 2^17
+#define DUTY_SCALE       (1u << 17)
+
+// glibc stdio per access: openat + fstat + read/write + close
+#define STDIO_SYSCALLS_PER_ACCESS   4
+
+struct bench_cfg {
+    const char *adc_sysfs;
+    const char *rgb_sysfs;
+    const char *adc_dev;
+    const char *rgb_dev;
+    unsigned long iterations;
+};
+
+struct bench_result {
+    double ns_per_sample;
+    double syscalls_per_sample;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t adc_to_duty(uint16_t adc)
+{
+    return (uint32_t)adc * DUTY_SCALE / 4095u;
+}
+
+/* ---------------- legacy stdio path (pot_to_rgb before hwio) ---------------- */
+
+static int stdio_read_u16(const char *path, uint16_t *out)
+{
+    unsigned int tmp = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return -1;
+    if (fscanf(f, "%u", &tmp) != 1) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    *out = (uint16_t)(tmp > 0xFFFF ? 0xFFFF : tmp);
+    return 0;
+}
+
+static int stdio_write_u32(const char *path, uint32_t value)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+        return -1;
+    if (fprintf(f, "%u\n", value) < 0) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int bench_stdio(const struct bench_cfg *cfg, struct bench_result *res)
+{
+    char adc_path[3][HWIO_PATH_MAX + 16];
+    char rgb_path[3][HWIO_PATH_MAX + 16];
+    static const char *const rgb_names[3] = { "red", "green", "blue" };
+    uint16_t v[3];
+    unsigned long i;
+    int ch;
+    uint64_t start;
+
+    for (ch = 0; ch < 3; ch++) {
+        snprintf(adc_path[ch], sizeof(adc_path[ch]), "%s/ch%d_raw", cfg->adc_sysfs, ch);
+        snprintf(rgb_path[ch], sizeof(rgb_path[ch]), "%s/%s", cfg->rgb_sysfs, rgb_names[ch]);
+    }
+
+    start = now_ns();
+    for (i = 0; i < cfg->iterations; i++) {
+        for (ch = 0; ch < 3; ch++) {
+            if (stdio_read_u16(adc_path[ch], &v[ch]) != 0)
+                return -1;
+        }
+        for (ch = 0; ch < 3; ch++) {
+            if (stdio_write_u32(rgb_path[ch], adc_to_duty(v[ch])) != 0)
+                return -1;
+        }
+    }
+
+    res->ns_per_sample = (double)(now_ns() - start) / cfg->iterations;
+    res->syscalls_per_sample = 6 * STDIO_SYSCALLS_PER_ACCESS;
+    return 0;
+}
+
+/* ------------------------------ hwio backends ------------------------------ */
+
+static int bench_hwio(const struct bench_cfg *cfg, enum hwio_backend backend,
+                      struct bench_result *res)
+{
+    struct hwio_adc adc;
+    struct hwio_rgb rgb;
+    uint16_t v[3];
+    unsigned long i, syscalls_before;
+    int ret = 0;
+    uint64_t start;
+
+    if (backend == HWIO_BACKEND_SYSFS) {
+        if (hwio_adc_open(&adc, backend, cfg->adc_sysfs) != 0)
+            return -1;
+        if (hwio_rgb_open(&rgb, backend, cfg->rgb_sysfs) != 0) {
+            hwio_adc_close(&adc);
+            return -1;
+        }
+    } else {
+        if (hwio_adc_open(&adc, backend, cfg->adc_dev) != 0)
+            return -1;
+        if (hwio_rgb_open(&rgb, backend, cfg->rgb_dev) != 0) {
+            hwio_adc_close(&adc);
+            return -1;
+        }
+    }
+
+    // warm-up pass opens the sysfs attributes (and sets the chardev channel
+    // mask) so they aren't counted
+    if (hwio_adc_read_channels(&adc, 0x7, v) != 0) {
+        ret = -1;
+        goto out;
+    }
+    if (hwio_rgb_set(&rgb, 0, 0, 0) != 0) {
+        ret = -1;
+        goto out;
+    }
+
+    syscalls_before = adc.syscalls + rgb.syscalls;
+    start = now_ns();
+    for (i = 0; i < cfg->iterations; i++) {
+        if (hwio_adc_read_channels(&adc, 0x7, v) != 0 ||
+            hwio_rgb_set(&rgb, adc_to_duty(v[0]), adc_to_duty(v[1]),
+                         adc_to_duty(v[2])) != 0) {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    res->ns_per_sample = (double)(now_ns() - start) / cfg->iterations;
+    res->syscalls_per_sample =
+        (double)(adc.syscalls + rgb.syscalls - syscalls_before) / cfg->iterations;
+
+out:
+    hwio_rgb_close(&rgb);
+    hwio_adc_close(&adc);
+    return ret;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n iterations] [-b stdio,sysfs,chardev]\n"
+            "          [-a adc_sysfs_dir] [-r rgb_sysfs_dir]\n"
+            "          [-A adc_dev] [-R rgb_dev]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_cfg cfg = {
+        .adc_sysfs = HWIO_ADC_SYSFS_BASE,
+        .rgb_sysfs = HWIO_RGB_SYSFS_BASE,
+        .adc_dev = HWIO_ADC_CHARDEV,
+        .rgb_dev = HWIO_RGB_CHARDEV,
+        .iterations = 10000,
+    };
+    const char *backends = "stdio,sysfs,chardev";
+    struct bench_result res;
+    double baseline_ns = 0;
+    int opt, ret = 0;
+
+    while ((opt = getopt(argc, argv, "n:b:a:r:A:R:h")) != -1) {
+        switch (opt) {
+            case 'n': cfg.iterations = strtoul(optarg, NULL, 0); break;
+            case 'b': backends = optarg; break;
+            case 'a': cfg.adc_sysfs = optarg; break;
+            case 'r': cfg.rgb_sysfs = optarg; break;
+            case 'A': cfg.adc_dev = optarg; break;
+            case 'R': cfg.rgb_dev = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (cfg.iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("hwio_bench: %lu samples (3 ADC reads + 1 RGB color each)\n",
+           cfg.iterations);
+    printf("%-10s %14s %16s %10s\n", "backend", "ns/sample", "syscalls/sample", "speedup");
+
+    if (strstr(backends, "stdio")) {
+        if (bench_stdio(&cfg, &res) == 0) {
+            baseline_ns = res.ns_per_sample;
+            printf("%-10s %14.0f %16.1f %10s\n", "stdio",
+                   res.ns_per_sample, res.syscalls_per_sample, "1.0x");
+        } else {
+            fprintf(stderr, "stdio: %s\n", strerror(errno));
+            ret = 1;
+        }
+    }
+
+    if (strstr(backends, "sysfs")) {
+        if (bench_hwio(&cfg, HWIO_BACKEND_SYSFS, &res) == 0) {
+            printf("%-10s %14.0f %16.1f %9.1fx\n", "sysfs",
+                   res.ns_per_sample, res.syscalls_per_sample,
+                   baseline_ns > 0 ? baseline_ns / res.ns_per_sample : 0.0);
+        } else {
+            fprintf(stderr, "sysfs: %s\n", strerror(errno));
+            ret = 1;
+        }
+    }
+
+    if (strstr(backends, "chardev")) {
+        if (bench_hwio(&cfg, HWIO_BACKEND_CHARDEV, &res) == 0) {
+            printf("%-10s %14.0f %16.1f %9.1fx\n", "chardev",
+                   res.ns_per_sample, res.syscalls_per_sample,
+                   baseline_ns > 0 ? baseline_ns / res.ns_per_sample : 0.0);
+        } else {
+            fprintf(stderr, "chardev: %s\n", strerror(errno));
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
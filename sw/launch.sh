@@ -3,15 +3,21 @@ pb_pid=""
 pot_pid=""
 bar_pid=""
 
+# pot_to_rgb handles the push button itself through /dev/push_button0;
+# custom_pb_colors.sh is only needed when that driver isn't loaded or has
+# no interrupt, since poll() never wakes up without one
+PB_HAS_IRQ=/sys/class/misc/push_button0/device/has_irq
 if [ $1 = "y" ]; then
-    bash ./custom_pb_colors.sh &
-    pb_pid=$!
+    if [ ! -e /dev/push_button0 ] || [ "$(cat $PB_HAS_IRQ 2>/dev/null)" != "1" ]; then
+        bash ./custom_pb_colors.sh &
+        pb_pid=$!
+    fi
     ./pot_to_rgb &
     pot_pid=$!
 fi
 
 if [ $2 = "y" ]; then
-    bash ./update_led_bar.sh &
+    ./load_bar &
     bar_pid=$!
 fi
 
@@ -20,7 +26,9 @@ read -p "Press enter to exit" response
 
 
 if [ $1 = "y" ]; then
-    kill "$pb_pid"
+    if [ -n "$pb_pid" ]; then
+        kill "$pb_pid"
+    fi
     kill "$pot_pid"
 fi
 
@@ -0,0 +1,605 @@
+// load_bar.c
+// Show a system load metric on the 10-LED bar. Replaces update_led_bar.sh,
+// which forked `ps -e | wc -l` in an unthrottled loop.
+// Assum:
+//   LED bar at /sys/class/misc/led_barN/device (or /dev/led_barN, -c),
+//   N from -i (default 0); -i all shows the metric on every bar
+//
+// Nothing is forked. Every /proc file and the LED bar attribute are opened
+// once and re-read with pread at offset 0 (/proc regenerates the text), and
+// /proc itself is rewound and re-listed for the process count. A timerfd
+// paces the refresh at --rate Hz, a signalfd handles SIGINT/SIGTERM, and the
+// bar is only written when the pattern changes. --stats reports our own CPU
+// use from getrusage().
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+
+#include "hwio.h"
+
+#define DEFAULT_RATE_HZ  4
+#define MAX_RATE_HZ      1000
+
+// /proc/stat's first line and /proc/meminfo's first three lines fit easily
+#define PROC_BUF_SIZE    512
+
+#define ALL_LEDS         ((1u << HWIO_LED_BAR_LEDS) - 1)
+
+enum metric {
+    METRIC_PROCS,       // processes, like ps -e | wc -l
+    METRIC_TASKS,       // threads, /proc/loadavg total
+    METRIC_RUNNING,     // runnable threads, /proc/loadavg running
+    METRIC_LOAD1,       // 1 minute load average * 100
+    METRIC_CPU,         // % CPU busy since the last refresh
+    METRIC_MEM,         // % memory in use (MemTotal - MemAvailable)
+    NUM_METRICS,
+};
+
+enum mapping {
+    MAP_BINARY,         // value as a 10-bit binary number (the old script)
+    MAP_BAR,            // bar graph, value / max of the LEDs lit
+    MAP_DOT,            // single LED at value / max
+    MAP_LOG,            // bar graph of the value's bit length (1, 2, 4, ... 512)
+    NUM_MAPPINGS,
+};
+
+static const char *const metric_names[NUM_METRICS] = {
+    "procs", "tasks", "running", "load1", "cpu", "mem",
+};
+
+static const char *const mapping_names[NUM_MAPPINGS] = {
+    "binary", "bar", "dot", "log",
+};
+
+struct stats {
+    unsigned long ticks;            // timer wakeups
+    unsigned long missed;           // timer expirations we slept through
+    unsigned long writes;           // patterns written to the LED bar
+    unsigned long skipped;          // refreshes where the pattern didn't change
+    unsigned long syscalls;         // /proc reads (LED bar writes are in bar[])
+    unsigned long errors;
+};
+
+struct app {
+    enum metric metric;
+    enum mapping mapping;
+    uint32_t max;                   // full scale for MAP_BAR / MAP_DOT
+    struct hwio_led_bar bar[HWIO_MAX_INSTANCES];
+    int num_bars;
+    int loadavg_fd;
+    int stat_fd;
+    int meminfo_fd;
+    DIR *proc_dir;
+    uint64_t cpu_busy;              // previous /proc/stat totals
+    uint64_t cpu_total;
+    uint32_t value;
+    uint32_t pattern;
+    int have_pattern;
+    struct stats st;
+};
+
+// read a /proc file from the start into buf and terminate it
+// return the length, or -1 with errno set
+static int read_proc(struct app *app, int fd, char *buf, size_t size)
+{
+    ssize_t n;
+
+    app->st.syscalls++;
+    n = pread(fd, buf, size - 1, 0);
+    if (n < 0)
+        return -1;
+
+    buf[n] = '\0';
+    return (int)n;
+}
+
+// number of numeric entries in /proc; the directory stays open and is
+// rewound each time
+static int count_procs(struct app *app, uint32_t *out)
+{
+    struct dirent *de;
+    uint32_t count = 0;
+
+    rewinddir(app->proc_dir);
+    errno = 0;
+    while ((de = readdir(app->proc_dir)) != NULL) {
+        if (de->d_name[0] >= '1' && de->d_name[0] <= '9')
+            count++;
+    }
+    // getdents, roughly one per 32 kB of entries, plus the lseek
+    app->st.syscalls += 2;
+    if (errno != 0)
+        return -1;
+
+    *out = count;
+    return 0;
+}
+
+// "0.52 0.58 0.59 3/167 2134" -> load1 * 100, running, total
+static int read_loadavg(struct app *app, uint32_t *load1, uint32_t *running,
+                        uint32_t *total)
+{
+    char buf[PROC_BUF_SIZE];
+    unsigned int whole, frac, r, t;
+
+    if (read_proc(app, app->loadavg_fd, buf, sizeof(buf)) < 0)
+        return -1;
+    if (sscanf(buf, "%u.%u %*s %*s %u/%u", &whole, &frac, &r, &t) != 4) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *load1 = whole * 100 + frac;
+    *running = r;
+    *total = t;
+    return 0;
+}
+
+// busy % of all CPUs since the previous call, from the "cpu" line of
+// /proc/stat (user nice system idle iowait irq softirq steal)
+static int read_cpu(struct app *app, uint32_t *out)
+{
+    char buf[PROC_BUF_SIZE];
+    unsigned long long v[8] = { 0 };
+    uint64_t busy, total, d_busy, d_total;
+    int i;
+
+    if (read_proc(app, app->stat_fd, buf, sizeof(buf)) < 0)
+        return -1;
+    if (sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    total = 0;
+    for (i = 0; i < 8; i++)
+        total += v[i];
+    busy = total - v[3] - v[4];
+
+    d_busy = busy - app->cpu_busy;
+    d_total = total - app->cpu_total;
+    app->cpu_busy = busy;
+    app->cpu_total = total;
+
+    *out = d_total ? (uint32_t)(d_busy * 100 / d_total) : 0;
+    return 0;
+}
+
+// % of MemTotal not counted in MemAvailable
+static int read_mem(struct app *app, uint32_t *out)
+{
+    char buf[PROC_BUF_SIZE];
+    unsigned long total = 0, avail = 0;
+    char *p;
+
+    if (read_proc(app, app->meminfo_fd, buf, sizeof(buf)) < 0)
+        return -1;
+
+    p = strstr(buf, "MemTotal:");
+    if (p)
+        total = strtoul(p + strlen("MemTotal:"), NULL, 10);
+    p = strstr(buf, "MemAvailable:");
+    if (p)
+        avail = strtoul(p + strlen("MemAvailable:"), NULL, 10);
+    if (total == 0 || avail > total) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *out = (uint32_t)((uint64_t)(total - avail) * 100 / total);
+    return 0;
+}
+
+// return 0 if successful
+static int read_metric(struct app *app, uint32_t *out)
+{
+    uint32_t load1, running, total;
+
+    switch (app->metric) {
+        case METRIC_PROCS:
+            return count_procs(app, out);
+        case METRIC_TASKS:
+        case METRIC_RUNNING:
+        case METRIC_LOAD1:
+            if (read_loadavg(app, &load1, &running, &total) != 0)
+                return -1;
+            *out = (app->metric == METRIC_TASKS) ? total :
+                   (app->metric == METRIC_RUNNING) ? running : load1;
+            return 0;
+        case METRIC_CPU:
+            return read_cpu(app, out);
+        case METRIC_MEM:
+            return read_mem(app, out);
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+}
+
+// number of LEDs for value out of max, rounded to nearest
+static unsigned int scale_leds(uint32_t value, uint32_t max)
+{
+    uint64_t n;
+
+    if (value >= max)
+        return HWIO_LED_BAR_LEDS;
+
+    n = ((uint64_t)value * HWIO_LED_BAR_LEDS + max / 2) / max;
+    return (unsigned int)n;
+}
+
+static uint32_t to_pattern(enum mapping mapping, uint32_t value, uint32_t max)
+{
+    unsigned int n;
+
+    switch (mapping) {
+        case MAP_BAR:
+            return (1u << scale_leds(value, max)) - 1;
+        case MAP_DOT:
+            // LED 0 at 0, LED 9 at max
+            n = (value >= max) ? HWIO_LED_BAR_LEDS - 1 :
+                (unsigned int)((uint64_t)value * HWIO_LED_BAR_LEDS / max);
+            return 1u << n;
+        case MAP_LOG:
+            n = 0;
+            while (value != 0 && n < HWIO_LED_BAR_LEDS) {
+                value >>= 1;
+                n++;
+            }
+            return (1u << n) - 1;
+        case MAP_BINARY:
+        default:
+            return value & ALL_LEDS;
+    }
+}
+
+// default full scale for the bar and dot mappings
+static uint32_t default_max(enum metric metric)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus < 1)
+        cpus = 1;
+
+    switch (metric) {
+        case METRIC_PROCS:   return 256;
+        case METRIC_TASKS:   return 512;
+        case METRIC_RUNNING: return (uint32_t)cpus;
+        case METRIC_LOAD1:   return (uint32_t)cpus * 100;
+        default:             return 100;
+    }
+}
+
+static void on_timer(struct app *app, int timer_fd)
+{
+    uint64_t expirations;
+    uint32_t value, pattern;
+    int i, ret = 0;
+
+    if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    app->st.ticks++;
+    app->st.missed += expirations - 1;
+
+    if (read_metric(app, &value) != 0) {
+        app->st.errors++;
+        return;
+    }
+    app->value = value;
+
+    pattern = to_pattern(app->mapping, value, app->max);
+    if (app->have_pattern && pattern == app->pattern) {
+        app->st.skipped++;
+        return;
+    }
+
+    for (i = 0; i < app->num_bars; i++) {
+        if (hwio_led_bar_write(&app->bar[i], pattern) != 0)
+            ret = -1;
+    }
+    if (ret != 0) {
+        app->st.errors++;
+        return;
+    }
+
+    app->pattern = pattern;
+    app->have_pattern = 1;
+    app->st.writes++;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// user + system CPU time used by this process so far
+static double cpu_s(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0.0;
+
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void print_stats(const struct app *app, double elapsed_s, double used_s)
+{
+    const struct stats *st = &app->st;
+    unsigned long syscalls = st->syscalls;
+    int i;
+
+    for (i = 0; i < app->num_bars; i++)
+        syscalls += app->bar[i].syscalls;
+
+    printf("load_bar: %.1fs %s=%u leds=0x%03x ticks=%lu missed=%lu "
+           "writes=%lu skipped=%lu errors=%lu syscalls=%lu cpu=%.3fms (%.3f%%)\n",
+           elapsed_s, metric_names[app->metric], app->value, app->pattern,
+           st->ticks, st->missed, st->writes, st->skipped, st->errors,
+           syscalls, used_s * 1e3,
+           elapsed_s > 0 ? used_s / elapsed_s * 100.0 : 0.0);
+    fflush(stdout);
+}
+
+// return the index of name in names[], or -1
+static int lookup(const char *const *names, int count, const char *name)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+// open the /proc source for the metric once
+// return 0 if successful
+static int open_metric(struct app *app)
+{
+    const char *path = NULL;
+    int *fd = NULL;
+
+    switch (app->metric) {
+        case METRIC_PROCS:
+            app->proc_dir = opendir("/proc");
+            if (!app->proc_dir) {
+                fprintf(stderr, "load_bar: failed to open /proc: %s\n",
+                        strerror(errno));
+                return -1;
+            }
+            return 0;
+        case METRIC_CPU:
+            path = "/proc/stat";
+            fd = &app->stat_fd;
+            break;
+        case METRIC_MEM:
+            path = "/proc/meminfo";
+            fd = &app->meminfo_fd;
+            break;
+        default:
+            path = "/proc/loadavg";
+            fd = &app->loadavg_fd;
+            break;
+    }
+
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (*fd < 0) {
+        fprintf(stderr, "load_bar: failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-c] [-i LIST] [-m metric] [-p mapping] [-x max] [-r HZ] [-s]\n"
+            "       [-R root]\n"
+            "  -c, --chardev        write /dev/led_barN instead of sw_led_control\n"
+            "  -i, --instance LIST  LED bars to drive, e.g. 0,1 or all (default 0)\n"
+            "  -m, --metric NAME    procs (default), tasks, running, load1 (x100),\n"
+            "                       cpu (%%), mem (%%)\n"
+            "  -p, --pattern NAME   binary (default), bar, dot, log\n"
+            "  -x, --max N          full scale for bar/dot (default depends on metric)\n"
+            "  -r, --rate HZ        refresh rate (default %d)\n"
+            "  -s, --stats          print statistics and our CPU use once per second\n"
+            "  -R, --root DIR       prefix for the LED bar path, e.g. a board_sim tree\n"
+            "                       (default $HWIO_ROOT, or the real board)\n",
+            prog, DEFAULT_RATE_HZ);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_opts[] = {
+        { "chardev",  no_argument,       NULL, 'c' },
+        { "instance", required_argument, NULL, 'i' },
+        { "metric",   required_argument, NULL, 'm' },
+        { "pattern",  required_argument, NULL, 'p' },
+        { "max",      required_argument, NULL, 'x' },
+        { "rate",     required_argument, NULL, 'r' },
+        { "stats",    no_argument,       NULL, 's' },
+        { "root",     required_argument, NULL, 'R' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    enum hwio_backend backend = HWIO_BACKEND_SYSFS;
+    const char *instances = "0";
+    unsigned int ids[HWIO_MAX_INSTANCES];
+    char path[HWIO_PATH_MAX];
+    unsigned long rate = DEFAULT_RATE_HZ;
+    unsigned long max = 0;
+    int stats = 0;
+    struct app app;
+    struct itimerspec its;
+    struct pollfd fds[2];
+    sigset_t sigs;
+    int timer_fd, sig_fd;
+    int running = 1;
+    int opt, idx, i;
+    double start, last_stats, cpu_start;
+
+    memset(&app, 0, sizeof(app));
+    app.metric = METRIC_PROCS;
+    app.mapping = MAP_BINARY;
+    app.loadavg_fd = app.stat_fd = app.meminfo_fd = -1;
+
+    while ((opt = getopt_long(argc, argv, "ci:m:p:x:r:sR:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'c': backend = HWIO_BACKEND_CHARDEV; break;
+            case 'i': instances = optarg; break;
+            case 'm':
+                idx = lookup(metric_names, NUM_METRICS, optarg);
+                if (idx < 0) {
+                    fprintf(stderr, "load_bar: unknown metric '%s'\n", optarg);
+                    return 1;
+                }
+                app.metric = idx;
+                break;
+            case 'p':
+                idx = lookup(mapping_names, NUM_MAPPINGS, optarg);
+                if (idx < 0) {
+                    fprintf(stderr, "load_bar: unknown pattern '%s'\n", optarg);
+                    return 1;
+                }
+                app.mapping = idx;
+                break;
+            case 'x': max = strtoul(optarg, NULL, 0); break;
+            case 'r': rate = strtoul(optarg, NULL, 0); break;
+            case 's': stats = 1; break;
+            case 'R': hwio_set_root(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (rate == 0 || rate > MAX_RATE_HZ) {
+        fprintf(stderr, "load_bar: rate must be 1..%d Hz\n", MAX_RATE_HZ);
+        return 1;
+    }
+    app.max = max ? (uint32_t)max : default_max(app.metric);
+
+    app.num_bars = hwio_parse_instances(instances, HWIO_LED_BAR_NAME, ids,
+                                        HWIO_MAX_INSTANCES);
+    if (app.num_bars < 0) {
+        fprintf(stderr, "load_bar: bad LED bar instance list '%s': %s\n",
+                instances, strerror(errno));
+        return 1;
+    }
+
+    if (open_metric(&app) != 0)
+        return 1;
+    for (i = 0; i < app.num_bars; i++) {
+        if (hwio_instance_path(path, sizeof(path), HWIO_LED_BAR_NAME, ids[i],
+                               backend) != 0 ||
+            hwio_led_bar_open(&app.bar[i], backend, path) != 0) {
+            fprintf(stderr, "Failed to open LED bar %u\n", ids[i]);
+            return 1;
+        }
+    }
+
+    // prime the CPU counters so the first refresh is a real delta
+    if (app.metric == METRIC_CPU)
+        read_cpu(&app, &app.value);
+
+    // SIGINT/SIGTERM are handled in the loop so we can exit cleanly
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    sig_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (timer_fd < 0 || sig_fd < 0) {
+        fprintf(stderr, "load_bar: failed to set up event loop: %s\n",
+                strerror(errno));
+        return 1;
+    }
+
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = 1000000000L / rate;
+    if (rate == 1) {
+        its.it_interval.tv_sec = 1;
+        its.it_interval.tv_nsec = 0;
+    }
+    // first refresh right away
+    its.it_value.tv_sec = 0;
+    its.it_value.tv_nsec = 1;
+    if (timerfd_settime(timer_fd, 0, &its, NULL) != 0) {
+        fprintf(stderr, "load_bar: timerfd_settime: %s\n", strerror(errno));
+        return 1;
+    }
+
+    fds[0].fd = timer_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = sig_fd;
+    fds[1].events = POLLIN;
+
+    printf("load_bar: %s as %s (max %u) at %lu Hz\n", metric_names[app.metric],
+           mapping_names[app.mapping], app.max, rate);
+    fflush(stdout);
+
+    start = last_stats = now_s();
+    cpu_start = cpu_s();
+
+    while (running) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "load_bar: poll: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+            on_timer(&app, timer_fd);
+        if (fds[1].revents & POLLIN)
+            running = 0;
+
+        if (stats) {
+            double t = now_s();
+
+            if (t - last_stats >= 1.0) {
+                print_stats(&app, t - start, cpu_s() - cpu_start);
+                last_stats = t;
+            }
+        }
+    }
+
+    // always report what we cost; that's what this replaced the script for
+    print_stats(&app, now_s() - start, cpu_s() - cpu_start);
+
+    close(sig_fd);
+    close(timer_fd);
+    if (app.proc_dir)
+        closedir(app.proc_dir);
+    if (app.loadavg_fd >= 0)
+        close(app.loadavg_fd);
+    if (app.stat_fd >= 0)
+        close(app.stat_fd);
+    if (app.meminfo_fd >= 0)
+        close(app.meminfo_fd);
+    for (i = 0; i < app.num_bars; i++)
+        hwio_led_bar_close(&app.bar[i]);
+    return 0;
+}
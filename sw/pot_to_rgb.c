@@ -1,8 +1,35 @@
 // pot_to_rgb.c
-// Read ADC channels 0–2 and drive RGB PWM via sysfs.
+// Read ADC channels 0–2 and drive RGB PWM via sysfs (default) or the
+// /dev/adc0 and /dev/rgb_pwmN char devices (-c).
 // Assum:
-//   ADC  at /sys/bus/platform/devices/ff37f400.adc
-//   RGB  at /sys/bus/platform/devices/ff37f430.rgb_pwm
+//   ADC  at /sys/class/misc/adc0/device
+//   RGB  at /sys/class/misc/rgb_pwmN/device, N from -i (default 0)
+// All attributes are opened once through hwio and accessed with pread/pwrite.
+// With several RGB instances (-i 0,1 or -i all) every one gets the same
+// color, each with its own persistent descriptor.
+//
+// Everything runs from one epoll loop:
+//   - a timerfd paces sampling at --rate Hz
+//   - button presses arrive as readiness on /dev/push_button0 (or, without
+//     the push button driver or its interrupt, as inotify events on
+//     number.txt from custom_pb_colors.sh) instead of re-reading a file
+//     every tick
+//   - SIGINT/SIGTERM arrive through a signalfd so we can print stats and exit
+// Pot readings become duties through color_map tables built at startup:
+// gamma (--gamma), RGB or HSV/HSL input (--mode), and per-pot range and
+// per-channel gain calibration (--pot-range, --gain).
+// The pots go through a software filter (--filter: EMA or median of N) and
+// then a per-pot dead-band (--deadband): a pot's reading only moves on when
+// it changed by more than the dead-band since it was last taken, so ADC
+// noise doesn't turn into a bridge write every tick. The dead-band is in ADC
+// codes ahead of the color map, so it is the same anywhere on the knob
+// whatever the gamma. Only the channels whose duty changed are written, in
+// one syscall per RGB instance (see hwio_rgb_set_channels).
+//
+// With -p every tick is timestamped (CLOCK_MONOTONIC) into fixed-size
+// histograms: loop period, wakeup lateness, ADC read, RGB write, ADC read to
+// PWM write, and the whole tick. Nothing is allocated or printed while
+// running; SIGUSR1 or exit dumps p50/p99/max per stage and deadline misses.
 
 #include <stdio.h>
 #include <stdint.h>
@@ -10,182 +37,971 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "hwio.h"
+#include "color_map.h"
 
-#define ADC_SYSFS_BASE   "/sys/bus/platform/devices/ff37f400.adc"
-#define RGB_SYSFS_BASE   "/sys/bus/platform/devices/ff37f430.rgb_pwm"
 #define BUTTON_PATH      "/home/soc/number.txt"
 
-// ADC attributes
-#define ADC_CH0_RAW      ADC_SYSFS_BASE "/ch0_raw"
-#define ADC_CH1_RAW      ADC_SYSFS_BASE "/ch1_raw"
-#define ADC_CH2_RAW      ADC_SYSFS_BASE "/ch2_raw"
-#define ADC_AUTO_UPDATE  ADC_SYSFS_BASE "/auto_update"
-#define ADC_UPDATE       ADC_SYSFS_BASE "/update"
-
-// RGB PWM attributes
-#define RGB_PERIOD       RGB_SYSFS_BASE "/period"
-#define RGB_RED          RGB_SYSFS_BASE "/red"
-#define RGB_GREEN        RGB_SYSFS_BASE "/green"
-#define RGB_BLUE         RGB_SYSFS_BASE "/blue"
-
 // duty is 18.17 => scale by 2^17
 #define DUTY_SCALE       (1u << 17)
 
-// write an integer to sysfs
-// driver expects 32 bit value
+#define DEFAULT_RATE_HZ  50
+#define MAX_RATE_HZ      100000
+#define NUM_COLORS       4
+#define NUM_POTS         3
+
+// EMA weight is 1/2^shift; median window is an odd number of samples
+#define DEFAULT_EMA_SHIFT    1
+#define MAX_EMA_SHIFT        8
+#define DEFAULT_MEDIAN_LEN   5
+#define MAX_MEDIAN_LEN       15
+// EMA state keeps this many fraction bits below the 12-bit ADC code
+#define EMA_FRAC_BITS        8
+
+// dead-band in ADC codes (of 4095 full scale)
+#define DEFAULT_DEADBAND     8
+
+// profile histograms: 2^PROF_SUB_BITS linear buckets per power of two of ns,
+// so a percentile is off by at most 1/32 (~3%)
+#define PROF_SUB_BITS    5
+#define PROF_SUB         (1u << PROF_SUB_BITS)
+#define PROF_BUCKETS     ((64 - PROF_SUB_BITS + 1) * PROF_SUB)
+
+// epoll tags
+enum source {
+    SRC_TIMER,
+    SRC_BUTTON,
+    SRC_SIGNAL,
+};
+
+enum button_kind {
+    BUTTON_NONE,
+    BUTTON_CHARDEV,     // /dev/push_button0, we own the press counter
+    BUTTON_SIMULATED,   // board_sim's /dev/push_button0, a plain file
+    BUTTON_INOTIFY,     // number.txt written by custom_pb_colors.sh
+};
+
+enum filter_kind {
+    FILTER_NONE,
+    FILTER_EMA,
+    FILTER_MEDIAN,
+};
+
+enum prof_stage {
+    PROF_PERIOD,        // wakeup to wakeup
+    PROF_WAKEUP,        // wakeup - timer expiration
+    PROF_ADC,           // hwio_adc_read_channels
+    PROF_RGB,           // hwio_rgb_set on every instance
+    PROF_ADC_TO_PWM,    // start of the ADC read to the end of the RGB write
+    PROF_TICK,          // wakeup to the end of on_timer
+    NUM_PROF_STAGES,
+};
+
+static const char *const prof_stage_names[NUM_PROF_STAGES] = {
+    [PROF_PERIOD]     = "period",
+    [PROF_WAKEUP]     = "wakeup",
+    [PROF_ADC]        = "adc_read",
+    [PROF_RGB]        = "rgb_write",
+    [PROF_ADC_TO_PWM] = "adc_to_pwm",
+    [PROF_TICK]       = "tick",
+};
+
+struct prof_hist {
+    uint64_t count;
+    uint64_t over;                  // samples over the stage's budget
+    uint64_t max;
+    uint32_t bucket[PROF_BUCKETS];
+};
+
+struct profile {
+    int enabled;
+    uint64_t period_ns;
+    uint64_t deadline;              // expiration of the tick being handled
+    uint64_t last_wake;
+    unsigned long late;             // ticks that ran into the next expiration
+    struct prof_hist stage[NUM_PROF_STAGES];
+};
+
+// Software filter in front of the dead-band, one state per pot.
+// len is the EMA shift or the median window.
+struct filter {
+    enum filter_kind kind;
+    unsigned int len;
+    int primed;                     // state holds at least one sample
+    int32_t ema[NUM_POTS];          // EMA_FRAC_BITS fixed point
+    uint16_t hist[NUM_POTS][MAX_MEDIAN_LEN];
+    unsigned int pos;               // next hist slot to overwrite
+    unsigned int fill;              // valid hist entries
+};
+
+struct stats {
+    unsigned long ticks;            // timer wakeups
+    unsigned long missed;           // timer expirations we slept through
+    unsigned long samples;          // ADC records read
+    unsigned long writes;           // colors written
+    unsigned long skipped;          // ticks where no channel was written
+    unsigned long suppressed;       // pot changes held back by the dead-band
+    unsigned long presses;          // button events handled
+    unsigned long errors;
+};
+
+struct app {
+    struct hwio_adc adc;
+    struct hwio_rgb rgb[HWIO_MAX_INSTANCES];
+    int num_rgb;
+    enum button_kind button_kind;
+    int button_fd;                  // /dev/push_button0 or inotify fd
+    int file_fd;                    // file watched by inotify
+    unsigned int color;             // 0 = pots, 1..3 = static red/green/blue
+    uint32_t last_duty[3];
+    int have_last;
+    struct filter filt;
+    uint16_t deadband;              // code change a pot needs to be taken
+    uint16_t held[NUM_POTS];        // pot readings last taken
+    int have_held;
+    uint16_t pot_lo[NUM_POTS];      // --pot-range, the ends always pass
+    uint16_t pot_hi[NUM_POTS];
+    struct color_map cmap;
+    struct stats st;
+    struct profile prof;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ---------------------------- filtering ---------------------------- */
+
+// parse "none", "ema[:SHIFT]" or "median[:N]"
 // return 0 if successful
-static int write_u32(const char *path, uint32_t value)
+static int parse_filter(struct filter *f, const char *arg)
 {
-    FILE *f = fopen(path, "w");
-    if (!f) {
-        fprintf(stderr, "Failed to open %s for write: %s\n",
-                path, strerror(errno));
-        return -1;
+    const char *colon = strchr(arg, ':');
+    size_t name_len = colon ? (size_t)(colon - arg) : strlen(arg);
+    char *end;
+    unsigned long len = 0;
+
+    if (colon) {
+        len = strtoul(colon + 1, &end, 0);
+        if (colon[1] == '\0' || *end != '\0')
+            return -1;
     }
 
-    if (fprintf(f, "%u\n", value) < 0) {                    // fprintf returns negative on error
-        fprintf(stderr, "Failed to write to %s: %s\n",
-                path, strerror(errno));
-        fclose(f);
+    if (name_len == 4 && strncmp(arg, "none", 4) == 0 && !colon) {
+        f->kind = FILTER_NONE;
+        f->len = 0;
+    } else if (name_len == 3 && strncmp(arg, "ema", 3) == 0) {
+        f->kind = FILTER_EMA;
+        f->len = colon ? len : DEFAULT_EMA_SHIFT;
+        if (f->len < 1 || f->len > MAX_EMA_SHIFT)
+            return -1;
+    } else if (name_len == 6 && strncmp(arg, "median", 6) == 0) {
+        f->kind = FILTER_MEDIAN;
+        f->len = colon ? len : DEFAULT_MEDIAN_LEN;
+        if (f->len < 3 || f->len > MAX_MEDIAN_LEN || f->len % 2 == 0)
+            return -1;
+    } else {
         return -1;
     }
 
-    fclose(f);
     return 0;
 }
 
-// write "1" or "0" (bool) to sysfs
-// return 0 if successful
-static int write_bool(const char *path, int value)
+static uint16_t median(const uint16_t *hist, unsigned int n)
 {
-    FILE *f = fopen(path, "w");
-    if (!f) {
-        fprintf(stderr, "Failed to open %s for write: %s\n",
-                path, strerror(errno));
-        return -1;
+    uint16_t v[MAX_MEDIAN_LEN];
+    unsigned int i, j;
+
+    // insertion sort, n is at most MAX_MEDIAN_LEN
+    for (i = 0; i < n; i++) {
+        uint16_t x = hist[i];
+
+        for (j = i; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
     }
+    return v[n / 2];
+}
 
-    if (fprintf(f, "%d\n", value ? 1 : 0) < 0) {                // if value nonzero, write 1, else 0
-        fprintf(stderr, "Failed to write to %s: %s\n",
-                path, strerror(errno));
-        fclose(f);
-        return -1;
+// filter one record of pot readings in place
+static void filter_apply(struct filter *f, uint16_t vals[NUM_POTS])
+{
+    unsigned int n;
+    int ch;
+
+    switch (f->kind) {
+        case FILTER_EMA:
+            for (ch = 0; ch < NUM_POTS; ch++) {
+                int32_t x = (int32_t)vals[ch] << EMA_FRAC_BITS;
+
+                // start at the first sample instead of ramping up from 0
+                if (!f->primed)
+                    f->ema[ch] = x;
+                else
+                    f->ema[ch] += (x - f->ema[ch]) >> f->len;
+                vals[ch] = (f->ema[ch] + (1 << (EMA_FRAC_BITS - 1))) >> EMA_FRAC_BITS;
+            }
+            break;
+
+        case FILTER_MEDIAN:
+            for (ch = 0; ch < NUM_POTS; ch++)
+                f->hist[ch][f->pos] = vals[ch];
+            f->pos = (f->pos + 1) % f->len;
+            if (f->fill < f->len)
+                f->fill++;
+            // until the window fills, slots 0..fill-1 hold the samples so
+            // far; use the newest odd number of them so the median is always
+            // a real sample
+            n = f->fill - !(f->fill & 1);
+            for (ch = 0; ch < NUM_POTS; ch++)
+                vals[ch] = median(&f->hist[ch][f->fill - n], n);
+            break;
+
+        default:
+            break;
     }
 
-    fclose(f);
+    f->primed = 1;
+}
+
+// forget the history, e.g. after the pots weren't sampled for a while
+static void filter_reset(struct filter *f)
+{
+    f->primed = 0;
+    f->pos = 0;
+    f->fill = 0;
+}
+
+// parse "POT:LO:HI", the usable ADC range of one pot
+// return 0 if successful
+static int parse_pot_range(struct cmap_cal *cal, const char *arg)
+{
+    unsigned int pot, lo, hi;
+    char extra;
+
+    if (sscanf(arg, "%u:%u:%u%c", &pot, &lo, &hi, &extra) != 3 ||
+        pot >= NUM_POTS || lo >= hi || hi > 4095)
+        return -1;
+
+    cal->lo[pot] = lo;
+    cal->hi[pot] = hi;
     return 0;
 }
 
-// read a 16-bit ADC value from sysfs
-// don't need 32 bits since ADC is 12-bit, 16 bits be good enough
+// parse "R,G,B" full-scale gains, each 0..1
 // return 0 if successful
-static int read_u16(const char *path, uint16_t *out)
+static int parse_gains(struct cmap_cal *cal, const char *arg)
 {
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        fprintf(stderr, "Failed to open %s for read: %s\n",
-                path, strerror(errno));
+    double g[3];
+    char extra;
+    int ch;
+
+    if (sscanf(arg, "%lf,%lf,%lf%c", &g[0], &g[1], &g[2], &extra) != 3)
         return -1;
+    for (ch = 0; ch < 3; ch++) {
+        if (!(g[ch] >= 0) || g[ch] > 1)
+            return -1;
+        cal->gain[ch] = g[ch];
+    }
+    return 0;
+}
+
+/* --------------------------- profiling --------------------------- */
+
+static unsigned int prof_bucket(uint64_t ns)
+{
+    unsigned int e;
+
+    if (ns < PROF_SUB)
+        return ns;
+    e = 63 - __builtin_clzll(ns);
+    return (e - PROF_SUB_BITS + 1) * PROF_SUB +
+           ((ns >> (e - PROF_SUB_BITS)) & (PROF_SUB - 1));
+}
+
+// smallest value that lands in bucket i
+static uint64_t prof_bucket_min(unsigned int i)
+{
+    unsigned int e;
+
+    if (i < PROF_SUB)
+        return i;
+    e = i / PROF_SUB + PROF_SUB_BITS - 1;
+    return (uint64_t)(PROF_SUB | (i % PROF_SUB)) << (e - PROF_SUB_BITS);
+}
+
+// 0 when profiling is off, so callers don't need to check
+static uint64_t prof_now(const struct profile *p)
+{
+    return p->enabled ? now_ns() : 0;
+}
+
+static void prof_record(struct profile *p, enum prof_stage stage, uint64_t ns)
+{
+    struct prof_hist *h = &p->stage[stage];
+    // a period may run a bit long without losing a tick, everything else
+    // has to fit in one period
+    uint64_t budget = stage == PROF_PERIOD ? p->period_ns * 3 / 2 : p->period_ns;
+
+    h->count++;
+    h->bucket[prof_bucket(ns)]++;
+    if (ns > h->max)
+        h->max = ns;
+    if (ns > budget)
+        h->over++;
+}
+
+// record now - t0 for stage; return now (0 when profiling is off)
+static uint64_t prof_since(struct profile *p, enum prof_stage stage, uint64_t t0)
+{
+    uint64_t t;
+
+    if (!p->enabled)
+        return 0;
+    t = now_ns();
+    prof_record(p, stage, t - t0);
+    return t;
+}
+
+// account a timer wakeup at t that covered `expirations` expirations
+static void prof_wake(struct profile *p, uint64_t t, uint64_t expirations)
+{
+    if (!p->enabled)
+        return;
+
+    p->deadline += expirations * p->period_ns;
+    prof_record(p, PROF_WAKEUP, t > p->deadline ? t - p->deadline : 0);
+    if (p->last_wake)
+        prof_record(p, PROF_PERIOD, t - p->last_wake);
+    p->last_wake = t;
+}
+
+static void prof_tick_done(struct profile *p, uint64_t t_wake)
+{
+    uint64_t t = prof_since(p, PROF_TICK, t_wake);
+
+    if (t > p->deadline + p->period_ns)
+        p->late++;
+}
+
+// value below which a fraction q of the samples fall, to bucket resolution
+static uint64_t prof_percentile(const struct prof_hist *h, double q)
+{
+    uint64_t want = (uint64_t)(q * h->count + 0.999999);
+    uint64_t seen = 0;
+    unsigned int i;
+
+    if (want == 0)
+        want = 1;
+    for (i = 0; i < PROF_BUCKETS - 1; i++) {
+        seen += h->bucket[i];
+        if (seen >= want)
+            break;
+    }
+    // report the top of the bucket, but never more than the real max
+    if (i < PROF_BUCKETS - 1 && prof_bucket_min(i + 1) - 1 < h->max)
+        return prof_bucket_min(i + 1) - 1;
+    return h->max;
+}
+
+static void print_profile(const struct app *app)
+{
+    const struct profile *p = &app->prof;
+    int i;
+
+    printf("pot_to_rgb profile: period=%.1fus missed=%lu late=%lu\n",
+           p->period_ns / 1e3, app->st.missed, p->late);
+    printf("  %-10s %10s %10s %10s %10s %8s\n",
+           "stage", "count", "p50_us", "p99_us", "max_us", "over");
+    for (i = 0; i < NUM_PROF_STAGES; i++) {
+        const struct prof_hist *h = &p->stage[i];
+
+        if (h->count == 0) {
+            printf("  %-10s %10s\n", prof_stage_names[i], "-");
+            continue;
+        }
+        printf("  %-10s %10llu %10.1f %10.1f %10.1f %8llu\n",
+               prof_stage_names[i], (unsigned long long)h->count,
+               prof_percentile(h, 0.50) / 1e3,
+               prof_percentile(h, 0.99) / 1e3, h->max / 1e3,
+               (unsigned long long)h->over);
+    }
+    fflush(stdout);
+}
+
+/* ------------------------------------------------------------------ */
+
+// hold each filtered pot reading at the one last taken unless it moved by
+// more than the dead-band. Readings at or past either end of the pot's
+// range always pass, so full off and full on stay reachable.
+static void deadband_apply(struct app *app, uint16_t vals[NUM_POTS])
+{
+    int i;
+
+    for (i = 0; i < NUM_POTS; i++) {
+        uint16_t held = app->held[i];
+        uint16_t diff = vals[i] > held ? vals[i] - held : held - vals[i];
+
+        if (app->have_held && diff <= app->deadband &&
+            vals[i] > app->pot_lo[i] && vals[i] < app->pot_hi[i]) {
+            if (diff != 0)
+                app->st.suppressed++;
+            vals[i] = held;
+            continue;
+        }
+        app->held[i] = vals[i];
+    }
+    app->have_held = 1;
+}
+
+// write the channels whose duty changed since they were last written; the
+// rest keep their old duty. The changed channels go out in one syscall per
+// RGB instance and latch together in hardware.
+// return 0 if successful
+static int update_rgb(struct app *app, const uint32_t duty[3])
+{
+    uint32_t next[3];
+    unsigned int mask = 0;
+    int ch, i, ret = 0;
+
+    for (ch = 0; ch < 3; ch++) {
+        uint32_t last = app->last_duty[ch];
+        uint32_t diff = duty[ch] > last ? duty[ch] - last : last - duty[ch];
+
+        next[ch] = last;
+        if (app->have_last && diff == 0)
+            continue;
+        next[ch] = duty[ch];
+        mask |= 1u << ch;
     }
 
-    unsigned int tmp = 0;
-    if (fscanf(f, "%u", &tmp) != 1) {             // fscanf returns 1 if successful
-        fprintf(stderr, "Failed to parse integer from %s\n", path);
-        fclose(f);
+    if (mask == 0) {
+        app->st.skipped++;
+        return 0;
+    }
+
+    for (i = 0; i < app->num_rgb; i++) {
+        if (hwio_rgb_set_channels(&app->rgb[i], mask, next) != 0)
+            ret = -1;
+    }
+    if (ret != 0)
         return -1;
+
+    memcpy(app->last_duty, next, sizeof(app->last_duty));
+    app->have_last = 1;
+    app->st.writes++;
+    return 0;
+}
+
+static void on_timer(struct app *app, int timer_fd)
+{
+    uint16_t adc_vals[NUM_POTS];
+    uint32_t duty[3];
+    uint64_t expirations;
+    uint64_t t_wake = prof_now(&app->prof);
+    uint64_t t_adc = 0, t_rgb, t_pwm;
+    unsigned long writes;
+
+    if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    app->st.ticks++;
+    app->st.missed += expirations - 1;
+    prof_wake(&app->prof, t_wake, expirations);
+
+    switch (app->color) {
+        case 1:
+            duty[0] = DUTY_SCALE; duty[1] = 0; duty[2] = 0;
+            break;
+        case 2:
+            duty[0] = 0; duty[1] = DUTY_SCALE; duty[2] = 0;
+            break;
+        case 3:
+            duty[0] = 0; duty[1] = 0; duty[2] = DUTY_SCALE;
+            break;
+        default:
+            // ch0-ch2 as one record (a single read() on the chardev backend)
+            t_adc = prof_now(&app->prof);
+            if (hwio_adc_read_channels(&app->adc, 0x7, adc_vals) != 0) {
+                app->st.errors++;
+                return;
+            }
+            prof_since(&app->prof, PROF_ADC, t_adc);
+            app->st.samples++;
+            filter_apply(&app->filt, adc_vals);
+            deadband_apply(app, adc_vals);
+            color_map_apply(&app->cmap, adc_vals, duty);
+            break;
     }
 
-    fclose(f);
+    writes = app->st.writes;
+    t_rgb = prof_now(&app->prof);
+    if (update_rgb(app, duty) != 0) {
+        app->st.errors++;
+    } else if (app->st.writes != writes) {
+        // ticks with nothing to write don't count as PWM writes
+        t_pwm = prof_since(&app->prof, PROF_RGB, t_rgb);
+        if (t_adc)
+            prof_record(&app->prof, PROF_ADC_TO_PWM, t_pwm - t_adc);
+    }
+
+    prof_tick_done(&app->prof, t_wake);
+}
+
+static void on_button(struct app *app)
+{
+    char buf[sizeof(struct inotify_event) + 256];
+    uint32_t number = 0;
+    uint32_t zero = 0;
+
+    switch (app->button_kind) {
+        case BUTTON_CHARDEV:
+            // press is latched by the driver until we clear it
+            app->color = (app->color + 1) % NUM_COLORS;
+            if (pwrite(app->button_fd, &zero, sizeof(zero), 0) != sizeof(zero))
+                app->st.errors++;
+            break;
+
+        case BUTTON_SIMULATED:
+            // same register semantics, but we get woken for every change,
+            // including our own clear
+            while (read(app->button_fd, buf, sizeof(buf)) > 0)
+                ;
+            if (pread(app->file_fd, &number, sizeof(number), 0) != sizeof(number) ||
+                number == 0)
+                return;
+            app->color = (app->color + 1) % NUM_COLORS;
+            if (pwrite(app->file_fd, &zero, sizeof(zero), 0) != sizeof(zero))
+                app->st.errors++;
+            break;
+
+        default:
+            // drain the inotify events, then read the new number once
+            while (read(app->button_fd, buf, sizeof(buf)) > 0)
+                ;
+            if (hwio_read_u32(app->file_fd, &number) != 0)
+                return;
+            app->color = number % NUM_COLORS;
+            break;
+    }
+
+    // the pots weren't sampled while a static color was shown
+    filter_reset(&app->filt);
+    app->have_held = 0;
+    app->st.presses++;
+}
 
-    if (tmp > 0xFFFF)
-        tmp = 0xFFFF;
+static void print_stats(const struct app *app, double elapsed_s)
+{
+    const struct stats *st = &app->st;
+    unsigned long syscalls = app->adc.syscalls;
+    int i;
+
+    for (i = 0; i < app->num_rgb; i++)
+        syscalls += app->rgb[i].syscalls;
+
+    printf("pot_to_rgb: %.1fs ticks=%lu (%.1f/s) missed=%lu samples=%lu "
+           "writes=%lu skipped=%lu suppressed=%lu presses=%lu errors=%lu "
+           "syscalls=%lu\n",
+           elapsed_s, st->ticks, elapsed_s > 0 ? st->ticks / elapsed_s : 0.0,
+           st->missed, st->samples, st->writes, st->skipped, st->suppressed,
+           st->presses, st->errors, syscalls);
+    fflush(stdout);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// watch path with inotify; file_fd must already be open
+// return 0 if successful
+static int watch_file(struct app *app, const char *path, uint32_t mask)
+{
+    app->button_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (app->button_fd < 0 || inotify_add_watch(app->button_fd, path, mask) < 0) {
+        close(app->file_fd);
+        app->file_fd = -1;
+        if (app->button_fd >= 0)
+            close(app->button_fd);
+        app->button_fd = -1;
+        return -1;
+    }
 
-    *out = (uint16_t)tmp;
     return 0;
 }
 
-// Map 12-bit ADC (0 to 4095) to 18.17 fixed-point duty (0 to 1
-static uint32_t adc_to_duty(uint16_t adc)
+// 1 if the push button driver wakes poll() on a press; without its
+// interrupt /dev/push_button0 never becomes readable
+static int button_has_irq(void)
 {
-    // ADC is 12-bit so 4095 max.
-    const uint32_t ADC_MAX = 4095u;
+    char path[HWIO_PATH_MAX];
+    uint32_t has_irq = 0;
+    int fd;
+
+    if (hwio_path(path, sizeof(path), HWIO_BUTTON_SYSFS_BASE "/has_irq") != 0 ||
+        (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return 0;
+    if (hwio_read_u32(fd, &has_irq) != 0)
+        has_irq = 0;
+    close(fd);
+    return has_irq == 1;
+}
 
-    // Scale 0 to ADC_MAX to 0 to DUTY_SCALE (0 to 1 in 18.17)
-    uint32_t duty = (uint32_t)adc * DUTY_SCALE / ADC_MAX;
+// open the button source; a missing button is not an error
+static void open_button(struct app *app)
+{
+    char path[HWIO_PATH_MAX];
+    struct stat sb;
+    uint32_t zero = 0;
+    int fd;
+
+    app->button_kind = BUTTON_NONE;
+    app->button_fd = -1;
+    app->file_fd = -1;
+
+    if (hwio_path(path, sizeof(path), HWIO_BUTTON_CHARDEV) == 0 &&
+        (fd = open(path, O_RDWR | O_CLOEXEC)) >= 0) {
+        // drop any press that happened before we started
+        if (pwrite(fd, &zero, sizeof(zero), 0) != sizeof(zero))
+            fprintf(stderr, "pot_to_rgb: failed to clear button: %s\n",
+                    strerror(errno));
+
+        if (fstat(fd, &sb) == 0 && S_ISCHR(sb.st_mode)) {
+            if (button_has_irq()) {
+                app->button_fd = fd;
+                app->button_kind = BUTTON_CHARDEV;
+                return;
+            }
+            // no interrupt: custom_pb_colors.sh polls the status instead
+            fprintf(stderr, "pot_to_rgb: push button has no interrupt, "
+                    "using %s\n", BUTTON_PATH);
+            close(fd);
+        } else {
+            // a plain file can't be polled, so wait for board_sim to modify it
+            app->file_fd = fd;
+            if (watch_file(app, path, IN_MODIFY) == 0)
+                app->button_kind = BUTTON_SIMULATED;
+            return;
+        }
+    }
 
-    return duty;
+    app->file_fd = open(BUTTON_PATH, O_RDONLY | O_CLOEXEC);
+    if (app->file_fd < 0 || watch_file(app, BUTTON_PATH, IN_CLOSE_WRITE) != 0)
+        return;
+
+    app->button_kind = BUTTON_INOTIFY;
+    on_button(app);         // pick up the current number
+    app->st.presses = 0;
 }
 
-int main(void)
+static int epoll_add(int epfd, int fd, uint32_t events, enum source src)
 {
-    uint16_t adc_r = 0, adc_g = 0, adc_b = 0, button_num = 0;
+    struct epoll_event ev = { .events = events, .data.u32 = src };
 
-    printf("pot_to_rgb: starting\n");
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
 
-    // Enable auto-update in the ADC
-    if (write_bool(ADC_AUTO_UPDATE, 1) != 0) {
-        fprintf(stderr, "Failed to enable auto_update on ADC\n");
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-c] [-i LIST] [-r HZ] [-f FILTER] [-d CODES]\n"
+            "       [-m MODE] [-g GAMMA] [-k POT:LO:HI]... [-w R,G,B] [-s] [-p] [-R root]\n"
+            "  -c, --chardev   use /dev/adc0 and /dev/rgb_pwmN instead of sysfs\n"
+            "  -i, --instance LIST\n"
+            "                  RGB PWM instances to drive, e.g. 0,2 or all (default 0)\n"
+            "  -r, --rate HZ   sampling rate (default %d)\n"
+            "  -f, --filter FILTER\n"
+            "                  pot filter: none, ema[:SHIFT] (weight 1/2^SHIFT, 1-%d,\n"
+            "                  default %d) or median[:N] (odd N, 3-%d, default %d);\n"
+            "                  default ema\n"
+            "  -d, --deadband CODES\n"
+            "                  change in ADC codes (of 4095) a pot needs before its\n"
+            "                  color is written again, 0 writes every change (default %d)\n"
+            "  -m, --mode MODE what the pots control: rgb (pot N = channel N), hsv or\n"
+            "                  hsl (pot 0 = hue, 1 = saturation, 2 = value/lightness)\n"
+            "                  (default rgb)\n"
+            "  -g, --gamma G   output gamma, 1 is linear (default %.1f, max %.0f)\n"
+            "  -k, --pot-range POT:LO:HI\n"
+            "                  usable ADC range of a pot, e.g. 0:30:4060; repeatable\n"
+            "  -w, --gain R,G,B\n"
+            "                  full-scale duty per channel, 0-1 (default 1,1,1)\n"
+            "  -s, --stats     print loop statistics once per second\n"
+            "  -p, --profile   time every stage of the loop; dump histograms\n"
+            "                  on SIGUSR1 and at exit\n"
+            "  -R, --root DIR  prefix for all device paths, e.g. a board_sim tree\n"
+            "                  (default $HWIO_ROOT, or the real board)\n",
+            prog, DEFAULT_RATE_HZ, MAX_EMA_SHIFT, DEFAULT_EMA_SHIFT,
+            MAX_MEDIAN_LEN, DEFAULT_MEDIAN_LEN, DEFAULT_DEADBAND,
+            CMAP_DEFAULT_GAMMA, CMAP_MAX_GAMMA);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_opts[] = {
+        { "chardev",  no_argument,       NULL, 'c' },
+        { "instance", required_argument, NULL, 'i' },
+        { "rate",     required_argument, NULL, 'r' },
+        { "filter",   required_argument, NULL, 'f' },
+        { "deadband", required_argument, NULL, 'd' },
+        { "mode",     required_argument, NULL, 'm' },
+        { "gamma",    required_argument, NULL, 'g' },
+        { "pot-range", required_argument, NULL, 'k' },
+        { "gain",     required_argument, NULL, 'w' },
+        { "stats",    no_argument,       NULL, 's' },
+        { "profile",  no_argument,       NULL, 'p' },
+        { "root",     required_argument, NULL, 'R' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    enum hwio_backend backend = HWIO_BACKEND_SYSFS;
+    const char *instances = "0";
+    unsigned int ids[HWIO_MAX_INSTANCES];
+    char path[HWIO_PATH_MAX];
+    unsigned long rate = DEFAULT_RATE_HZ;
+    const char *filter = "ema";
+    unsigned long deadband = DEFAULT_DEADBAND;
+    enum cmap_mode mode = CMAP_RGB;
+    double gamma = CMAP_DEFAULT_GAMMA;
+    struct cmap_cal cal;
+    int stats = 0;
+    int profile = 0;
+    static struct app app;          // profile histograms and color tables, ~140 KiB
+    struct signalfd_siginfo si;
+    struct itimerspec its;
+    struct epoll_event events[4];
+    sigset_t sigs;
+    int epfd, timer_fd, sig_fd;
+    int running = 1;
+    int opt, i, n;
+    double start, last_stats;
+
+    color_map_default_cal(&cal);
+
+    while ((opt = getopt_long(argc, argv, "ci:r:f:d:m:g:k:w:spR:h", long_opts,
+                              NULL)) != -1) {
+        switch (opt) {
+            case 'c': backend = HWIO_BACKEND_CHARDEV; break;
+            case 'i': instances = optarg; break;
+            case 'r': rate = strtoul(optarg, NULL, 0); break;
+            case 'f': filter = optarg; break;
+            case 'd': deadband = strtoul(optarg, NULL, 0); break;
+            case 'g': gamma = strtod(optarg, NULL); break;
+            case 'm':
+                if (color_map_parse_mode(optarg, &mode) != 0) {
+                    fprintf(stderr, "pot_to_rgb: bad mode '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'k':
+                if (parse_pot_range(&cal, optarg) != 0) {
+                    fprintf(stderr, "pot_to_rgb: bad pot range '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                if (parse_gains(&cal, optarg) != 0) {
+                    fprintf(stderr, "pot_to_rgb: bad gains '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's': stats = 1; break;
+            case 'p': profile = 1; break;
+            case 'R': hwio_set_root(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (rate == 0 || rate > MAX_RATE_HZ) {
+        fprintf(stderr, "pot_to_rgb: rate must be 1..%d Hz\n", MAX_RATE_HZ);
         return 1;
     }
 
-    
-    if (write_u32(RGB_PERIOD, 320) != 0) {
-        fprintf(stderr, "Failed to set RGB period\n");
+    if (deadband > 4095) {
+        fprintf(stderr, "pot_to_rgb: deadband must be 0..4095 codes\n");
+        return 1;
+    }
+
+    memset(&app, 0, sizeof(app));
+    app.prof.enabled = profile;
+    if (parse_filter(&app.filt, filter) != 0) {
+        fprintf(stderr, "pot_to_rgb: bad filter '%s'\n", filter);
+        usage(argv[0]);
+        return 1;
+    }
+    app.deadband = deadband;
+    for (i = 0; i < NUM_POTS; i++) {
+        app.pot_lo[i] = cal.lo[i];
+        app.pot_hi[i] = cal.hi[i];
+    }
+    if (color_map_build(&app.cmap, mode, gamma, &cal) != 0) {
+        fprintf(stderr, "pot_to_rgb: gamma must be above 0 and at most %.0f\n",
+                CMAP_MAX_GAMMA);
         return 1;
     }
 
-    usleep(100000);
+    // after option parsing, so "all" looks under the -R root
+    app.num_rgb = hwio_parse_instances(instances, HWIO_RGB_NAME, ids,
+                                       HWIO_MAX_INSTANCES);
+    if (app.num_rgb < 0) {
+        fprintf(stderr, "pot_to_rgb: bad RGB instance list '%s': %s\n",
+                instances, strerror(errno));
+        return 1;
+    }
 
-    // Busy loop: read pots and update RGB channels
-    while (1) {
-        if (read_u16(ADC_CH0_RAW, &adc_r) != 0 ||
-            read_u16(ADC_CH1_RAW, &adc_g) != 0 ||
-            read_u16(ADC_CH2_RAW, &adc_b) != 0) {
+    printf("pot_to_rgb: starting at %lu Hz, %d RGB instance%s, %s gamma %.2f\n",
+           rate, app.num_rgb, app.num_rgb == 1 ? "" : "s",
+           color_map_mode_name(mode), gamma);
 
-            fprintf(stderr, "Error reading ADC channels\n");
-            
-            usleep(100000);
-            continue;
+    if (hwio_adc_open(&app.adc, backend, NULL) != 0) {
+        fprintf(stderr, "Failed to open ADC\n");
+        return 1;
+    }
+    for (i = 0; i < app.num_rgb; i++) {
+        if (hwio_instance_path(path, sizeof(path), HWIO_RGB_NAME, ids[i],
+                               backend) != 0 ||
+            hwio_rgb_open(&app.rgb[i], backend, path) != 0) {
+            fprintf(stderr, "Failed to open RGB PWM %u\n", ids[i]);
+            return 1;
         }
+    }
 
-        if (read_u16(BUTTON_PATH, &button_num) != 0) {
-            button_num = 0;
+    // Enable auto-update in the ADC
+    if (hwio_adc_set_auto_update(&app.adc, 1) != 0) {
+        fprintf(stderr, "Failed to enable auto_update on ADC: %s\n",
+                strerror(errno));
+        return 1;
+    }
+
+    for (i = 0; i < app.num_rgb; i++) {
+        if (hwio_rgb_write(&app.rgb[i], HWIO_RGB_PERIOD, 320) != 0) {
+            fprintf(stderr, "Failed to set RGB period: %s\n", strerror(errno));
+            return 1;
         }
+    }
 
-        uint32_t duty_r = adc_to_duty(adc_r);
-        uint32_t duty_g = adc_to_duty(adc_g);
-        uint32_t duty_b = adc_to_duty(adc_b);
+    open_button(&app);
+    if (app.button_kind == BUTTON_NONE)
+        fprintf(stderr, "pot_to_rgb: no button source, pots only\n");
+
+    // SIGINT/SIGTERM are handled in the loop so we can exit cleanly,
+    // SIGUSR1 dumps the profile (or the stats) without stopping
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    sig_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epfd < 0 || timer_fd < 0 || sig_fd < 0) {
+        fprintf(stderr, "pot_to_rgb: failed to set up event loop: %s\n",
+                strerror(errno));
+        return 1;
+    }
 
-        switch (button_num) {
-            case 1:
-                duty_r = 0xff * DUTY_SCALE / 0xff;
-                duty_g = 0x0;
-                duty_b = 0x0;
-                break;
-            case 2:
-                duty_r = 0x0;
-                duty_g = 0xff * DUTY_SCALE / 0xff;
-                duty_b = 0x0;
-                break;
-            case 3:
-                duty_r = 0x0;
-                duty_g = 0x0;
-                duty_b = 0xff * DUTY_SCALE / 0xff;
-                break;
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = 1000000000L / rate;
+    if (rate == 1) {
+        its.it_interval.tv_sec = 1;
+        its.it_interval.tv_nsec = 0;
+    }
+    app.prof.period_ns = (uint64_t)its.it_interval.tv_sec * 1000000000ull +
+                         its.it_interval.tv_nsec;
+
+    // absolute first expiration, so the profile knows every deadline exactly
+    app.prof.deadline = now_ns();
+    its.it_value.tv_sec = (app.prof.deadline + app.prof.period_ns) / 1000000000ull;
+    its.it_value.tv_nsec = (app.prof.deadline + app.prof.period_ns) % 1000000000ull;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+        fprintf(stderr, "pot_to_rgb: timerfd_settime: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (epoll_add(epfd, timer_fd, EPOLLIN, SRC_TIMER) != 0 ||
+        epoll_add(epfd, sig_fd, EPOLLIN, SRC_SIGNAL) != 0 ||
+        (app.button_kind != BUTTON_NONE &&
+         epoll_add(epfd, app.button_fd, EPOLLIN | EPOLLPRI, SRC_BUTTON) != 0)) {
+        fprintf(stderr, "pot_to_rgb: epoll_ctl: %s\n", strerror(errno));
+        return 1;
+    }
+
+    start = last_stats = now_s();
+
+    while (running) {
+        n = epoll_wait(epfd, events, 4, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "pot_to_rgb: epoll_wait: %s\n", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            switch (events[i].data.u32) {
+                case SRC_TIMER:
+                    on_timer(&app, timer_fd);
+                    break;
+                case SRC_BUTTON:
+                    on_button(&app);
+                    break;
+                case SRC_SIGNAL:
+                    if (read(sig_fd, &si, sizeof(si)) != sizeof(si))
+                        break;
+                    if (si.ssi_signo != SIGUSR1)
+                        running = 0;
+                    else if (profile)
+                        print_profile(&app);
+                    else
+                        print_stats(&app, now_s() - start);
+                    break;
+            }
         }
 
-        // Write to RGB PWM sysfs
-        if (write_u32(RGB_RED, duty_r) != 0 ||
-            write_u32(RGB_GREEN, duty_g) != 0 ||
-            write_u32(RGB_BLUE, duty_b) != 0) {
+        // clock_gettime is a vDSO call, cheap enough to do every wakeup
+        if (stats) {
+            double t = now_s();
 
-            fprintf(stderr, "Error writing RGB duties\n");
-            usleep(100000);
-            continue;
+            if (t - last_stats >= 1.0) {
+                print_stats(&app, t - start);
+                last_stats = t;
+            }
         }
-        
-        usleep(20000);
     }
 
+    if (stats)
+        print_stats(&app, now_s() - start);
+    if (profile)
+        print_profile(&app);
+
+    close(sig_fd);
+    close(timer_fd);
+    close(epfd);
+    if (app.button_fd >= 0)
+        close(app.button_fd);
+    if (app.file_fd >= 0)
+        close(app.file_fd);
+    for (i = 0; i < app.num_rgb; i++)
+        hwio_rgb_close(&app.rgb[i]);
+    hwio_adc_close(&app.adc);
     return 0;
 }
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Run pot_to_rgb against board_sim at increasing rates and print both sides'
+# statistics. Works on any Linux box; build first with `make`.
+#
+# Usage: bash ./sim_bench.sh [seconds per run] [rates...]
+#   bash ./sim_bench.sh 5 100 1000 10000
+
+SECONDS_PER_RUN=${1:-5}
+shift
+RATES=${@:-50 1000 10000}
+ROOT=$(mktemp -d /tmp/de10nano.XXXXXX)
+
+for backend in sysfs chardev; do
+    flag=""
+    if [ $backend = "chardev" ]; then
+        flag="-c"
+    fi
+
+    for rate in $RATES; do
+        echo "=== $backend, $rate Hz ==="
+        ./board_sim -R "$ROOT" -t $((SECONDS_PER_RUN + 1)) -p 1000 &
+        sim_pid=$!
+        sleep 0.5
+        timeout -s INT "$SECONDS_PER_RUN" ./pot_to_rgb $flag -R "$ROOT" -r "$rate" -s | tail -n 1
+        wait "$sim_pid"
+    done
+done
+
+rm -rf "$ROOT"